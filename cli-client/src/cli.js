@@ -7,6 +7,16 @@ const spear = require('../spear_addon.node');
 
 const program = new Command();
 
+function fileKey(options) {
+  const secretKey = fs.readFileSync(options.key);
+  const peerPublicKey = fs.readFileSync(options.peer);
+  const sharedSecret = spear.deriveSharedSecret(secretKey, peerPublicKey);
+  
+  const key = Buffer.alloc(32);
+  sharedSecret.copy(key, 0, 0, 32);
+  return key;
+}
+
 program
   .name('spear-cli')
   .description('SPEAR - Secure file encryption CLI')
@@ -42,9 +52,21 @@ program
   .requiredOption('-o, --output <file>', 'Output encrypted file')
   .requiredOption('-k, --key <file>', 'Secret key file')
   .requiredOption('-p, --peer <file>', 'Peer public key file')
-  .action((options) => {
+  .option('-s, --stream', 'Stream through the native file pipeline (constant memory, any file size)')
+  .action(async (options) => {
     console.log('Encrypting file...');
     
+    if (options.stream) {
+      const key = fileKey(options);
+      const size = await spear.encryptFile(options.input, options.output, key);
+      key.fill(0);
+      
+      console.log(`File encrypted: ${options.output}`);
+      console.log(`Original size: ${size} bytes`);
+      console.log(`Encrypted size: ${fs.statSync(options.output).size} bytes`);
+      return;
+    }
+    
     const plaintext = fs.readFileSync(options.input);
     const secretKey = fs.readFileSync(options.key);
     const peerPublicKey = fs.readFileSync(options.peer);
@@ -75,9 +97,21 @@ program
   .requiredOption('-o, --output <file>', 'Output decrypted file')
   .requiredOption('-k, --key <file>', 'Secret key file')
   .requiredOption('-p, --peer <file>', 'Peer public key file')
-  .action((options) => {
+  .option('-s, --stream', 'Input was written with encrypt --stream')
+  .action(async (options) => {
     console.log('Decrypting file...');
     
+    if (options.stream) {
+      const key = fileKey(options);
+      const size = await spear.decryptFile(options.input, options.output, key);
+      key.fill(0);
+      
+      console.log(`File decrypted: ${options.output}`);
+      console.log(`Encrypted size: ${fs.statSync(options.input).size} bytes`);
+      console.log(`Decrypted size: ${size} bytes`);
+      return;
+    }
+    
     const encrypted = fs.readFileSync(options.input);
     const secretKey = fs.readFileSync(options.key);
     const peerPublicKey = fs.readFileSync(options.peer);
@@ -99,4 +133,7 @@ program
     console.log(`Decrypted size: ${plaintext.length} bytes`);
   });
 
-program.parse();
\ No newline at end of file
+program.parseAsync().catch((err) => {
+  console.error(`Error: ${err.message}`);
+  process.exit(1);
+});
\ No newline at end of file
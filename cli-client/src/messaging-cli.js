@@ -6,6 +6,8 @@ const path = require('path');
 const spear = require('../spear_addon.node');
 
 const SERVER_URL = process.env.SPEAR_SERVER || 'http://localhost:3000';
+// Binary message envelopes; see the server's messageController
+const WIRE_TYPE = 'application/vnd.spear.message';
 
 const program = new Command();
 
@@ -102,13 +104,13 @@ program
       console.log('Sending to server...');
       const response = await fetch(`${SERVER_URL}/api/messages`, {
         method: 'POST',
-        headers: { 'Content-Type': 'application/json' },
-        body: JSON.stringify({
+        headers: { 'Content-Type': WIRE_TYPE },
+        body: spear.encodeMessage({
           fromUsername: options.from,
           toUsername: options.to,
-          encryptedContent: ciphertext.toString('base64'),
-          nonce: nonce.toString('base64'),
-          signature: signature.toString('base64'),
+          encryptedContent: ciphertext,
+          nonce,
+          signature,
           counter: 1
         })
       });
@@ -135,55 +137,77 @@ program
   .action(async (options) => {
     try {
       console.log('Fetching messages...');
-      const response = await fetch(`${SERVER_URL}/api/messages/${options.username}`);
+      const response = await fetch(`${SERVER_URL}/api/messages/${options.username}`, {
+        headers: { Accept: WIRE_TYPE }
+      });
       
       if (!response.ok) {
         console.error('Failed to fetch messages');
         process.exit(1);
       }
 
-      const data = await response.json();
+      // Buffer fields are views into the response body
+      const messages = spear.decodeMessages(Buffer.from(await response.arrayBuffer()));
 
-      if (data.messages.length === 0) {
+      if (messages.length === 0) {
         console.log('No new messages');
         return;
       }
 
       const secretKey = fs.readFileSync(path.join(options.keydir, 'secret.key'));
 
-      console.log(`\nYou have ${data.messages.length} new message(s):\n`);
+      console.log(`\nYou have ${messages.length} new message(s):\n`);
+
+      const senders = new Map();
+      for (const msg of messages) {
+        if (!senders.has(msg.fromUsername)) {
+          const senderResponse = await fetch(`${SERVER_URL}/api/users/${msg.fromUsername}`);
+          const senderData = await senderResponse.json();
+          const publicKey = Buffer.from(senderData.publicKey, 'base64');
+          const sharedSecret = spear.deriveSharedSecret(secretKey, publicKey);
+          const key = Buffer.alloc(32);
+          sharedSecret.copy(key, 0, 0, 32);
+          senders.set(msg.fromUsername, {
+            key,
+            signingPublicKey: Buffer.from(senderData.signingPublicKey, 'base64')
+          });
+        }
+      }
 
-      for (const msg of data.messages) {
+      const ciphertexts = messages.map(msg => msg.encryptedContent);
+      const validity = spear.verifyBatch(
+        ciphertexts,
+        messages.map(msg => msg.signature),
+        messages.map(msg => senders.get(msg.fromUsername).signingPublicKey)
+      );
+      const opened = spear.decryptBatch(
+        ciphertexts,
+        messages.map(msg => senders.get(msg.fromUsername).key),
+        messages.map(msg => msg.nonce)
+      );
+
+      for (const [i, msg] of messages.entries()) {
         console.log(`--- Message from ${msg.fromUsername} ---`);
 
-        const senderResponse = await fetch(`${SERVER_URL}/api/users/${msg.fromUsername}`);
-        const senderData = await senderResponse.json();
-        const senderPublicKey = Buffer.from(senderData.publicKey, 'base64');
-        const senderSigningPublicKey = Buffer.from(senderData.signingPublicKey, 'base64');
-
-        const sharedSecret = spear.deriveSharedSecret(secretKey, senderPublicKey);
-        const key = Buffer.alloc(32);
-        sharedSecret.copy(key, 0, 0, 32);
-
-        const ciphertext = Buffer.from(msg.encryptedContent, 'base64');
-        const nonce = Buffer.from(msg.nonce, 'base64');
-        const signature = Buffer.from(msg.signature, 'base64');
-
-        const isValid = spear.verify(ciphertext, signature, senderSigningPublicKey);
-        if (!isValid) {
+        if (!validity[i]) {
           console.log('WARNING: Invalid signature!');
           continue;
         }
+        if (!opened.ok[i]) {
+          console.log('WARNING: Decryption failed!');
+          continue;
+        }
 
-        const plaintext = spear.decrypt(ciphertext, key, nonce);
+        const plaintext = opened.data.subarray(opened.offsets[i], opened.offsets[i + 1]);
         console.log('Message:', plaintext.toString('utf8'));
-        console.log('Timestamp:', msg.createdAt);
+        console.log('Timestamp:', new Date(msg.createdAt).toISOString());
         console.log('Counter:', msg.counter);
         console.log();
-
-        await fetch(`${SERVER_URL}/api/messages/${msg.id}`, { method: 'DELETE' });
       }
 
+      const lastId = messages[messages.length - 1].id;
+      await fetch(`${SERVER_URL}/api/messages/${options.username}/${lastId}`, { method: 'DELETE' });
+
       console.log('All messages processed');
     } catch (error) {
       console.error('Error:', error.message);
@@ -0,0 +1,431 @@
+// Microbenchmarks for the crypto-core primitives.
+//
+//   spear_bench [--filter=<substring>] [--min-time=<seconds>] [--out=<file>]
+//
+// Each benchmark is repeated until it has run for at least --min-time, then
+// reported as ns/op, ops/s and (for payload benchmarks) MB/s. Results are
+// written as JSON to stdout or --out so runs can be diffed between releases.
+
+#include "types.hpp"
+#include "utils.hpp"
+#include "key_management.hpp"
+#include "key_exchange.hpp"
+#include "symmetric_crypto.hpp"
+#include "signing.hpp"
+#include "streaming.hpp"
+#include "async_file_crypto.hpp"
+#include "wire_codec.hpp"
+#include "replay_window.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace spear::crypto;
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Benchmark {
+    std::string name;
+    size_t bytes_per_op;
+    std::function<void()> body;
+};
+
+struct Result {
+    std::string name;
+    uint64_t iterations;
+    double ns_per_op;
+    double ops_per_second;
+    double mb_per_second;
+};
+
+// Scratch files for the file encryption benchmarks, removed on exit
+const char* const BENCH_PLAIN_FILE = "spear_bench_plain.bin";
+const char* const BENCH_SEALED_FILE = "spear_bench_sealed.bin";
+
+// Keeps the optimizer from discarding results that are otherwise unused
+volatile uint8_t sink;
+
+void consume(const uint8_t* data, size_t size) {
+    if (size > 0) {
+        sink = data[0] ^ data[size - 1];
+    }
+}
+
+void consume(const ByteVector& data) {
+    consume(data.data(), data.size());
+}
+
+std::string size_label(size_t bytes) {
+    if (bytes >= 1024 * 1024 && bytes % (1024 * 1024) == 0) {
+        return std::to_string(bytes / (1024 * 1024)) + "M";
+    }
+    if (bytes >= 1024 && bytes % 1024 == 0) {
+        return std::to_string(bytes / 1024) + "K";
+    }
+    return std::to_string(bytes);
+}
+
+ByteVector random_payload(size_t size) {
+    ByteVector data(size);
+    utils::random_bytes(data.data(), data.size());
+    return data;
+}
+
+// Grows the batch size until one batch takes min_time, like Google
+// Benchmark's iteration estimation, and reports the last batch
+Result run(const Benchmark& bench, double min_time) {
+    bench.body();
+    
+    uint64_t iterations = 1;
+    double elapsed = 0;
+    while (true) {
+        auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            bench.body();
+        }
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        
+        if (elapsed >= min_time || iterations >= (1ull << 40)) {
+            break;
+        }
+        double scale = elapsed > 0 ? min_time * 1.4 / elapsed : 10.0;
+        iterations = static_cast<uint64_t>(iterations * std::min(std::max(scale, 2.0), 10.0));
+    }
+    
+    Result result;
+    result.name = bench.name;
+    result.iterations = iterations;
+    result.ns_per_op = elapsed * 1e9 / iterations;
+    result.ops_per_second = iterations / elapsed;
+    result.mb_per_second = bench.bytes_per_op * result.ops_per_second / (1024.0 * 1024.0);
+    return result;
+}
+
+std::vector<Benchmark> build_benchmarks() {
+    std::vector<Benchmark> benches;
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    Nonce nonce = utils::random_nonce();
+    
+    const size_t aead_sizes[] = {16, 256, 4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024};
+    for (size_t size : aead_sizes) {
+        auto plaintext = std::make_shared<ByteVector>(random_payload(size));
+        auto ciphertext = std::make_shared<ByteVector>(
+            *SymmetricCrypto::encrypt_aead(*plaintext, key, nonce));
+        auto out = std::make_shared<ByteVector>(size + SymmetricCrypto::TAG_SIZE);
+        
+        benches.push_back({"encrypt_aead/" + size_label(size), size, [=] {
+            consume(*SymmetricCrypto::encrypt_aead(*plaintext, key, nonce));
+        }});
+        benches.push_back({"decrypt_aead/" + size_label(size), size, [=] {
+            consume(*SymmetricCrypto::decrypt_aead(*ciphertext, key, nonce));
+        }});
+        benches.push_back({"encrypt_aead_span/" + size_label(size), size, [=] {
+            SymmetricCrypto::encrypt_aead(*plaintext, key, nonce, {}, *out);
+            consume(*out);
+        }});
+        benches.push_back({"encrypt_aead_arena/" + size_label(size), size, [=] {
+            ScratchArena& arena = ScratchArena::for_thread();
+            ByteSpan sealed = *SymmetricCrypto::encrypt_aead(*plaintext, key, nonce, {}, arena);
+            consume(sealed.data(), sealed.size());
+            arena.reset();
+        }});
+        
+        if (SymmetricCrypto::is_available(AeadAlgorithm::Aes256Gcm)) {
+            auto gcm_context = std::make_shared<AeadContext>(key, AeadAlgorithm::Aes256Gcm);
+            benches.push_back({"encrypt_aead_gcm/" + size_label(size), size, [=] {
+                SymmetricCrypto::encrypt_aead(*plaintext, key, nonce, {}, *out, AeadAlgorithm::Aes256Gcm);
+                consume(*out);
+            }});
+            benches.push_back({"encrypt_aead_gcm_context/" + size_label(size), size, [=] {
+                gcm_context->encrypt(*plaintext, nonce, {}, *out);
+                consume(*out);
+            }});
+        }
+    }
+    
+    const size_t chunk_sizes[] = {4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024};
+    for (size_t chunk_size : chunk_sizes) {
+        auto chunk = std::make_shared<ByteVector>(random_payload(chunk_size));
+        auto frame = std::make_shared<ByteVector>(chunk_size + StreamingEncryption::CHUNK_OVERHEAD);
+        auto enc = std::make_shared<StreamingEncryption>(key, nonce, chunk_size);
+        
+        benches.push_back({"encrypt_chunk/" + size_label(chunk_size), chunk_size, [=] {
+            consume(*enc->encrypt_chunk(*chunk, false));
+        }});
+        benches.push_back({"encrypt_chunk_span/" + size_label(chunk_size), chunk_size, [=] {
+            enc->encrypt_chunk(*chunk, false, *frame);
+            consume(*frame);
+        }});
+        // Sealed where it sits, header and tag in their own buffers
+        benches.push_back({"encrypt_chunk_in_place/" + size_label(chunk_size), chunk_size, [=] {
+            ByteSpan body(frame->data() + StreamingEncryption::CHUNK_HEADER_SIZE, chunk_size);
+            enc->encrypt_chunk(body, false, ByteSpan(frame->data(), StreamingEncryption::CHUNK_HEADER_SIZE),
+                               body, ByteSpan(frame->data() + frame->size() - MAC_SIZE, MAC_SIZE));
+            consume(*frame);
+        }});
+    }
+    
+    const size_t stream_size = 16 * 1024 * 1024;
+    auto stream_data = std::make_shared<ByteVector>(random_payload(stream_size));
+    auto stream_out = std::make_shared<ByteVector>(StreamingEncryption::encrypted_size(stream_size));
+    benches.push_back({"encrypt_parallel/16M", stream_size, [=] {
+        StreamingEncryption enc(key, nonce);
+        enc.encrypt_parallel(*stream_data, *stream_out);
+        consume(*stream_out);
+    }});
+    
+    // Source and sink copy through memory, standing in for file or socket I/O
+    auto stream_source = [stream_data](size_t& offset) {
+        return [stream_data, &offset](ByteSpan out) -> std::optional<size_t> {
+            size_t n = std::min(out.size(), stream_data->size() - offset);
+            std::memcpy(out.data(), stream_data->data() + offset, n);
+            offset += n;
+            return n;
+        };
+    };
+    auto stream_sink = [stream_out](size_t& offset) {
+        return [stream_out, &offset](ConstByteSpan data) {
+            std::memcpy(stream_out->data() + offset, data.data(), data.size());
+            offset += data.size();
+            return true;
+        };
+    };
+    benches.push_back({"encrypt_sequential/16M", stream_size, [=] {
+        size_t read_offset = 0;
+        size_t write_offset = 0;
+        StreamSource source = stream_source(read_offset);
+        StreamSink sink = stream_sink(write_offset);
+        StreamingEncryption enc(key, nonce);
+        ByteVector chunk(enc.chunk_size());
+        ByteVector frame(enc.chunk_size() + StreamingEncryption::CHUNK_OVERHEAD);
+        while (true) {
+            size_t len = *source(chunk);
+            bool is_final = read_offset == stream_data->size();
+            sink(ConstByteSpan(frame.data(), *enc.encrypt_chunk(ConstByteSpan(chunk.data(), len),
+                                                                 is_final, frame)));
+            if (is_final) {
+                break;
+            }
+        }
+        consume(*stream_out);
+    }});
+    benches.push_back({"encrypt_pipeline/16M", stream_size, [=] {
+        size_t read_offset = 0;
+        size_t write_offset = 0;
+        StreamingEncryption enc(key, nonce);
+        StreamPipeline::encrypt(enc, stream_source(read_offset), stream_sink(write_offset));
+        consume(*stream_out);
+    }});
+    
+    // Real files in the working directory; the page cache usually holds them,
+    // so this mostly measures syscall and submission overhead
+    std::ofstream(BENCH_PLAIN_FILE, std::ios::binary)
+        .write(reinterpret_cast<const char*>(stream_data->data()), stream_data->size());
+    for (bool use_io_uring : {true, false}) {
+        std::string name = use_io_uring ? "encrypt_file_io_uring/16M" : "encrypt_file_blocking/16M";
+        benches.push_back({name, stream_size, [=] {
+            AsyncFileOptions options;
+            options.use_io_uring = use_io_uring;
+            StreamingEncryption enc(key, nonce);
+            auto stats = AsyncFileCrypto::encrypt_file(BENCH_PLAIN_FILE, BENCH_SEALED_FILE, enc, options);
+            sink = stats ? static_cast<uint8_t>(stats->chunks) : 0;
+        }});
+    }
+    
+    auto signing_keys = std::make_shared<SigningKeyPair>(*KeyManagement::generate_signing_keypair());
+    const size_t sign_sizes[] = {64, 1024, 64 * 1024};
+    for (size_t size : sign_sizes) {
+        auto message = std::make_shared<ByteVector>(random_payload(size));
+        auto signature = std::make_shared<Signature>(
+            *Signing::sign_message(*message, signing_keys->secret_key));
+        
+        benches.push_back({"sign/" + size_label(size), size, [=] {
+            auto sig = Signing::sign_message(*message, signing_keys->secret_key);
+            consume(sig->data(), sig->size());
+        }});
+        benches.push_back({"verify/" + size_label(size), size, [=] {
+            sink = Signing::verify_signature(*message, *signature, signing_keys->public_key);
+        }});
+    }
+    
+    auto alice = std::make_shared<KeyPair>(*KeyManagement::generate_keypair());
+    auto bob = std::make_shared<KeyPair>(*KeyManagement::generate_keypair());
+    auto shared = std::make_shared<SharedSecret>(
+        *KeyExchange::derive_shared_secret(alice->secret_key, bob->public_key));
+    
+    benches.push_back({"derive_shared_secret", 0, [=] {
+        auto secret = KeyExchange::derive_shared_secret(alice->secret_key, bob->public_key);
+        consume(secret->data(), secret->size());
+    }});
+    benches.push_back({"derive_session_key", 0, [=] {
+        consume(KeyExchange::derive_session_key(*shared, "spear-bench"));
+    }});
+    benches.push_back({"generate_keypair", 0, [] {
+        auto keypair = KeyManagement::generate_keypair();
+        consume(keypair->public_key.data(), keypair->public_key.size());
+    }});
+    benches.push_back({"generate_signing_keypair", 0, [] {
+        auto keypair = KeyManagement::generate_signing_keypair();
+        consume(keypair->public_key.data(), keypair->public_key.size());
+    }});
+    benches.push_back({"generate_keypairs/1024", 0, [] {
+        auto keypairs = KeyManagement::generate_keypairs(1024);
+        consume(keypairs->back().public_key.data(), keypairs->back().public_key.size());
+    }});
+    
+    // In-order counters round-robin over 1024 sessions
+    auto windows = std::make_shared<ReplayWindowTable>();
+    auto sessions = std::make_shared<std::vector<std::string>>();
+    for (int i = 0; i < 1024; ++i) {
+        sessions->push_back("session-" + std::to_string(i));
+    }
+    auto next = std::make_shared<uint64_t>(0);
+    benches.push_back({"replay_check", 0, [=] {
+        uint64_t n = (*next)++;
+        sink = static_cast<uint8_t>(windows->check((*sessions)[n & 1023], (n >> 10) + 1));
+    }});
+    
+    const size_t encode_sizes[] = {32, 1024, 64 * 1024, 1024 * 1024};
+    for (size_t size : encode_sizes) {
+        auto raw = std::make_shared<ByteVector>(random_payload(size));
+        auto hex = std::make_shared<std::string>(utils::to_hex(raw->data(), raw->size()));
+        auto b64 = std::make_shared<std::string>(utils::to_base64(raw->data(), raw->size()));
+        
+        benches.push_back({"to_hex/" + size_label(size), size, [=] {
+            std::string out = utils::to_hex(raw->data(), raw->size());
+            sink = static_cast<uint8_t>(out.back());
+        }});
+        benches.push_back({"from_hex/" + size_label(size), size, [=] {
+            consume(utils::from_hex(*hex));
+        }});
+        benches.push_back({"to_base64/" + size_label(size), size, [=] {
+            std::string out = utils::to_base64(raw->data(), raw->size());
+            sink = static_cast<uint8_t>(out.back());
+        }});
+        benches.push_back({"from_base64/" + size_label(size), size, [=] {
+            consume(utils::from_base64(*b64));
+        }});
+    }
+    
+    // Message envelopes, against from_base64 on the same ciphertext sizes
+    const size_t wire_sizes[] = {1024, 64 * 1024};
+    for (size_t size : wire_sizes) {
+        auto nonce_bytes = std::make_shared<ByteVector>(random_payload(NONCE_SIZE));
+        auto signature_bytes = std::make_shared<ByteVector>(random_payload(SIGNATURE_SIZE));
+        auto content = std::make_shared<ByteVector>(random_payload(size));
+        WireMessage message;
+        message.recipient = "bob";
+        message.record.sender = "alice";
+        message.record.nonce = *nonce_bytes;
+        message.record.signature = *signature_bytes;
+        message.record.content = *content;
+        auto envelope = std::make_shared<ByteVector>(*WireCodec::encode(message));
+        
+        benches.push_back({"wire_encode/" + size_label(size), size,
+                           [=, keep = std::make_tuple(nonce_bytes, signature_bytes, content)] {
+            consume(*WireCodec::encode(message));
+        }});
+        benches.push_back({"wire_decode/" + size_label(size), size, [=] {
+            consume(WireCodec::decode(*envelope)->record.content.data(), size);
+        }});
+    }
+    
+    return benches;
+}
+
+std::string json_escape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+std::string to_json(const std::vector<Result>& results, double min_time) {
+    std::ostringstream json;
+    json << "{\n  \"context\": {\n"
+         << "    \"library\": \"spear_crypto\",\n"
+         << "    \"min_time_seconds\": " << min_time << ",\n"
+         << "    \"threads\": " << ThreadPool::shared().size() << "\n"
+         << "  },\n  \"benchmarks\": [\n";
+    
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result& r = results[i];
+        json << "    {\"name\": \"" << json_escape(r.name) << "\", "
+             << "\"iterations\": " << r.iterations << ", "
+             << "\"ns_per_op\": " << r.ns_per_op << ", "
+             << "\"ops_per_second\": " << r.ops_per_second << ", "
+             << "\"mb_per_second\": " << r.mb_per_second << "}"
+             << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    
+    json << "  ]\n}\n";
+    return json.str();
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string filter;
+    std::string out_path;
+    double min_time = 0.5;
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0) {
+            filter = arg.substr(9);
+        } else if (arg.rfind("--min-time=", 0) == 0) {
+            min_time = std::stod(arg.substr(11));
+        } else if (arg.rfind("--out=", 0) == 0) {
+            out_path = arg.substr(6);
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--filter=<substring>] [--min-time=<seconds>] [--out=<file>]" << std::endl;
+            return 1;
+        }
+    }
+    
+    if (!utils::initialize()) {
+        std::cerr << "Failed to initialize crypto library" << std::endl;
+        return 1;
+    }
+    
+    std::vector<Result> results;
+    for (const Benchmark& bench : build_benchmarks()) {
+        if (!filter.empty() && bench.name.find(filter) == std::string::npos) {
+            continue;
+        }
+        
+        Result result = run(bench, min_time);
+        std::fprintf(stderr, "%-28s %14.1f ns/op %14.1f ops/s %10.1f MB/s\n",
+                     result.name.c_str(), result.ns_per_op, result.ops_per_second,
+                     result.mb_per_second);
+        results.push_back(result);
+    }
+    std::remove(BENCH_PLAIN_FILE);
+    std::remove(BENCH_SEALED_FILE);
+    
+    std::string json = to_json(results, min_time);
+    if (out_path.empty()) {
+        std::cout << json;
+    } else {
+        std::ofstream(out_path) << json;
+    }
+    return 0;
+}
@@ -0,0 +1,81 @@
+#ifndef SPEAR_CRYPTO_ASYNC_FILE_CRYPTO_HPP
+#define SPEAR_CRYPTO_ASYNC_FILE_CRYPTO_HPP
+
+#include "types.hpp"
+#include "streaming.hpp"
+#include <optional>
+#include <string>
+
+namespace spear {
+namespace crypto {
+
+enum class FileIoBackend : uint8_t {
+    IoUring,
+    Blocking,
+};
+
+struct AsyncFileOptions {
+    // Chunks with a read or write in flight at once
+    size_t depth = 8;
+    // Open the plaintext side O_DIRECT when the chunk size and the
+    // filesystem allow it; the frame side is never block-aligned
+    bool direct_io = true;
+    // False forces the pread/pwrite backend
+    bool use_io_uring = true;
+};
+
+// File-to-file streaming encryption for large files: the output is the raw
+// StreamingEncryption frames back to back, the same bytes encrypt_parallel
+// produces. Chunk i of the plaintext sits at i * chunk_size and its frame at
+// i * (chunk_size + CHUNK_OVERHEAD), so reads and writes for several chunks
+// can be in flight and complete in any order, while sealing and opening run
+// in counter order on the calling thread.
+//
+// I/O goes through io_uring where the kernel allows it, with every chunk
+// buffer registered up front so the kernel does not pin pages per request.
+// Without io_uring, or when the kernel turns its requests down, the same
+// loop runs on blocking pread/pwrite; Stats::backend names the one that
+// finished the file. An output path that names the input is refused
+// before anything is written.
+class AsyncFileCrypto {
+public:
+    // O_DIRECT needs chunk sizes, offsets and buffers aligned to this
+    static constexpr size_t DIRECT_IO_ALIGNMENT = 4096;
+    
+    struct Stats {
+        uint64_t chunks;
+        uint64_t plaintext_bytes;
+        FileIoBackend backend;
+        bool direct_io;
+        bool registered_buffers;
+    };
+    
+    // Seals the whole input with `encryption`, whose chunk size and counter
+    // are used; the last chunk is flagged final. On failure the output file
+    // is removed.
+    static std::optional<Stats> encrypt_file(
+        const std::string& input_path,
+        const std::string& output_path,
+        StreamingEncryption& encryption,
+        const AsyncFileOptions& options = AsyncFileOptions()
+    );
+    
+    // Opens a file of frames produced with `chunk_size`. Every chunk is
+    // authenticated before it is written and the final flag must be on the
+    // last frame; on any failure the output file is removed.
+    static std::optional<Stats> decrypt_file(
+        const std::string& input_path,
+        const std::string& output_path,
+        StreamingDecryption& decryption,
+        size_t chunk_size,
+        const AsyncFileOptions& options = AsyncFileOptions()
+    );
+    
+    // Whether this process can set up an io_uring instance
+    static bool io_uring_available();
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_ASYNC_FILE_CRYPTO_HPP
@@ -0,0 +1,112 @@
+#ifndef SPEAR_CRYPTO_CONTAINER_HPP
+#define SPEAR_CRYPTO_CONTAINER_HPP
+
+#include "types.hpp"
+#include "streaming.hpp"
+#include <functional>
+#include <memory>
+#include <optional>
+
+namespace spear {
+namespace crypto {
+
+// Seekable container layout (integers little-endian):
+//
+//   header   "SPRC" | version:u8 | algorithm:u8 | reserved:u16 | chunk_size:u32 | base_nonce:24
+//   chunks   StreamingEncryption frames of chunk_size plaintext bytes each,
+//            the last one shorter and flagged final
+//   trailer  AEAD(plaintext_size:u64 | chunk_count:u64), header as AAD
+//
+// Every chunk sits at a fixed offset, so a reader can decrypt any byte range
+// by fetching only the frames that cover it.
+constexpr size_t CONTAINER_HEADER_SIZE = 36;
+constexpr size_t CONTAINER_TRAILER_SIZE = 16 + MAC_SIZE;
+constexpr uint8_t CONTAINER_VERSION = 1;
+
+using ContainerSink = std::function<bool(ConstByteSpan data)>;
+using ContainerSource = std::function<bool(uint64_t offset, ByteSpan out)>;
+
+ContainerSink vector_sink(ByteVector& out);
+ContainerSource memory_source(ConstByteSpan container);
+
+class SeekableContainerWriter {
+public:
+    SeekableContainerWriter(const SymmetricKey& key,
+                            ContainerSink sink,
+                            size_t chunk_size = StreamingEncryption::DEFAULT_CHUNK_SIZE,
+                            AeadAlgorithm algorithm = SymmetricCrypto::preferred_algorithm());
+    ~SeekableContainerWriter();
+    
+    SeekableContainerWriter(const SeekableContainerWriter&) = delete;
+    SeekableContainerWriter& operator=(const SeekableContainerWriter&) = delete;
+    
+    bool write(ConstByteSpan data);
+    
+    // Seals the buffered tail as the final chunk and appends the trailer
+    bool finish();
+    
+    uint64_t plaintext_size() const { return plaintext_size_; }
+    static uint64_t container_size(uint64_t plaintext_size,
+                                   size_t chunk_size = StreamingEncryption::DEFAULT_CHUNK_SIZE);
+
+private:
+    bool flush_chunk(bool is_final);
+    
+    SecureBox<SymmetricKey> key_;
+    Nonce base_nonce_;
+    ContainerSink sink_;
+    size_t chunk_size_;
+    AeadAlgorithm algorithm_;
+    StreamingEncryption encryption_;
+    ByteVector header_;
+    ByteVector pending_;
+    ByteVector frame_;
+    uint64_t plaintext_size_;
+    bool started_;
+    bool finished_;
+    bool failed_;
+};
+
+// Not thread-safe: reads share one scratch frame buffer
+class SeekableContainerReader {
+public:
+    // Validates the header and the authenticated trailer; nullptr on failure
+    static std::unique_ptr<SeekableContainerReader> open(const SymmetricKey& key,
+                                                         ContainerSource source,
+                                                         uint64_t container_size);
+    ~SeekableContainerReader();
+    
+    SeekableContainerReader(const SeekableContainerReader&) = delete;
+    SeekableContainerReader& operator=(const SeekableContainerReader&) = delete;
+    
+    uint64_t plaintext_size() const { return plaintext_size_; }
+    uint64_t chunk_count() const { return chunk_count_; }
+    size_t chunk_size() const { return chunk_size_; }
+    AeadAlgorithm algorithm() const { return algorithm_; }
+    
+    // Decrypts one whole chunk into `out`; returns its plaintext length
+    std::optional<size_t> read_chunk(uint64_t index, ByteSpan out);
+    
+    // Decrypts [offset, offset + length), clamped to the end of the plaintext,
+    // touching only the chunks that cover it
+    std::optional<ByteVector> read(uint64_t offset, size_t length);
+    std::optional<size_t> read(uint64_t offset, ByteSpan out);
+
+private:
+    SeekableContainerReader(const SymmetricKey& key, const Nonce& base_nonce,
+                            AeadAlgorithm algorithm, ContainerSource source, size_t chunk_size);
+    
+    StreamingDecryption decryption_;
+    ContainerSource source_;
+    size_t chunk_size_;
+    AeadAlgorithm algorithm_;
+    uint64_t plaintext_size_;
+    uint64_t chunk_count_;
+    ByteVector frame_;
+    ByteVector scratch_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_CONTAINER_HPP
@@ -0,0 +1,42 @@
+#ifndef SPEAR_CRYPTO_FILE_CRYPTO_HPP
+#define SPEAR_CRYPTO_FILE_CRYPTO_HPP
+
+#include "types.hpp"
+#include "streaming.hpp"
+#include <optional>
+#include <string>
+
+namespace spear {
+namespace crypto {
+
+// File-to-file encryption in the seekable container format. The input is
+// memory-mapped and consumed one chunk at a time; the output goes through a
+// fixed-size write buffer, so memory use does not grow with file size.
+// Both calls fail, leaving the file alone, when the output path names the
+// input.
+class FileCrypto {
+public:
+    static constexpr size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+    
+    // Returns the number of plaintext bytes encrypted
+    static std::optional<uint64_t> encrypt_file(
+        const std::string& input_path,
+        const std::string& output_path,
+        const SymmetricKey& key,
+        size_t chunk_size = StreamingEncryption::DEFAULT_CHUNK_SIZE
+    );
+    
+    // Returns the number of plaintext bytes written. Every chunk is
+    // authenticated before it reaches the output; on failure the partial
+    // output file is removed.
+    static std::optional<uint64_t> decrypt_file(
+        const std::string& input_path,
+        const std::string& output_path,
+        const SymmetricKey& key
+    );
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_FILE_CRYPTO_HPP
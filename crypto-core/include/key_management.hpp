@@ -2,16 +2,31 @@
 #define SPEAR_CRYPTO_KEY_MANAGEMENT_HPP
 
 #include "types.hpp"
+#include "thread_pool.hpp"
 #include <optional>
+#include <vector>
 
 namespace spear {
 namespace crypto {
 
 class KeyManagement {
 public:
+    // Bulk requests at least this large are spread across the thread pool
+    static constexpr size_t PARALLEL_BATCH_THRESHOLD = 64;
+    
     static std::optional<KeyPair> generate_keypair();
     static std::optional<SigningKeyPair> generate_signing_keypair();
     
+    // `count` pairs in one contiguous array; nullopt if any generation fails
+    static std::optional<std::vector<KeyPair>> generate_keypairs(
+        size_t count,
+        ThreadPool* pool = nullptr
+    );
+    static std::optional<std::vector<SigningKeyPair>> generate_signing_keypairs(
+        size_t count,
+        ThreadPool* pool = nullptr
+    );
+    
     static ByteVector serialize_public_key(const PublicKey& key);
     static std::optional<PublicKey> deserialize_public_key(const ByteVector& data);
     
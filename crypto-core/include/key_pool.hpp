@@ -0,0 +1,87 @@
+#ifndef SPEAR_CRYPTO_KEY_POOL_HPP
+#define SPEAR_CRYPTO_KEY_POOL_HPP
+
+#include "types.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+namespace spear {
+namespace crypto {
+
+// Pre-generated X25519 and Ed25519 keypairs, so bursts of registrations or
+// per-session ephemeral keys do not wait on key generation. Keys wait in
+// locked, guard-paged slabs; a background thread tops each kind back up to
+// `capacity` once it falls below the low watermark. When a kind runs dry,
+// callers generate inline instead of blocking. Thread-safe.
+class KeyPool {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 128;
+    
+    struct Stats {
+        size_t keypairs;
+        size_t signing_keypairs;
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t generated;
+    };
+    
+    // low_watermark == 0 uses capacity / 4
+    explicit KeyPool(size_t capacity = DEFAULT_CAPACITY, size_t low_watermark = 0);
+    ~KeyPool();
+    
+    KeyPool(const KeyPool&) = delete;
+    KeyPool& operator=(const KeyPool&) = delete;
+    
+    std::optional<KeyPair> take_keypair();
+    std::optional<SigningKeyPair> take_signing_keypair();
+    
+    // Tops both kinds up to capacity and blocks until they are full, e.g. to
+    // warm up before a burst. Returns false if key generation failed first
+    bool wait_full();
+    
+    Stats stats() const;
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct KeySlot {
+        PublicKey public_key;
+        SecretKey secret_key;
+    };
+    
+    struct SigningKeySlot {
+        SigningPublicKey public_key;
+        SigningSecretKey secret_key;
+    };
+    
+    bool needs_refill() const;
+    bool full() const;
+    void refill_loop();
+    
+    size_t capacity_;
+    size_t low_watermark_;
+    
+    // capacity_ + 1 slots each; the last one is the refill thread's scratch
+    KeySlot* keypairs_;
+    SigningKeySlot* signing_keypairs_;
+    size_t keypair_count_ = 0;
+    size_t signing_count_ = 0;
+    
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t generated_ = 0;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable refill_;
+    std::condition_variable filled_;
+    bool top_up_ = false;
+    bool refill_failed_ = false;
+    bool stopping_ = false;
+    std::thread refiller_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_KEY_POOL_HPP
@@ -0,0 +1,193 @@
+#ifndef SPEAR_CRYPTO_MESSAGE_STORE_HPP
+#define SPEAR_CRYPTO_MESSAGE_STORE_HPP
+
+#include "types.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+// One queued message. On append the views point at caller memory and `id`
+// and `timestamp_ms` are assigned by the store; records returned by fetch()
+// point into the mapped segment and stay valid as long as their batch.
+struct MessageRecord {
+    uint64_t id = 0;
+    uint64_t counter = 0;
+    uint64_t timestamp_ms = 0;
+    std::string_view sender;
+    ConstByteSpan nonce;
+    ConstByteSpan signature;
+    ConstByteSpan content;
+};
+
+// Messages returned by MessageStore::fetch. Holds the segment mappings the
+// records point into, so they survive a concurrent compaction.
+class MessageBatch {
+public:
+    size_t size() const { return records_.size(); }
+    bool empty() const { return records_.empty(); }
+    const MessageRecord& operator[](size_t index) const { return records_[index]; }
+    std::vector<MessageRecord>::const_iterator begin() const { return records_.begin(); }
+    std::vector<MessageRecord>::const_iterator end() const { return records_.end(); }
+
+private:
+    friend class MessageStore;
+    std::vector<MessageRecord> records_;
+    std::vector<std::shared_ptr<const void>> mappings_;
+};
+
+struct MessageStoreOptions {
+    // A segment is sealed and a new one started once it reaches this size
+    uint64_t segment_size = 64 * 1024 * 1024;
+    // fdatasync every commit; appends return only once their record is durable
+    bool sync = true;
+};
+
+// Append-only message queue for the relay server. Messages and acks are
+// records in a log of fixed-size segment files; an in-memory per-recipient
+// index is rebuilt from the log on open.
+//
+// Concurrent appends are group-committed: one caller writes and syncs every
+// record queued so far while the others wait for it. Delivery reads the
+// segments through read-only mappings. Acks move a per-recipient cursor, and
+// compact() deletes the oldest segments once every message in them is acked.
+//
+// All methods are thread-safe.
+class MessageStore {
+public:
+    static constexpr size_t RECORD_HEADER_SIZE = 48;
+    static constexpr size_t MAX_FIELD_SIZE = 0xFFFF;
+    
+    struct Stats {
+        uint64_t queued_messages;
+        size_t recipients;
+        size_t segments;
+        uint64_t commits;
+        uint64_t records;
+    };
+    
+    // Creates the directory if needed and replays the log. A torn record at
+    // the tail of the last segment is truncated away.
+    static std::unique_ptr<MessageStore> open(const std::string& directory,
+                                              const MessageStoreOptions& options = {});
+    ~MessageStore();
+    
+    MessageStore(const MessageStore&) = delete;
+    MessageStore& operator=(const MessageStore&) = delete;
+    
+    // Returns the message id; ids increase monotonically across recipients
+    std::optional<uint64_t> append(std::string_view recipient, const MessageRecord& message);
+    
+    // Appends messages[i] for recipients[i] in one commit, so a caller with
+    // many messages in hand waits for a single sync. Ids are consecutive from
+    // the returned one. Nothing is appended if any message is invalid.
+    std::optional<uint64_t> append_batch(const std::vector<std::string_view>& recipients,
+                                         const std::vector<MessageRecord>& messages);
+    
+    // Unacknowledged messages for a recipient, oldest first
+    MessageBatch fetch(std::string_view recipient, size_t limit = SIZE_MAX);
+    
+    // Acknowledges every message for the recipient up to and including
+    // `up_to_id`. Returns how many messages left the queue. The cursor never
+    // moves past the newest message delivered to the recipient, so acking an
+    // id that does not exist yet cannot swallow later messages.
+    std::optional<size_t> ack(std::string_view recipient, uint64_t up_to_id);
+    
+    // Id of the newest message ever queued for the recipient, acked or not;
+    // 0 if there has been none
+    uint64_t last_id(std::string_view recipient) const;
+    
+    // Recipient of a message still queued, found by id alone. Scans every
+    // queue, so it is for the legacy per-message ack route, not hot paths.
+    std::optional<std::string> recipient_of(uint64_t id) const;
+    
+    // Makes every record appended so far durable (a no-op with sync enabled)
+    bool flush();
+    
+    // Deletes the leading run of sealed segments with no queued messages.
+    // Returns how many segment files were removed.
+    size_t compact();
+    
+    Stats stats() const;
+
+private:
+    struct Segment;
+    
+    struct Entry {
+        uint64_t id;
+        Segment* segment;
+        uint32_t offset;
+        uint32_t size;
+    };
+    
+    struct Queue {
+        std::deque<Entry> entries;
+        uint64_t acked = 0;
+        uint64_t newest = 0;
+    };
+    
+    struct PendingRecord {
+        uint8_t type;
+        uint64_t seq;
+        uint32_t size;
+        std::string recipient;
+    };
+    
+    struct Placement {
+        std::shared_ptr<Segment> segment;
+        uint32_t offset;
+    };
+    
+    MessageStore(const std::string& directory, const MessageStoreOptions& options);
+    
+    bool recover();
+    bool replay(const std::shared_ptr<Segment>& segment, bool last);
+    std::shared_ptr<Segment> create_segment(uint64_t base_seq);
+    
+    uint64_t enqueue(uint8_t type, std::string_view recipient, const MessageRecord& message);
+    bool commit(std::unique_lock<std::mutex>& lock, uint64_t seq);
+    bool write_batch(const ByteVector& batch, const std::vector<PendingRecord>& records,
+                     std::vector<Placement>& placements,
+                     std::vector<std::shared_ptr<Segment>>& created);
+    
+    void index_message(const std::string& recipient, uint64_t id, Segment* segment,
+                       uint32_t offset, uint32_t size);
+    size_t apply_ack(Queue& queue, uint64_t up_to_id);
+    
+    std::string directory_;
+    MessageStoreOptions options_;
+    
+    mutable std::mutex mutex_;
+    std::condition_variable committed_;
+    std::deque<std::shared_ptr<Segment>> segments_;
+    std::unordered_map<std::string, Queue> queues_;
+    uint64_t queued_messages_ = 0;
+    
+    // Group commit state: records are encoded into pending_ under the lock,
+    // and whichever caller finds no commit in flight writes them out
+    ByteVector pending_;
+    std::vector<PendingRecord> pending_records_;
+    uint64_t next_seq_ = 1;
+    uint64_t committed_seq_ = 0;
+    bool committing_ = false;
+    bool failed_ = false;
+    uint64_t commits_ = 0;
+    uint64_t records_ = 0;
+    
+    // Owned by the committing caller
+    std::shared_ptr<Segment> active_;
+    uint64_t active_size_ = 0;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_MESSAGE_STORE_HPP
@@ -0,0 +1,114 @@
+#ifndef SPEAR_CRYPTO_METRICS_HPP
+#define SPEAR_CRYPTO_METRICS_HPP
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace spear {
+namespace crypto {
+
+enum class MetricOp : uint8_t {
+    AeadEncrypt,
+    AeadDecrypt,
+    Sign,
+    Verify,
+    KeyExchange,
+    StreamEncryptChunk,
+    StreamDecryptChunk
+};
+
+constexpr size_t METRIC_OP_COUNT = 7;
+
+// Log-linear latency buckets in the style of HdrHistogram: 8 sub-buckets per
+// power of two, so a reported value is within 12.5% of the real one.
+// Latencies from 2^36 ns (about 69 s) up share the last bucket.
+struct LatencyHistogram {
+    static constexpr size_t SUB_BUCKETS = 8;
+    static constexpr unsigned MAX_POWER = 36;
+    static constexpr size_t BUCKETS = (MAX_POWER - 2) * SUB_BUCKETS;
+    
+    std::array<uint64_t, BUCKETS> counts{};
+    
+    static size_t bucket_for(uint64_t nanos);
+    static uint64_t bucket_lower(size_t bucket);
+    static uint64_t bucket_upper(size_t bucket);
+    
+    uint64_t count() const;
+    // Upper bound of the bucket holding the given quantile (0..1); 0 if empty
+    uint64_t quantile(double q) const;
+    uint64_t max() const;
+};
+
+struct OpMetrics {
+    uint64_t ops = 0;
+    uint64_t failures = 0;
+    uint64_t bytes = 0;
+    uint64_t total_nanos = 0;
+    LatencyHistogram latency;
+};
+
+struct MetricsSnapshot {
+    bool enabled = false;
+    std::array<OpMetrics, METRIC_OP_COUNT> ops;
+    
+    const OpMetrics& operator[](MetricOp op) const { return ops[static_cast<size_t>(op)]; }
+};
+
+// Process-wide counters and latency histograms for the crypto primitives.
+// Each thread records into one of SHARDS cache-aligned shards with relaxed
+// atomics, so the hot path never contends on a shared line; snapshot() sums
+// the shards. Recording is compiled in only when SPEAR_METRICS is defined;
+// otherwise the SPEAR_METRICS_* macros expand to nothing and snapshots are
+// empty.
+class Metrics {
+public:
+    static constexpr size_t SHARDS = 16;
+    
+    static bool enabled();
+    static void record(MetricOp op, uint64_t bytes, uint64_t nanos, bool ok);
+    static MetricsSnapshot snapshot();
+    static void reset();
+    
+    // snake_case name, e.g. "aead_encrypt"
+    static const char* op_name(MetricOp op);
+};
+
+// Records one operation when it goes out of scope; counted as a failure
+// unless succeed() was called first
+class MetricsTimer {
+public:
+    MetricsTimer(MetricOp op, uint64_t bytes)
+        : op_(op), bytes_(bytes), ok_(false), start_(std::chrono::steady_clock::now()) {}
+    
+    ~MetricsTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start_;
+        Metrics::record(op_, bytes_, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()), ok_);
+    }
+    
+    MetricsTimer(const MetricsTimer&) = delete;
+    MetricsTimer& operator=(const MetricsTimer&) = delete;
+    
+    void succeed() { ok_ = true; }
+
+private:
+    MetricOp op_;
+    uint64_t bytes_;
+    bool ok_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#ifdef SPEAR_METRICS
+#define SPEAR_METRICS_TIMER(name, op, bytes) ::spear::crypto::MetricsTimer name(op, bytes)
+#define SPEAR_METRICS_SUCCEED(name) name.succeed()
+#else
+#define SPEAR_METRICS_TIMER(name, op, bytes) do {} while (0)
+#define SPEAR_METRICS_SUCCEED(name) do {} while (0)
+#endif
+
+#endif // SPEAR_CRYPTO_METRICS_HPP
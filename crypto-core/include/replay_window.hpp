@@ -0,0 +1,82 @@
+#ifndef SPEAR_CRYPTO_REPLAY_WINDOW_HPP
+#define SPEAR_CRYPTO_REPLAY_WINDOW_HPP
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+enum class ReplayCheck : uint8_t {
+    Accepted,
+    Replayed,
+    TooOld
+};
+
+// Per-session anti-replay state for message counters, in the style of the
+// IPsec sliding window (RFC 4303 3.4.3 / RFC 6479): a counter is accepted
+// once if it is newer than the highest seen, or within WINDOW_SIZE of it and
+// not seen before. Reordered messages are accepted as long as they are not
+// more than a window behind.
+//
+// Sessions live in sharded open-addressing tables, one 64-byte slot per
+// session, keyed by a SipHash of the session name under a per-instance key.
+// Each shard has its own lock, so checks on different sessions rarely
+// contend. Thread-safe.
+class ReplayWindowTable {
+public:
+    static constexpr size_t WINDOW_WORDS = 6;
+    static constexpr uint64_t WINDOW_SIZE = WINDOW_WORDS * 64;
+    static constexpr size_t DEFAULT_SHARDS = 64;
+    
+    explicit ReplayWindowTable(size_t shards = DEFAULT_SHARDS);
+    ~ReplayWindowTable();
+    
+    ReplayWindowTable(const ReplayWindowTable&) = delete;
+    ReplayWindowTable& operator=(const ReplayWindowTable&) = delete;
+    
+    // Records the counter if it is accepted. Unknown sessions start with
+    // every counter above zero unused.
+    ReplayCheck check(std::string_view session, uint64_t counter);
+    
+    // Starts a session at a persisted high-water mark, treating every
+    // counter up to it as used. No-op if the session is already tracked.
+    bool seed(std::string_view session, uint64_t highest);
+    
+    std::optional<uint64_t> highest(std::string_view session) const;
+    bool forget(std::string_view session);
+    size_t size() const;
+
+private:
+    struct alignas(64) Slot {
+        uint64_t key;
+        uint64_t highest;
+        uint64_t bitmap[WINDOW_WORDS];
+    };
+    
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::vector<Slot> slots;
+        size_t size = 0;
+    };
+    
+    uint64_t hash(std::string_view session) const;
+    Shard& shard_for(uint64_t key) const;
+    static Slot* find(Shard& shard, uint64_t key);
+    static Slot& insert(Shard& shard, uint64_t key);
+    static void grow(Shard& shard);
+    
+    std::array<uint8_t, 16> hash_key_;
+    std::unique_ptr<Shard[]> shards_;
+    size_t shard_mask_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_REPLAY_WINDOW_HPP
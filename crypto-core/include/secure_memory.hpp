@@ -0,0 +1,148 @@
+#ifndef SPEAR_CRYPTO_SECURE_MEMORY_HPP
+#define SPEAR_CRYPTO_SECURE_MEMORY_HPP
+
+#include "types.hpp"
+#include "utils.hpp"
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+// Fixed-size blocks for secrets, carved out of sodium_malloc'd slabs: every
+// slab is mlock'd (never swapped out) and bracketed by guard pages. A block
+// is wiped as soon as it is released. Thread-safe.
+class SecureSlab {
+public:
+    static constexpr size_t DEFAULT_BLOCK_SIZE = 128;
+    static constexpr size_t DEFAULT_BLOCKS_PER_SLAB = 256;
+    
+    // block_size is rounded up to a multiple of 16
+    explicit SecureSlab(size_t block_size = DEFAULT_BLOCK_SIZE,
+                        size_t blocks_per_slab = DEFAULT_BLOCKS_PER_SLAB);
+    ~SecureSlab();
+    
+    SecureSlab(const SecureSlab&) = delete;
+    SecureSlab& operator=(const SecureSlab&) = delete;
+    
+    // nullptr when a new slab cannot be allocated
+    void* allocate();
+    void deallocate(void* block);
+    
+    size_t block_size() const { return block_size_; }
+    size_t in_use() const;
+    
+    // Process-wide slab used by SecureBox. Never destroyed, so boxes in
+    // static objects stay valid through exit.
+    static SecureSlab& shared();
+
+private:
+    size_t block_size_;
+    size_t blocks_per_slab_;
+    std::vector<void*> slabs_;
+    std::vector<void*> free_blocks_;
+    size_t in_use_ = 0;
+    mutable std::mutex mutex_;
+};
+
+// Owns one T in the shared secure slab. If locked memory cannot be had the
+// value falls back to the heap and is still wiped on destruction.
+template <typename T>
+class SecureBox {
+    static_assert(sizeof(T) <= SecureSlab::DEFAULT_BLOCK_SIZE, "too large for a secure slab block");
+    static_assert(alignof(T) <= 16, "secure slab blocks are 16-byte aligned");
+
+public:
+    SecureBox() : SecureBox(T{}) {}
+    
+    explicit SecureBox(const T& value) : ptr_(nullptr), locked_(true) {
+        void* block = SecureSlab::shared().allocate();
+        if (!block) {
+            block = ::operator new(sizeof(T));
+            locked_ = false;
+        }
+        ptr_ = new (block) T(value);
+    }
+    
+    ~SecureBox() { release(); }
+    
+    SecureBox(const SecureBox&) = delete;
+    SecureBox& operator=(const SecureBox&) = delete;
+    
+    SecureBox(SecureBox&& other) noexcept
+        : ptr_(std::exchange(other.ptr_, nullptr)), locked_(other.locked_) {
+    }
+    
+    SecureBox& operator=(SecureBox&& other) noexcept {
+        if (this != &other) {
+            release();
+            ptr_ = std::exchange(other.ptr_, nullptr);
+            locked_ = other.locked_;
+        }
+        return *this;
+    }
+    
+    T& operator*() const { return *ptr_; }
+    T* operator->() const { return ptr_; }
+    T* get() const { return ptr_; }
+    
+    // False when the value lives on the ordinary heap
+    bool locked() const { return locked_; }
+
+private:
+    void release() {
+        if (!ptr_) {
+            return;
+        }
+        ptr_->~T();
+        if (locked_) {
+            SecureSlab::shared().deallocate(ptr_);
+        } else {
+            utils::secure_memzero(ptr_, sizeof(T));
+            ::operator delete(ptr_);
+        }
+        ptr_ = nullptr;
+    }
+    
+    T* ptr_;
+    bool locked_;
+};
+
+// Bump allocator for transient plaintext and ciphertext buffers. Requests are
+// carved out of one preallocated block with no heap traffic; reset() wipes
+// everything handed out since the last reset with a single memzero and
+// rewinds. Requests that do not fit spill into separate buffers, which reset()
+// wipes and frees. Not thread-safe: use one arena per thread.
+class ScratchArena {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1024 * 1024;
+    static constexpr size_t ALIGNMENT = 16;
+    
+    explicit ScratchArena(size_t capacity = DEFAULT_CAPACITY);
+    ~ScratchArena();
+    
+    ScratchArena(const ScratchArena&) = delete;
+    ScratchArena& operator=(const ScratchArena&) = delete;
+    
+    // Valid until the next reset()
+    ByteSpan allocate(size_t size);
+    void reset();
+    
+    size_t used() const { return used_; }
+    size_t capacity() const { return block_.size(); }
+    
+    // Arena owned by the calling thread
+    static ScratchArena& for_thread();
+
+private:
+    ByteVector block_;
+    size_t used_;
+    std::vector<ByteVector> overflow_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_SECURE_MEMORY_HPP
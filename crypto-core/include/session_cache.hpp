@@ -0,0 +1,110 @@
+#ifndef SPEAR_CRYPTO_SESSION_CACHE_HPP
+#define SPEAR_CRYPTO_SESSION_CACHE_HPP
+
+#include "types.hpp"
+#include "symmetric_crypto.hpp"
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+// Thread-safe LRU cache of X25519 shared secrets and derived session keys,
+// keyed by (local key id, remote public key, context). Secrets live in one
+// locked, guard-paged slab and are wiped as soon as their entry is evicted.
+class SessionKeyCache {
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 1024;
+    static constexpr std::chrono::seconds DEFAULT_TTL{3600};
+    
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t evictions;
+        size_t size;
+    };
+    
+    explicit SessionKeyCache(size_t capacity = DEFAULT_CAPACITY,
+                             std::chrono::seconds ttl = DEFAULT_TTL);
+    ~SessionKeyCache();
+    
+    SessionKeyCache(const SessionKeyCache&) = delete;
+    SessionKeyCache& operator=(const SessionKeyCache&) = delete;
+    
+    // Same result as KeyExchange::derive_shared_secret; the scalar
+    // multiplication only runs on a miss.
+    std::optional<SharedSecret> shared_secret(
+        const std::string& local_key_id,
+        const SecretKey& local_secret_key,
+        const PublicKey& remote_public_key
+    );
+    
+    // Same result as derive_session_key(derive_shared_secret(...), context)
+    std::optional<SymmetricKey> session_key(
+        const std::string& local_key_id,
+        const SecretKey& local_secret_key,
+        const PublicKey& remote_public_key,
+        const std::string& context
+    );
+    
+    // An AeadContext over session_key(...), set up once and shared by every
+    // caller until the entry is evicted; callers holding one keep it alive
+    std::shared_ptr<const AeadContext> session_context(
+        const std::string& local_key_id,
+        const SecretKey& local_secret_key,
+        const PublicKey& remote_public_key,
+        const std::string& context,
+        AeadAlgorithm algorithm = SymmetricCrypto::preferred_algorithm()
+    );
+    
+    // Drops every entry derived from a local key, e.g. after rotation
+    void erase_local_key(const std::string& local_key_id);
+    void clear();
+    
+    Stats stats() const;
+    size_t capacity() const { return capacity_; }
+
+private:
+    struct Slot {
+        SharedSecret shared_secret;
+        SymmetricKey session_key;
+    };
+    
+    struct Node {
+        std::string key;
+        std::string local_key_id;
+        size_t slot;
+        std::chrono::steady_clock::time_point expires;
+        std::shared_ptr<const AeadContext> aead;
+    };
+    
+    using LruList = std::list<Node>;
+    
+    std::optional<Slot> lookup(const std::string& key);
+    void insert(const std::string& key, const std::string& local_key_id, const Slot& value);
+    void evict(LruList::iterator it);
+    
+    size_t capacity_;
+    std::chrono::seconds ttl_;
+    Slot* slots_;
+    std::vector<size_t> free_slots_;
+    LruList lru_;
+    std::unordered_map<std::string, LruList::iterator> index_;
+    mutable std::mutex mutex_;
+    
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> evictions_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_SESSION_CACHE_HPP
@@ -2,13 +2,36 @@
 #define SPEAR_CRYPTO_SIGNING_HPP
 
 #include "types.hpp"
+#include "thread_pool.hpp"
+#include <memory>
 #include <optional>
+#include <vector>
 
 namespace spear {
 namespace crypto {
 
+// One (message, signature, key) triple; the message is borrowed, not copied
+struct SignatureCheck {
+    ConstByteSpan message;
+    Signature signature;
+    SigningPublicKey public_key;
+};
+
+// Per-item verification results, bit i set when item i verified
+struct BatchVerifyResult {
+    std::vector<uint64_t> bits;
+    size_t count = 0;
+    
+    bool valid(size_t index) const { return (bits[index / 64] >> (index % 64)) & 1; }
+    bool all_valid() const { return valid_count() == count; }
+    size_t valid_count() const;
+};
+
 class Signing {
 public:
+    // Batches at least this large are spread across the thread pool
+    static constexpr size_t PARALLEL_BATCH_THRESHOLD = 64;
+    
     static std::optional<Signature> sign_message(
         const ByteVector& message,
         const SigningSecretKey& secret_key
@@ -19,9 +42,66 @@ public:
         const Signature& signature,
         const SigningPublicKey& public_key
     );
+    
+    static std::optional<Signature> sign_message(
+        ConstByteSpan message,
+        const SigningSecretKey& secret_key
+    );
+    
+    static bool verify_signature(
+        ConstByteSpan message,
+        const Signature& signature,
+        const SigningPublicKey& public_key
+    );
+    
+    static BatchVerifyResult verify_batch(
+        const std::vector<SignatureCheck>& items,
+        ThreadPool* pool = nullptr
+    );
+};
+
+// Incremental Ed25519ph (RFC 8032 pre-hashed Ed25519): the message is fed
+// through SHA-512 piece by piece and only the digest is signed, so memory
+// stays constant however large the payload. Ed25519ph signatures do not
+// verify with verify_signature, nor pure Ed25519 ones here.
+class StreamSigner {
+public:
+    StreamSigner();
+    ~StreamSigner();
+    
+    StreamSigner(const StreamSigner&) = delete;
+    StreamSigner& operator=(const StreamSigner&) = delete;
+    
+    void update(ConstByteSpan data);
+    
+    // Signs everything passed to update() since construction or the last
+    // finish(), then starts over
+    std::optional<Signature> finish(const SigningSecretKey& secret_key);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
+};
+
+class StreamVerifier {
+public:
+    StreamVerifier();
+    ~StreamVerifier();
+    
+    StreamVerifier(const StreamVerifier&) = delete;
+    StreamVerifier& operator=(const StreamVerifier&) = delete;
+    
+    void update(ConstByteSpan data);
+    
+    // Checks the signature over everything passed to update(), then starts over
+    bool finish(const Signature& signature, const SigningPublicKey& public_key);
+
+private:
+    struct State;
+    std::unique_ptr<State> state_;
 };
 
 } // namespace crypto
 } // namespace spear
 
-#endif // SPEAR_CRYPTO_SIGNING_HPP
\ No newline at end of file
+#endif // SPEAR_CRYPTO_SIGNING_HPP
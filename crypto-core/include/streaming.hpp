@@ -2,53 +2,186 @@
 #define SPEAR_CRYPTO_STREAMING_HPP
 
 #include "types.hpp"
+#include "symmetric_crypto.hpp"
+#include "secure_memory.hpp"
+#include "signing.hpp"
+#include "thread_pool.hpp"
+#include <functional>
 #include <optional>
 #include <memory>
 
 namespace spear {
 namespace crypto {
 
+// Frame layout: counter:u64 | flags:u8 | ciphertext | tag. Flag bit 0 marks
+// the final chunk; bits 1-7 hold the AeadAlgorithm id (0 = ChaCha20-Poly1305,
+// so frames from before the algorithm was recorded still parse).
 class StreamingEncryption {
 public:
     static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+    static constexpr size_t CHUNK_HEADER_SIZE = 9;
+    static constexpr size_t CHUNK_OVERHEAD = CHUNK_HEADER_SIZE + MAC_SIZE;
     
     StreamingEncryption(const SymmetricKey& key, 
                        const Nonce& base_nonce,
-                       size_t chunk_size = DEFAULT_CHUNK_SIZE);
+                       size_t chunk_size = DEFAULT_CHUNK_SIZE,
+                       AeadAlgorithm algorithm = SymmetricCrypto::preferred_algorithm());
     ~StreamingEncryption();
     
     StreamingEncryption(const StreamingEncryption&) = delete;
     StreamingEncryption& operator=(const StreamingEncryption&) = delete;
     
     std::optional<ByteVector> encrypt_chunk(const ByteVector& chunk, bool is_final);
+    
+    // Seals one chunk into `frame`, which must hold chunk.size() + CHUNK_OVERHEAD
+    // bytes. Returns the frame length.
+    std::optional<size_t> encrypt_chunk(ConstByteSpan chunk, bool is_final, ByteSpan frame);
+    
+    // Scatter variant: the frame's header (CHUNK_HEADER_SIZE bytes),
+    // ciphertext (chunk.size()) and tag (MAC_SIZE) go to separate buffers,
+    // e.g. for writev. `ciphertext` may be `chunk` itself to seal in place.
+    // Returns the frame length.
+    std::optional<size_t> encrypt_chunk(ConstByteSpan chunk, bool is_final,
+                                        ByteSpan header, ByteSpan ciphertext, ByteSpan tag);
+    
+    // Splits `data` into chunk_size() chunks, the last one flagged final, and
+    // seals them on `pool` (the shared pool when null). The frames are written
+    // back to back in counter order, byte-identical to encrypt_chunk output.
+    std::optional<ByteVector> encrypt_parallel(ConstByteSpan data, ThreadPool* pool = nullptr);
+    std::optional<size_t> encrypt_parallel(ConstByteSpan data, ByteSpan out,
+                                           ThreadPool* pool = nullptr);
+    
+    static size_t encrypted_size(size_t plaintext_size, size_t chunk_size = DEFAULT_CHUNK_SIZE);
+    
+    // Feeds every frame sealed from now on to `signer`, in counter order, so
+    // the stream is signed as it is produced. The signer is borrowed and
+    // must outlive its use; nullptr detaches it.
+    void set_signer(StreamSigner* signer) { signer_ = signer; }
+    
+    size_t chunk_size() const { return chunk_size_; }
+    AeadAlgorithm algorithm() const { return context_.algorithm(); }
     uint64_t current_chunk() const { return chunk_counter_; }
     void reset(const Nonce& new_base_nonce);
 
 private:
-    SymmetricKey key_;
+    AeadContext context_;
     Nonce base_nonce_;
     size_t chunk_size_;
     uint64_t chunk_counter_;
+    StreamSigner* signer_ = nullptr;
 };
 
 class StreamingDecryption {
 public:
-    StreamingDecryption(const SymmetricKey& key, const Nonce& base_nonce);
+    // The algorithm is read from each frame header. When `algorithm` is given
+    // only frames sealed with it are accepted; otherwise the first frame
+    // fixes it for the rest of the stream.
+    StreamingDecryption(const SymmetricKey& key, const Nonce& base_nonce,
+                        std::optional<AeadAlgorithm> algorithm = std::nullopt);
     ~StreamingDecryption();
     
     StreamingDecryption(const StreamingDecryption&) = delete;
     StreamingDecryption& operator=(const StreamingDecryption&) = delete;
     
     std::optional<ByteVector> decrypt_chunk(const ByteVector& encrypted_chunk);
+    
+    // Opens the next frame into `out`, which must hold
+    // frame.size() - CHUNK_OVERHEAD bytes. Returns the plaintext length.
+    std::optional<size_t> decrypt_chunk(ConstByteSpan frame, ByteSpan out);
+    
+    // Gather variant: the frame's header, ciphertext and tag sit in separate
+    // buffers, e.g. filled by readv. `out` must hold ciphertext.size() bytes
+    // and may be `ciphertext` itself to open in place. In place, an attached
+    // verifier is fed before the tag is checked, so a rejected frame makes
+    // the stream signature fail.
+    std::optional<size_t> decrypt_chunk(ConstByteSpan header, ConstByteSpan ciphertext,
+                                        ConstByteSpan tag, ByteSpan out);
+    
+    // Opens the frame of chunk `counter` out of order, without touching the
+    // sequential state. The frame's final flag must equal `is_final`.
+    std::optional<size_t> decrypt_chunk_at(uint64_t counter, bool is_final,
+                                           ConstByteSpan frame, ByteSpan out) const;
+    
+    // Verifies and opens a run of back-to-back frames produced with
+    // `chunk_size`, continuing from expected_chunk(). The run must end with the
+    // final chunk; on any failure nothing is returned and state is unchanged.
+    std::optional<ByteVector> decrypt_parallel(ConstByteSpan frames, size_t chunk_size,
+                                               ThreadPool* pool = nullptr);
+    std::optional<size_t> decrypt_parallel(ConstByteSpan frames, size_t chunk_size,
+                                           ByteSpan out, ThreadPool* pool = nullptr);
+    
+    static std::optional<size_t> decrypted_size(size_t frames_size, size_t chunk_size);
+    
+    // Feeds every frame accepted in sequence from now on to `verifier`, to
+    // check a signature made with StreamingEncryption::set_signer once the
+    // stream is complete. decrypt_chunk_at does not feed it.
+    void set_verifier(StreamVerifier* verifier) { verifier_ = verifier; }
+    
     bool is_complete() const { return received_final_; }
+    std::optional<AeadAlgorithm> algorithm() const { return algorithm_; }
     uint64_t expected_chunk() const { return expected_chunk_counter_; }
     void reset(const Nonce& new_base_nonce);
 
 private:
-    SymmetricKey key_;
+    const AeadContext& context_for(AeadAlgorithm algorithm) const;
+    
+    // One per algorithm the stream may use, indexed by AeadAlgorithm id;
+    // the others stay empty
+    AeadContext contexts_[2];
     Nonce base_nonce_;
+    std::optional<AeadAlgorithm> required_algorithm_;
+    std::optional<AeadAlgorithm> algorithm_;
     uint64_t expected_chunk_counter_;
     bool received_final_;
+    StreamVerifier* verifier_ = nullptr;
+};
+
+// A source fills `out` and returns the byte count, 0 at end of input or
+// nullopt on error; short reads are fine. A sink consumes all of `data` or
+// returns false.
+using StreamSource = std::function<std::optional<size_t>(ByteSpan out)>;
+using StreamSink = std::function<bool(ConstByteSpan data)>;
+
+// Runs a stream through three stages at once: the source on a reader thread,
+// sealing or opening on the calling thread, and the sink on a writer thread.
+// Stages hand chunk buffers to each other through bounded single-producer
+// single-consumer rings and return them for reuse, so 2 * `depth` frame
+// buffers are allocated up front and nothing else is allocated per chunk.
+// Each chunk is read into, sealed or opened in, and written from the same
+// buffer. With
+// I/O on both ends, throughput approaches the slowest stage rather than the
+// sum of all three.
+class StreamPipeline {
+public:
+    static constexpr size_t DEFAULT_DEPTH = 4;
+    
+    struct Stats {
+        uint64_t chunks;
+        uint64_t bytes_read;
+        uint64_t bytes_written;
+    };
+    
+    // Seals the source in encryption.chunk_size() chunks, the last one
+    // flagged final; the sink receives exactly what encrypt_chunk would
+    // produce.
+    static std::optional<Stats> encrypt(StreamingEncryption& encryption,
+                                        const StreamSource& source,
+                                        const StreamSink& sink,
+                                        size_t depth = DEFAULT_DEPTH);
+    
+    // Opens frames produced with `chunk_size`. Every chunk is authenticated
+    // before it reaches the sink, but the sink may already have taken a
+    // prefix of the stream when a later frame fails or the final frame is
+    // missing.
+    static std::optional<Stats> decrypt(StreamingDecryption& decryption,
+                                        size_t chunk_size,
+                                        const StreamSource& source,
+                                        const StreamSink& sink,
+                                        size_t depth = DEFAULT_DEPTH);
+    
+    // Plain read(2) / write(2) stages; the descriptors stay open
+    static StreamSource fd_source(int fd);
+    static StreamSink fd_sink(int fd);
 };
 
 } // namespace crypto
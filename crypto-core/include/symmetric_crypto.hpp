@@ -2,39 +2,271 @@
 #define SPEAR_CRYPTO_SYMMETRIC_HPP
 
 #include "types.hpp"
+#include "secure_memory.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
 #include <optional>
+#include <vector>
 
 namespace spear {
 namespace crypto {
 
+// Wire identifiers, recorded in stream frame and container headers
+enum class AeadAlgorithm : uint8_t {
+    ChaCha20Poly1305 = 0,
+    Aes256Gcm = 1,
+};
+
+// One message of a batch. Input, key and AAD are borrowed and must outlive
+// the call; many items may point at the same key.
+struct AeadBatchItem {
+    ConstByteSpan input;
+    const SymmetricKey* key = nullptr;
+    Nonce nonce{};
+    ConstByteSpan aad;
+    AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305;
+};
+
+// All outputs of a batch, back to back in one arena. Item i occupies
+// [offsets[i], offsets[i + 1]); a failed item's slot is zeroed.
+struct AeadBatchResult {
+    ByteVector arena;
+    std::vector<size_t> offsets;
+    std::vector<uint8_t> status;
+    
+    size_t size() const { return status.size(); }
+    bool ok(size_t index) const { return status[index] != 0; }
+    bool all_ok() const;
+    ConstByteSpan output(size_t index) const {
+        return ConstByteSpan(arena.data() + offsets[index], offsets[index + 1] - offsets[index]);
+    }
+};
+
 class SymmetricCrypto {
 public:
+    static constexpr size_t TAG_SIZE = MAC_SIZE;
+    
+    // Batches with at least this many input bytes are spread across the pool
+    static constexpr size_t PARALLEL_BATCH_BYTES = 64 * 1024;
+    
+    // AES-256-GCM needs AES-NI and PCLMUL; ChaCha20-Poly1305 is always available
+    static bool is_available(AeadAlgorithm algorithm);
+    
+    // AES-256-GCM where the CPU accelerates it, ChaCha20-Poly1305 otherwise
+    static AeadAlgorithm preferred_algorithm();
+    
+    static std::optional<AeadAlgorithm> algorithm_from_id(uint8_t id);
+    static const char* algorithm_name(AeadAlgorithm algorithm);
+    
     static std::optional<ByteVector> encrypt_aead(
         const ByteVector& plaintext,
         const SymmetricKey& key,
         const Nonce& nonce,
-        const ByteVector& aad = {}
+        const ByteVector& aad = {},
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
     );
     
     static std::optional<ByteVector> decrypt_aead(
         const ByteVector& ciphertext,
         const SymmetricKey& key,
         const Nonce& nonce,
-        const ByteVector& aad = {}
+        const ByteVector& aad = {},
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    // Caller-buffer variants: `ciphertext` must hold plaintext.size() + TAG_SIZE
+    // bytes and `plaintext` must hold ciphertext.size() - TAG_SIZE bytes. Input
+    // and output may be the same buffer. Return the number of bytes written.
+    static std::optional<size_t> encrypt_aead(
+        ConstByteSpan plaintext,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan ciphertext,
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    static std::optional<size_t> decrypt_aead(
+        ConstByteSpan ciphertext,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan plaintext,
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    // In-place variants: `buffer` holds the message followed by TAG_SIZE bytes
+    // reserved for the tag. Return the ciphertext / plaintext length.
+    static std::optional<size_t> encrypt_aead_in_place(
+        ByteSpan buffer,
+        size_t plaintext_len,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad = {},
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    static std::optional<size_t> decrypt_aead_in_place(
+        ByteSpan buffer,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad = {},
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    // Arena variants: the output is carved from `arena` and stays valid until
+    // the arena is reset, so per-message loops make no heap allocations
+    static std::optional<ByteSpan> encrypt_aead(
+        ConstByteSpan plaintext,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ScratchArena& arena,
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    static std::optional<ByteSpan> decrypt_aead(
+        ConstByteSpan ciphertext,
+        const SymmetricKey& key,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ScratchArena& arena,
+        AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305
+    );
+    
+    // Seals / opens every item into a single arena with one allocation. Items
+    // fail independently: a bad tag clears only that item's status.
+    static AeadBatchResult encrypt_batch(
+        const std::vector<AeadBatchItem>& items,
+        ThreadPool* pool = nullptr
     );
+    
+    static AeadBatchResult decrypt_batch(
+        const std::vector<AeadBatchItem>& items,
+        ThreadPool* pool = nullptr
+    );
+};
+
+// Key-dependent state for one key and algorithm, set up once and reused for
+// every message under that key: for AES-256-GCM the expanded key schedule and
+// GHASH table, for ChaCha20-Poly1305 just the key. The state lives in a locked
+// slab and is wiped on destruction. encrypt/decrypt are const and may be
+// called from any number of threads; the output is identical to the
+// SymmetricCrypto functions with the same key and algorithm.
+class AeadContext {
+public:
+    // An empty context; every call on it fails
+    AeadContext();
+    
+    explicit AeadContext(const SymmetricKey& key,
+                         AeadAlgorithm algorithm = AeadAlgorithm::ChaCha20Poly1305);
+    ~AeadContext();
+    
+    AeadContext(const AeadContext&) = delete;
+    AeadContext& operator=(const AeadContext&) = delete;
+    
+    AeadContext(AeadContext&& other) noexcept;
+    AeadContext& operator=(AeadContext&& other) noexcept;
+    
+    // False for an empty context or when the algorithm is unavailable
+    bool valid() const { return state_ != nullptr; }
+    AeadAlgorithm algorithm() const { return algorithm_; }
+    
+    std::optional<ByteVector> encrypt(
+        const ByteVector& plaintext,
+        const Nonce& nonce,
+        const ByteVector& aad = {}
+    ) const;
+    
+    std::optional<ByteVector> decrypt(
+        const ByteVector& ciphertext,
+        const Nonce& nonce,
+        const ByteVector& aad = {}
+    ) const;
+    
+    // Same buffer rules as the SymmetricCrypto caller-buffer variants
+    std::optional<size_t> encrypt(
+        ConstByteSpan plaintext,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan ciphertext
+    ) const;
+    
+    std::optional<size_t> decrypt(
+        ConstByteSpan ciphertext,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan plaintext
+    ) const;
+    
+    // Detached variants: the TAG_SIZE tag has its own buffer, so a message
+    // can be sealed or opened in place wherever it sits. `ciphertext` and
+    // `plaintext` are the same size and may be the same buffer.
+    bool encrypt_detached(
+        ConstByteSpan plaintext,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan ciphertext,
+        ByteSpan tag
+    ) const;
+    
+    bool decrypt_detached(
+        ConstByteSpan ciphertext,
+        ConstByteSpan tag,
+        const Nonce& nonce,
+        ConstByteSpan aad,
+        ByteSpan plaintext
+    ) const;
+
+private:
+    struct State;
+    
+    void release();
+    
+    State* state_;
+    AeadAlgorithm algorithm_;
+    bool locked_;
+};
+
+// A run of counters reserved from a NonceManager for one thread; handing
+// them out touches no shared state. Not thread-safe itself.
+class NonceBlock {
+public:
+    std::optional<Nonce> next();
+    uint64_t remaining() const { return end_ - next_; }
+
+private:
+    friend class NonceManager;
+    NonceBlock(const Nonce& base_nonce, uint64_t begin, uint64_t end);
+    
+    Nonce base_nonce_;
+    uint64_t next_;
+    uint64_t end_;
 };
 
+// Lock-free: next_nonce() and reserve_block() may be called from any number
+// of threads. reset() and set_counter() must not race with them.
 class NonceManager {
 public:
     NonceManager();
+    
+    NonceManager(const NonceManager&) = delete;
+    NonceManager& operator=(const NonceManager&) = delete;
+    
     std::optional<Nonce> next_nonce();
-    uint64_t current_counter() const { return counter_; }
-    void set_counter(uint64_t counter) { counter_ = counter; }
+    
+    // Claims up to `count` consecutive counters; the block is shorter only
+    // when the counter space is nearly exhausted. nullopt once exhausted.
+    std::optional<NonceBlock> reserve_block(uint64_t count);
+    
+    uint64_t current_counter() const { return counter_.load(std::memory_order_relaxed); }
+    void set_counter(uint64_t counter) { counter_.store(counter, std::memory_order_relaxed); }
     void reset();
 
 private:
     Nonce base_nonce_;
-    uint64_t counter_;
+    // Own cache line: every sender hammers it, base_nonce_ is read-only
+    alignas(64) std::atomic<uint64_t> counter_;
 };
 
 } // namespace crypto
@@ -0,0 +1,48 @@
+#ifndef SPEAR_CRYPTO_THREAD_POOL_HPP
+#define SPEAR_CRYPTO_THREAD_POOL_HPP
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+class ThreadPool {
+public:
+    // num_threads == 0 uses one worker per hardware thread
+    explicit ThreadPool(size_t num_threads = 0);
+    ~ThreadPool();
+    
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    
+    size_t size() const { return workers_.size(); }
+    
+    void submit(std::function<void()> task);
+    
+    // Runs fn(0) .. fn(count - 1) on the workers and the calling thread and
+    // returns once every call has finished. Safe to call from a worker.
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+    
+    // Process-wide pool used when callers do not supply their own
+    static ThreadPool& shared();
+
+private:
+    void worker_loop();
+    
+    std::vector<std::thread> workers_;
+    std::deque<std::function<void()>> tasks_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    bool stopping_;
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_THREAD_POOL_HPP
@@ -5,6 +5,7 @@
 #include <vector>
 #include <cstdint>
 #include <string>
+#include <cstddef>
 
 namespace spear {
 namespace crypto {
@@ -31,6 +32,50 @@ using Nonce = std::array<uint8_t, NONCE_SIZE>;
 using Signature = std::array<uint8_t, SIGNATURE_SIZE>;
 using ByteVector = std::vector<uint8_t>;
 
+// Non-owning views over caller memory (std::span stand-ins for C++17)
+class ConstByteSpan {
+public:
+    constexpr ConstByteSpan() noexcept : data_(nullptr), size_(0) {}
+    constexpr ConstByteSpan(const uint8_t* data, size_t size) noexcept : data_(data), size_(size) {}
+    ConstByteSpan(const ByteVector& v) noexcept : data_(v.data()), size_(v.size()) {}
+    template <size_t N>
+    constexpr ConstByteSpan(const std::array<uint8_t, N>& a) noexcept : data_(a.data()), size_(N) {}
+    
+    constexpr const uint8_t* data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr const uint8_t& operator[](size_t i) const noexcept { return data_[i]; }
+    constexpr ConstByteSpan subspan(size_t offset, size_t count) const noexcept {
+        return ConstByteSpan(data_ + offset, count);
+    }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+class ByteSpan {
+public:
+    constexpr ByteSpan() noexcept : data_(nullptr), size_(0) {}
+    constexpr ByteSpan(uint8_t* data, size_t size) noexcept : data_(data), size_(size) {}
+    ByteSpan(ByteVector& v) noexcept : data_(v.data()), size_(v.size()) {}
+    template <size_t N>
+    constexpr ByteSpan(std::array<uint8_t, N>& a) noexcept : data_(a.data()), size_(N) {}
+    
+    constexpr uint8_t* data() const noexcept { return data_; }
+    constexpr size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return size_ == 0; }
+    constexpr uint8_t& operator[](size_t i) const noexcept { return data_[i]; }
+    constexpr ByteSpan subspan(size_t offset, size_t count) const noexcept {
+        return ByteSpan(data_ + offset, count);
+    }
+    constexpr operator ConstByteSpan() const noexcept { return ConstByteSpan(data_, size_); }
+
+private:
+    uint8_t* data_;
+    size_t size_;
+};
+
 // Key pair for encryption (X25519)
 struct KeyPair {
     PublicKey public_key;
@@ -2,7 +2,9 @@
 #define SPEAR_CRYPTO_UTILS_HPP
 
 #include "types.hpp"
+#include <optional>
 #include <string>
+#include <string_view>
 
 namespace spear {
 namespace crypto {
@@ -24,6 +26,19 @@ ByteVector from_hex(const std::string& hex);
 std::string to_base64(const uint8_t* data, size_t size);
 ByteVector from_base64(const std::string& base64);
 
+// Caller-buffer codecs: no allocation and no exceptions. Each returns the
+// number of bytes written, or nullopt on malformed input or when `out` is too
+// small. Hex decoding accepts either case; base64 is the padded standard
+// alphabet, decoded strictly.
+size_t hex_encoded_size(size_t size);
+size_t base64_encoded_size(size_t size);
+size_t base64_decoded_max_size(size_t length);
+
+std::optional<size_t> to_hex(ConstByteSpan data, char* out, size_t out_size);
+std::optional<size_t> from_hex(std::string_view hex, ByteSpan out);
+std::optional<size_t> to_base64(ConstByteSpan data, char* out, size_t out_size);
+std::optional<size_t> from_base64(std::string_view base64, ByteSpan out);
+
 } // namespace utils
 } // namespace crypto
 } // namespace spear
@@ -0,0 +1,58 @@
+#ifndef SPEAR_CRYPTO_WIRE_CODEC_HPP
+#define SPEAR_CRYPTO_WIRE_CODEC_HPP
+
+#include "types.hpp"
+#include "message_store.hpp"
+#include <optional>
+#include <string_view>
+#include <vector>
+
+namespace spear {
+namespace crypto {
+
+// One message as exchanged between clients and the relay. Decoded messages
+// point into the buffer they were parsed from and are valid as long as it is.
+// `record.id` and `record.timestamp_ms` are zero when a client sends.
+struct WireMessage {
+    std::string_view recipient;
+    MessageRecord record;
+};
+
+// Versioned binary envelope for messages, replacing JSON with base64 fields
+// on the hot path. Little-endian:
+//   0 magic "SPRW" | 4 version u8 | 5 reserved u8 | 6 sender_len u16 |
+//   8 recipient_len u16 | 10 reserved u16 | 12 content_len u32 |
+//   16 counter u64 | 24 id u64 | 32 timestamp_ms u64 | 40 nonce | 64 signature |
+//   128 sender | recipient | content
+// Envelopes are self-delimiting, so a batch is simply several back to back.
+class WireCodec {
+public:
+    static constexpr uint8_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 40 + NONCE_SIZE + SIGNATURE_SIZE;
+    static constexpr size_t MAX_NAME_SIZE = MessageStore::MAX_FIELD_SIZE;
+    static constexpr size_t MAX_CONTENT_SIZE = 64 * 1024 * 1024;
+    
+    // Zero if the message cannot be encoded (see encode)
+    static size_t encoded_size(const WireMessage& message);
+    
+    // The sender must be non-empty, the nonce NONCE_SIZE, the signature
+    // SIGNATURE_SIZE and the content a whole AEAD ciphertext (at least
+    // MAC_SIZE, at most MAX_CONTENT_SIZE). Returns the bytes written.
+    static std::optional<size_t> encode(const WireMessage& message, ByteSpan out);
+    static std::optional<ByteVector> encode(const WireMessage& message);
+    
+    // Appends one envelope to a batch body
+    static bool append(const WireMessage& message, ByteVector& out);
+    
+    // Parses the envelope at the front of `data` in place, applying the same
+    // size checks as encode. `consumed` receives its encoded size.
+    static std::optional<WireMessage> decode(ConstByteSpan data, size_t* consumed = nullptr);
+    
+    // Parses a whole batch body; fails on any malformed envelope or trailing bytes
+    static std::optional<std::vector<WireMessage>> decode_all(ConstByteSpan data);
+};
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_WIRE_CODEC_HPP
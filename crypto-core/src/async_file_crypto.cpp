@@ -0,0 +1,729 @@
+#include "async_file_crypto.hpp"
+#include <sodium.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef SPEAR_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+constexpr size_t FRAME_OVERHEAD = StreamingEncryption::CHUNK_OVERHEAD;
+constexpr size_t ALIGNMENT = AsyncFileCrypto::DIRECT_IO_ALIGNMENT;
+constexpr size_t MAX_DEPTH = 256;
+
+size_t align_up(size_t n) {
+    return (n + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+struct IoRequest {
+    int fd;
+    uint8_t* buffer;
+    size_t length;
+    uint64_t offset;
+    bool write;
+    // Registered buffer the request falls in, or -1
+    int buffer_index;
+    uint64_t tag;
+};
+
+struct IoCompletion {
+    uint64_t tag;
+    // Bytes transferred, or -errno
+    int64_t result;
+};
+
+#ifdef SPEAR_IO_URING
+// Submission and completion rings over the raw system calls. READ / WRITE
+// opcodes need Linux 5.6; older kernels fail setup or reject the requests,
+// and run_chunks then finishes the file with blocking I/O.
+class Ring {
+public:
+    static std::unique_ptr<Ring> create(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd < 0) {
+            return nullptr;
+        }
+        
+        std::unique_ptr<Ring> ring(new Ring(fd));
+        if (!ring->map(params)) {
+            return nullptr;
+        }
+        return ring;
+    }
+    
+    ~Ring() {
+        if (sqes_) {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (cq_ && cq_ != sq_) {
+            ::munmap(cq_, cq_size_);
+        }
+        if (sq_) {
+            ::munmap(sq_, sq_size_);
+        }
+        ::close(fd_);
+    }
+    
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+    
+    bool register_buffers(const std::vector<iovec>& buffers) {
+        return ::syscall(__NR_io_uring_register, fd_, IORING_REGISTER_BUFFERS,
+                         buffers.data(), static_cast<unsigned>(buffers.size())) == 0;
+    }
+    
+    // False when the submission ring is full
+    bool push(const IoRequest& request) {
+        unsigned tail = *sq_tail_;
+        if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+            return false;
+        }
+        
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe& sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        bool fixed = request.buffer_index >= 0;
+        sqe.opcode = request.write ? (fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE)
+                                   : (fixed ? IORING_OP_READ_FIXED : IORING_OP_READ);
+        sqe.fd = request.fd;
+        sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+        sqe.len = static_cast<uint32_t>(request.length);
+        sqe.off = request.offset;
+        if (fixed) {
+            sqe.buf_index = static_cast<uint16_t>(request.buffer_index);
+        }
+        sqe.user_data = request.tag;
+        
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted_++;
+        return true;
+    }
+    
+    // Submits everything pushed so far and, with `wait`, blocks until at
+    // least one completion is posted
+    bool enter(bool wait) {
+        if (unsubmitted_ == 0 && !wait) {
+            return true;
+        }
+        
+        while (true) {
+            long submitted = ::syscall(__NR_io_uring_enter, fd_, unsubmitted_, wait ? 1 : 0,
+                                       wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+            if (submitted >= 0) {
+                unsubmitted_ -= static_cast<unsigned>(submitted);
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+    }
+    
+    void reap(std::vector<IoCompletion>& out) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            out.push_back(IoCompletion{cqe.user_data, cqe.res});
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    explicit Ring(int fd) : fd_(fd) {}
+    
+    bool map(const io_uring_params& params) {
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+        
+        sq_ = map_region(sq_size_, IORING_OFF_SQ_RING);
+        cq_ = single_mmap ? sq_ : map_region(cq_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(map_region(sqes_size_, IORING_OFF_SQES));
+        if (!sq_ || !cq_ || !sqes_) {
+            return false;
+        }
+        
+        uint8_t* sq = static_cast<uint8_t*>(sq_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        
+        uint8_t* cq = static_cast<uint8_t*>(cq_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+    
+    void* map_region(size_t size, off_t offset) {
+        void* region = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              fd_, offset);
+        return region == MAP_FAILED ? nullptr : region;
+    }
+    
+    int fd_;
+    void* sq_ = nullptr;
+    void* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned unsubmitted_ = 0;
+    
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    io_uring_cqe* cqes_ = nullptr;
+    unsigned cq_mask_ = 0;
+};
+#endif
+
+// Runs requests on an io_uring when one can be set up, otherwise right away
+// with pread/pwrite; either way results come back through wait()
+class IoQueue {
+public:
+    IoQueue(bool use_io_uring, unsigned entries) {
+#ifdef SPEAR_IO_URING
+        if (use_io_uring) {
+            ring_ = Ring::create(entries);
+        }
+#else
+        (void)use_io_uring;
+        (void)entries;
+#endif
+    }
+    
+    FileIoBackend backend() const {
+#ifdef SPEAR_IO_URING
+        if (ring_) {
+            return FileIoBackend::IoUring;
+        }
+#endif
+        return FileIoBackend::Blocking;
+    }
+    
+    // Drops the ring; later requests run with pread/pwrite. Only once
+    // nothing is in flight.
+    void fall_back() {
+#ifdef SPEAR_IO_URING
+        ring_.reset();
+#endif
+    }
+    
+    // Requests may then name a buffer by index
+    bool register_buffers(const std::vector<iovec>& buffers) {
+#ifdef SPEAR_IO_URING
+        return ring_ && ring_->register_buffers(buffers);
+#else
+        (void)buffers;
+        return false;
+#endif
+    }
+    
+    bool push(const IoRequest& request) {
+#ifdef SPEAR_IO_URING
+        if (ring_) {
+            return ring_->push(request);
+        }
+#endif
+        ssize_t n;
+        do {
+            n = request.write
+                ? ::pwrite(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset))
+                : ::pread(request.fd, request.buffer, request.length, static_cast<off_t>(request.offset));
+        } while (n < 0 && errno == EINTR);
+        done_.push_back(IoCompletion{request.tag, n < 0 ? -errno : n});
+        return true;
+    }
+    
+    bool submit() {
+#ifdef SPEAR_IO_URING
+        if (ring_) {
+            return ring_->enter(false);
+        }
+#endif
+        return true;
+    }
+    
+    // Submits, then blocks until at least one request has completed
+    bool wait(std::vector<IoCompletion>& completions) {
+#ifdef SPEAR_IO_URING
+        if (ring_) {
+            if (!ring_->enter(true)) {
+                return false;
+            }
+            ring_->reap(completions);
+            return true;
+        }
+#endif
+        completions.insert(completions.end(), done_.begin(), done_.end());
+        done_.clear();
+        return true;
+    }
+
+private:
+#ifdef SPEAR_IO_URING
+    std::unique_ptr<Ring> ring_;
+#endif
+    std::vector<IoCompletion> done_;
+};
+
+// Descriptor that may have been opened O_DIRECT; the flag is dropped again
+// when the filesystem turns the first request down
+class FileHandle {
+public:
+    FileHandle(const std::string& path, int flags, bool direct)
+        : path_(path), fd_(-1), direct_(false) {
+        if (direct) {
+            fd_ = ::open(path.c_str(), flags | O_DIRECT | O_CLOEXEC, 0600);
+            direct_ = fd_ >= 0;
+        }
+        if (fd_ < 0) {
+            fd_ = ::open(path.c_str(), flags | O_CLOEXEC, 0600);
+        }
+    }
+    
+    ~FileHandle() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+    
+    FileHandle(const FileHandle&) = delete;
+    FileHandle& operator=(const FileHandle&) = delete;
+    
+    bool ok() const { return fd_ >= 0; }
+    int fd() const { return fd_; }
+    bool direct() const { return direct_; }
+    
+    std::optional<uint64_t> regular_file_size() const {
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            return std::nullopt;
+        }
+        return static_cast<uint64_t>(st.st_size);
+    }
+    
+    // Whether `path` names this file, directly or through a link
+    bool same_file(const std::string& path) const {
+        struct stat ours;
+        struct stat theirs;
+        return ::fstat(fd_, &ours) == 0 && ::stat(path.c_str(), &theirs) == 0 &&
+               ours.st_dev == theirs.st_dev && ours.st_ino == theirs.st_ino;
+    }
+    
+    bool clear_direct() {
+        if (!direct_) {
+            return false;
+        }
+        int flags = ::fcntl(fd_, F_GETFL);
+        if (flags < 0 || ::fcntl(fd_, F_SETFL, flags & ~O_DIRECT) != 0) {
+            return false;
+        }
+        direct_ = false;
+        return true;
+    }
+    
+    bool commit(std::optional<uint64_t> size = std::nullopt) {
+        bool ok = !size || ::ftruncate(fd_, static_cast<off_t>(*size)) == 0;
+        ok = ::close(fd_) == 0 && ok;
+        fd_ = -1;
+        return ok;
+    }
+    
+    void discard() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        ::unlink(path_.c_str());
+    }
+
+private:
+    std::string path_;
+    int fd_;
+    bool direct_;
+};
+
+// One plaintext and one frame buffer per slot. Plaintext buffers are
+// block-aligned for O_DIRECT and wiped on destruction.
+class ChunkBuffers {
+public:
+    ChunkBuffers(size_t depth, size_t chunk_size)
+        : depth_(depth),
+          plain_stride_(align_up(std::max<size_t>(chunk_size, 1))),
+          frame_stride_(chunk_size + FRAME_OVERHEAD),
+          plain_(static_cast<uint8_t*>(::operator new(depth * plain_stride_, std::align_val_t(ALIGNMENT)))),
+          frames_(depth * frame_stride_) {
+    }
+    
+    ~ChunkBuffers() {
+        sodium_memzero(plain_, depth_ * plain_stride_);
+        ::operator delete(plain_, std::align_val_t(ALIGNMENT));
+    }
+    
+    ChunkBuffers(const ChunkBuffers&) = delete;
+    ChunkBuffers& operator=(const ChunkBuffers&) = delete;
+    
+    uint8_t* plain(size_t slot) { return plain_ + slot * plain_stride_; }
+    uint8_t* frame(size_t slot) { return frames_.data() + slot * frame_stride_; }
+    size_t plain_capacity() const { return plain_stride_; }
+    
+    // Plaintext buffer of slot s is index s, its frame buffer depth + s
+    int plain_index(size_t slot) const { return registered_ ? static_cast<int>(slot) : -1; }
+    int frame_index(size_t slot) const { return registered_ ? static_cast<int>(depth_ + slot) : -1; }
+    
+    bool register_with(IoQueue& queue) {
+        std::vector<iovec> buffers;
+        for (size_t i = 0; i < depth_; ++i) {
+            buffers.push_back(iovec{plain(i), plain_stride_});
+        }
+        for (size_t i = 0; i < depth_; ++i) {
+            buffers.push_back(iovec{frame(i), frame_stride_});
+        }
+        registered_ = queue.register_buffers(buffers);
+        return registered_;
+    }
+
+private:
+    size_t depth_;
+    size_t plain_stride_;
+    size_t frame_stride_;
+    uint8_t* plain_;
+    ByteVector frames_;
+    bool registered_ = false;
+};
+
+// A request plus the bytes it has to move; direct reads and writes may ask
+// for more, rounded up to the block size
+struct Transfer {
+    IoRequest request;
+    size_t want;
+};
+
+struct ChunkSlot {
+    enum class State { Free, Reading, Ready, Writing };
+    
+    State state = State::Free;
+    uint64_t chunk = 0;
+    IoRequest request{};
+    size_t want = 0;
+    size_t done = 0;
+    // Whether the request went out while its file was O_DIRECT
+    bool direct = false;
+};
+
+// Keeps a read in flight for every free slot and hands chunks to `transform`
+// strictly in order as their reads land; `transform` returns the write for
+// the chunk. A slot is reused once its write completes. Short transfers are
+// resumed and direct requests the filesystem rejects are retried buffered.
+// Requests the ring itself rejects are retried with blocking I/O once the
+// ring has drained.
+template <typename ReadFor, typename Transform>
+bool run_chunks(IoQueue& queue, size_t depth, uint64_t chunks, FileHandle& input, FileHandle& output,
+                ReadFor read_for, Transform transform) {
+    std::vector<ChunkSlot> slots(depth);
+    std::vector<IoCompletion> completions;
+    std::vector<size_t> rejected;
+    uint64_t next_read = 0;
+    uint64_t next_chunk = 0;
+    size_t in_flight = 0;
+    bool failed = false;
+    
+    auto push = [&](ChunkSlot& slot) {
+        FileHandle& file = slot.state == ChunkSlot::State::Reading ? input : output;
+        slot.direct = file.direct();
+        if (!queue.push(slot.request)) {
+            return false;
+        }
+        in_flight++;
+        return true;
+    };
+    
+    auto start = [&](size_t index, const Transfer& transfer, ChunkSlot::State state) {
+        ChunkSlot& slot = slots[index];
+        slot.request = transfer.request;
+        slot.request.tag = index;
+        slot.want = transfer.want;
+        slot.done = 0;
+        // Empty chunks move no bytes
+        if (transfer.want == 0) {
+            slot.state = state == ChunkSlot::State::Reading ? ChunkSlot::State::Ready
+                                                            : ChunkSlot::State::Free;
+            return true;
+        }
+        slot.state = state;
+        return push(slot);
+    };
+    
+    while (!failed) {
+        if (!rejected.empty() && in_flight == 0) {
+            queue.fall_back();
+            for (size_t index : rejected) {
+                if (!push(slots[index])) {
+                    failed = true;
+                    break;
+                }
+            }
+            rejected.clear();
+            continue;
+        }
+        
+        // Nothing new goes to a ring that is turning requests down
+        while (rejected.empty() && next_read < chunks &&
+               slots[next_read % depth].state == ChunkSlot::State::Free) {
+            size_t index = next_read % depth;
+            slots[index].chunk = next_read;
+            if (!start(index, read_for(next_read, index), ChunkSlot::State::Reading)) {
+                failed = true;
+                break;
+            }
+            next_read++;
+        }
+        if (failed || !queue.submit()) {
+            failed = true;
+            break;
+        }
+        
+        size_t index = next_chunk % depth;
+        if (rejected.empty() && next_chunk < chunks && slots[index].state == ChunkSlot::State::Ready &&
+            slots[index].chunk == next_chunk) {
+            auto write = transform(next_chunk, index);
+            if (!write || !start(index, *write, ChunkSlot::State::Writing)) {
+                failed = true;
+                break;
+            }
+            next_chunk++;
+            continue;
+        }
+        if (in_flight == 0) {
+            break;
+        }
+        
+        completions.clear();
+        if (!queue.wait(completions)) {
+            failed = true;
+            break;
+        }
+        for (const IoCompletion& completion : completions) {
+            in_flight--;
+            ChunkSlot& slot = slots[completion.tag];
+            FileHandle& file = slot.state == ChunkSlot::State::Reading ? input : output;
+            
+            // Every direct request already in flight fails the same way, not
+            // just the one that cleared the flag
+            if (completion.result == -EINVAL && slot.direct && (!file.direct() || file.clear_direct())) {
+                failed = failed || !push(slot);
+                continue;
+            }
+            if ((completion.result == -EINVAL || completion.result == -EOPNOTSUPP) &&
+                queue.backend() == FileIoBackend::IoUring) {
+                rejected.push_back(completion.tag);
+                continue;
+            }
+            if (completion.result <= 0) {
+                failed = true;
+                continue;
+            }
+            
+            size_t moved = static_cast<size_t>(completion.result);
+            slot.done += moved;
+            if (slot.done < slot.want) {
+                slot.request.buffer += moved;
+                slot.request.offset += moved;
+                slot.request.length -= std::min(moved, slot.request.length);
+                failed = failed || !push(slot);
+                continue;
+            }
+            slot.state = slot.state == ChunkSlot::State::Reading ? ChunkSlot::State::Ready
+                                                                 : ChunkSlot::State::Free;
+        }
+    }
+    
+    // The kernel may still be using the buffers
+    while (in_flight > 0) {
+        completions.clear();
+        if (!queue.submit() || !queue.wait(completions)) {
+            break;
+        }
+        in_flight -= std::min(in_flight, completions.size());
+    }
+    
+    return !failed && next_chunk == chunks;
+}
+
+uint64_t chunk_count(uint64_t size, size_t chunk_size) {
+    return size == 0 ? 1 : (size + chunk_size - 1) / chunk_size;
+}
+
+} // namespace
+
+std::optional<AsyncFileCrypto::Stats> AsyncFileCrypto::encrypt_file(
+    const std::string& input_path,
+    const std::string& output_path,
+    StreamingEncryption& encryption,
+    const AsyncFileOptions& options) {
+    
+    size_t chunk_size = encryption.chunk_size();
+    if (chunk_size == 0) {
+        return std::nullopt;
+    }
+    
+    FileHandle input(input_path, O_RDONLY, options.direct_io && chunk_size % ALIGNMENT == 0);
+    auto size = input.ok() ? input.regular_file_size() : std::nullopt;
+    // Opening the input as the output would truncate it
+    if (!size || input.same_file(output_path)) {
+        return std::nullopt;
+    }
+    
+    FileHandle output(output_path, O_WRONLY | O_CREAT | O_TRUNC, false);
+    if (!output.ok()) {
+        return std::nullopt;
+    }
+    
+    size_t depth = std::min(std::max<size_t>(options.depth, 1), MAX_DEPTH);
+    IoQueue queue(options.use_io_uring, static_cast<unsigned>(depth));
+    ChunkBuffers buffers(depth, chunk_size);
+    bool registered = buffers.register_with(queue);
+    uint64_t chunks = chunk_count(*size, chunk_size);
+    size_t frame_size = chunk_size + FRAME_OVERHEAD;
+    
+    auto plain_len = [&](uint64_t chunk) {
+        return static_cast<size_t>(std::min<uint64_t>(chunk_size, *size - chunk * chunk_size));
+    };
+    
+    auto read_for = [&](uint64_t chunk, size_t slot) {
+        size_t len = plain_len(chunk);
+        // Direct reads cover whole blocks; the one at EOF comes back short
+        size_t request = input.direct() && len > 0 ? align_up(len) : len;
+        return Transfer{IoRequest{input.fd(), buffers.plain(slot), request, chunk * chunk_size, false,
+                                  buffers.plain_index(slot), 0}, len};
+    };
+    
+    auto transform = [&](uint64_t chunk, size_t slot) -> std::optional<Transfer> {
+        size_t len = plain_len(chunk);
+        auto written = encryption.encrypt_chunk(ConstByteSpan(buffers.plain(slot), len),
+                                                chunk + 1 == chunks,
+                                                ByteSpan(buffers.frame(slot), len + FRAME_OVERHEAD));
+        if (!written) {
+            return std::nullopt;
+        }
+        return Transfer{IoRequest{output.fd(), buffers.frame(slot), *written, chunk * frame_size, true,
+                                  buffers.frame_index(slot), 0}, *written};
+    };
+    
+    if (!run_chunks(queue, depth, chunks, input, output, read_for, transform) || !output.commit()) {
+        output.discard();
+        return std::nullopt;
+    }
+    return Stats{chunks, *size, queue.backend(), input.direct(), registered};
+}
+
+std::optional<AsyncFileCrypto::Stats> AsyncFileCrypto::decrypt_file(
+    const std::string& input_path,
+    const std::string& output_path,
+    StreamingDecryption& decryption,
+    size_t chunk_size,
+    const AsyncFileOptions& options) {
+    
+    if (chunk_size == 0 || decryption.is_complete()) {
+        return std::nullopt;
+    }
+    
+    FileHandle input(input_path, O_RDONLY, false);
+    auto frames_size = input.ok() ? input.regular_file_size() : std::nullopt;
+    auto plaintext_size = frames_size ? StreamingDecryption::decrypted_size(*frames_size, chunk_size)
+                                      : std::nullopt;
+    if (!plaintext_size || input.same_file(output_path)) {
+        return std::nullopt;
+    }
+    
+    FileHandle output(output_path, O_WRONLY | O_CREAT | O_TRUNC,
+                      options.direct_io && chunk_size % ALIGNMENT == 0);
+    if (!output.ok()) {
+        return std::nullopt;
+    }
+    
+    size_t depth = std::min(std::max<size_t>(options.depth, 1), MAX_DEPTH);
+    IoQueue queue(options.use_io_uring, static_cast<unsigned>(depth));
+    ChunkBuffers buffers(depth, chunk_size);
+    bool registered = buffers.register_with(queue);
+    size_t frame_size = chunk_size + FRAME_OVERHEAD;
+    uint64_t chunks = (*frames_size + frame_size - 1) / frame_size;
+    
+    auto frame_len = [&](uint64_t chunk) {
+        return static_cast<size_t>(std::min<uint64_t>(frame_size, *frames_size - chunk * frame_size));
+    };
+    
+    auto read_for = [&](uint64_t chunk, size_t slot) {
+        size_t len = frame_len(chunk);
+        return Transfer{IoRequest{input.fd(), buffers.frame(slot), len, chunk * frame_size, false,
+                                  buffers.frame_index(slot), 0}, len};
+    };
+    
+    auto transform = [&](uint64_t chunk, size_t slot) -> std::optional<Transfer> {
+        uint8_t* plain = buffers.plain(slot);
+        auto len = decryption.decrypt_chunk(ConstByteSpan(buffers.frame(slot), frame_len(chunk)),
+                                            ByteSpan(plain, buffers.plain_capacity()));
+        // The frame flagged final must be the last one in the file
+        if (!len || decryption.is_complete() != (chunk + 1 == chunks)) {
+            return std::nullopt;
+        }
+        
+        // Direct writes cover whole blocks; the padding is truncated away
+        size_t request = output.direct() && *len > 0 ? align_up(*len) : *len;
+        std::memset(plain + *len, 0, request - *len);
+        return Transfer{IoRequest{output.fd(), plain, request, chunk * chunk_size, true,
+                                  buffers.plain_index(slot), 0}, *len};
+    };
+    
+    if (!run_chunks(queue, depth, chunks, input, output, read_for, transform) ||
+        !output.commit(*plaintext_size)) {
+        output.discard();
+        return std::nullopt;
+    }
+    return Stats{chunks, *plaintext_size, queue.backend(), output.direct(), registered};
+}
+
+bool AsyncFileCrypto::io_uring_available() {
+#ifdef SPEAR_IO_URING
+    static const bool available = Ring::create(1) != nullptr;
+    return available;
+#else
+    return false;
+#endif
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,300 @@
+#include "container.hpp"
+#include "endian.hpp"
+#include "symmetric_crypto.hpp"
+#include "utils.hpp"
+#include <sodium.h>
+#include <algorithm>
+#include <cstring>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+constexpr uint8_t CONTAINER_MAGIC[4] = {'S', 'P', 'R', 'C'};
+constexpr size_t FRAME_OVERHEAD = StreamingEncryption::CHUNK_OVERHEAD;
+
+// The trailer uses the nonce of chunk UINT64_MAX, which no chunk can reach
+Nonce trailer_nonce(const Nonce& base_nonce) {
+    Nonce nonce = base_nonce;
+    std::memset(nonce.data(), 0xFF, 8);
+    return nonce;
+}
+
+uint64_t chunks_for(uint64_t plaintext_size, size_t chunk_size) {
+    return plaintext_size == 0 ? 1 : (plaintext_size + chunk_size - 1) / chunk_size;
+}
+
+} // namespace
+
+ContainerSink vector_sink(ByteVector& out) {
+    return [&out](ConstByteSpan data) {
+        out.insert(out.end(), data.data(), data.data() + data.size());
+        return true;
+    };
+}
+
+ContainerSource memory_source(ConstByteSpan container) {
+    return [container](uint64_t offset, ByteSpan out) {
+        if (offset > container.size() || out.size() > container.size() - offset) {
+            return false;
+        }
+        std::memcpy(out.data(), container.data() + offset, out.size());
+        return true;
+    };
+}
+
+// ============================================================================
+// SeekableContainerWriter
+// ============================================================================
+
+SeekableContainerWriter::SeekableContainerWriter(
+    const SymmetricKey& key,
+    ContainerSink sink,
+    size_t chunk_size,
+    AeadAlgorithm algorithm)
+    : key_(key),
+      base_nonce_(utils::random_nonce()),
+      sink_(std::move(sink)),
+      chunk_size_(chunk_size),
+      algorithm_(algorithm),
+      encryption_(key, base_nonce_, chunk_size, algorithm),
+      header_(CONTAINER_HEADER_SIZE, 0),
+      plaintext_size_(0),
+      started_(false),
+      finished_(false),
+      failed_(chunk_size == 0 || chunk_size > UINT32_MAX) {
+    
+    std::memcpy(header_.data(), CONTAINER_MAGIC, 4);
+    header_[4] = CONTAINER_VERSION;
+    header_[5] = static_cast<uint8_t>(algorithm);
+    put_u32(header_.data() + 8, static_cast<uint32_t>(chunk_size));
+    std::memcpy(header_.data() + 12, base_nonce_.data(), base_nonce_.size());
+    
+    pending_.reserve(chunk_size_);
+    frame_.resize(chunk_size_ + FRAME_OVERHEAD);
+}
+
+SeekableContainerWriter::~SeekableContainerWriter() {
+    if (!pending_.empty()) {
+        sodium_memzero(pending_.data(), pending_.size());
+    }
+}
+
+bool SeekableContainerWriter::flush_chunk(bool is_final) {
+    auto frame_size = encryption_.encrypt_chunk(pending_, is_final, frame_);
+    sodium_memzero(pending_.data(), pending_.size());
+    pending_.clear();
+    
+    if (!frame_size || !sink_(ConstByteSpan(frame_).subspan(0, *frame_size))) {
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
+
+bool SeekableContainerWriter::write(ConstByteSpan data) {
+    if (failed_ || finished_) {
+        return false;
+    }
+    
+    if (!started_) {
+        if (!sink_(header_)) {
+            failed_ = true;
+            return false;
+        }
+        started_ = true;
+    }
+    
+    // A full chunk is held back until more data arrives, so the last chunk
+    // can still be flagged final by finish()
+    size_t pos = 0;
+    while (pos < data.size()) {
+        if (pending_.size() == chunk_size_ && !flush_chunk(false)) {
+            return false;
+        }
+        
+        size_t take = std::min(chunk_size_ - pending_.size(), data.size() - pos);
+        pending_.insert(pending_.end(), data.data() + pos, data.data() + pos + take);
+        pos += take;
+    }
+    
+    plaintext_size_ += data.size();
+    return true;
+}
+
+bool SeekableContainerWriter::finish() {
+    if (!write(ConstByteSpan()) || !flush_chunk(true)) {
+        return false;
+    }
+    
+    uint8_t summary[16];
+    put_u64(summary, plaintext_size_);
+    put_u64(summary + 8, encryption_.current_chunk());
+    
+    uint8_t trailer[CONTAINER_TRAILER_SIZE];
+    if (!SymmetricCrypto::encrypt_aead(ConstByteSpan(summary, sizeof(summary)), *key_,
+                                       trailer_nonce(base_nonce_), header_,
+                                       ByteSpan(trailer, sizeof(trailer)), algorithm_) ||
+        !sink_(ConstByteSpan(trailer, sizeof(trailer)))) {
+        failed_ = true;
+        return false;
+    }
+    
+    finished_ = true;
+    return true;
+}
+
+uint64_t SeekableContainerWriter::container_size(uint64_t plaintext_size, size_t chunk_size) {
+    return CONTAINER_HEADER_SIZE + plaintext_size +
+           chunks_for(plaintext_size, chunk_size) * FRAME_OVERHEAD + CONTAINER_TRAILER_SIZE;
+}
+
+// ============================================================================
+// SeekableContainerReader
+// ============================================================================
+
+SeekableContainerReader::SeekableContainerReader(
+    const SymmetricKey& key,
+    const Nonce& base_nonce,
+    AeadAlgorithm algorithm,
+    ContainerSource source,
+    size_t chunk_size)
+    : decryption_(key, base_nonce, algorithm),
+      source_(std::move(source)),
+      chunk_size_(chunk_size),
+      algorithm_(algorithm),
+      plaintext_size_(0),
+      chunk_count_(0),
+      frame_(chunk_size + FRAME_OVERHEAD) {
+}
+
+SeekableContainerReader::~SeekableContainerReader() {
+    if (!scratch_.empty()) {
+        sodium_memzero(scratch_.data(), scratch_.size());
+    }
+}
+
+std::unique_ptr<SeekableContainerReader> SeekableContainerReader::open(
+    const SymmetricKey& key,
+    ContainerSource source,
+    uint64_t container_size) {
+    
+    if (container_size < CONTAINER_HEADER_SIZE + FRAME_OVERHEAD + CONTAINER_TRAILER_SIZE) {
+        return nullptr;
+    }
+    
+    uint8_t header[CONTAINER_HEADER_SIZE];
+    if (!source(0, ByteSpan(header, sizeof(header))) ||
+        std::memcmp(header, CONTAINER_MAGIC, 4) != 0 ||
+        header[4] != CONTAINER_VERSION) {
+        return nullptr;
+    }
+    
+    auto algorithm = SymmetricCrypto::algorithm_from_id(header[5]);
+    if (!algorithm || !SymmetricCrypto::is_available(*algorithm)) {
+        return nullptr;
+    }
+    
+    size_t chunk_size = get_u32(header + 8);
+    if (chunk_size == 0) {
+        return nullptr;
+    }
+    
+    Nonce base_nonce;
+    std::memcpy(base_nonce.data(), header + 12, base_nonce.size());
+    
+    uint8_t trailer[CONTAINER_TRAILER_SIZE];
+    uint8_t summary[16];
+    if (!source(container_size - CONTAINER_TRAILER_SIZE, ByteSpan(trailer, sizeof(trailer))) ||
+        !SymmetricCrypto::decrypt_aead(ConstByteSpan(trailer, sizeof(trailer)), key,
+                                       trailer_nonce(base_nonce),
+                                       ConstByteSpan(header, sizeof(header)),
+                                       ByteSpan(summary, sizeof(summary)), *algorithm)) {
+        return nullptr;
+    }
+    
+    uint64_t plaintext_size = get_u64(summary);
+    uint64_t chunk_count = get_u64(summary + 8);
+    if (plaintext_size > container_size ||
+        chunk_count != chunks_for(plaintext_size, chunk_size) ||
+        container_size != SeekableContainerWriter::container_size(plaintext_size, chunk_size)) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<SeekableContainerReader> reader(
+        new SeekableContainerReader(key, base_nonce, *algorithm, std::move(source), chunk_size));
+    reader->plaintext_size_ = plaintext_size;
+    reader->chunk_count_ = chunk_count;
+    return reader;
+}
+
+std::optional<size_t> SeekableContainerReader::read_chunk(uint64_t index, ByteSpan out) {
+    if (index >= chunk_count_) {
+        return std::nullopt;
+    }
+    
+    bool is_final = index + 1 == chunk_count_;
+    size_t len = is_final ? static_cast<size_t>(plaintext_size_ - index * chunk_size_) : chunk_size_;
+    if (out.size() < len) {
+        return std::nullopt;
+    }
+    
+    uint64_t offset = CONTAINER_HEADER_SIZE + index * (chunk_size_ + FRAME_OVERHEAD);
+    ByteSpan frame = ByteSpan(frame_).subspan(0, len + FRAME_OVERHEAD);
+    if (!source_(offset, frame)) {
+        return std::nullopt;
+    }
+    
+    return decryption_.decrypt_chunk_at(index, is_final, frame, out.subspan(0, len));
+}
+
+std::optional<ByteVector> SeekableContainerReader::read(uint64_t offset, size_t length) {
+    if (offset > plaintext_size_) {
+        return std::nullopt;
+    }
+    
+    ByteVector result(static_cast<size_t>(std::min<uint64_t>(length, plaintext_size_ - offset)));
+    if (!read(offset, result)) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+std::optional<size_t> SeekableContainerReader::read(uint64_t offset, ByteSpan out) {
+    if (offset > plaintext_size_) {
+        return std::nullopt;
+    }
+    
+    size_t total = static_cast<size_t>(std::min<uint64_t>(out.size(), plaintext_size_ - offset));
+    size_t written = 0;
+    
+    while (written < total) {
+        uint64_t position = offset + written;
+        uint64_t index = position / chunk_size_;
+        size_t skip = static_cast<size_t>(position % chunk_size_);
+        size_t take = std::min(chunk_size_ - skip, total - written);
+        
+        // Whole chunks decrypt straight into the caller's buffer; partial
+        // ones go through scratch so only the requested bytes are exposed
+        if (skip == 0 && take == chunk_size_) {
+            if (!read_chunk(index, out.subspan(written, take))) {
+                sodium_memzero(out.data(), total);
+                return std::nullopt;
+            }
+        } else {
+            scratch_.resize(chunk_size_);
+            if (!read_chunk(index, scratch_)) {
+                sodium_memzero(out.data(), total);
+                return std::nullopt;
+            }
+            std::memcpy(out.data() + written, scratch_.data() + skip, take);
+        }
+        written += take;
+    }
+    
+    return total;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,75 @@
+#ifndef SPEAR_CRYPTO_ENDIAN_HPP
+#define SPEAR_CRYPTO_ENDIAN_HPP
+
+// Internal: little-endian field access and the CRC-32 shared by the wire
+// codec, the container format, the message store and the relay journal
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace spear {
+namespace crypto {
+
+inline void put_u16(uint8_t* out, uint16_t value) {
+    out[0] = static_cast<uint8_t>(value);
+    out[1] = static_cast<uint8_t>(value >> 8);
+}
+
+inline void put_u32(uint8_t* out, uint32_t value) {
+    for (size_t i = 0; i < 4; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+inline void put_u64(uint8_t* out, uint64_t value) {
+    for (size_t i = 0; i < 8; ++i) {
+        out[i] = static_cast<uint8_t>(value >> (i * 8));
+    }
+}
+
+inline uint16_t get_u16(const uint8_t* in) {
+    return static_cast<uint16_t>(in[0] | (in[1] << 8));
+}
+
+inline uint32_t get_u32(const uint8_t* in) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        value |= static_cast<uint32_t>(in[i]) << (i * 8);
+    }
+    return value;
+}
+
+inline uint64_t get_u64(const uint8_t* in) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        value |= static_cast<uint64_t>(in[i]) << (i * 8);
+    }
+    return value;
+}
+
+// CRC-32 (IEEE); only guards against torn and partially written records
+inline uint32_t crc32(const uint8_t* data, size_t size) {
+    static const auto table = [] {
+        std::array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+    
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < size; ++i) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+} // namespace crypto
+} // namespace spear
+
+#endif // SPEAR_CRYPTO_ENDIAN_HPP
@@ -0,0 +1,260 @@
+#include "file_crypto.hpp"
+#include "container.hpp"
+#include <sodium.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+// Pages behind the cursor are dropped once this much input has been consumed
+constexpr size_t RELEASE_WINDOW = 8 * 1024 * 1024;
+
+// Read-only mapping of a whole file, advised for one sequential pass
+class MappedInput {
+public:
+    explicit MappedInput(const std::string& path) : fd_(-1), data_(nullptr), size_(0) {
+        fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) {
+            return;
+        }
+        
+        struct stat st;
+        if (::fstat(fd_, &st) != 0 || !S_ISREG(st.st_mode)) {
+            close_fd();
+            return;
+        }
+        
+        device_ = st.st_dev;
+        inode_ = st.st_ino;
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            return;
+        }
+        
+        void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            close_fd();
+            return;
+        }
+        data_ = static_cast<uint8_t*>(mapped);
+        ::madvise(data_, size_, MADV_SEQUENTIAL);
+    }
+    
+    ~MappedInput() {
+        if (data_) {
+            ::munmap(data_, size_);
+        }
+        close_fd();
+    }
+    
+    MappedInput(const MappedInput&) = delete;
+    MappedInput& operator=(const MappedInput&) = delete;
+    
+    bool ok() const { return fd_ >= 0; }
+    size_t size() const { return size_; }
+    ConstByteSpan span() const { return ConstByteSpan(data_, size_); }
+    
+    // Whether `path` names this file, directly or through a link; opening
+    // it as the output would truncate the input
+    bool same_file(const std::string& path) const {
+        struct stat st;
+        return ::stat(path.c_str(), &st) == 0 && st.st_dev == device_ && st.st_ino == inode_;
+    }
+    
+    // Drops the pages before `offset` once a full window has been consumed,
+    // so resident memory stays bounded
+    void release_before(size_t offset) {
+        size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t end = offset / page * page;
+        if (data_ && end >= released_ + RELEASE_WINDOW) {
+            ::madvise(data_ + released_, end - released_, MADV_DONTNEED);
+            released_ = end;
+        }
+    }
+
+private:
+    void close_fd() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+    
+    int fd_;
+    uint8_t* data_;
+    size_t size_;
+    size_t released_ = 0;
+    dev_t device_ = 0;
+    ino_t inode_ = 0;
+};
+
+// Output file fed through a fixed-size buffer
+class BufferedOutput {
+public:
+    explicit BufferedOutput(const std::string& path)
+        : path_(path), fd_(::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) {
+        buffer_.reserve(FileCrypto::WRITE_BUFFER_SIZE);
+    }
+    
+    ~BufferedOutput() {
+        if (!buffer_.empty()) {
+            sodium_memzero(buffer_.data(), buffer_.size());
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
+    
+    BufferedOutput(const BufferedOutput&) = delete;
+    BufferedOutput& operator=(const BufferedOutput&) = delete;
+    
+    bool ok() const { return fd_ >= 0; }
+    
+    bool write(ConstByteSpan data) {
+        if (buffer_.size() + data.size() > buffer_.capacity() && !flush()) {
+            return false;
+        }
+        if (data.size() >= buffer_.capacity()) {
+            return write_all(data);
+        }
+        buffer_.insert(buffer_.end(), data.data(), data.data() + data.size());
+        return true;
+    }
+    
+    bool flush() {
+        bool written = write_all(buffer_);
+        sodium_memzero(buffer_.data(), buffer_.size());
+        buffer_.clear();
+        return written;
+    }
+    
+    bool commit() {
+        if (!flush() || ::close(fd_) != 0) {
+            fd_ = -1;
+            return false;
+        }
+        fd_ = -1;
+        return true;
+    }
+    
+    void discard() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        ::unlink(path_.c_str());
+    }
+
+private:
+    bool write_all(ConstByteSpan data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd_, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    }
+    
+    std::string path_;
+    int fd_;
+    ByteVector buffer_;
+};
+
+} // namespace
+
+std::optional<uint64_t> FileCrypto::encrypt_file(
+    const std::string& input_path,
+    const std::string& output_path,
+    const SymmetricKey& key,
+    size_t chunk_size) {
+    
+    MappedInput input(input_path);
+    if (!input.ok() || chunk_size == 0 || input.same_file(output_path)) {
+        return std::nullopt;
+    }
+    
+    BufferedOutput output(output_path);
+    if (!output.ok()) {
+        return std::nullopt;
+    }
+    
+    SeekableContainerWriter writer(key, [&output](ConstByteSpan data) { return output.write(data); },
+                                   chunk_size);
+    
+    ConstByteSpan data = input.span();
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t len = std::min(chunk_size, data.size() - offset);
+        if (!writer.write(data.subspan(offset, len))) {
+            output.discard();
+            return std::nullopt;
+        }
+        offset += len;
+        input.release_before(offset);
+    }
+    
+    if (!writer.finish() || !output.commit()) {
+        output.discard();
+        return std::nullopt;
+    }
+    return writer.plaintext_size();
+}
+
+std::optional<uint64_t> FileCrypto::decrypt_file(
+    const std::string& input_path,
+    const std::string& output_path,
+    const SymmetricKey& key) {
+    
+    MappedInput input(input_path);
+    if (!input.ok() || input.same_file(output_path)) {
+        return std::nullopt;
+    }
+    
+    auto reader = SeekableContainerReader::open(key, memory_source(input.span()), input.size());
+    if (!reader) {
+        return std::nullopt;
+    }
+    
+    BufferedOutput output(output_path);
+    if (!output.ok()) {
+        return std::nullopt;
+    }
+    
+    ByteVector chunk(reader->chunk_size());
+    uint64_t written = 0;
+    for (uint64_t i = 0; i < reader->chunk_count(); ++i) {
+        auto len = reader->read_chunk(i, chunk);
+        if (!len || !output.write(ConstByteSpan(chunk).subspan(0, *len))) {
+            sodium_memzero(chunk.data(), chunk.size());
+            output.discard();
+            return std::nullopt;
+        }
+        written += *len;
+        input.release_before(CONTAINER_HEADER_SIZE + written +
+                             (i + 1) * StreamingEncryption::CHUNK_OVERHEAD);
+    }
+    
+    sodium_memzero(chunk.data(), chunk.size());
+    if (!output.commit()) {
+        output.discard();
+        return std::nullopt;
+    }
+    return written;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -1,4 +1,5 @@
 #include "key_exchange.hpp"
+#include "metrics.hpp"
 #include <sodium.h>
 
 namespace spear {
@@ -8,6 +9,7 @@ std::optional<SharedSecret> KeyExchange::derive_shared_secret(
     const SecretKey& local_secret_key,
     const PublicKey& remote_public_key) {
     
+    SPEAR_METRICS_TIMER(timer, MetricOp::KeyExchange, 0);
     SharedSecret shared_secret;
     
     if (crypto_scalarmult(shared_secret.data(),
@@ -16,6 +18,7 @@ std::optional<SharedSecret> KeyExchange::derive_shared_secret(
         return std::nullopt;
     }
     
+    SPEAR_METRICS_SUCCEED(timer);
     return shared_secret;
 }
 
@@ -1,10 +1,44 @@
 #include "key_management.hpp"
 #include "utils.hpp"
 #include <sodium.h>
+#include <algorithm>
+#include <atomic>
 
 namespace spear {
 namespace crypto {
 
+namespace {
+
+constexpr size_t BULK_BLOCK = 32;
+
+// Fills `pairs` in blocks of BULK_BLOCK, one pool task per block
+template <typename Pair, typename Generate>
+bool generate_bulk(std::vector<Pair>& pairs, ThreadPool* pool, Generate generate) {
+    std::atomic<bool> failed{false};
+    
+    auto fill = [&](size_t block) {
+        size_t end = std::min(pairs.size(), (block + 1) * BULK_BLOCK);
+        for (size_t i = block * BULK_BLOCK; i < end; ++i) {
+            if (generate(pairs[i].public_key.data(), pairs[i].secret_key.data()) != 0) {
+                failed.store(true, std::memory_order_relaxed);
+            }
+        }
+    };
+    
+    size_t blocks = (pairs.size() + BULK_BLOCK - 1) / BULK_BLOCK;
+    if (pairs.size() < KeyManagement::PARALLEL_BATCH_THRESHOLD) {
+        for (size_t block = 0; block < blocks; ++block) {
+            fill(block);
+        }
+    } else {
+        (pool ? *pool : ThreadPool::shared()).parallel_for(blocks, fill);
+    }
+    
+    return !failed.load();
+}
+
+} // namespace
+
 std::optional<KeyPair> KeyManagement::generate_keypair() {
     KeyPair kp;
     
@@ -25,6 +59,28 @@ std::optional<SigningKeyPair> KeyManagement::generate_signing_keypair() {
     return kp;
 }
 
+std::optional<std::vector<KeyPair>> KeyManagement::generate_keypairs(
+    size_t count,
+    ThreadPool* pool) {
+    
+    std::vector<KeyPair> pairs(count);
+    if (!generate_bulk(pairs, pool, crypto_box_keypair)) {
+        return std::nullopt;
+    }
+    return pairs;
+}
+
+std::optional<std::vector<SigningKeyPair>> KeyManagement::generate_signing_keypairs(
+    size_t count,
+    ThreadPool* pool) {
+    
+    std::vector<SigningKeyPair> pairs(count);
+    if (!generate_bulk(pairs, pool, crypto_sign_keypair)) {
+        return std::nullopt;
+    }
+    return pairs;
+}
+
 ByteVector KeyManagement::serialize_public_key(const PublicKey& key) {
     return ByteVector(key.begin(), key.end());
 }
@@ -0,0 +1,171 @@
+#include "key_pool.hpp"
+#include "key_management.hpp"
+#include <sodium.h>
+#include <algorithm>
+#include <cstring>
+
+namespace spear {
+namespace crypto {
+
+KeyPool::KeyPool(size_t capacity, size_t low_watermark)
+    : capacity_(capacity),
+      low_watermark_(low_watermark ? std::min(low_watermark, capacity) : std::max<size_t>(capacity / 4, 1)),
+      keypairs_(nullptr),
+      signing_keypairs_(nullptr) {
+    
+    if (capacity_ > 0) {
+        keypairs_ = static_cast<KeySlot*>(sodium_allocarray(capacity_ + 1, sizeof(KeySlot)));
+        signing_keypairs_ = static_cast<SigningKeySlot*>(
+            sodium_allocarray(capacity_ + 1, sizeof(SigningKeySlot)));
+    }
+    if (keypairs_ == nullptr || signing_keypairs_ == nullptr) {
+        // Without locked memory the pool passes every call through
+        capacity_ = 0;
+        return;
+    }
+    
+    refiller_ = std::thread([this] { refill_loop(); });
+}
+
+KeyPool::~KeyPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    refill_.notify_all();
+    filled_.notify_all();
+    if (refiller_.joinable()) {
+        refiller_.join();
+    }
+    
+    if (keypairs_ != nullptr) {
+        sodium_free(keypairs_);
+    }
+    if (signing_keypairs_ != nullptr) {
+        sodium_free(signing_keypairs_);
+    }
+}
+
+std::optional<KeyPair> KeyPool::take_keypair() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (keypair_count_ > 0) {
+            KeySlot& slot = keypairs_[--keypair_count_];
+            KeyPair kp;
+            kp.public_key = slot.public_key;
+            kp.secret_key = slot.secret_key;
+            sodium_memzero(&slot, sizeof(slot));
+            hits_++;
+            if (needs_refill()) {
+                refill_.notify_one();
+            }
+            return kp;
+        }
+        misses_++;
+        refill_.notify_one();
+    }
+    
+    return KeyManagement::generate_keypair();
+}
+
+std::optional<SigningKeyPair> KeyPool::take_signing_keypair() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (signing_count_ > 0) {
+            SigningKeySlot& slot = signing_keypairs_[--signing_count_];
+            SigningKeyPair kp;
+            kp.public_key = slot.public_key;
+            kp.secret_key = slot.secret_key;
+            sodium_memzero(&slot, sizeof(slot));
+            hits_++;
+            if (needs_refill()) {
+                refill_.notify_one();
+            }
+            return kp;
+        }
+        misses_++;
+        refill_.notify_one();
+    }
+    
+    return KeyManagement::generate_signing_keypair();
+}
+
+bool KeyPool::wait_full() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!full()) {
+        // Above the low watermark the refill thread would otherwise stay idle
+        top_up_ = true;
+        refill_failed_ = false;
+        refill_.notify_one();
+    }
+    filled_.wait(lock, [this] { return stopping_ || full() || refill_failed_; });
+    return full();
+}
+
+KeyPool::Stats KeyPool::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{keypair_count_, signing_count_, hits_, misses_, generated_};
+}
+
+bool KeyPool::needs_refill() const {
+    return keypair_count_ < low_watermark_ || signing_count_ < low_watermark_;
+}
+
+bool KeyPool::full() const {
+    return keypair_count_ == capacity_ && signing_count_ == capacity_;
+}
+
+// Keys are generated into a scratch slot in the same locked slab with the
+// lock released, then copied into place, so takers never wait on generation
+void KeyPool::refill_loop() {
+    KeySlot& key_scratch = keypairs_[capacity_];
+    SigningKeySlot& signing_scratch = signing_keypairs_[capacity_];
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        refill_.wait(lock, [this] { return stopping_ || top_up_ || needs_refill(); });
+        
+        bool failed = false;
+        while (!stopping_ && !full() && !failed) {
+            // Top up whichever kind is emptier
+            bool signing = signing_count_ < keypair_count_;
+            lock.unlock();
+            if (signing) {
+                failed = crypto_sign_keypair(signing_scratch.public_key.data(),
+                                             signing_scratch.secret_key.data()) != 0;
+            } else {
+                failed = crypto_box_keypair(key_scratch.public_key.data(),
+                                            key_scratch.secret_key.data()) != 0;
+            }
+            lock.lock();
+            
+            if (signing) {
+                if (!failed && signing_count_ < capacity_) {
+                    std::memcpy(&signing_keypairs_[signing_count_++], &signing_scratch, sizeof(SigningKeySlot));
+                    generated_++;
+                }
+                sodium_memzero(&signing_scratch, sizeof(SigningKeySlot));
+            } else {
+                if (!failed && keypair_count_ < capacity_) {
+                    std::memcpy(&keypairs_[keypair_count_++], &key_scratch, sizeof(KeySlot));
+                    generated_++;
+                }
+                sodium_memzero(&key_scratch, sizeof(KeySlot));
+            }
+        }
+        
+        if (stopping_) {
+            return;
+        }
+        top_up_ = false;
+        refill_failed_ = failed;
+        filled_.notify_all();
+        if (failed) {
+            // Try again on the next take rather than spinning
+            refill_.wait(lock);
+        }
+    }
+}
+
+} // namespace crypto
+} // namespace spear
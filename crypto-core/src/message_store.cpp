@@ -0,0 +1,604 @@
+#include "message_store.hpp"
+#include "endian.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+// Record layout, little-endian:
+//   0 size u32 | 4 crc32 u32 | 8 type u8 | 9 reserved u8 | 10 recipient_len u16 |
+//   12 sender_len u16 | 14 nonce_len u16 | 16 signature_len u16 | 18 reserved u16 |
+//   20 content_len u32 | 24 seq u64 | 32 counter u64 | 40 timestamp_ms u64 |
+//   48 recipient | sender | nonce | signature | content
+// The checksum covers everything after itself. Ack records carry the acked
+// id in the counter field and no payload.
+constexpr uint8_t RECORD_MESSAGE = 1;
+constexpr uint8_t RECORD_ACK = 2;
+constexpr const char* SEGMENT_SUFFIX = ".seg";
+
+uint64_t now_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    size_t written = 0;
+    while (written < size) {
+        ssize_t n = ::write(fd, data + written, size - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Read-only mapping of a segment. Mapping past the end of the file is fine as
+// long as only bytes that were written are touched.
+class Mapping {
+public:
+    Mapping(int fd, size_t size) : data_(nullptr), size_(size) {
+        void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(mapped);
+        }
+    }
+    
+    ~Mapping() {
+        if (data_) {
+            ::munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+    
+    Mapping(const Mapping&) = delete;
+    Mapping& operator=(const Mapping&) = delete;
+    
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+// Maps at least `needed` bytes of a segment, reusing the current mapping when
+// it is already large enough
+const Mapping* map_segment(const std::shared_ptr<const Mapping>& current, int fd,
+                           size_t needed, size_t reserve,
+                           std::shared_ptr<const Mapping>& out) {
+    if (current && current->size() >= needed) {
+        out = current;
+        return current.get();
+    }
+    auto mapping = std::make_shared<const Mapping>(fd, std::max(needed, reserve));
+    if (!mapping->data()) {
+        return nullptr;
+    }
+    out = mapping;
+    return mapping.get();
+}
+
+std::string segment_name(uint64_t base_seq) {
+    static const char digits[] = "0123456789abcdef";
+    std::string name(16, '0');
+    for (size_t i = 0; i < 16; ++i) {
+        name[15 - i] = digits[(base_seq >> (i * 4)) & 0xF];
+    }
+    return name + SEGMENT_SUFFIX;
+}
+
+std::optional<uint64_t> parse_segment_name(const std::string& name) {
+    if (name.size() != 16 + std::char_traits<char>::length(SEGMENT_SUFFIX) ||
+        name.compare(16, std::string::npos, SEGMENT_SUFFIX) != 0) {
+        return std::nullopt;
+    }
+    uint64_t base_seq = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        char c = name[i];
+        int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+        if (digit < 0) {
+            return std::nullopt;
+        }
+        base_seq = (base_seq << 4) | static_cast<uint64_t>(digit);
+    }
+    return base_seq;
+}
+
+} // namespace
+
+struct MessageStore::Segment {
+    uint64_t base_seq = 0;
+    std::string path;
+    int fd = -1;
+    uint64_t live = 0;
+    std::shared_ptr<const Mapping> mapping;
+    
+    ~Segment() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+MessageStore::MessageStore(const std::string& directory, const MessageStoreOptions& options)
+    : directory_(directory), options_(options) {
+}
+
+MessageStore::~MessageStore() {
+    flush();
+}
+
+std::unique_ptr<MessageStore> MessageStore::open(const std::string& directory,
+                                                 const MessageStoreOptions& options) {
+    if (directory.empty() || options.segment_size < RECORD_HEADER_SIZE ||
+        options.segment_size > UINT32_MAX) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<MessageStore> store(new MessageStore(directory, options));
+    if (!store->recover()) {
+        return nullptr;
+    }
+    return store;
+}
+
+bool MessageStore::recover() {
+    if (::mkdir(directory_.c_str(), 0700) != 0 && errno != EEXIST) {
+        return false;
+    }
+    
+    DIR* dir = ::opendir(directory_.c_str());
+    if (!dir) {
+        return false;
+    }
+    std::vector<uint64_t> bases;
+    while (dirent* entry = ::readdir(dir)) {
+        if (auto base_seq = parse_segment_name(entry->d_name)) {
+            bases.push_back(*base_seq);
+        }
+    }
+    ::closedir(dir);
+    std::sort(bases.begin(), bases.end());
+    
+    for (size_t i = 0; i < bases.size(); ++i) {
+        auto segment = std::make_shared<Segment>();
+        segment->base_seq = bases[i];
+        segment->path = directory_ + "/" + segment_name(bases[i]);
+        segment->fd = ::open(segment->path.c_str(), O_RDWR | O_APPEND | O_CLOEXEC);
+        if (segment->fd < 0) {
+            return false;
+        }
+        
+        next_seq_ = std::max(next_seq_, bases[i]);
+        segments_.push_back(segment);
+        if (!replay(segment, i + 1 == bases.size())) {
+            return false;
+        }
+    }
+    
+    if (segments_.empty()) {
+        auto segment = create_segment(next_seq_);
+        if (!segment) {
+            return false;
+        }
+        segments_.push_back(segment);
+    }
+    
+    active_ = segments_.back();
+    struct stat st;
+    if (::fstat(active_->fd, &st) != 0) {
+        return false;
+    }
+    active_size_ = static_cast<uint64_t>(st.st_size);
+    committed_seq_ = next_seq_ - 1;
+    
+    compact();
+    return true;
+}
+
+bool MessageStore::replay(const std::shared_ptr<Segment>& segment, bool last) {
+    struct stat st;
+    if (::fstat(segment->fd, &st) != 0) {
+        return false;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    if (size == 0) {
+        return true;
+    }
+    
+    std::shared_ptr<const Mapping> mapping;
+    const Mapping* map = map_segment(nullptr, segment->fd, size, 0, mapping);
+    if (!map) {
+        return false;
+    }
+    const uint8_t* data = map->data();
+    
+    size_t offset = 0;
+    while (offset + RECORD_HEADER_SIZE <= size) {
+        const uint8_t* rec = data + offset;
+        uint32_t record_size = get_u32(rec);
+        if (record_size < RECORD_HEADER_SIZE || record_size > size - offset ||
+            get_u32(rec + 4) != crc32(rec + 8, record_size - 8)) {
+            break;
+        }
+        
+        size_t recipient_len = get_u16(rec + 10);
+        size_t payload = recipient_len + get_u16(rec + 12) + get_u16(rec + 14) +
+                         get_u16(rec + 16) + static_cast<size_t>(get_u32(rec + 20));
+        if (RECORD_HEADER_SIZE + payload != record_size) {
+            break;
+        }
+        
+        uint64_t seq = get_u64(rec + 24);
+        std::string recipient(reinterpret_cast<const char*>(rec + RECORD_HEADER_SIZE), recipient_len);
+        if (rec[8] == RECORD_MESSAGE) {
+            index_message(recipient, seq, segment.get(), static_cast<uint32_t>(offset), record_size);
+        } else if (rec[8] == RECORD_ACK) {
+            // Logs written before acks were bounded may hold a cursor past
+            // every message; bound it here too so later messages survive
+            Queue& queue = queues_[recipient];
+            apply_ack(queue, std::min(get_u64(rec + 32), queue.newest));
+        }
+        next_seq_ = std::max(next_seq_, seq + 1);
+        offset += record_size;
+    }
+    
+    if (offset < size) {
+        // A torn write can only be at the very end of the log; anything
+        // else is corruption and must not be silently dropped
+        if (!last || ::ftruncate(segment->fd, static_cast<off_t>(offset)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<MessageStore::Segment> MessageStore::create_segment(uint64_t base_seq) {
+    auto segment = std::make_shared<Segment>();
+    segment->base_seq = base_seq;
+    segment->path = directory_ + "/" + segment_name(base_seq);
+    segment->fd = ::open(segment->path.c_str(),
+                         O_RDWR | O_APPEND | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (segment->fd < 0) {
+        return nullptr;
+    }
+    
+    if (options_.sync) {
+        int dir_fd = ::open(directory_.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dir_fd >= 0) {
+            ::fsync(dir_fd);
+            ::close(dir_fd);
+        }
+    }
+    return segment;
+}
+
+uint64_t MessageStore::enqueue(uint8_t type, std::string_view recipient,
+                               const MessageRecord& message) {
+    size_t size = RECORD_HEADER_SIZE + recipient.size() + message.sender.size() +
+                  message.nonce.size() + message.signature.size() + message.content.size();
+    uint64_t seq = next_seq_++;
+    
+    size_t start = pending_.size();
+    pending_.resize(start + size);
+    uint8_t* rec = pending_.data() + start;
+    put_u32(rec, static_cast<uint32_t>(size));
+    rec[8] = type;
+    rec[9] = 0;
+    put_u16(rec + 10, static_cast<uint16_t>(recipient.size()));
+    put_u16(rec + 12, static_cast<uint16_t>(message.sender.size()));
+    put_u16(rec + 14, static_cast<uint16_t>(message.nonce.size()));
+    put_u16(rec + 16, static_cast<uint16_t>(message.signature.size()));
+    put_u16(rec + 18, 0);
+    put_u32(rec + 20, static_cast<uint32_t>(message.content.size()));
+    put_u64(rec + 24, seq);
+    put_u64(rec + 32, message.counter);
+    put_u64(rec + 40, message.timestamp_ms ? message.timestamp_ms : now_ms());
+    
+    uint8_t* out = rec + RECORD_HEADER_SIZE;
+    out = std::copy(recipient.begin(), recipient.end(), out);
+    out = std::copy(message.sender.begin(), message.sender.end(), out);
+    out = std::copy(message.nonce.data(), message.nonce.data() + message.nonce.size(), out);
+    out = std::copy(message.signature.data(), message.signature.data() + message.signature.size(), out);
+    std::copy(message.content.data(), message.content.data() + message.content.size(), out);
+    put_u32(rec + 4, crc32(rec + 8, size - 8));
+    
+    pending_records_.push_back({type, seq, static_cast<uint32_t>(size), std::string(recipient)});
+    return seq;
+}
+
+bool MessageStore::commit(std::unique_lock<std::mutex>& lock, uint64_t seq) {
+    while (committed_seq_ < seq && !failed_) {
+        if (committing_) {
+            committed_.wait(lock);
+            continue;
+        }
+        
+        // Become the leader: take everything queued so far, including
+        // records from callers now waiting on us
+        committing_ = true;
+        ByteVector batch;
+        batch.swap(pending_);
+        std::vector<PendingRecord> records;
+        records.swap(pending_records_);
+        lock.unlock();
+        
+        std::vector<Placement> placements;
+        std::vector<std::shared_ptr<Segment>> created;
+        bool written = write_batch(batch, records, placements, created);
+        
+        lock.lock();
+        if (written) {
+            segments_.insert(segments_.end(), created.begin(), created.end());
+            for (size_t i = 0; i < records.size(); ++i) {
+                if (records[i].type == RECORD_MESSAGE) {
+                    index_message(records[i].recipient, records[i].seq, placements[i].segment.get(),
+                                  placements[i].offset, records[i].size);
+                }
+            }
+            committed_seq_ = records.back().seq;
+            commits_++;
+            records_ += records.size();
+        } else {
+            failed_ = true;
+        }
+        committing_ = false;
+        committed_.notify_all();
+    }
+    return !failed_;
+}
+
+bool MessageStore::write_batch(const ByteVector& batch, const std::vector<PendingRecord>& records,
+                               std::vector<Placement>& placements,
+                               std::vector<std::shared_ptr<Segment>>& created) {
+    placements.reserve(records.size());
+    
+    size_t run_start = 0;
+    size_t offset = 0;
+    for (const PendingRecord& record : records) {
+        if (active_size_ > 0 && active_size_ + record.size > options_.segment_size) {
+            // Seal the active segment; it is synced even without options_.sync
+            // so flush() only ever has to sync the newest segment
+            if (!write_all(active_->fd, batch.data() + run_start, offset - run_start) ||
+                ::fdatasync(active_->fd) != 0) {
+                return false;
+            }
+            run_start = offset;
+            
+            auto segment = create_segment(record.seq);
+            if (!segment) {
+                return false;
+            }
+            created.push_back(segment);
+            active_ = segment;
+            active_size_ = 0;
+        }
+        
+        placements.push_back({active_, static_cast<uint32_t>(active_size_)});
+        active_size_ += record.size;
+        offset += record.size;
+    }
+    
+    if (!write_all(active_->fd, batch.data() + run_start, offset - run_start)) {
+        return false;
+    }
+    return !options_.sync || ::fdatasync(active_->fd) == 0;
+}
+
+void MessageStore::index_message(const std::string& recipient, uint64_t id, Segment* segment,
+                                 uint32_t offset, uint32_t size) {
+    Queue& queue = queues_[recipient];
+    queue.newest = std::max(queue.newest, id);
+    if (id <= queue.acked) {
+        return;
+    }
+    queue.entries.push_back({id, segment, offset, size});
+    segment->live++;
+    queued_messages_++;
+}
+
+size_t MessageStore::apply_ack(Queue& queue, uint64_t up_to_id) {
+    queue.acked = std::max(queue.acked, up_to_id);
+    
+    size_t removed = 0;
+    while (!queue.entries.empty() && queue.entries.front().id <= up_to_id) {
+        queue.entries.front().segment->live--;
+        queue.entries.pop_front();
+        removed++;
+    }
+    queued_messages_ -= removed;
+    return removed;
+}
+
+std::optional<uint64_t> MessageStore::append(std::string_view recipient, const MessageRecord& message) {
+    return append_batch({recipient}, {message});
+}
+
+std::optional<uint64_t> MessageStore::append_batch(const std::vector<std::string_view>& recipients,
+                                                   const std::vector<MessageRecord>& messages) {
+    if (recipients.empty() || recipients.size() != messages.size()) {
+        return std::nullopt;
+    }
+    for (size_t i = 0; i < messages.size(); ++i) {
+        const MessageRecord& message = messages[i];
+        if (recipients[i].empty() || recipients[i].size() > MAX_FIELD_SIZE ||
+            message.sender.size() > MAX_FIELD_SIZE || message.nonce.size() > MAX_FIELD_SIZE ||
+            message.signature.size() > MAX_FIELD_SIZE ||
+            message.content.size() > UINT32_MAX - RECORD_HEADER_SIZE - 4 * MAX_FIELD_SIZE) {
+            return std::nullopt;
+        }
+    }
+    
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_) {
+        return std::nullopt;
+    }
+    uint64_t first = 0;
+    uint64_t seq = 0;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        seq = enqueue(RECORD_MESSAGE, recipients[i], messages[i]);
+        first = i == 0 ? seq : first;
+    }
+    if (!commit(lock, seq)) {
+        return std::nullopt;
+    }
+    return first;
+}
+
+MessageBatch MessageStore::fetch(std::string_view recipient, size_t limit) {
+    MessageBatch batch;
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(std::string(recipient));
+    if (it == queues_.end()) {
+        return batch;
+    }
+    
+    const std::deque<Entry>& entries = it->second.entries;
+    size_t count = std::min(limit, entries.size());
+    batch.records_.reserve(count);
+    
+    for (size_t i = 0; i < count; ++i) {
+        const Entry& entry = entries[i];
+        Segment* segment = entry.segment;
+        
+        std::shared_ptr<const Mapping> mapping;
+        const Mapping* map = map_segment(segment->mapping, segment->fd,
+                                         static_cast<size_t>(entry.offset) + entry.size,
+                                         static_cast<size_t>(options_.segment_size), mapping);
+        if (!map) {
+            break;
+        }
+        segment->mapping = mapping;
+        if (batch.mappings_.empty() || batch.mappings_.back() != mapping) {
+            batch.mappings_.push_back(mapping);
+        }
+        
+        const uint8_t* rec = map->data() + entry.offset;
+        size_t recipient_len = get_u16(rec + 10);
+        size_t sender_len = get_u16(rec + 12);
+        size_t nonce_len = get_u16(rec + 14);
+        size_t signature_len = get_u16(rec + 16);
+        size_t content_len = get_u32(rec + 20);
+        
+        MessageRecord record;
+        record.id = get_u64(rec + 24);
+        record.counter = get_u64(rec + 32);
+        record.timestamp_ms = get_u64(rec + 40);
+        const uint8_t* field = rec + RECORD_HEADER_SIZE + recipient_len;
+        record.sender = std::string_view(reinterpret_cast<const char*>(field), sender_len);
+        field += sender_len;
+        record.nonce = ConstByteSpan(field, nonce_len);
+        field += nonce_len;
+        record.signature = ConstByteSpan(field, signature_len);
+        field += signature_len;
+        record.content = ConstByteSpan(field, content_len);
+        batch.records_.push_back(record);
+    }
+    return batch;
+}
+
+std::optional<size_t> MessageStore::ack(std::string_view recipient, uint64_t up_to_id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (failed_) {
+        return std::nullopt;
+    }
+    
+    // Acks never create queues, and stop at the newest delivered message
+    auto it = queues_.find(std::string(recipient));
+    if (it == queues_.end()) {
+        return 0;
+    }
+    Queue& queue = it->second;
+    up_to_id = std::min(up_to_id, queue.newest);
+    if (up_to_id <= queue.acked) {
+        return 0;
+    }
+    size_t removed = apply_ack(queue, up_to_id);
+    
+    MessageRecord cursor;
+    cursor.counter = up_to_id;
+    if (!commit(lock, enqueue(RECORD_ACK, recipient, cursor))) {
+        return std::nullopt;
+    }
+    lock.unlock();
+    
+    if (removed > 0) {
+        compact();
+    }
+    return removed;
+}
+
+bool MessageStore::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!commit(lock, next_seq_ - 1)) {
+        return false;
+    }
+    if (options_.sync || !active_) {
+        return true;
+    }
+    
+    committed_.wait(lock, [this] { return !committing_; });
+    return ::fdatasync(active_->fd) == 0;
+}
+
+size_t MessageStore::compact() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // The newest registered segment may still be receiving writes, and acks
+    // in a segment only refer to messages in it or before it, so removing a
+    // prefix never loses a cursor that a surviving message depends on
+    size_t removed = 0;
+    while (segments_.size() > 1 && segments_.front()->live == 0) {
+        ::unlink(segments_.front()->path.c_str());
+        segments_.pop_front();
+        removed++;
+    }
+    return removed;
+}
+
+uint64_t MessageStore::last_id(std::string_view recipient) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = queues_.find(std::string(recipient));
+    return it == queues_.end() ? 0 : it->second.newest;
+}
+
+std::optional<std::string> MessageStore::recipient_of(uint64_t id) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& entry : queues_) {
+        const std::deque<Entry>& entries = entry.second.entries;
+        auto it = std::lower_bound(entries.begin(), entries.end(), id,
+                                   [](const Entry& e, uint64_t value) { return e.id < value; });
+        if (it != entries.end() && it->id == id) {
+            return entry.first;
+        }
+    }
+    return std::nullopt;
+}
+
+MessageStore::Stats MessageStore::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.queued_messages = queued_messages_;
+    stats.recipients = queues_.size();
+    stats.segments = segments_.size();
+    stats.commits = commits_;
+    stats.records = records_;
+    return stats;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,183 @@
+#include "metrics.hpp"
+#include <atomic>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+struct OpCounters {
+    std::atomic<uint64_t> ops{0};
+    std::atomic<uint64_t> failures{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> total_nanos{0};
+    std::atomic<uint64_t> buckets[LatencyHistogram::BUCKETS] = {};
+};
+
+struct alignas(64) Shard {
+    OpCounters ops[METRIC_OP_COUNT];
+};
+
+#ifdef SPEAR_METRICS
+Shard shards[Metrics::SHARDS];
+std::atomic<size_t> next_shard{0};
+
+// Threads are spread round-robin, so up to SHARDS threads never share a shard
+Shard& thread_shard() {
+    thread_local Shard& shard = shards[next_shard.fetch_add(1, std::memory_order_relaxed) % Metrics::SHARDS];
+    return shard;
+}
+#endif
+
+} // namespace
+
+size_t LatencyHistogram::bucket_for(uint64_t nanos) {
+    if (nanos < SUB_BUCKETS) {
+        return static_cast<size_t>(nanos);
+    }
+    
+    unsigned power = 63 - static_cast<unsigned>(__builtin_clzll(nanos));
+    if (power >= MAX_POWER) {
+        return BUCKETS - 1;
+    }
+    size_t sub = static_cast<size_t>(nanos >> (power - 3)) & (SUB_BUCKETS - 1);
+    return (power - 2) * SUB_BUCKETS + sub;
+}
+
+uint64_t LatencyHistogram::bucket_lower(size_t bucket) {
+    if (bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    unsigned power = static_cast<unsigned>(bucket / SUB_BUCKETS) + 2;
+    return (SUB_BUCKETS + bucket % SUB_BUCKETS) << (power - 3);
+}
+
+uint64_t LatencyHistogram::bucket_upper(size_t bucket) {
+    if (bucket + 1 >= BUCKETS) {
+        return UINT64_MAX;
+    }
+    return bucket_lower(bucket + 1) - 1;
+}
+
+uint64_t LatencyHistogram::count() const {
+    uint64_t total = 0;
+    for (uint64_t n : counts) {
+        total += n;
+    }
+    return total;
+}
+
+uint64_t LatencyHistogram::quantile(double q) const {
+    uint64_t total = count();
+    if (total == 0) {
+        return 0;
+    }
+    
+    uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+    rank = rank < 1 ? 1 : (rank > total ? total : rank);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= rank) {
+            return bucket_upper(i);
+        }
+    }
+    return bucket_upper(BUCKETS - 1);
+}
+
+uint64_t LatencyHistogram::max() const {
+    for (size_t i = BUCKETS; i-- > 0;) {
+        if (counts[i] != 0) {
+            return bucket_upper(i);
+        }
+    }
+    return 0;
+}
+
+bool Metrics::enabled() {
+#ifdef SPEAR_METRICS
+    return true;
+#else
+    return false;
+#endif
+}
+
+void Metrics::record(MetricOp op, uint64_t bytes, uint64_t nanos, bool ok) {
+#ifdef SPEAR_METRICS
+    OpCounters& counters = thread_shard().ops[static_cast<size_t>(op)];
+    counters.ops.fetch_add(1, std::memory_order_relaxed);
+    if (!ok) {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+    }
+    counters.bytes.fetch_add(bytes, std::memory_order_relaxed);
+    counters.total_nanos.fetch_add(nanos, std::memory_order_relaxed);
+    counters.buckets[LatencyHistogram::bucket_for(nanos)].fetch_add(1, std::memory_order_relaxed);
+#else
+    (void)op;
+    (void)bytes;
+    (void)nanos;
+    (void)ok;
+#endif
+}
+
+// Shards are read without stopping writers, so a snapshot taken under load
+// may be off by the operations in flight
+MetricsSnapshot Metrics::snapshot() {
+    MetricsSnapshot snapshot;
+#ifdef SPEAR_METRICS
+    snapshot.enabled = true;
+    for (const Shard& shard : shards) {
+        for (size_t op = 0; op < METRIC_OP_COUNT; ++op) {
+            const OpCounters& counters = shard.ops[op];
+            OpMetrics& out = snapshot.ops[op];
+            out.ops += counters.ops.load(std::memory_order_relaxed);
+            out.failures += counters.failures.load(std::memory_order_relaxed);
+            out.bytes += counters.bytes.load(std::memory_order_relaxed);
+            out.total_nanos += counters.total_nanos.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < LatencyHistogram::BUCKETS; ++i) {
+                out.latency.counts[i] += counters.buckets[i].load(std::memory_order_relaxed);
+            }
+        }
+    }
+#endif
+    return snapshot;
+}
+
+void Metrics::reset() {
+#ifdef SPEAR_METRICS
+    for (Shard& shard : shards) {
+        for (OpCounters& counters : shard.ops) {
+            counters.ops.store(0, std::memory_order_relaxed);
+            counters.failures.store(0, std::memory_order_relaxed);
+            counters.bytes.store(0, std::memory_order_relaxed);
+            counters.total_nanos.store(0, std::memory_order_relaxed);
+            for (auto& bucket : counters.buckets) {
+                bucket.store(0, std::memory_order_relaxed);
+            }
+        }
+    }
+#endif
+}
+
+const char* Metrics::op_name(MetricOp op) {
+    switch (op) {
+        case MetricOp::AeadEncrypt:
+            return "aead_encrypt";
+        case MetricOp::AeadDecrypt:
+            return "aead_decrypt";
+        case MetricOp::Sign:
+            return "sign";
+        case MetricOp::Verify:
+            return "verify";
+        case MetricOp::KeyExchange:
+            return "key_exchange";
+        case MetricOp::StreamEncryptChunk:
+            return "stream_encrypt_chunk";
+        case MetricOp::StreamDecryptChunk:
+            return "stream_decrypt_chunk";
+    }
+    return "unknown";
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,222 @@
+#include "replay_window.hpp"
+#include "utils.hpp"
+#include <sodium.h>
+#include <algorithm>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+constexpr size_t INITIAL_SLOTS = 64;
+
+// Bit d of the bitmap stands for counter (highest - d)
+void shift_window(uint64_t* bitmap, uint64_t shift) {
+    constexpr size_t words = ReplayWindowTable::WINDOW_WORDS;
+    if (shift >= ReplayWindowTable::WINDOW_SIZE) {
+        std::fill(bitmap, bitmap + words, 0);
+        return;
+    }
+    
+    size_t word_shift = static_cast<size_t>(shift / 64);
+    unsigned bit_shift = static_cast<unsigned>(shift % 64);
+    for (size_t i = words; i-- > 0;) {
+        uint64_t value = 0;
+        if (i >= word_shift) {
+            value = bitmap[i - word_shift] << bit_shift;
+            if (bit_shift != 0 && i > word_shift) {
+                value |= bitmap[i - word_shift - 1] >> (64 - bit_shift);
+            }
+        }
+        bitmap[i] = value;
+    }
+}
+
+size_t round_up_pow2(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // namespace
+
+ReplayWindowTable::ReplayWindowTable(size_t shards)
+    : shards_(new Shard[round_up_pow2(std::max<size_t>(shards, 1))]),
+      shard_mask_(round_up_pow2(std::max<size_t>(shards, 1)) - 1) {
+    utils::random_bytes(hash_key_.data(), hash_key_.size());
+}
+
+ReplayWindowTable::~ReplayWindowTable() {
+    utils::secure_memzero(hash_key_.data(), hash_key_.size());
+}
+
+// Zero marks an empty slot, so it is never used as a key
+uint64_t ReplayWindowTable::hash(std::string_view session) const {
+    uint8_t out[crypto_shorthash_BYTES];
+    crypto_shorthash(out, reinterpret_cast<const unsigned char*>(session.data()),
+                     session.size(), hash_key_.data());
+    
+    uint64_t key = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        key |= static_cast<uint64_t>(out[i]) << (i * 8);
+    }
+    return key ? key : 1;
+}
+
+// High bits pick the shard and low bits the slot, so the two stay independent
+ReplayWindowTable::Shard& ReplayWindowTable::shard_for(uint64_t key) const {
+    return shards_[(key >> 40) & shard_mask_];
+}
+
+ReplayWindowTable::Slot* ReplayWindowTable::find(Shard& shard, uint64_t key) {
+    if (shard.slots.empty()) {
+        return nullptr;
+    }
+    
+    size_t mask = shard.slots.size() - 1;
+    for (size_t i = key & mask;; i = (i + 1) & mask) {
+        if (shard.slots[i].key == key) {
+            return &shard.slots[i];
+        }
+        if (shard.slots[i].key == 0) {
+            return nullptr;
+        }
+    }
+}
+
+// Linear probing at a load factor of at most 0.7
+ReplayWindowTable::Slot& ReplayWindowTable::insert(Shard& shard, uint64_t key) {
+    if ((shard.size + 1) * 10 > shard.slots.size() * 7) {
+        grow(shard);
+    }
+    
+    size_t mask = shard.slots.size() - 1;
+    size_t i = key & mask;
+    while (shard.slots[i].key != 0) {
+        i = (i + 1) & mask;
+    }
+    
+    Slot& slot = shard.slots[i];
+    slot = Slot{};
+    slot.key = key;
+    shard.size++;
+    return slot;
+}
+
+void ReplayWindowTable::grow(Shard& shard) {
+    std::vector<Slot> old;
+    old.swap(shard.slots);
+    shard.slots.assign(std::max(INITIAL_SLOTS, old.size() * 2), Slot{});
+    
+    size_t mask = shard.slots.size() - 1;
+    for (const Slot& slot : old) {
+        if (slot.key == 0) {
+            continue;
+        }
+        size_t i = slot.key & mask;
+        while (shard.slots[i].key != 0) {
+            i = (i + 1) & mask;
+        }
+        shard.slots[i] = slot;
+    }
+}
+
+ReplayCheck ReplayWindowTable::check(std::string_view session, uint64_t counter) {
+    uint64_t key = hash(session);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    Slot* slot = find(shard, key);
+    if (!slot) {
+        // Counter zero is never valid, matching the old strictly-increasing check
+        slot = &insert(shard, key);
+        slot->bitmap[0] = 1;
+    }
+    
+    if (counter > slot->highest) {
+        shift_window(slot->bitmap, counter - slot->highest);
+        slot->bitmap[0] |= 1;
+        slot->highest = counter;
+        return ReplayCheck::Accepted;
+    }
+    
+    uint64_t age = slot->highest - counter;
+    if (age >= WINDOW_SIZE) {
+        return ReplayCheck::TooOld;
+    }
+    
+    uint64_t bit = uint64_t(1) << (age % 64);
+    uint64_t& word = slot->bitmap[age / 64];
+    if (word & bit) {
+        return ReplayCheck::Replayed;
+    }
+    word |= bit;
+    return ReplayCheck::Accepted;
+}
+
+bool ReplayWindowTable::seed(std::string_view session, uint64_t highest) {
+    uint64_t key = hash(session);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    if (find(shard, key)) {
+        return false;
+    }
+    Slot& slot = insert(shard, key);
+    slot.highest = highest;
+    std::fill(slot.bitmap, slot.bitmap + WINDOW_WORDS, ~uint64_t(0));
+    return true;
+}
+
+std::optional<uint64_t> ReplayWindowTable::highest(std::string_view session) const {
+    uint64_t key = hash(session);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    const Slot* slot = find(shard, key);
+    if (!slot) {
+        return std::nullopt;
+    }
+    return slot->highest;
+}
+
+// Backward-shift deletion keeps probe chains intact without tombstones
+bool ReplayWindowTable::forget(std::string_view session) {
+    uint64_t key = hash(session);
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    
+    Slot* slot = find(shard, key);
+    if (!slot) {
+        return false;
+    }
+    
+    size_t mask = shard.slots.size() - 1;
+    size_t hole = static_cast<size_t>(slot - shard.slots.data());
+    for (size_t i = (hole + 1) & mask; shard.slots[i].key != 0; i = (i + 1) & mask) {
+        size_t home = shard.slots[i].key & mask;
+        // Move the entry back unless its home lies cyclically in (hole, i]
+        bool stays = hole <= i ? (hole < home && home <= i) : (hole < home || home <= i);
+        if (!stays) {
+            shard.slots[hole] = shard.slots[i];
+            hole = i;
+        }
+    }
+    shard.slots[hole].key = 0;
+    shard.size--;
+    return true;
+}
+
+size_t ReplayWindowTable::size() const {
+    size_t total = 0;
+    for (size_t i = 0; i <= shard_mask_; ++i) {
+        std::lock_guard<std::mutex> lock(shards_[i].mutex);
+        total += shards_[i].size;
+    }
+    return total;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,101 @@
+#include "secure_memory.hpp"
+#include <sodium.h>
+#include <algorithm>
+
+namespace spear {
+namespace crypto {
+
+SecureSlab::SecureSlab(size_t block_size, size_t blocks_per_slab)
+    : block_size_((std::max<size_t>(block_size, 1) + 15) & ~size_t(15)),
+      blocks_per_slab_(std::max<size_t>(blocks_per_slab, 1)) {
+}
+
+SecureSlab::~SecureSlab() {
+    // sodium_free wipes, unlocks and unmaps each slab
+    for (void* slab : slabs_) {
+        sodium_free(slab);
+    }
+}
+
+void* SecureSlab::allocate() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    if (free_blocks_.empty()) {
+        // The slab size is a multiple of 16, so sodium_malloc's end-aligned
+        // region starts 16-byte aligned too
+        void* slab = sodium_allocarray(blocks_per_slab_, block_size_);
+        if (!slab) {
+            return nullptr;
+        }
+        slabs_.push_back(slab);
+        
+        uint8_t* base = static_cast<uint8_t*>(slab);
+        sodium_memzero(base, blocks_per_slab_ * block_size_);
+        for (size_t i = blocks_per_slab_; i-- > 0;) {
+            free_blocks_.push_back(base + i * block_size_);
+        }
+    }
+    
+    void* block = free_blocks_.back();
+    free_blocks_.pop_back();
+    in_use_++;
+    return block;
+}
+
+void SecureSlab::deallocate(void* block) {
+    if (!block) {
+        return;
+    }
+    sodium_memzero(block, block_size_);
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_blocks_.push_back(block);
+    in_use_--;
+}
+
+size_t SecureSlab::in_use() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_use_;
+}
+
+SecureSlab& SecureSlab::shared() {
+    static SecureSlab* slab = new SecureSlab();
+    return *slab;
+}
+
+ScratchArena::ScratchArena(size_t capacity) : block_(capacity), used_(0) {
+}
+
+ScratchArena::~ScratchArena() {
+    reset();
+}
+
+ByteSpan ScratchArena::allocate(size_t size) {
+    size_t offset = (used_ + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    if (offset <= block_.size() && size <= block_.size() - offset) {
+        used_ = offset + size;
+        return ByteSpan(block_.data() + offset, size);
+    }
+    
+    overflow_.emplace_back(size);
+    return overflow_.back();
+}
+
+void ScratchArena::reset() {
+    if (used_ > 0) {
+        sodium_memzero(block_.data(), used_);
+        used_ = 0;
+    }
+    for (ByteVector& buffer : overflow_) {
+        sodium_memzero(buffer.data(), buffer.size());
+    }
+    overflow_.clear();
+}
+
+ScratchArena& ScratchArena::for_thread() {
+    thread_local ScratchArena arena;
+    return arena;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -0,0 +1,249 @@
+#include "session_cache.hpp"
+#include "key_exchange.hpp"
+#include <sodium.h>
+#include <cstring>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+enum class EntryKind : char { SharedSecret = 's', SessionKey = 'k' };
+
+std::string make_key(EntryKind kind,
+                     const std::string& local_key_id,
+                     const PublicKey& remote_public_key,
+                     const std::string& context) {
+    uint32_t id_len = static_cast<uint32_t>(local_key_id.size());
+    
+    std::string key;
+    key.reserve(1 + sizeof(id_len) + local_key_id.size() + remote_public_key.size() + context.size());
+    key.push_back(static_cast<char>(kind));
+    key.append(reinterpret_cast<const char*>(&id_len), sizeof(id_len));
+    key.append(local_key_id);
+    key.append(reinterpret_cast<const char*>(remote_public_key.data()), remote_public_key.size());
+    key.append(context);
+    return key;
+}
+
+} // namespace
+
+SessionKeyCache::SessionKeyCache(size_t capacity, std::chrono::seconds ttl)
+    : capacity_(capacity), ttl_(ttl), slots_(nullptr), hits_(0), misses_(0), evictions_(0) {
+    
+    if (capacity_ > 0) {
+        slots_ = static_cast<Slot*>(sodium_allocarray(capacity_, sizeof(Slot)));
+    }
+    if (slots_ == nullptr) {
+        capacity_ = 0;
+        return;
+    }
+    
+    free_slots_.reserve(capacity_);
+    for (size_t i = capacity_; i > 0; --i) {
+        free_slots_.push_back(i - 1);
+    }
+    index_.reserve(capacity_);
+}
+
+SessionKeyCache::~SessionKeyCache() {
+    if (slots_ != nullptr) {
+        sodium_free(slots_);
+    }
+}
+
+std::optional<SharedSecret> SessionKeyCache::shared_secret(
+    const std::string& local_key_id,
+    const SecretKey& local_secret_key,
+    const PublicKey& remote_public_key) {
+    
+    std::string key = make_key(EntryKind::SharedSecret, local_key_id, remote_public_key, {});
+    
+    if (auto cached = lookup(key)) {
+        SharedSecret result = cached->shared_secret;
+        sodium_memzero(&*cached, sizeof(Slot));
+        return result;
+    }
+    
+    auto derived = KeyExchange::derive_shared_secret(local_secret_key, remote_public_key);
+    if (!derived) {
+        return std::nullopt;
+    }
+    
+    Slot value{};
+    value.shared_secret = *derived;
+    insert(key, local_key_id, value);
+    sodium_memzero(&value, sizeof(value));
+    
+    return derived;
+}
+
+std::optional<SymmetricKey> SessionKeyCache::session_key(
+    const std::string& local_key_id,
+    const SecretKey& local_secret_key,
+    const PublicKey& remote_public_key,
+    const std::string& context) {
+    
+    std::string key = make_key(EntryKind::SessionKey, local_key_id, remote_public_key, context);
+    
+    if (auto cached = lookup(key)) {
+        SymmetricKey result = cached->session_key;
+        sodium_memzero(&*cached, sizeof(Slot));
+        return result;
+    }
+    
+    auto shared = KeyExchange::derive_shared_secret(local_secret_key, remote_public_key);
+    if (!shared) {
+        return std::nullopt;
+    }
+    
+    ByteVector derived = KeyExchange::derive_session_key(*shared, context, SYMMETRIC_KEY_SIZE);
+    
+    Slot value{};
+    value.shared_secret = *shared;
+    std::memcpy(value.session_key.data(), derived.data(), SYMMETRIC_KEY_SIZE);
+    sodium_memzero(derived.data(), derived.size());
+    sodium_memzero(shared->data(), shared->size());
+    
+    insert(key, local_key_id, value);
+    
+    SymmetricKey result = value.session_key;
+    sodium_memzero(&value, sizeof(value));
+    return result;
+}
+
+std::shared_ptr<const AeadContext> SessionKeyCache::session_context(
+    const std::string& local_key_id,
+    const SecretKey& local_secret_key,
+    const PublicKey& remote_public_key,
+    const std::string& context,
+    AeadAlgorithm algorithm) {
+    
+    std::string key = make_key(EntryKind::SessionKey, local_key_id, remote_public_key, context);
+    
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto found = index_.find(key);
+        if (found != index_.end()) {
+            LruList::iterator it = found->second;
+            if (it->aead && it->aead->algorithm() == algorithm &&
+                std::chrono::steady_clock::now() < it->expires) {
+                lru_.splice(lru_.begin(), lru_, it);
+                hits_.fetch_add(1, std::memory_order_relaxed);
+                return it->aead;
+            }
+        }
+    }
+    
+    auto session = session_key(local_key_id, local_secret_key, remote_public_key, context);
+    if (!session) {
+        return nullptr;
+    }
+    
+    auto aead = std::make_shared<const AeadContext>(*session, algorithm);
+    sodium_memzero(session->data(), session->size());
+    if (!aead->valid()) {
+        return nullptr;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        found->second->aead = aead;
+    }
+    return aead;
+}
+
+void SessionKeyCache::erase_local_key(const std::string& local_key_id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    for (auto it = lru_.begin(); it != lru_.end();) {
+        auto next = std::next(it);
+        if (it->local_key_id == local_key_id) {
+            evict(it);
+        }
+        it = next;
+    }
+}
+
+void SessionKeyCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    while (!lru_.empty()) {
+        evict(std::prev(lru_.end()));
+    }
+}
+
+SessionKeyCache::Stats SessionKeyCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    return Stats{
+        hits_.load(std::memory_order_relaxed),
+        misses_.load(std::memory_order_relaxed),
+        evictions_.load(std::memory_order_relaxed),
+        lru_.size()
+    };
+}
+
+std::optional<SessionKeyCache::Slot> SessionKeyCache::lookup(const std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    auto found = index_.find(key);
+    if (found == index_.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    
+    LruList::iterator it = found->second;
+    if (std::chrono::steady_clock::now() >= it->expires) {
+        evict(it);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    
+    lru_.splice(lru_.begin(), lru_, it);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return slots_[it->slot];
+}
+
+void SessionKeyCache::insert(const std::string& key,
+                             const std::string& local_key_id,
+                             const Slot& value) {
+    if (capacity_ == 0) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    // Another thread may have derived the same entry while we were unlocked
+    auto found = index_.find(key);
+    if (found != index_.end()) {
+        LruList::iterator it = found->second;
+        slots_[it->slot] = value;
+        it->expires = std::chrono::steady_clock::now() + ttl_;
+        lru_.splice(lru_.begin(), lru_, it);
+        return;
+    }
+    
+    if (free_slots_.empty()) {
+        evict(std::prev(lru_.end()));
+    }
+    
+    size_t slot = free_slots_.back();
+    free_slots_.pop_back();
+    slots_[slot] = value;
+    
+    lru_.push_front(Node{key, local_key_id, slot, std::chrono::steady_clock::now() + ttl_, nullptr});
+    index_.emplace(key, lru_.begin());
+}
+
+void SessionKeyCache::evict(LruList::iterator it) {
+    sodium_memzero(&slots_[it->slot], sizeof(Slot));
+    free_slots_.push_back(it->slot);
+    index_.erase(it->key);
+    lru_.erase(it);
+    evictions_.fetch_add(1, std::memory_order_relaxed);
+}
+
+} // namespace crypto
+} // namespace spear
@@ -1,13 +1,63 @@
 #include "signing.hpp"
+#include "metrics.hpp"
 #include <sodium.h>
+#include <algorithm>
 
 namespace spear {
 namespace crypto {
 
+namespace {
+
+uint64_t verify_word(const std::vector<SignatureCheck>& items, size_t word) {
+    uint64_t bits = 0;
+    size_t end = std::min(items.size(), (word + 1) * 64);
+    
+    for (size_t i = word * 64; i < end; ++i) {
+        const SignatureCheck& item = items[i];
+        SPEAR_METRICS_TIMER(timer, MetricOp::Verify, item.message.size());
+        if (crypto_sign_verify_detached(
+                item.signature.data(),
+                item.message.data(),
+                item.message.size(),
+                item.public_key.data()) == 0) {
+            bits |= uint64_t(1) << (i % 64);
+            SPEAR_METRICS_SUCCEED(timer);
+        }
+    }
+    
+    return bits;
+}
+
+} // namespace
+
+size_t BatchVerifyResult::valid_count() const {
+    size_t n = 0;
+    for (uint64_t word : bits) {
+        n += static_cast<size_t>(__builtin_popcountll(word));
+    }
+    return n;
+}
+
 std::optional<Signature> Signing::sign_message(
     const ByteVector& message,
     const SigningSecretKey& secret_key) {
     
+    return sign_message(ConstByteSpan(message), secret_key);
+}
+
+bool Signing::verify_signature(
+    const ByteVector& message,
+    const Signature& signature,
+    const SigningPublicKey& public_key) {
+    
+    return verify_signature(ConstByteSpan(message), signature, public_key);
+}
+
+std::optional<Signature> Signing::sign_message(
+    ConstByteSpan message,
+    const SigningSecretKey& secret_key) {
+    
+    SPEAR_METRICS_TIMER(timer, MetricOp::Sign, message.size());
     Signature signature;
     
     if (crypto_sign_detached(
@@ -19,21 +69,102 @@ std::optional<Signature> Signing::sign_message(
         return std::nullopt;
     }
     
+    SPEAR_METRICS_SUCCEED(timer);
     return signature;
 }
 
 bool Signing::verify_signature(
-    const ByteVector& message,
+    ConstByteSpan message,
     const Signature& signature,
     const SigningPublicKey& public_key) {
     
-    return crypto_sign_verify_detached(
-        signature.data(),
-        message.data(),
-        message.size(),
-        public_key.data()
-    ) == 0;
+    SPEAR_METRICS_TIMER(timer, MetricOp::Verify, message.size());
+    if (crypto_sign_verify_detached(
+            signature.data(),
+            message.data(),
+            message.size(),
+            public_key.data()) != 0) {
+        return false;
+    }
+    
+    SPEAR_METRICS_SUCCEED(timer);
+    return true;
+}
+
+BatchVerifyResult Signing::verify_batch(
+    const std::vector<SignatureCheck>& items,
+    ThreadPool* pool) {
+    
+    BatchVerifyResult result;
+    result.count = items.size();
+    result.bits.assign((items.size() + 63) / 64, 0);
+    
+    // Each task owns one 64-item word of the bitmap, so no two threads ever
+    // write the same word.
+    auto verify = [&](size_t word) {
+        result.bits[word] = verify_word(items, word);
+    };
+    
+    if (items.size() < PARALLEL_BATCH_THRESHOLD) {
+        for (size_t word = 0; word < result.bits.size(); ++word) {
+            verify(word);
+        }
+    } else {
+        (pool ? *pool : ThreadPool::shared()).parallel_for(result.bits.size(), verify);
+    }
+    
+    return result;
+}
+
+struct StreamSigner::State {
+    crypto_sign_state sign;
+};
+
+StreamSigner::StreamSigner() : state_(new State) {
+    crypto_sign_init(&state_->sign);
+}
+
+// The hash state buffers the tail of whatever was signed
+StreamSigner::~StreamSigner() {
+    sodium_memzero(state_.get(), sizeof(State));
+}
+
+void StreamSigner::update(ConstByteSpan data) {
+    crypto_sign_update(&state_->sign, data.data(), data.size());
+}
+
+std::optional<Signature> StreamSigner::finish(const SigningSecretKey& secret_key) {
+    Signature signature;
+    int rc = crypto_sign_final_create(&state_->sign, signature.data(), nullptr, secret_key.data());
+    crypto_sign_init(&state_->sign);
+    
+    if (rc != 0) {
+        return std::nullopt;
+    }
+    return signature;
+}
+
+struct StreamVerifier::State {
+    crypto_sign_state sign;
+};
+
+StreamVerifier::StreamVerifier() : state_(new State) {
+    crypto_sign_init(&state_->sign);
+}
+
+StreamVerifier::~StreamVerifier() {
+    sodium_memzero(state_.get(), sizeof(State));
+}
+
+void StreamVerifier::update(ConstByteSpan data) {
+    crypto_sign_update(&state_->sign, data.data(), data.size());
+}
+
+bool StreamVerifier::finish(const Signature& signature, const SigningPublicKey& public_key) {
+    bool valid = crypto_sign_final_verify(&state_->sign, signature.data(), public_key.data()) == 0;
+    crypto_sign_init(&state_->sign);
+    return valid;
 }
 
 } // namespace crypto
-} // namespace spear
\ No newline at end of file
+} // namespace spear
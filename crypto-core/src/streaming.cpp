@@ -1,49 +1,428 @@
 #include "streaming.hpp"
 #include "symmetric_crypto.hpp"
+#include "metrics.hpp"
 #include <sodium.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
 #include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace spear {
 namespace crypto {
 
+namespace {
+
+constexpr size_t HEADER_SIZE = StreamingEncryption::CHUNK_HEADER_SIZE;
+constexpr size_t FRAME_OVERHEAD = StreamingEncryption::CHUNK_OVERHEAD;
+
+Nonce chunk_nonce(const Nonce& base_nonce, uint64_t counter) {
+    Nonce nonce = base_nonce;
+    for (size_t i = 0; i < 8 && i < nonce.size(); ++i) {
+        nonce[i] = static_cast<uint8_t>((counter >> (i * 8)) & 0xFF);
+    }
+    return nonce;
+}
+
+uint8_t frame_flags(bool is_final, AeadAlgorithm algorithm) {
+    return static_cast<uint8_t>((is_final ? 1 : 0) | (static_cast<uint8_t>(algorithm) << 1));
+}
+
+bool frame_is_final(ConstByteSpan frame) {
+    return (frame[8] & 1) != 0;
+}
+
+std::optional<AeadAlgorithm> frame_algorithm(ConstByteSpan frame) {
+    return SymmetricCrypto::algorithm_from_id(frame[8] >> 1);
+}
+
+// Writes the header, ciphertext and tag of one chunk into three buffers of
+// CHUNK_HEADER_SIZE, chunk.size() and MAC_SIZE bytes. `ciphertext` may be
+// `chunk` itself.
+bool seal_frame(const AeadContext& context, const Nonce& base_nonce, uint64_t counter,
+                bool is_final, ConstByteSpan chunk,
+                ByteSpan header, ByteSpan ciphertext, ByteSpan tag) {
+    SPEAR_METRICS_TIMER(timer, MetricOp::StreamEncryptChunk, chunk.size());
+    std::memcpy(header.data(), &counter, 8);
+    header[8] = frame_flags(is_final, context.algorithm());
+    
+    if (!context.encrypt_detached(chunk, chunk_nonce(base_nonce, counter),
+                                  header.subspan(0, HEADER_SIZE), ciphertext, tag)) {
+        return false;
+    }
+    
+    SPEAR_METRICS_SUCCEED(timer);
+    return true;
+}
+
+// Contiguous frame: `frame` must hold chunk.size() + FRAME_OVERHEAD bytes
+bool seal_frame(const AeadContext& context, const Nonce& base_nonce, uint64_t counter,
+                bool is_final, ConstByteSpan chunk, ByteSpan frame) {
+    return seal_frame(context, base_nonce, counter, is_final, chunk,
+                      frame.subspan(0, HEADER_SIZE),
+                      frame.subspan(HEADER_SIZE, chunk.size()),
+                      frame.subspan(HEADER_SIZE + chunk.size(), MAC_SIZE));
+}
+
+bool open_frame(const AeadContext& context, const Nonce& base_nonce, uint64_t counter,
+                ConstByteSpan header, ConstByteSpan ciphertext, ConstByteSpan tag,
+                ByteSpan plaintext) {
+    SPEAR_METRICS_TIMER(timer, MetricOp::StreamDecryptChunk, HEADER_SIZE + ciphertext.size() + tag.size());
+    if (!context.decrypt_detached(ciphertext, tag, chunk_nonce(base_nonce, counter),
+                                  header.subspan(0, HEADER_SIZE), plaintext)) {
+        return false;
+    }
+    
+    SPEAR_METRICS_SUCCEED(timer);
+    return true;
+}
+
+bool open_frame(const AeadContext& context, const Nonce& base_nonce, uint64_t counter,
+                ConstByteSpan frame, ByteSpan plaintext) {
+    size_t ciphertext_size = frame.size() - FRAME_OVERHEAD;
+    return open_frame(context, base_nonce, counter,
+                      frame.subspan(0, HEADER_SIZE),
+                      frame.subspan(HEADER_SIZE, ciphertext_size),
+                      frame.subspan(HEADER_SIZE + ciphertext_size, MAC_SIZE), plaintext);
+}
+
+size_t chunk_count(size_t plaintext_size, size_t chunk_size) {
+    return plaintext_size == 0 ? 1 : (plaintext_size + chunk_size - 1) / chunk_size;
+}
+
+// The payload is data[offset, offset + size): the reader fills it at the
+// input offset and the transform rewrites it in place, moving the window
+struct PipelineChunk {
+    ByteVector data;
+    size_t offset = 0;
+    size_t size = 0;
+    bool is_final = false;
+};
+
+// Bounded SPSC queue of chunk pointers. Both indices are plain atomics, so a
+// side only takes the mutex when it has to sleep or wake the other one up.
+// close() aborts the pipeline: blocked calls return and later ones fail.
+class ChunkRing {
+public:
+    explicit ChunkRing(size_t capacity) : slots_(capacity + 1) {}
+    
+    bool push(PipelineChunk* chunk) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t next = (tail + 1) % slots_.size();
+        wait_until([&] { return next != head_.load() || closed_.load(); });
+        if (closed_.load()) {
+            return false;
+        }
+        
+        slots_[tail] = chunk;
+        tail_.store(next);
+        wake();
+        return true;
+    }
+    
+    // nullptr once the ring is closed
+    PipelineChunk* pop() {
+        size_t head = head_.load(std::memory_order_relaxed);
+        wait_until([&] { return head != tail_.load() || closed_.load(); });
+        if (closed_.load()) {
+            return nullptr;
+        }
+        
+        PipelineChunk* chunk = slots_[head];
+        head_.store((head + 1) % slots_.size());
+        wake();
+        return chunk;
+    }
+    
+    void close() {
+        closed_.store(true);
+        std::lock_guard<std::mutex> lock(mutex_);
+        cv_.notify_all();
+    }
+
+private:
+    // A sleeper registers before its final check under the mutex, and a
+    // publisher checks for sleepers after its index store; with sequentially
+    // consistent atomics one of the two always sees the other.
+    template <typename Ready>
+    void wait_until(Ready ready) {
+        for (int spin = 0; spin < 64; ++spin) {
+            if (ready()) {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleepers_.fetch_add(1);
+        cv_.wait(lock, ready);
+        sleepers_.fetch_sub(1);
+    }
+    
+    void wake() {
+        if (sleepers_.load() > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            cv_.notify_all();
+        }
+    }
+    
+    std::vector<PipelineChunk*> slots_;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+    std::atomic<bool> closed_{false};
+    std::atomic<int> sleepers_{0};
+    std::mutex mutex_;
+    std::condition_variable cv_;
+};
+
+// Reads until `chunk` holds `size` bytes at `offset` or the source is
+// exhausted
+bool fill_chunk(const StreamSource& source, PipelineChunk& chunk, size_t offset, size_t size) {
+    chunk.offset = offset;
+    chunk.size = 0;
+    while (chunk.size < size) {
+        auto n = source(ByteSpan(chunk.data.data() + offset + chunk.size, size - chunk.size));
+        if (!n || *n > size - chunk.size) {
+            return false;
+        }
+        if (*n == 0) {
+            break;
+        }
+        chunk.size += *n;
+    }
+    return true;
+}
+
+// Shared driver for encrypt/decrypt. Each chunk lives in one buffer from
+// read to write: the reader reads up to `in_size` bytes at `in_offset`, one
+// chunk ahead so it can flag the last chunk of the input as final, and
+// `transform` seals or opens it in place on the calling thread. Buffers carry
+// plaintext on one side or the other, so all are wiped at the end.
+template <typename Transform>
+std::optional<StreamPipeline::Stats> run_pipeline(
+    size_t buffer_size, size_t in_offset, size_t in_size, size_t depth,
+    const StreamSource& source, const StreamSink& sink, Transform transform) {
+    
+    // As many buffers in flight as separate input and output sets would give
+    size_t buffers = 2 * std::max<size_t>(depth, 2);
+    std::vector<PipelineChunk> chunks(buffers);
+    ChunkRing free_chunks(buffers), filled(buffers), ready(buffers);
+    for (PipelineChunk& chunk : chunks) {
+        chunk.data.resize(buffer_size);
+        free_chunks.push(&chunk);
+    }
+    
+    std::atomic<bool> failed{false};
+    auto abort = [&] {
+        failed.store(true);
+        free_chunks.close();
+        filled.close();
+        ready.close();
+    };
+    
+    uint64_t bytes_read = 0;
+    std::thread reader([&] {
+        PipelineChunk* current = free_chunks.pop();
+        if (!current || !fill_chunk(source, *current, in_offset, in_size)) {
+            abort();
+            return;
+        }
+        
+        while (true) {
+            bytes_read += current->size;
+            // A short read means the source is exhausted; a full chunk has to
+            // wait for the next read to know whether it is the last one
+            PipelineChunk* next = nullptr;
+            if (current->size == in_size) {
+                next = free_chunks.pop();
+                if (!next || !fill_chunk(source, *next, in_offset, in_size)) {
+                    abort();
+                    return;
+                }
+            }
+            
+            current->is_final = !next || next->size == 0;
+            if (!filled.push(current)) {
+                return;
+            }
+            if (current->is_final) {
+                return;
+            }
+            current = next;
+        }
+    });
+    
+    uint64_t bytes_written = 0;
+    std::thread writer([&] {
+        while (PipelineChunk* chunk = ready.pop()) {
+            if (!sink(ConstByteSpan(chunk->data.data() + chunk->offset, chunk->size))) {
+                abort();
+                return;
+            }
+            bytes_written += chunk->size;
+            bool is_final = chunk->is_final;
+            if (is_final || !free_chunks.push(chunk)) {
+                return;
+            }
+        }
+    });
+    
+    uint64_t count = 0;
+    while (PipelineChunk* chunk = filled.pop()) {
+        if (!transform(*chunk)) {
+            abort();
+            break;
+        }
+        count++;
+        
+        bool is_final = chunk->is_final;
+        if (!ready.push(chunk) || is_final) {
+            break;
+        }
+    }
+    
+    reader.join();
+    writer.join();
+    
+    for (PipelineChunk& chunk : chunks) {
+        sodium_memzero(chunk.data.data(), chunk.data.size());
+    }
+    
+    if (failed.load()) {
+        return std::nullopt;
+    }
+    return StreamPipeline::Stats{count, bytes_read, bytes_written};
+}
+
+} // namespace
+
 StreamingEncryption::StreamingEncryption(
     const SymmetricKey& key,
     const Nonce& base_nonce,
-    size_t chunk_size)
-    : key_(key), base_nonce_(base_nonce), chunk_size_(chunk_size), chunk_counter_(0) {
+    size_t chunk_size,
+    AeadAlgorithm algorithm)
+    : context_(key, algorithm),
+      base_nonce_(base_nonce),
+      chunk_size_(chunk_size),
+      chunk_counter_(0) {
 }
 
-StreamingEncryption::~StreamingEncryption() {
-    sodium_memzero(key_.data(), key_.size());
-}
+StreamingEncryption::~StreamingEncryption() = default;
 
 std::optional<ByteVector> StreamingEncryption::encrypt_chunk(
     const ByteVector& chunk,
     bool is_final) {
     
-    Nonce nonce = base_nonce_;
-    for (size_t i = 0; i < 8 && i < nonce.size(); ++i) {
-        nonce[i] = static_cast<uint8_t>((chunk_counter_ >> (i * 8)) & 0xFF);
+    ByteVector result(chunk.size() + FRAME_OVERHEAD);
+    if (!encrypt_chunk(chunk, is_final, result)) {
+        return std::nullopt;
     }
+    return result;
+}
+
+std::optional<size_t> StreamingEncryption::encrypt_chunk(
+    ConstByteSpan chunk,
+    bool is_final,
+    ByteSpan frame) {
     
-    ByteVector header(9);
-    std::memcpy(header.data(), &chunk_counter_, 8);
-    header[8] = is_final ? 1 : 0;
+    if (frame.size() < chunk.size() + FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    
+    return encrypt_chunk(chunk, is_final,
+                         frame.subspan(0, HEADER_SIZE),
+                         frame.subspan(HEADER_SIZE, chunk.size()),
+                         frame.subspan(HEADER_SIZE + chunk.size(), MAC_SIZE));
+}
+
+std::optional<size_t> StreamingEncryption::encrypt_chunk(
+    ConstByteSpan chunk,
+    bool is_final,
+    ByteSpan header,
+    ByteSpan ciphertext,
+    ByteSpan tag) {
     
-    auto encrypted = SymmetricCrypto::encrypt_aead(chunk, key_, nonce, header);
-    if (!encrypted) {
+    if (header.size() < HEADER_SIZE || ciphertext.size() < chunk.size() || tag.size() < MAC_SIZE) {
         return std::nullopt;
     }
     
-    ByteVector result;
-    result.reserve(header.size() + encrypted->size());
-    result.insert(result.end(), header.begin(), header.end());
-    result.insert(result.end(), encrypted->begin(), encrypted->end());
+    header = header.subspan(0, HEADER_SIZE);
+    ciphertext = ciphertext.subspan(0, chunk.size());
+    tag = tag.subspan(0, MAC_SIZE);
+    if (!seal_frame(context_, base_nonce_, chunk_counter_, is_final, chunk, header, ciphertext, tag)) {
+        return std::nullopt;
+    }
     
+    if (signer_) {
+        signer_->update(header);
+        signer_->update(ciphertext);
+        signer_->update(tag);
+    }
     chunk_counter_++;
+    return chunk.size() + FRAME_OVERHEAD;
+}
+
+std::optional<ByteVector> StreamingEncryption::encrypt_parallel(
+    ConstByteSpan data,
+    ThreadPool* pool) {
+    
+    ByteVector result(encrypted_size(data.size(), chunk_size_));
+    if (!encrypt_parallel(data, result, pool)) {
+        return std::nullopt;
+    }
     return result;
 }
 
+std::optional<size_t> StreamingEncryption::encrypt_parallel(
+    ConstByteSpan data,
+    ByteSpan out,
+    ThreadPool* pool) {
+    
+    if (chunk_size_ == 0) {
+        return std::nullopt;
+    }
+    
+    size_t total = encrypted_size(data.size(), chunk_size_);
+    if (out.size() < total) {
+        return std::nullopt;
+    }
+    
+    size_t chunks = chunk_count(data.size(), chunk_size_);
+    uint64_t first_counter = chunk_counter_;
+    std::atomic<bool> failed{false};
+    
+    auto seal = [&](size_t i) {
+        size_t offset = i * chunk_size_;
+        size_t len = std::min(chunk_size_, data.size() - offset);
+        ByteSpan frame = out.subspan(i * (chunk_size_ + FRAME_OVERHEAD), len + FRAME_OVERHEAD);
+        
+        if (!seal_frame(context_, base_nonce_, first_counter + i, i + 1 == chunks,
+                        data.subspan(offset, len), frame)) {
+            failed.store(true, std::memory_order_relaxed);
+        }
+    };
+    (pool ? *pool : ThreadPool::shared()).parallel_for(chunks, seal);
+    
+    if (failed.load()) {
+        return std::nullopt;
+    }
+    
+    // Hashing is sequential, so the signer sees the frames after the fact
+    if (signer_) {
+        signer_->update(out.subspan(0, total));
+    }
+    chunk_counter_ += chunks;
+    return total;
+}
+
+size_t StreamingEncryption::encrypted_size(size_t plaintext_size, size_t chunk_size) {
+    return plaintext_size + chunk_count(plaintext_size, chunk_size) * FRAME_OVERHEAD;
+}
+
 void StreamingEncryption::reset(const Nonce& new_base_nonce) {
     base_nonce_ = new_base_nonce;
     chunk_counter_ = 0;
@@ -51,56 +430,325 @@ void StreamingEncryption::reset(const Nonce& new_base_nonce) {
 
 StreamingDecryption::StreamingDecryption(
     const SymmetricKey& key,
-    const Nonce& base_nonce)
-    : key_(key), base_nonce_(base_nonce), expected_chunk_counter_(0), received_final_(false) {
+    const Nonce& base_nonce,
+    std::optional<AeadAlgorithm> algorithm)
+    : base_nonce_(base_nonce),
+      required_algorithm_(algorithm),
+      algorithm_(algorithm),
+      expected_chunk_counter_(0),
+      received_final_(false) {
+    
+    // Until the first frame arrives either algorithm may be in use, so both
+    // are set up; an unavailable one stays empty and its frames fail to open
+    for (AeadAlgorithm candidate : {AeadAlgorithm::ChaCha20Poly1305, AeadAlgorithm::Aes256Gcm}) {
+        if (!algorithm || *algorithm == candidate) {
+            contexts_[static_cast<size_t>(candidate)] = AeadContext(key, candidate);
+        }
+    }
 }
 
-StreamingDecryption::~StreamingDecryption() {
-    sodium_memzero(key_.data(), key_.size());
-}
+StreamingDecryption::~StreamingDecryption() = default;
 
 std::optional<ByteVector> StreamingDecryption::decrypt_chunk(
     const ByteVector& encrypted_chunk) {
     
-    if (encrypted_chunk.size() < 9) {
+    if (encrypted_chunk.size() < FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    
+    ByteVector decrypted(encrypted_chunk.size() - FRAME_OVERHEAD);
+    if (!decrypt_chunk(encrypted_chunk, decrypted)) {
+        return std::nullopt;
+    }
+    return decrypted;
+}
+
+std::optional<size_t> StreamingDecryption::decrypt_chunk(
+    ConstByteSpan frame,
+    ByteSpan out) {
+    
+    if (frame.size() < FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    
+    size_t ciphertext_size = frame.size() - FRAME_OVERHEAD;
+    return decrypt_chunk(frame.subspan(0, HEADER_SIZE),
+                         frame.subspan(HEADER_SIZE, ciphertext_size),
+                         frame.subspan(HEADER_SIZE + ciphertext_size, MAC_SIZE), out);
+}
+
+std::optional<size_t> StreamingDecryption::decrypt_chunk(
+    ConstByteSpan header,
+    ConstByteSpan ciphertext,
+    ConstByteSpan tag,
+    ByteSpan out) {
+    
+    if (header.size() != HEADER_SIZE || tag.size() != MAC_SIZE || out.size() < ciphertext.size()) {
         return std::nullopt;
     }
     
     uint64_t chunk_counter;
-    std::memcpy(&chunk_counter, encrypted_chunk.data(), 8);
+    std::memcpy(&chunk_counter, header.data(), 8);
     
     if (chunk_counter != expected_chunk_counter_) {
         return std::nullopt;
     }
     
-    bool is_final = encrypted_chunk[8] != 0;
-    
-    ByteVector header(encrypted_chunk.begin(), encrypted_chunk.begin() + 9);
-    ByteVector ciphertext(encrypted_chunk.begin() + 9, encrypted_chunk.end());
+    bool is_final = frame_is_final(header);
+    auto algorithm = frame_algorithm(header);
+    if (!algorithm || (algorithm_ && *algorithm != *algorithm_)) {
+        return std::nullopt;
+    }
     
-    Nonce nonce = base_nonce_;
-    for (size_t i = 0; i < 8 && i < nonce.size(); ++i) {
-        nonce[i] = static_cast<uint8_t>((chunk_counter >> (i * 8)) & 0xFF);
+    // Opening in place overwrites the ciphertext, so the verifier has to see
+    // it first; a frame rejected after that leaves the signature unverifiable
+    bool hash_first = verifier_ && out.data() == ciphertext.data();
+    if (hash_first) {
+        verifier_->update(header);
+        verifier_->update(ciphertext);
+        verifier_->update(tag);
     }
     
-    auto decrypted = SymmetricCrypto::decrypt_aead(ciphertext, key_, nonce, header);
-    if (!decrypted) {
+    if (!open_frame(context_for(*algorithm), base_nonce_, chunk_counter, header, ciphertext, tag,
+                    out.subspan(0, ciphertext.size()))) {
         return std::nullopt;
     }
     
+    if (verifier_ && !hash_first) {
+        verifier_->update(header);
+        verifier_->update(ciphertext);
+        verifier_->update(tag);
+    }
+    algorithm_ = algorithm;
     expected_chunk_counter_++;
     if (is_final) {
         received_final_ = true;
     }
     
-    return decrypted;
+    return ciphertext.size();
+}
+
+std::optional<size_t> StreamingDecryption::decrypt_chunk_at(
+    uint64_t counter,
+    bool is_final,
+    ConstByteSpan frame,
+    ByteSpan out) const {
+    
+    if (frame.size() < FRAME_OVERHEAD || out.size() < frame.size() - FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    
+    uint64_t frame_counter;
+    std::memcpy(&frame_counter, frame.data(), 8);
+    auto algorithm = frame_algorithm(frame);
+    if (frame_counter != counter || frame_is_final(frame) != is_final || !algorithm ||
+        (algorithm_ && *algorithm != *algorithm_)) {
+        return std::nullopt;
+    }
+    
+    if (!open_frame(context_for(*algorithm), base_nonce_, counter, frame, out)) {
+        return std::nullopt;
+    }
+    
+    return frame.size() - FRAME_OVERHEAD;
+}
+
+std::optional<ByteVector> StreamingDecryption::decrypt_parallel(
+    ConstByteSpan frames,
+    size_t chunk_size,
+    ThreadPool* pool) {
+    
+    auto size = decrypted_size(frames.size(), chunk_size);
+    if (!size) {
+        return std::nullopt;
+    }
+    
+    ByteVector result(*size);
+    if (!decrypt_parallel(frames, chunk_size, result, pool)) {
+        return std::nullopt;
+    }
+    return result;
+}
+
+std::optional<size_t> StreamingDecryption::decrypt_parallel(
+    ConstByteSpan frames,
+    size_t chunk_size,
+    ByteSpan out,
+    ThreadPool* pool) {
+    
+    auto total = decrypted_size(frames.size(), chunk_size);
+    if (!total || out.size() < *total || received_final_) {
+        return std::nullopt;
+    }
+    
+    size_t frame_size = chunk_size + FRAME_OVERHEAD;
+    size_t chunks = (frames.size() + frame_size - 1) / frame_size;
+    uint64_t first_counter = expected_chunk_counter_;
+    
+    // Headers are authenticated as AAD, so ordering, the final flag and the
+    // algorithm can be checked up front and any tampering is still caught by
+    // the tag.
+    auto algorithm = frame_algorithm(frames);
+    if (!algorithm || (algorithm_ && *algorithm != *algorithm_)) {
+        return std::nullopt;
+    }
+    
+    for (size_t i = 0; i < chunks; ++i) {
+        ConstByteSpan header = frames.subspan(i * frame_size, HEADER_SIZE);
+        uint64_t counter;
+        std::memcpy(&counter, header.data(), 8);
+        if (counter != first_counter + i || frame_is_final(header) != (i + 1 == chunks) ||
+            frame_algorithm(header) != algorithm) {
+            return std::nullopt;
+        }
+    }
+    
+    const AeadContext& context = context_for(*algorithm);
+    std::atomic<bool> failed{false};
+    
+    auto open = [&](size_t i) {
+        size_t offset = i * frame_size;
+        size_t len = std::min(frame_size, frames.size() - offset);
+        
+        if (!open_frame(context, base_nonce_, first_counter + i, frames.subspan(offset, len),
+                        out.subspan(i * chunk_size, len - FRAME_OVERHEAD))) {
+            failed.store(true, std::memory_order_relaxed);
+        }
+    };
+    (pool ? *pool : ThreadPool::shared()).parallel_for(chunks, open);
+    
+    if (failed.load()) {
+        sodium_memzero(out.data(), *total);
+        return std::nullopt;
+    }
+    
+    if (verifier_) {
+        verifier_->update(frames);
+    }
+    algorithm_ = algorithm;
+    expected_chunk_counter_ += chunks;
+    received_final_ = true;
+    return *total;
+}
+
+std::optional<size_t> StreamingDecryption::decrypted_size(size_t frames_size, size_t chunk_size) {
+    if (chunk_size == 0 || frames_size < FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    
+    size_t frame_size = chunk_size + FRAME_OVERHEAD;
+    size_t full_frames = frames_size / frame_size;
+    size_t tail = frames_size % frame_size;
+    
+    if (tail == 0) {
+        return full_frames * chunk_size;
+    }
+    if (tail < FRAME_OVERHEAD) {
+        return std::nullopt;
+    }
+    return full_frames * chunk_size + tail - FRAME_OVERHEAD;
+}
+
+const AeadContext& StreamingDecryption::context_for(AeadAlgorithm algorithm) const {
+    return contexts_[static_cast<size_t>(algorithm)];
 }
 
 void StreamingDecryption::reset(const Nonce& new_base_nonce) {
     base_nonce_ = new_base_nonce;
+    algorithm_ = required_algorithm_;
     expected_chunk_counter_ = 0;
     received_final_ = false;
 }
 
+std::optional<StreamPipeline::Stats> StreamPipeline::encrypt(
+    StreamingEncryption& encryption,
+    const StreamSource& source,
+    const StreamSink& sink,
+    size_t depth) {
+    
+    size_t chunk_size = encryption.chunk_size();
+    if (chunk_size == 0) {
+        return std::nullopt;
+    }
+    
+    // Plaintext is read straight into the ciphertext slot of its frame
+    return run_pipeline(chunk_size + FRAME_OVERHEAD, HEADER_SIZE, chunk_size, depth, source, sink,
+        [&](PipelineChunk& chunk) {
+            uint8_t* frame = chunk.data.data();
+            ByteSpan body(frame + HEADER_SIZE, chunk.size);
+            auto written = encryption.encrypt_chunk(body, chunk.is_final, ByteSpan(frame, HEADER_SIZE),
+                                                    body, ByteSpan(frame + HEADER_SIZE + chunk.size, MAC_SIZE));
+            if (!written) {
+                return false;
+            }
+            chunk.offset = 0;
+            chunk.size = *written;
+            return true;
+        });
+}
+
+std::optional<StreamPipeline::Stats> StreamPipeline::decrypt(
+    StreamingDecryption& decryption,
+    size_t chunk_size,
+    const StreamSource& source,
+    const StreamSink& sink,
+    size_t depth) {
+    
+    if (chunk_size == 0 || decryption.is_complete()) {
+        return std::nullopt;
+    }
+    
+    return run_pipeline(chunk_size + FRAME_OVERHEAD, 0, chunk_size + FRAME_OVERHEAD, depth, source, sink,
+        [&](PipelineChunk& chunk) {
+            if (chunk.size < FRAME_OVERHEAD) {
+                return false;
+            }
+            uint8_t* frame = chunk.data.data();
+            size_t body_size = chunk.size - FRAME_OVERHEAD;
+            ByteSpan body(frame + HEADER_SIZE, body_size);
+            auto written = decryption.decrypt_chunk(ConstByteSpan(frame, HEADER_SIZE), body,
+                                                    ConstByteSpan(frame + HEADER_SIZE + body_size, MAC_SIZE),
+                                                    body);
+            // The frame flagged final must be the last one in the input
+            if (!written || decryption.is_complete() != chunk.is_final) {
+                return false;
+            }
+            chunk.offset = HEADER_SIZE;
+            chunk.size = *written;
+            return true;
+        });
+}
+
+StreamSource StreamPipeline::fd_source(int fd) {
+    return [fd](ByteSpan out) -> std::optional<size_t> {
+        while (true) {
+            ssize_t n = ::read(fd, out.data(), out.size());
+            if (n >= 0) {
+                return static_cast<size_t>(n);
+            }
+            if (errno != EINTR) {
+                return std::nullopt;
+            }
+        }
+    };
+}
+
+StreamSink StreamPipeline::fd_sink(int fd) {
+    return [fd](ConstByteSpan data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = ::write(fd, data.data() + written, data.size() - written);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            written += static_cast<size_t>(n);
+        }
+        return true;
+    };
+}
+
 } // namespace crypto
-} // namespace spear
\ No newline at end of file
+} // namespace spear
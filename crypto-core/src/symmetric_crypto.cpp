@@ -1,20 +1,178 @@
 #include "symmetric_crypto.hpp"
 #include "utils.hpp"
+#include "metrics.hpp"
 #include <sodium.h>
+#include <algorithm>
+#include <new>
+#include <utility>
 
 namespace spear {
 namespace crypto {
 
+namespace {
+
+// Little-endian counter in the first 8 bytes of the base nonce
+Nonce nonce_for_counter(const Nonce& base_nonce, uint64_t counter) {
+    Nonce nonce = base_nonce;
+    for (size_t i = 0; i < 8 && i < nonce.size(); ++i) {
+        nonce[i] = static_cast<uint8_t>((counter >> (i * 8)) & 0xFF);
+    }
+    return nonce;
+}
+
+AeadBatchResult run_batch(const std::vector<AeadBatchItem>& items, bool encrypt, ThreadPool* pool) {
+    AeadBatchResult result;
+    result.offsets.resize(items.size() + 1);
+    result.status.assign(items.size(), 0);
+    
+    size_t total_input = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+        size_t input = items[i].input.size();
+        size_t output = encrypt ? input + SymmetricCrypto::TAG_SIZE
+                                : input - std::min(input, SymmetricCrypto::TAG_SIZE);
+        result.offsets[i + 1] = result.offsets[i] + output;
+        total_input += input;
+    }
+    result.arena.resize(result.offsets.back());
+    
+    auto process = [&](size_t i) {
+        const AeadBatchItem& item = items[i];
+        ByteSpan out(result.arena.data() + result.offsets[i], result.offsets[i + 1] - result.offsets[i]);
+        
+        bool ok = item.key != nullptr &&
+            (encrypt ? SymmetricCrypto::encrypt_aead(item.input, *item.key, item.nonce, item.aad, out,
+                                                     item.algorithm)
+                     : SymmetricCrypto::decrypt_aead(item.input, *item.key, item.nonce, item.aad, out,
+                                                     item.algorithm)).has_value();
+        if (ok) {
+            result.status[i] = 1;
+        } else if (!out.empty()) {
+            sodium_memzero(out.data(), out.size());
+        }
+    };
+    
+    if (items.size() > 1 && total_input >= SymmetricCrypto::PARALLEL_BATCH_BYTES) {
+        (pool ? *pool : ThreadPool::shared()).parallel_for(items.size(), process);
+    } else {
+        for (size_t i = 0; i < items.size(); ++i) {
+            process(i);
+        }
+    }
+    
+    return result;
+}
+
+// Contexts are much larger than a SecureBox block, so they get their own
+// slab. Never destroyed, like SecureSlab::shared().
+SecureSlab& context_slab(size_t block_size) {
+    static SecureSlab* slab = new SecureSlab(block_size, 64);
+    return *slab;
+}
+
+} // namespace
+
+bool AeadBatchResult::all_ok() const {
+    return std::all_of(status.begin(), status.end(), [](uint8_t s) { return s != 0; });
+}
+
+bool SymmetricCrypto::is_available(AeadAlgorithm algorithm) {
+    switch (algorithm) {
+        case AeadAlgorithm::ChaCha20Poly1305:
+            return true;
+        case AeadAlgorithm::Aes256Gcm:
+            return crypto_aead_aes256gcm_is_available() == 1;
+    }
+    return false;
+}
+
+AeadAlgorithm SymmetricCrypto::preferred_algorithm() {
+    static const AeadAlgorithm preferred = is_available(AeadAlgorithm::Aes256Gcm)
+        ? AeadAlgorithm::Aes256Gcm
+        : AeadAlgorithm::ChaCha20Poly1305;
+    return preferred;
+}
+
+std::optional<AeadAlgorithm> SymmetricCrypto::algorithm_from_id(uint8_t id) {
+    switch (id) {
+        case static_cast<uint8_t>(AeadAlgorithm::ChaCha20Poly1305):
+            return AeadAlgorithm::ChaCha20Poly1305;
+        case static_cast<uint8_t>(AeadAlgorithm::Aes256Gcm):
+            return AeadAlgorithm::Aes256Gcm;
+    }
+    return std::nullopt;
+}
+
+const char* SymmetricCrypto::algorithm_name(AeadAlgorithm algorithm) {
+    switch (algorithm) {
+        case AeadAlgorithm::ChaCha20Poly1305:
+            return "chacha20-poly1305";
+        case AeadAlgorithm::Aes256Gcm:
+            return "aes-256-gcm";
+    }
+    return "unknown";
+}
+
 std::optional<ByteVector> SymmetricCrypto::encrypt_aead(
     const ByteVector& plaintext,
     const SymmetricKey& key,
     const Nonce& nonce,
-    const ByteVector& aad) {
+    const ByteVector& aad,
+    AeadAlgorithm algorithm) {
+    
+    ByteVector ciphertext(plaintext.size() + TAG_SIZE);
+    
+    auto written = encrypt_aead(plaintext, key, nonce, aad, ciphertext, algorithm);
+    if (!written) {
+        return std::nullopt;
+    }
+    
+    ciphertext.resize(*written);
+    return ciphertext;
+}
+
+std::optional<ByteVector> SymmetricCrypto::decrypt_aead(
+    const ByteVector& ciphertext,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    const ByteVector& aad,
+    AeadAlgorithm algorithm) {
+    
+    if (ciphertext.size() < TAG_SIZE) {
+        return std::nullopt;
+    }
+    
+    ByteVector plaintext(ciphertext.size() - TAG_SIZE);
+    
+    auto written = decrypt_aead(ciphertext, key, nonce, aad, plaintext, algorithm);
+    if (!written) {
+        return std::nullopt;
+    }
+    
+    plaintext.resize(*written);
+    return plaintext;
+}
+
+std::optional<size_t> SymmetricCrypto::encrypt_aead(
+    ConstByteSpan plaintext,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ByteSpan ciphertext,
+    AeadAlgorithm algorithm) {
+    
+    SPEAR_METRICS_TIMER(timer, MetricOp::AeadEncrypt, plaintext.size());
+    if (ciphertext.size() < plaintext.size() + TAG_SIZE || !is_available(algorithm)) {
+        return std::nullopt;
+    }
+    
+    // Both ciphers take a 96-bit nonce: the first 12 bytes of `nonce`
+    auto encrypt = algorithm == AeadAlgorithm::Aes256Gcm
+        ? crypto_aead_aes256gcm_encrypt
+        : crypto_aead_chacha20poly1305_ietf_encrypt;
     
-    ByteVector ciphertext(plaintext.size() + crypto_aead_chacha20poly1305_ietf_ABYTES);
     unsigned long long ciphertext_len;
     
-    if (crypto_aead_chacha20poly1305_ietf_encrypt(
+    if (encrypt(
             ciphertext.data(), &ciphertext_len,
             plaintext.data(), plaintext.size(),
             aad.empty() ? nullptr : aad.data(), aad.size(),
@@ -24,24 +182,31 @@ std::optional<ByteVector> SymmetricCrypto::encrypt_aead(
         return std::nullopt;
     }
     
-    ciphertext.resize(ciphertext_len);
-    return ciphertext;
+    SPEAR_METRICS_SUCCEED(timer);
+    return static_cast<size_t>(ciphertext_len);
 }
 
-std::optional<ByteVector> SymmetricCrypto::decrypt_aead(
-    const ByteVector& ciphertext,
+std::optional<size_t> SymmetricCrypto::decrypt_aead(
+    ConstByteSpan ciphertext,
     const SymmetricKey& key,
     const Nonce& nonce,
-    const ByteVector& aad) {
+    ConstByteSpan aad,
+    ByteSpan plaintext,
+    AeadAlgorithm algorithm) {
     
-    if (ciphertext.size() < crypto_aead_chacha20poly1305_ietf_ABYTES) {
+    SPEAR_METRICS_TIMER(timer, MetricOp::AeadDecrypt, ciphertext.size());
+    if (ciphertext.size() < TAG_SIZE || plaintext.size() < ciphertext.size() - TAG_SIZE ||
+        !is_available(algorithm)) {
         return std::nullopt;
     }
     
-    ByteVector plaintext(ciphertext.size() - crypto_aead_chacha20poly1305_ietf_ABYTES);
+    auto decrypt = algorithm == AeadAlgorithm::Aes256Gcm
+        ? crypto_aead_aes256gcm_decrypt
+        : crypto_aead_chacha20poly1305_ietf_decrypt;
+    
     unsigned long long plaintext_len;
     
-    if (crypto_aead_chacha20poly1305_ietf_decrypt(
+    if (decrypt(
             plaintext.data(), &plaintext_len,
             nullptr,
             ciphertext.data(), ciphertext.size(),
@@ -51,31 +216,326 @@ std::optional<ByteVector> SymmetricCrypto::decrypt_aead(
         return std::nullopt;
     }
     
-    plaintext.resize(plaintext_len);
+    SPEAR_METRICS_SUCCEED(timer);
+    return static_cast<size_t>(plaintext_len);
+}
+
+std::optional<ByteSpan> SymmetricCrypto::encrypt_aead(
+    ConstByteSpan plaintext,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ScratchArena& arena,
+    AeadAlgorithm algorithm) {
+    
+    ByteSpan ciphertext = arena.allocate(plaintext.size() + TAG_SIZE);
+    auto written = encrypt_aead(plaintext, key, nonce, aad, ciphertext, algorithm);
+    if (!written) {
+        return std::nullopt;
+    }
+    return ciphertext.subspan(0, *written);
+}
+
+std::optional<ByteSpan> SymmetricCrypto::decrypt_aead(
+    ConstByteSpan ciphertext,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ScratchArena& arena,
+    AeadAlgorithm algorithm) {
+    
+    if (ciphertext.size() < TAG_SIZE) {
+        return std::nullopt;
+    }
+    
+    ByteSpan plaintext = arena.allocate(ciphertext.size() - TAG_SIZE);
+    auto written = decrypt_aead(ciphertext, key, nonce, aad, plaintext, algorithm);
+    if (!written) {
+        return std::nullopt;
+    }
+    return plaintext.subspan(0, *written);
+}
+
+std::optional<size_t> SymmetricCrypto::encrypt_aead_in_place(
+    ByteSpan buffer,
+    size_t plaintext_len,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    AeadAlgorithm algorithm) {
+    
+    if (plaintext_len > buffer.size()) {
+        return std::nullopt;
+    }
+    
+    return encrypt_aead(buffer.subspan(0, plaintext_len), key, nonce, aad, buffer, algorithm);
+}
+
+std::optional<size_t> SymmetricCrypto::decrypt_aead_in_place(
+    ByteSpan buffer,
+    const SymmetricKey& key,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    AeadAlgorithm algorithm) {
+    
+    return decrypt_aead(buffer, key, nonce, aad, buffer, algorithm);
+}
+
+AeadBatchResult SymmetricCrypto::encrypt_batch(
+    const std::vector<AeadBatchItem>& items,
+    ThreadPool* pool) {
+    
+    return run_batch(items, true, pool);
+}
+
+AeadBatchResult SymmetricCrypto::decrypt_batch(
+    const std::vector<AeadBatchItem>& items,
+    ThreadPool* pool) {
+    
+    return run_batch(items, false, pool);
+}
+
+struct AeadContext::State {
+    crypto_aead_aes256gcm_state aes;
+    SymmetricKey key;
+};
+
+AeadContext::AeadContext()
+    : state_(nullptr), algorithm_(AeadAlgorithm::ChaCha20Poly1305), locked_(false) {
+}
+
+AeadContext::AeadContext(const SymmetricKey& key, AeadAlgorithm algorithm)
+    : state_(nullptr), algorithm_(algorithm), locked_(true) {
+    
+    if (!SymmetricCrypto::is_available(algorithm)) {
+        return;
+    }
+    
+    void* block = context_slab(sizeof(State)).allocate();
+    if (!block) {
+        block = ::operator new(sizeof(State), std::align_val_t(alignof(State)));
+        locked_ = false;
+    }
+    state_ = new (block) State;
+    
+    // ChaCha20 has no key schedule to precompute; AES-GCM expands the round
+    // keys and the GHASH powers of H here instead of on every message
+    if (algorithm == AeadAlgorithm::Aes256Gcm) {
+        if (crypto_aead_aes256gcm_beforenm(&state_->aes, key.data()) != 0) {
+            release();
+        }
+    } else {
+        state_->key = key;
+    }
+}
+
+AeadContext::~AeadContext() {
+    release();
+}
+
+AeadContext::AeadContext(AeadContext&& other) noexcept
+    : state_(std::exchange(other.state_, nullptr)),
+      algorithm_(other.algorithm_),
+      locked_(other.locked_) {
+}
+
+AeadContext& AeadContext::operator=(AeadContext&& other) noexcept {
+    if (this != &other) {
+        release();
+        state_ = std::exchange(other.state_, nullptr);
+        algorithm_ = other.algorithm_;
+        locked_ = other.locked_;
+    }
+    return *this;
+}
+
+void AeadContext::release() {
+    if (!state_) {
+        return;
+    }
+    if (locked_) {
+        context_slab(sizeof(State)).deallocate(state_);
+    } else {
+        sodium_memzero(state_, sizeof(State));
+        ::operator delete(state_, std::align_val_t(alignof(State)));
+    }
+    state_ = nullptr;
+}
+
+std::optional<ByteVector> AeadContext::encrypt(
+    const ByteVector& plaintext,
+    const Nonce& nonce,
+    const ByteVector& aad) const {
+    
+    ByteVector ciphertext(plaintext.size() + SymmetricCrypto::TAG_SIZE);
+    
+    auto written = encrypt(plaintext, nonce, aad, ciphertext);
+    if (!written) {
+        return std::nullopt;
+    }
+    
+    ciphertext.resize(*written);
+    return ciphertext;
+}
+
+std::optional<ByteVector> AeadContext::decrypt(
+    const ByteVector& ciphertext,
+    const Nonce& nonce,
+    const ByteVector& aad) const {
+    
+    if (ciphertext.size() < SymmetricCrypto::TAG_SIZE) {
+        return std::nullopt;
+    }
+    
+    ByteVector plaintext(ciphertext.size() - SymmetricCrypto::TAG_SIZE);
+    
+    auto written = decrypt(ciphertext, nonce, aad, plaintext);
+    if (!written) {
+        return std::nullopt;
+    }
+    
+    plaintext.resize(*written);
     return plaintext;
 }
 
+std::optional<size_t> AeadContext::encrypt(
+    ConstByteSpan plaintext,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ByteSpan ciphertext) const {
+    
+    if (ciphertext.size() < plaintext.size() + SymmetricCrypto::TAG_SIZE ||
+        !encrypt_detached(plaintext, nonce, aad, ciphertext.subspan(0, plaintext.size()),
+                          ciphertext.subspan(plaintext.size(), SymmetricCrypto::TAG_SIZE))) {
+        return std::nullopt;
+    }
+    return plaintext.size() + SymmetricCrypto::TAG_SIZE;
+}
+
+std::optional<size_t> AeadContext::decrypt(
+    ConstByteSpan ciphertext,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ByteSpan plaintext) const {
+    
+    if (ciphertext.size() < SymmetricCrypto::TAG_SIZE) {
+        return std::nullopt;
+    }
+    
+    size_t message_len = ciphertext.size() - SymmetricCrypto::TAG_SIZE;
+    if (plaintext.size() < message_len ||
+        !decrypt_detached(ciphertext.subspan(0, message_len),
+                          ciphertext.subspan(message_len, SymmetricCrypto::TAG_SIZE),
+                          nonce, aad, plaintext.subspan(0, message_len))) {
+        return std::nullopt;
+    }
+    return message_len;
+}
+
+bool AeadContext::encrypt_detached(
+    ConstByteSpan plaintext,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ByteSpan ciphertext,
+    ByteSpan tag) const {
+    
+    SPEAR_METRICS_TIMER(timer, MetricOp::AeadEncrypt, plaintext.size());
+    if (!state_ || ciphertext.size() < plaintext.size() || tag.size() < SymmetricCrypto::TAG_SIZE) {
+        return false;
+    }
+    
+    const unsigned char* ad = aad.empty() ? nullptr : aad.data();
+    
+    int rc = algorithm_ == AeadAlgorithm::Aes256Gcm
+        ? crypto_aead_aes256gcm_encrypt_detached_afternm(
+              ciphertext.data(), tag.data(), nullptr, plaintext.data(), plaintext.size(),
+              ad, aad.size(), nullptr, nonce.data(), &state_->aes)
+        : crypto_aead_chacha20poly1305_ietf_encrypt_detached(
+              ciphertext.data(), tag.data(), nullptr, plaintext.data(), plaintext.size(),
+              ad, aad.size(), nullptr, nonce.data(), state_->key.data());
+    if (rc != 0) {
+        return false;
+    }
+    
+    SPEAR_METRICS_SUCCEED(timer);
+    return true;
+}
+
+bool AeadContext::decrypt_detached(
+    ConstByteSpan ciphertext,
+    ConstByteSpan tag,
+    const Nonce& nonce,
+    ConstByteSpan aad,
+    ByteSpan plaintext) const {
+    
+    SPEAR_METRICS_TIMER(timer, MetricOp::AeadDecrypt, ciphertext.size() + tag.size());
+    if (!state_ || plaintext.size() < ciphertext.size() || tag.size() != SymmetricCrypto::TAG_SIZE) {
+        return false;
+    }
+    
+    const unsigned char* ad = aad.empty() ? nullptr : aad.data();
+    
+    int rc = algorithm_ == AeadAlgorithm::Aes256Gcm
+        ? crypto_aead_aes256gcm_decrypt_detached_afternm(
+              plaintext.data(), nullptr, ciphertext.data(), ciphertext.size(), tag.data(),
+              ad, aad.size(), nonce.data(), &state_->aes)
+        : crypto_aead_chacha20poly1305_ietf_decrypt_detached(
+              plaintext.data(), nullptr, ciphertext.data(), ciphertext.size(), tag.data(),
+              ad, aad.size(), nonce.data(), state_->key.data());
+    if (rc != 0) {
+        return false;
+    }
+    
+    SPEAR_METRICS_SUCCEED(timer);
+    return true;
+}
+
+NonceBlock::NonceBlock(const Nonce& base_nonce, uint64_t begin, uint64_t end)
+    : base_nonce_(base_nonce), next_(begin), end_(end) {
+}
+
+std::optional<Nonce> NonceBlock::next() {
+    if (next_ == end_) {
+        return std::nullopt;
+    }
+    return nonce_for_counter(base_nonce_, next_++);
+}
+
 NonceManager::NonceManager() : counter_(0) {
     utils::random_bytes(base_nonce_.data(), base_nonce_.size());
 }
 
 std::optional<Nonce> NonceManager::next_nonce() {
-    if (counter_ == UINT64_MAX) {
+    // CAS rather than fetch_add so the counter never wraps past UINT64_MAX
+    uint64_t counter = counter_.load(std::memory_order_relaxed);
+    do {
+        if (counter == UINT64_MAX) {
+            return std::nullopt;
+        }
+    } while (!counter_.compare_exchange_weak(counter, counter + 1, std::memory_order_relaxed));
+    
+    return nonce_for_counter(base_nonce_, counter);
+}
+
+std::optional<NonceBlock> NonceManager::reserve_block(uint64_t count) {
+    if (count == 0) {
         return std::nullopt;
     }
     
-    Nonce nonce = base_nonce_;
+    uint64_t begin = counter_.load(std::memory_order_relaxed);
+    uint64_t end;
+    do {
+        if (begin == UINT64_MAX) {
+            return std::nullopt;
+        }
+        end = begin + std::min(count, UINT64_MAX - begin);
+    } while (!counter_.compare_exchange_weak(begin, end, std::memory_order_relaxed));
     
-    for (size_t i = 0; i < 8 && i < nonce.size(); ++i) {
-        nonce[i] = static_cast<uint8_t>((counter_ >> (i * 8)) & 0xFF);
-    }
-    
-    counter_++;
-    return nonce;
+    return NonceBlock(base_nonce_, begin, end);
 }
 
 void NonceManager::reset() {
-    counter_ = 0;
+    counter_.store(0, std::memory_order_relaxed);
     utils::random_bytes(base_nonce_.data(), base_nonce_.size());
 }
 
@@ -0,0 +1,116 @@
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+struct ParallelJob {
+    const std::function<void(size_t)>* fn;
+    size_t count;
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+void run_job(ParallelJob& job) {
+    size_t i;
+    while ((i = job.next.fetch_add(1, std::memory_order_relaxed)) < job.count) {
+        (*job.fn)(i);
+        if (job.done.fetch_add(1, std::memory_order_acq_rel) + 1 == job.count) {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.cv.notify_all();
+        }
+    }
+}
+
+} // namespace
+
+ThreadPool::ThreadPool(size_t num_threads) : stopping_(false) {
+    if (num_threads == 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    workers_.reserve(num_threads);
+    for (size_t i = 0; i < num_threads; ++i) {
+        workers_.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tasks_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0) {
+        return;
+    }
+    if (count == 1 || workers_.empty()) {
+        for (size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+    
+    // Helpers may be dequeued after the job is finished, so they share
+    // ownership of it and never touch fn once every index is claimed.
+    auto job = std::make_shared<ParallelJob>();
+    job->fn = &fn;
+    job->count = count;
+    
+    size_t helpers = std::min(workers_.size(), count - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([job] { run_job(*job); });
+    }
+    
+    run_job(*job);
+    
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->cv.wait(lock, [&] {
+        return job->done.load(std::memory_order_acquire) == job->count;
+    });
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (stopping_ && tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+} // namespace crypto
+} // namespace spear
@@ -1,12 +1,466 @@
 #include "utils.hpp"
 #include <sodium.h>
-#include <sstream>
-#include <iomanip>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define SPEAR_X86_SIMD 1
+#include <immintrin.h>
+#endif
 
 namespace spear {
 namespace crypto {
 namespace utils {
 
+namespace {
+
+const char HEX_DIGITS[] = "0123456789abcdef";
+const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// 0xFF marks bytes outside the alphabet
+struct DecodeTables {
+    uint8_t hex[256];
+    uint8_t base64[256];
+    
+    DecodeTables() {
+        std::memset(hex, 0xFF, sizeof(hex));
+        std::memset(base64, 0xFF, sizeof(base64));
+        for (uint8_t i = 0; i < 10; ++i) {
+            hex['0' + i] = i;
+        }
+        for (uint8_t i = 0; i < 6; ++i) {
+            hex['a' + i] = static_cast<uint8_t>(10 + i);
+            hex['A' + i] = static_cast<uint8_t>(10 + i);
+        }
+        for (uint8_t i = 0; i < 64; ++i) {
+            base64[static_cast<uint8_t>(BASE64_ALPHABET[i])] = i;
+        }
+    }
+};
+
+const DecodeTables& tables() {
+    static const DecodeTables instance;
+    return instance;
+}
+
+// ----------------------------------------------------------------------------
+// Scalar codecs, also used for the tails the vector loops leave behind
+// ----------------------------------------------------------------------------
+
+void hex_encode_scalar(const uint8_t* in, size_t size, char* out) {
+    for (size_t i = 0; i < size; ++i) {
+        out[2 * i] = HEX_DIGITS[in[i] >> 4];
+        out[2 * i + 1] = HEX_DIGITS[in[i] & 0x0F];
+    }
+}
+
+bool hex_decode_scalar(const char* in, size_t out_size, uint8_t* out) {
+    const uint8_t* table = tables().hex;
+    uint8_t invalid = 0;
+    for (size_t i = 0; i < out_size; ++i) {
+        uint8_t hi = table[static_cast<uint8_t>(in[2 * i])];
+        uint8_t lo = table[static_cast<uint8_t>(in[2 * i + 1])];
+        invalid |= (hi | lo) & 0xF0;
+        out[i] = static_cast<uint8_t>((hi << 4) | (lo & 0x0F));
+    }
+    return invalid == 0;
+}
+
+void base64_encode_scalar(const uint8_t* in, size_t size, char* out) {
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        uint32_t v = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8) | in[i + 2];
+        *out++ = BASE64_ALPHABET[(v >> 18) & 0x3F];
+        *out++ = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        *out++ = BASE64_ALPHABET[(v >> 6) & 0x3F];
+        *out++ = BASE64_ALPHABET[v & 0x3F];
+    }
+    
+    if (size - i == 1) {
+        uint32_t v = uint32_t(in[i]) << 16;
+        *out++ = BASE64_ALPHABET[(v >> 18) & 0x3F];
+        *out++ = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        *out++ = '=';
+        *out++ = '=';
+    } else if (size - i == 2) {
+        uint32_t v = (uint32_t(in[i]) << 16) | (uint32_t(in[i + 1]) << 8);
+        *out++ = BASE64_ALPHABET[(v >> 18) & 0x3F];
+        *out++ = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        *out++ = BASE64_ALPHABET[(v >> 6) & 0x3F];
+        *out++ = '=';
+    }
+}
+
+// Decodes whole quanta; only the last one may carry padding, and the bits
+// the padding drops must be zero, matching libsodium's strict decoder
+std::optional<size_t> base64_decode_scalar(const char* in, size_t length, uint8_t* out) {
+    const uint8_t* table = tables().base64;
+    size_t written = 0;
+    
+    for (size_t i = 0; i < length; i += 4) {
+        const uint8_t* q = reinterpret_cast<const uint8_t*>(in + i);
+        bool last = i + 4 == length;
+        size_t pad = 0;
+        if (last) {
+            pad = (q[3] == '=') + (q[3] == '=' && q[2] == '=');
+        }
+        
+        uint8_t a = table[q[0]];
+        uint8_t b = table[q[1]];
+        uint8_t c = pad >= 2 ? 0 : table[q[2]];
+        uint8_t d = pad >= 1 ? 0 : table[q[3]];
+        if ((a | b | c | d) & 0xC0) {
+            return std::nullopt;
+        }
+        
+        uint32_t v = (uint32_t(a) << 18) | (uint32_t(b) << 12) | (uint32_t(c) << 6) | d;
+        out[written++] = static_cast<uint8_t>(v >> 16);
+        if (pad == 2) {
+            if (v & 0xFFFF) {
+                return std::nullopt;
+            }
+            break;
+        }
+        out[written++] = static_cast<uint8_t>(v >> 8);
+        if (pad == 1) {
+            if (v & 0xFF) {
+                return std::nullopt;
+            }
+            break;
+        }
+        out[written++] = static_cast<uint8_t>(v);
+    }
+    
+    return written;
+}
+
+// ----------------------------------------------------------------------------
+// x86 vector codecs (SSSE3 / AVX2), selected once at runtime. Each loop
+// returns how much input it consumed; the scalar code finishes the rest.
+// The base64 kernels follow Muła and Lemire, "Faster Base64 Encoding and
+// Decoding using AVX2 Instructions" (2018).
+// ----------------------------------------------------------------------------
+
+#ifdef SPEAR_X86_SIMD
+
+enum class SimdLevel { None, SSSE3, AVX2 };
+
+SimdLevel simd_level() {
+    static const SimdLevel level = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::AVX2;
+        }
+        if (__builtin_cpu_supports("ssse3")) {
+            return SimdLevel::SSSE3;
+        }
+        return SimdLevel::None;
+    }();
+    return level;
+}
+
+__attribute__((target("ssse3")))
+size_t hex_encode_ssse3(const uint8_t* in, size_t size, char* out) {
+    const __m128i lut = _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), mask));
+        __m128i lo = _mm_shuffle_epi8(lut, _mm_and_si128(v, mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i), _mm_unpacklo_epi8(hi, lo));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 2 * i + 16), _mm_unpackhi_epi8(hi, lo));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t hex_encode_avx2(const uint8_t* in, size_t size, char* out) {
+    const __m256i lut = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(HEX_DIGITS)));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(v, 4), mask));
+        __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(v, mask));
+        
+        // unpack works per 128-bit lane; permute the halves back into order
+        __m256i a = _mm256_unpacklo_epi8(hi, lo);
+        __m256i b = _mm256_unpackhi_epi8(hi, lo);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i), _mm256_permute2x128_si256(a, b, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 2 * i + 32), _mm256_permute2x128_si256(a, b, 0x31));
+    }
+    return i;
+}
+
+// Maps 16 hex characters to nibble values; `valid` collects the lanes that
+// were digits or letters
+__attribute__((target("ssse3")))
+inline __m128i hex_nibbles_ssse3(__m128i c, __m128i& valid) {
+    __m128i digit = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+    __m128i letter = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+    __m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+    __m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+    valid = _mm_and_si128(valid, _mm_or_si128(is_digit, is_letter));
+    return _mm_or_si128(_mm_and_si128(is_digit, digit),
+                        _mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+__attribute__((target("ssse3")))
+size_t hex_decode_ssse3(const char* in, size_t out_size, uint8_t* out, bool& ok) {
+    const __m128i weights = _mm_set1_epi16(0x0110);
+    __m128i valid = _mm_set1_epi8(-1);
+    
+    size_t i = 0;
+    for (; i + 16 <= out_size; i += 16) {
+        __m128i c0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        __m128i c1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16));
+        __m128i n0 = _mm_maddubs_epi16(hex_nibbles_ssse3(c0, valid), weights);
+        __m128i n1 = _mm_maddubs_epi16(hex_nibbles_ssse3(c1, valid), weights);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(n0, n1));
+    }
+    ok = _mm_movemask_epi8(valid) == 0xFFFF;
+    return i;
+}
+
+__attribute__((target("avx2")))
+inline __m256i hex_nibbles_avx2(__m256i c, __m256i& valid) {
+    __m256i digit = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+    __m256i letter = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+    __m256i is_digit = _mm256_cmpeq_epi8(_mm256_min_epu8(digit, _mm256_set1_epi8(9)), digit);
+    __m256i is_letter = _mm256_cmpeq_epi8(_mm256_min_epu8(letter, _mm256_set1_epi8(5)), letter);
+    valid = _mm256_and_si256(valid, _mm256_or_si256(is_digit, is_letter));
+    return _mm256_or_si256(_mm256_and_si256(is_digit, digit),
+                           _mm256_and_si256(is_letter, _mm256_add_epi8(letter, _mm256_set1_epi8(10))));
+}
+
+__attribute__((target("avx2")))
+size_t hex_decode_avx2(const char* in, size_t out_size, uint8_t* out, bool& ok) {
+    const __m256i weights = _mm256_set1_epi16(0x0110);
+    __m256i valid = _mm256_set1_epi8(-1);
+    
+    size_t i = 0;
+    for (; i + 32 <= out_size; i += 32) {
+        __m256i c0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i));
+        __m256i c1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + 2 * i + 32));
+        __m256i n0 = _mm256_maddubs_epi16(hex_nibbles_avx2(c0, valid), weights);
+        __m256i n1 = _mm256_maddubs_epi16(hex_nibbles_avx2(c1, valid), weights);
+        __m256i packed = _mm256_packus_epi16(n0, n1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+    }
+    ok = static_cast<uint32_t>(_mm256_movemask_epi8(valid)) == 0xFFFFFFFFu;
+    return i;
+}
+
+// Spreads 12 input bytes per lane into sixteen 6-bit indices
+__attribute__((target("ssse3")))
+inline __m128i base64_indices_ssse3(__m128i in) {
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0FC0FC00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003F03F0)), _mm_set1_epi32(0x01000010));
+    return _mm_or_si128(t0, t1);
+}
+
+__attribute__((target("ssse3")))
+inline __m128i base64_ascii_ssse3(__m128i indices) {
+    const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                          '+' - 62, '/' - 63, 'A', 0, 0);
+    __m128i reduced = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+    reduced = _mm_or_si128(reduced, _mm_and_si128(less, _mm_set1_epi8(13)));
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, reduced), indices);
+}
+
+__attribute__((target("ssse3")))
+size_t base64_encode_ssse3(const uint8_t* in, size_t size, char* out) {
+    size_t i = 0;
+    for (; i + 16 <= size; i += 12) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 3 * 4),
+                         base64_ascii_ssse3(base64_indices_ssse3(v)));
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t base64_encode_avx2(const uint8_t* in, size_t size, char* out) {
+    const __m256i shuffle = _mm256_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+                                             1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '+' - 62, '/' - 63, 'A', 0, 0,
+                                             'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                             '+' - 62, '/' - 63, 'A', 0, 0);
+    
+    size_t i = 0;
+    for (; i + 28 <= size; i += 24) {
+        // Each lane takes 12 bytes: [i, i + 12) and [i + 12, i + 24)
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(v, _mm256_set1_epi32(0x0FC0FC00)),
+                                        _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(v, _mm256_set1_epi32(0x003F03F0)),
+                                        _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+        
+        __m256i reduced = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+        reduced = _mm256_or_si256(reduced, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+        __m256i ascii = _mm256_add_epi8(_mm256_shuffle_epi8(offsets, reduced), indices);
+        
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i / 3 * 4), ascii);
+    }
+    return i;
+}
+
+// Translates 16 base64 characters to 6-bit values; returns false if any lane
+// is outside the alphabet (padding included)
+__attribute__((target("ssse3")))
+inline bool base64_values_ssse3(__m128i in, __m128i& values) {
+    const __m128i lut_lo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                         0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m128i lut_hi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                         0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lut_roll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(in, 4), mask);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, _mm_and_si128(in, mask));
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0xFFFF) {
+        return false;
+    }
+    
+    __m128i roll = _mm_shuffle_epi8(lut_roll,
+        _mm_add_epi8(_mm_cmpeq_epi8(in, _mm_set1_epi8('/')), hi_nibbles));
+    values = _mm_add_epi8(in, roll);
+    return true;
+}
+
+__attribute__((target("ssse3")))
+size_t base64_decode_ssse3(const char* in, size_t length, uint8_t* out) {
+    const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    alignas(16) uint8_t block[16];
+    
+    // The final quantum may hold padding, so it is always left to the scalar path
+    size_t i = 0;
+    for (; i + 20 <= length; i += 16) {
+        __m128i values;
+        if (!base64_values_ssse3(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), values)) {
+            break;
+        }
+        
+        __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+        merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+        _mm_store_si128(reinterpret_cast<__m128i*>(block), _mm_shuffle_epi8(merged, pack));
+        std::memcpy(out + i / 4 * 3, block, 12);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+size_t base64_decode_avx2(const char* in, size_t length, uint8_t* out) {
+    const __m256i lut_lo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+                                            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                            0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+    const __m256i lut_hi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+                                            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+                                            0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lut_roll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+                                              0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i pack = _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+                                          2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    alignas(32) uint8_t block[32];
+    
+    size_t i = 0;
+    for (; i + 36 <= length; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hi_nibbles = _mm256_and_si256(_mm256_srli_epi32(v, 4), mask);
+        __m256i lo = _mm256_shuffle_epi8(lut_lo, _mm256_and_si256(v, mask));
+        __m256i hi = _mm256_shuffle_epi8(lut_hi, hi_nibbles);
+        if (!_mm256_testz_si256(lo, hi)) {
+            break;
+        }
+        
+        __m256i roll = _mm256_shuffle_epi8(lut_roll,
+            _mm256_add_epi8(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('/')), hi_nibbles));
+        __m256i values = _mm256_add_epi8(v, roll);
+        
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, pack);
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(block), merged);
+        std::memcpy(out + i / 4 * 3, block, 24);
+    }
+    return i;
+}
+
+#endif // SPEAR_X86_SIMD
+
+size_t hex_encode_fast(const uint8_t* in, size_t size, char* out) {
+#ifdef SPEAR_X86_SIMD
+    switch (simd_level()) {
+        case SimdLevel::AVX2: return hex_encode_avx2(in, size, out);
+        case SimdLevel::SSSE3: return hex_encode_ssse3(in, size, out);
+        case SimdLevel::None: break;
+    }
+#endif
+    (void)in; (void)size; (void)out;
+    return 0;
+}
+
+size_t hex_decode_fast(const char* in, size_t out_size, uint8_t* out, bool& ok) {
+    ok = true;
+#ifdef SPEAR_X86_SIMD
+    switch (simd_level()) {
+        case SimdLevel::AVX2: return hex_decode_avx2(in, out_size, out, ok);
+        case SimdLevel::SSSE3: return hex_decode_ssse3(in, out_size, out, ok);
+        case SimdLevel::None: break;
+    }
+#endif
+    (void)in; (void)out_size; (void)out;
+    return 0;
+}
+
+size_t base64_encode_fast(const uint8_t* in, size_t size, char* out) {
+#ifdef SPEAR_X86_SIMD
+    switch (simd_level()) {
+        case SimdLevel::AVX2: return base64_encode_avx2(in, size, out);
+        case SimdLevel::SSSE3: return base64_encode_ssse3(in, size, out);
+        case SimdLevel::None: break;
+    }
+#endif
+    (void)in; (void)size; (void)out;
+    return 0;
+}
+
+// Stops early at the first block holding a character outside the alphabet;
+// the scalar decoder then reports the error (or handles the padding)
+size_t base64_decode_fast(const char* in, size_t length, uint8_t* out) {
+#ifdef SPEAR_X86_SIMD
+    switch (simd_level()) {
+        case SimdLevel::AVX2: return base64_decode_avx2(in, length, out);
+        case SimdLevel::SSSE3: return base64_decode_ssse3(in, length, out);
+        case SimdLevel::None: break;
+    }
+#endif
+    (void)in; (void)length; (void)out;
+    return 0;
+}
+
+} // namespace
+
 bool initialize() {
     return sodium_init() >= 0;
 }
@@ -26,60 +480,108 @@ void secure_memzero(void* ptr, size_t size) {
     sodium_memzero(ptr, size);
 }
 
-std::string to_hex(const uint8_t* data, size_t size) {
-    std::ostringstream oss;
-    oss << std::hex << std::setfill('0');
-    for (size_t i = 0; i < size; ++i) {
-        oss << std::setw(2) << static_cast<int>(data[i]);
-    }
-    return oss.str();
+size_t hex_encoded_size(size_t size) {
+    return size * 2;
 }
 
-ByteVector from_hex(const std::string& hex) {
-    if (hex.length() % 2 != 0) {
-        return {};
+size_t base64_encoded_size(size_t size) {
+    return (size + 2) / 3 * 4;
+}
+
+size_t base64_decoded_max_size(size_t length) {
+    return length / 4 * 3;
+}
+
+std::optional<size_t> to_hex(ConstByteSpan data, char* out, size_t out_size) {
+    size_t needed = hex_encoded_size(data.size());
+    if (out_size < needed) {
+        return std::nullopt;
     }
     
-    ByteVector result;
-    result.reserve(hex.length() / 2);
-    
-    for (size_t i = 0; i < hex.length(); i += 2) {
-        std::string byte_str = hex.substr(i, 2);
-        uint8_t byte = static_cast<uint8_t>(std::stoi(byte_str, nullptr, 16));
-        result.push_back(byte);
+    size_t done = hex_encode_fast(data.data(), data.size(), out);
+    hex_encode_scalar(data.data() + done, data.size() - done, out + 2 * done);
+    return needed;
+}
+
+std::optional<size_t> from_hex(std::string_view hex, ByteSpan out) {
+    size_t needed = hex.size() / 2;
+    if (hex.size() % 2 != 0 || out.size() < needed) {
+        return std::nullopt;
     }
     
-    return result;
+    bool ok = true;
+    size_t done = hex_decode_fast(hex.data(), needed, out.data(), ok);
+    if (!ok || !hex_decode_scalar(hex.data() + 2 * done, needed - done, out.data() + done)) {
+        return std::nullopt;
+    }
+    return needed;
 }
 
-std::string to_base64(const uint8_t* data, size_t size) {
-    size_t b64_len = sodium_base64_encoded_len(size, sodium_base64_VARIANT_ORIGINAL);
-    std::string result(b64_len, '\0');
+std::optional<size_t> to_base64(ConstByteSpan data, char* out, size_t out_size) {
+    size_t needed = base64_encoded_size(data.size());
+    if (out_size < needed) {
+        return std::nullopt;
+    }
     
-    sodium_bin2base64(result.data(), b64_len, data, size, sodium_base64_VARIANT_ORIGINAL);
+    size_t done = base64_encode_fast(data.data(), data.size(), out);
+    base64_encode_scalar(data.data() + done, data.size() - done, out + done / 3 * 4);
+    return needed;
+}
+
+std::optional<size_t> from_base64(std::string_view base64, ByteSpan out) {
+    if (base64.size() % 4 != 0) {
+        return std::nullopt;
+    }
     
-    if (!result.empty() && result.back() == '\0') {
-        result.pop_back();
+    // Padding trims up to two bytes from the last quantum
+    size_t padding = 0;
+    if (!base64.empty() && base64.back() == '=') {
+        padding = base64[base64.size() - 2] == '=' ? 2 : 1;
+    }
+    if (out.size() < base64_decoded_max_size(base64.size()) - padding) {
+        return std::nullopt;
     }
     
+    size_t done = base64_decode_fast(base64.data(), base64.size(), out.data());
+    auto tail = base64_decode_scalar(base64.data() + done, base64.size() - done,
+                                     out.data() + done / 4 * 3);
+    if (!tail) {
+        return std::nullopt;
+    }
+    return done / 4 * 3 + *tail;
+}
+
+std::string to_hex(const uint8_t* data, size_t size) {
+    std::string result(hex_encoded_size(size), '\0');
+    to_hex(ConstByteSpan(data, size), result.data(), result.size());
+    return result;
+}
+
+ByteVector from_hex(const std::string& hex) {
+    ByteVector result(hex.size() / 2);
+    if (!from_hex(hex, result)) {
+        return {};
+    }
+    return result;
+}
+
+std::string to_base64(const uint8_t* data, size_t size) {
+    std::string result(base64_encoded_size(size), '\0');
+    to_base64(ConstByteSpan(data, size), result.data(), result.size());
     return result;
 }
 
 ByteVector from_base64(const std::string& base64) {
-    ByteVector result(base64.length());
-    size_t bin_len;
-    
-    if (sodium_base642bin(result.data(), result.size(),
-                          base64.c_str(), base64.length(),
-                          nullptr, &bin_len, nullptr,
-                          sodium_base64_VARIANT_ORIGINAL) != 0) {
+    ByteVector result(base64_decoded_max_size(base64.size()));
+    auto written = from_base64(base64, result);
+    if (!written) {
         return {};
     }
     
-    result.resize(bin_len);
+    result.resize(*written);
     return result;
 }
 
 } // namespace utils
 } // namespace crypto
-} // namespace spear
\ No newline at end of file
+} // namespace spear
@@ -0,0 +1,135 @@
+#include "wire_codec.hpp"
+#include "endian.hpp"
+#include <cstring>
+
+namespace spear {
+namespace crypto {
+
+namespace {
+
+constexpr uint8_t WIRE_MAGIC[4] = {'S', 'P', 'R', 'W'};
+constexpr size_t NONCE_OFFSET = 40;
+constexpr size_t SIGNATURE_OFFSET = NONCE_OFFSET + NONCE_SIZE;
+
+bool valid_sizes(size_t sender, size_t recipient, size_t nonce, size_t signature, size_t content) {
+    return sender > 0 && sender <= WireCodec::MAX_NAME_SIZE && recipient <= WireCodec::MAX_NAME_SIZE &&
+           nonce == NONCE_SIZE && signature == SIGNATURE_SIZE &&
+           content >= MAC_SIZE && content <= WireCodec::MAX_CONTENT_SIZE;
+}
+
+} // namespace
+
+size_t WireCodec::encoded_size(const WireMessage& message) {
+    const MessageRecord& record = message.record;
+    if (!valid_sizes(record.sender.size(), message.recipient.size(), record.nonce.size(),
+                     record.signature.size(), record.content.size())) {
+        return 0;
+    }
+    return HEADER_SIZE + record.sender.size() + message.recipient.size() + record.content.size();
+}
+
+std::optional<size_t> WireCodec::encode(const WireMessage& message, ByteSpan out) {
+    size_t size = encoded_size(message);
+    if (size == 0 || out.size() < size) {
+        return std::nullopt;
+    }
+    
+    const MessageRecord& record = message.record;
+    uint8_t* header = out.data();
+    std::memcpy(header, WIRE_MAGIC, sizeof(WIRE_MAGIC));
+    header[4] = VERSION;
+    header[5] = 0;
+    put_u16(header + 6, static_cast<uint16_t>(record.sender.size()));
+    put_u16(header + 8, static_cast<uint16_t>(message.recipient.size()));
+    put_u16(header + 10, 0);
+    put_u32(header + 12, static_cast<uint32_t>(record.content.size()));
+    put_u64(header + 16, record.counter);
+    put_u64(header + 24, record.id);
+    put_u64(header + 32, record.timestamp_ms);
+    std::memcpy(header + NONCE_OFFSET, record.nonce.data(), NONCE_SIZE);
+    std::memcpy(header + SIGNATURE_OFFSET, record.signature.data(), SIGNATURE_SIZE);
+    
+    uint8_t* body = header + HEADER_SIZE;
+    std::memcpy(body, record.sender.data(), record.sender.size());
+    body += record.sender.size();
+    if (!message.recipient.empty()) {
+        std::memcpy(body, message.recipient.data(), message.recipient.size());
+        body += message.recipient.size();
+    }
+    std::memcpy(body, record.content.data(), record.content.size());
+    return size;
+}
+
+std::optional<ByteVector> WireCodec::encode(const WireMessage& message) {
+    ByteVector out;
+    if (!append(message, out)) {
+        return std::nullopt;
+    }
+    return out;
+}
+
+bool WireCodec::append(const WireMessage& message, ByteVector& out) {
+    size_t size = encoded_size(message);
+    if (size == 0) {
+        return false;
+    }
+    size_t offset = out.size();
+    out.resize(offset + size);
+    return encode(message, ByteSpan(out.data() + offset, size)).has_value();
+}
+
+std::optional<WireMessage> WireCodec::decode(ConstByteSpan data, size_t* consumed) {
+    if (data.size() < HEADER_SIZE) {
+        return std::nullopt;
+    }
+    
+    const uint8_t* header = data.data();
+    if (std::memcmp(header, WIRE_MAGIC, sizeof(WIRE_MAGIC)) != 0 || header[4] != VERSION ||
+        header[5] != 0 || get_u16(header + 10) != 0) {
+        return std::nullopt;
+    }
+    
+    size_t sender_len = get_u16(header + 6);
+    size_t recipient_len = get_u16(header + 8);
+    size_t content_len = get_u32(header + 12);
+    if (!valid_sizes(sender_len, recipient_len, NONCE_SIZE, SIGNATURE_SIZE, content_len)) {
+        return std::nullopt;
+    }
+    size_t size = HEADER_SIZE + sender_len + recipient_len + content_len;
+    if (data.size() < size) {
+        return std::nullopt;
+    }
+    
+    const char* names = reinterpret_cast<const char*>(header + HEADER_SIZE);
+    WireMessage message;
+    message.recipient = std::string_view(names + sender_len, recipient_len);
+    message.record.counter = get_u64(header + 16);
+    message.record.id = get_u64(header + 24);
+    message.record.timestamp_ms = get_u64(header + 32);
+    message.record.sender = std::string_view(names, sender_len);
+    message.record.nonce = data.subspan(NONCE_OFFSET, NONCE_SIZE);
+    message.record.signature = data.subspan(SIGNATURE_OFFSET, SIGNATURE_SIZE);
+    message.record.content = data.subspan(HEADER_SIZE + sender_len + recipient_len, content_len);
+    if (consumed != nullptr) {
+        *consumed = size;
+    }
+    return message;
+}
+
+std::optional<std::vector<WireMessage>> WireCodec::decode_all(ConstByteSpan data) {
+    std::vector<WireMessage> messages;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        size_t consumed = 0;
+        auto message = decode(data.subspan(offset, data.size() - offset), &consumed);
+        if (!message) {
+            return std::nullopt;
+        }
+        messages.push_back(*message);
+        offset += consumed;
+    }
+    return messages;
+}
+
+} // namespace crypto
+} // namespace spear
@@ -5,8 +5,29 @@
 #include "../include/symmetric_crypto.hpp"
 #include "../include/signing.hpp"
 #include "../include/streaming.hpp"
+#include "../include/session_cache.hpp"
+#include "../include/container.hpp"
+#include "../include/file_crypto.hpp"
+#include "../include/async_file_crypto.hpp"
+#include "../include/wire_codec.hpp"
+#include "../include/message_store.hpp"
+#include "../include/replay_window.hpp"
+#include "../include/secure_memory.hpp"
+#include "../include/metrics.hpp"
+#include "../include/key_pool.hpp"
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace spear::crypto;
 
@@ -58,6 +79,67 @@ void test_utils() {
     } else {
         test_fail("base64 encode/decode");
     }
+    
+    const char* vectors[][2] = {{"", ""}, {"f", "Zg=="}, {"fo", "Zm8="}, {"foo", "Zm9v"},
+                                {"foob", "Zm9vYg=="}, {"fooba", "Zm9vYmE="}, {"foobar", "Zm9vYmFy"}};
+    bool vectors_ok = true;
+    for (auto& v : vectors) {
+        const uint8_t* raw = reinterpret_cast<const uint8_t*>(v[0]);
+        ByteVector decoded_vector = utils::from_base64(v[1]);
+        vectors_ok = vectors_ok && utils::to_base64(raw, std::strlen(v[0])) == v[1] &&
+                     ByteVector(raw, raw + std::strlen(v[0])) == decoded_vector;
+    }
+    if (vectors_ok) {
+        test_pass("base64 RFC 4648 vectors");
+    } else {
+        test_fail("base64 RFC 4648 vectors");
+    }
+    
+    // Lengths straddle the vector block sizes, so prefixes of one buffer
+    // exercise both the vector and scalar paths against each other
+    ByteVector sample(1500);
+    utils::random_bytes(sample.data(), sample.size());
+    std::string full_hex = utils::to_hex(sample.data(), sample.size());
+    std::string full_b64 = utils::to_base64(sample.data(), sample.size());
+    bool codecs_ok = true;
+    for (size_t len = 0; len <= sample.size(); len += (len < 200 ? 1 : 97)) {
+        std::string h = utils::to_hex(sample.data(), len);
+        std::string b = utils::to_base64(sample.data(), len);
+        ByteVector prefix(sample.begin(), sample.begin() + len);
+        codecs_ok = codecs_ok && h == full_hex.substr(0, 2 * len) &&
+                    b.substr(0, len / 3 * 4) == full_b64.substr(0, len / 3 * 4) &&
+                    utils::from_hex(h) == prefix && utils::from_base64(b) == prefix;
+    }
+    std::string upper = full_hex;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    if (codecs_ok && utils::from_hex(upper) == sample) {
+        test_pass("hex/base64 vector and scalar paths agree");
+    } else {
+        test_fail("hex/base64 vector and scalar paths agree");
+    }
+    
+    std::string bad_hex = full_hex;
+    bad_hex[700] = 'g';
+    std::string bad_b64 = full_b64;
+    bad_b64[300] = '*';
+    if (utils::from_hex(bad_hex).empty() && utils::from_hex("abc").empty() &&
+        utils::from_base64(bad_b64).empty() && utils::from_base64("Zg=").empty() &&
+        utils::from_base64("Zh==").empty() && utils::from_base64("Zg==Zg==").empty()) {
+        test_pass("malformed hex/base64 rejected without throwing");
+    } else {
+        test_fail("malformed hex/base64 rejected without throwing");
+    }
+    
+    char small[8];
+    uint8_t small_out[2];
+    auto hex_written = utils::to_hex(ConstByteSpan(test_data, 4), small, sizeof(small));
+    if (hex_written && *hex_written == 8 &&
+        !utils::to_hex(ConstByteSpan(test_data, 5), small, sizeof(small)) &&
+        !utils::from_base64("Zm9v", ByteSpan(small_out, sizeof(small_out)))) {
+        test_pass("caller-buffer codecs check output size");
+    } else {
+        test_fail("caller-buffer codecs check output size");
+    }
 }
 
 void test_key_management() {
@@ -91,6 +173,54 @@ void test_key_management() {
     } else {
         test_fail("generate_signing_keypair");
     }
+    
+    // Bulk pairs must be distinct and usable: pair i and i+1 agree on a secret
+    auto bulk = KeyManagement::generate_keypairs(300);
+    auto signing_bulk = KeyManagement::generate_signing_keypairs(70);
+    bool bulk_ok = bulk && bulk->size() == 300 && signing_bulk && signing_bulk->size() == 70;
+    if (bulk_ok) {
+        std::set<PublicKey> distinct;
+        for (const KeyPair& pair : *bulk) {
+            distinct.insert(pair.public_key);
+        }
+        auto ab = KeyExchange::derive_shared_secret((*bulk)[298].secret_key, (*bulk)[299].public_key);
+        auto ba = KeyExchange::derive_shared_secret((*bulk)[299].secret_key, (*bulk)[298].public_key);
+        ByteVector message = {'b', 'u', 'l', 'k'};
+        auto signature = Signing::sign_message(message, (*signing_bulk)[69].secret_key);
+        bulk_ok = distinct.size() == 300 && ab && ba && *ab == *ba && signature &&
+                  Signing::verify_signature(message, *signature, (*signing_bulk)[69].public_key);
+    }
+    if (bulk_ok) {
+        test_pass("generate_keypairs/generate_signing_keypairs in bulk");
+    } else {
+        test_fail("generate_keypairs/generate_signing_keypairs in bulk");
+    }
+    
+    {
+        KeyPool pool(16, 4);
+        bool filled = pool.wait_full();
+        KeyPool::Stats full = pool.stats();
+        
+        std::set<PublicKey> taken;
+        for (int i = 0; i < 20; ++i) {
+            auto pair = pool.take_keypair();
+            if (pair) {
+                taken.insert(pair->public_key);
+            }
+        }
+        auto signing_pair = pool.take_signing_keypair();
+        KeyPool::Stats drained = pool.stats();
+        bool refilled_ok = pool.wait_full();
+        KeyPool::Stats refilled = pool.stats();
+        
+        if (filled && refilled_ok && full.keypairs == 16 && full.signing_keypairs == 16 && taken.size() == 20 && signing_pair &&
+            drained.hits + drained.misses == 21 && drained.hits >= 17 &&
+            refilled.keypairs == 16 && refilled.signing_keypairs == 16) {
+            test_pass("KeyPool serves pre-generated keys and refills");
+        } else {
+            test_fail("KeyPool serves pre-generated keys and refills");
+        }
+    }
 }
 
 void test_key_exchange() {
@@ -126,6 +256,63 @@ void test_key_exchange() {
     } else {
         test_fail("derive_session_key");
     }
+    
+    SessionKeyCache cache(2);
+    auto cached1 = cache.shared_secret("kp1", kp1->secret_key, kp2->public_key);
+    auto cached2 = cache.shared_secret("kp1", kp1->secret_key, kp2->public_key);
+    SessionKeyCache::Stats stats = cache.stats();
+    if (cached1 && cached2 && *cached1 == *secret1 && *cached2 == *secret1 &&
+        stats.hits == 1 && stats.misses == 1) {
+        test_pass("SessionKeyCache serves repeat peers from cache");
+    } else {
+        test_fail("SessionKeyCache serves repeat peers from cache");
+    }
+    
+    auto cached_session = cache.session_key("kp1", kp1->secret_key, kp2->public_key, "test-context");
+    if (cached_session &&
+        ByteVector(cached_session->begin(), cached_session->end()) == session_key) {
+        test_pass("SessionKeyCache session_key matches derive_session_key");
+    } else {
+        test_fail("SessionKeyCache session_key matches derive_session_key");
+    }
+    
+    cache.session_key("kp1", kp1->secret_key, kp2->public_key, "other-ctx");
+    stats = cache.stats();
+    cache.erase_local_key("kp1");
+    if (stats.size == 2 && stats.evictions == 1 && cache.stats().size == 0) {
+        test_pass("SessionKeyCache LRU eviction and erase");
+    } else {
+        test_fail("SessionKeyCache LRU eviction and erase");
+    }
+    
+    SessionKeyCache expiring(4, std::chrono::seconds(0));
+    expiring.shared_secret("kp1", kp1->secret_key, kp2->public_key);
+    expiring.shared_secret("kp1", kp1->secret_key, kp2->public_key);
+    if (expiring.stats().hits == 0 && expiring.stats().misses == 2) {
+        test_pass("SessionKeyCache TTL expiry");
+    } else {
+        test_fail("SessionKeyCache TTL expiry");
+    }
+    
+    SessionKeyCache contexts(4);
+    auto session_aead = contexts.session_context("kp1", kp1->secret_key, kp2->public_key, "test-context",
+                                                 AeadAlgorithm::ChaCha20Poly1305);
+    auto again = contexts.session_context("kp1", kp1->secret_key, kp2->public_key, "test-context",
+                                          AeadAlgorithm::ChaCha20Poly1305);
+    SymmetricKey derived_key;
+    std::copy(session_key.begin(), session_key.end(), derived_key.begin());
+    Nonce session_nonce = utils::random_nonce();
+    ByteVector note = {'h', 'i'};
+    auto via_context = session_aead ? session_aead->encrypt(note, session_nonce) : std::nullopt;
+    contexts.clear();
+    auto rebuilt = contexts.session_context("kp1", kp1->secret_key, kp2->public_key, "test-context",
+                                            AeadAlgorithm::ChaCha20Poly1305);
+    if (session_aead && again == session_aead && rebuilt && rebuilt != session_aead && via_context &&
+        *via_context == *SymmetricCrypto::encrypt_aead(note, derived_key, session_nonce)) {
+        test_pass("SessionKeyCache shares one AeadContext per session key");
+    } else {
+        test_fail("SessionKeyCache shares one AeadContext per session key");
+    }
 }
 
 void test_symmetric_crypto() {
@@ -169,6 +356,122 @@ void test_symmetric_crypto() {
         test_fail("encrypt/decrypt with AAD");
     }
     
+    ByteVector span_ciphertext(plaintext.size() + SymmetricCrypto::TAG_SIZE);
+    auto span_written = SymmetricCrypto::encrypt_aead(plaintext, key, nonce, {}, span_ciphertext);
+    if (span_written && *span_written == span_ciphertext.size() && span_ciphertext == *ciphertext) {
+        test_pass("encrypt_aead into caller buffer");
+    } else {
+        test_fail("encrypt_aead into caller buffer");
+    }
+    
+    ByteVector too_small(plaintext.size());
+    if (!SymmetricCrypto::encrypt_aead(plaintext, key, nonce, {}, too_small)) {
+        test_pass("encrypt_aead rejects short output buffer");
+    } else {
+        test_fail("encrypt_aead rejects short output buffer");
+    }
+    
+    ByteVector in_place(plaintext);
+    in_place.resize(plaintext.size() + SymmetricCrypto::TAG_SIZE);
+    auto sealed_len = SymmetricCrypto::encrypt_aead_in_place(in_place, plaintext.size(), key, nonce, aad);
+    auto opened_len = sealed_len
+        ? SymmetricCrypto::decrypt_aead_in_place(ByteSpan(in_place.data(), *sealed_len), key, nonce, aad)
+        : std::nullopt;
+    if (opened_len && *opened_len == plaintext.size() &&
+        ByteVector(in_place.begin(), in_place.begin() + *opened_len) == plaintext) {
+        test_pass("encrypt/decrypt in place");
+    } else {
+        test_fail("encrypt/decrypt in place");
+    }
+    
+    if (SymmetricCrypto::is_available(AeadAlgorithm::Aes256Gcm)) {
+        auto gcm = SymmetricCrypto::encrypt_aead(plaintext, key, nonce, aad, AeadAlgorithm::Aes256Gcm);
+        auto chacha = SymmetricCrypto::encrypt_aead(plaintext, key, nonce, aad);
+        auto gcm_opened = gcm
+            ? SymmetricCrypto::decrypt_aead(*gcm, key, nonce, aad, AeadAlgorithm::Aes256Gcm)
+            : std::nullopt;
+        if (gcm_opened && *gcm_opened == plaintext && *gcm != *chacha &&
+            !SymmetricCrypto::decrypt_aead(*gcm, key, nonce, aad)) {
+            test_pass("AES-256-GCM encrypt/decrypt");
+        } else {
+            test_fail("AES-256-GCM encrypt/decrypt");
+        }
+    } else {
+        std::cout << "[SKIP] AES-256-GCM not supported by this CPU" << std::endl;
+    }
+    
+    SymmetricKey key2;
+    utils::random_bytes(key2.data(), key2.size());
+    std::vector<ByteVector> messages(300);
+    std::vector<AeadBatchItem> batch(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        messages[i].resize(i * 3);
+        utils::random_bytes(messages[i].data(), messages[i].size());
+        batch[i].input = messages[i];
+        batch[i].key = i % 2 ? &key2 : &key;
+        batch[i].nonce = utils::random_nonce();
+        batch[i].aad = aad;
+    }
+    
+    ThreadPool batch_pool(4);
+    AeadBatchResult sealed_batch = SymmetricCrypto::encrypt_batch(batch, &batch_pool);
+    bool batch_matches = sealed_batch.all_ok() && sealed_batch.size() == messages.size();
+    for (size_t i = 0; batch_matches && i < messages.size(); ++i) {
+        auto single = SymmetricCrypto::encrypt_aead(messages[i], *batch[i].key, batch[i].nonce, aad);
+        ConstByteSpan out = sealed_batch.output(i);
+        batch_matches = ByteVector(out.data(), out.data() + out.size()) == *single;
+    }
+    if (batch_matches) {
+        test_pass("encrypt_batch matches single-message encryption");
+    } else {
+        test_fail("encrypt_batch matches single-message encryption");
+    }
+    
+    std::vector<AeadBatchItem> open_batch(batch);
+    ByteVector tampered_arena(sealed_batch.arena);
+    for (size_t i = 0; i < open_batch.size(); ++i) {
+        open_batch[i].input = ConstByteSpan(tampered_arena).subspan(
+            sealed_batch.offsets[i], sealed_batch.offsets[i + 1] - sealed_batch.offsets[i]);
+    }
+    tampered_arena[sealed_batch.offsets[7]] ^= 1;
+    
+    AeadBatchResult opened_batch = SymmetricCrypto::decrypt_batch(open_batch, &batch_pool);
+    bool batch_opened = !opened_batch.ok(7) && !opened_batch.all_ok();
+    for (size_t i = 0; batch_opened && i < messages.size(); ++i) {
+        ConstByteSpan out = opened_batch.output(i);
+        ByteVector expected = i == 7 ? ByteVector(messages[i].size(), 0) : messages[i];
+        batch_opened = (i == 7 || opened_batch.ok(i)) &&
+                       ByteVector(out.data(), out.data() + out.size()) == expected;
+    }
+    if (batch_opened) {
+        test_pass("decrypt_batch isolates a tampered message");
+    } else {
+        test_fail("decrypt_batch isolates a tampered message");
+    }
+    
+    bool contexts_match = true;
+    for (AeadAlgorithm algorithm : {AeadAlgorithm::ChaCha20Poly1305, AeadAlgorithm::Aes256Gcm}) {
+        AeadContext context(key, algorithm);
+        if (!SymmetricCrypto::is_available(algorithm)) {
+            contexts_match = contexts_match && !context.valid() && !context.encrypt(plaintext, nonce);
+            continue;
+        }
+        auto one_shot = SymmetricCrypto::encrypt_aead(plaintext, key, nonce, aad, algorithm);
+        auto sealed = context.encrypt(plaintext, nonce, aad);
+        auto opened = sealed ? context.decrypt(*sealed, nonce, aad) : std::nullopt;
+        ByteVector tampered = sealed ? *sealed : ByteVector(SymmetricCrypto::TAG_SIZE);
+        tampered.back() ^= 1;
+        AeadContext moved(std::move(context));
+        contexts_match = contexts_match && sealed && *sealed == *one_shot && opened &&
+                         *opened == plaintext && !moved.decrypt(tampered, nonce, aad) &&
+                         moved.decrypt(*sealed, nonce, aad) && !context.valid();
+    }
+    if (contexts_match) {
+        test_pass("AeadContext matches one-shot AEAD for each algorithm");
+    } else {
+        test_fail("AeadContext matches one-shot AEAD for each algorithm");
+    }
+    
     NonceManager nm;
     auto nonce1 = nm.next_nonce();
     auto nonce2 = nm.next_nonce();
@@ -177,6 +480,47 @@ void test_symmetric_crypto() {
     } else {
         test_fail("NonceManager generates unique nonces");
     }
+    
+    NonceManager shared_nm;
+    std::vector<std::vector<Nonce>> per_thread(4);
+    std::vector<std::thread> workers;
+    for (size_t t = 0; t < per_thread.size(); ++t) {
+        workers.emplace_back([&shared_nm, &per_thread, t] {
+            for (int i = 0; i < 500; ++i) {
+                per_thread[t].push_back(*shared_nm.next_nonce());
+            }
+            auto block = shared_nm.reserve_block(64);
+            while (auto nonce = block->next()) {
+                per_thread[t].push_back(*nonce);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    std::vector<Nonce> all_nonces;
+    for (const auto& nonces : per_thread) {
+        all_nonces.insert(all_nonces.end(), nonces.begin(), nonces.end());
+    }
+    std::sort(all_nonces.begin(), all_nonces.end());
+    bool concurrent_unique = all_nonces.size() == 4 * (500 + 64) &&
+                             std::adjacent_find(all_nonces.begin(), all_nonces.end()) == all_nonces.end() &&
+                             shared_nm.current_counter() == all_nonces.size();
+    if (concurrent_unique) {
+        test_pass("NonceManager is unique across threads and blocks");
+    } else {
+        test_fail("NonceManager is unique across threads and blocks");
+    }
+    
+    nm.set_counter(UINT64_MAX - 3);
+    auto tail_block = nm.reserve_block(10);
+    bool exhausted = tail_block && tail_block->remaining() == 3 &&
+                     !nm.reserve_block(1) && !nm.next_nonce();
+    if (exhausted) {
+        test_pass("NonceManager stops at UINT64_MAX");
+    } else {
+        test_fail("NonceManager stops at UINT64_MAX");
+    }
 }
 
 void test_signing() {
@@ -212,6 +556,59 @@ void test_signing() {
     } else {
         test_fail("verify_signature (invalid - tampered message)");
     }
+    
+    uint8_t raw_message[] = {'s', 'p', 'a', 'n'};
+    auto span_signature = Signing::sign_message(ConstByteSpan(raw_message, sizeof(raw_message)), kp->secret_key);
+    if (span_signature &&
+        Signing::verify_signature(ByteVector(raw_message, raw_message + sizeof(raw_message)),
+                                  *span_signature, kp->public_key)) {
+        test_pass("sign/verify over borrowed memory");
+    } else {
+        test_fail("sign/verify over borrowed memory");
+    }
+    
+    std::vector<ByteVector> messages(150);
+    std::vector<SignatureCheck> checks(messages.size());
+    for (size_t i = 0; i < messages.size(); ++i) {
+        messages[i] = ByteVector(32, static_cast<uint8_t>(i));
+        checks[i].message = messages[i];
+        checks[i].signature = *Signing::sign_message(messages[i], kp->secret_key);
+        checks[i].public_key = kp->public_key;
+    }
+    checks[3].signature[0] ^= 1;
+    checks[70].public_key[0] ^= 1;
+    messages[149][0] ^= 1;
+    
+    BatchVerifyResult batch = Signing::verify_batch(checks);
+    if (batch.count == 150 && batch.valid_count() == 147 && batch.valid(0) &&
+        !batch.valid(3) && !batch.valid(70) && !batch.valid(149) && batch.valid(148)) {
+        test_pass("verify_batch flags only the bad items");
+    } else {
+        test_fail("verify_batch flags only the bad items");
+    }
+    
+    ByteVector payload(100000);
+    utils::random_bytes(payload.data(), payload.size());
+    StreamSigner signer;
+    for (size_t offset = 0; offset < payload.size(); offset += 7777) {
+        size_t len = std::min<size_t>(7777, payload.size() - offset);
+        signer.update(ConstByteSpan(payload).subspan(offset, len));
+    }
+    auto prehashed = signer.finish(kp->secret_key);
+    
+    StreamVerifier verifier;
+    verifier.update(payload);
+    bool whole = prehashed && verifier.finish(*prehashed, kp->public_key);
+    verifier.update(ConstByteSpan(payload).subspan(0, payload.size() - 1));
+    bool short_rejected = !verifier.finish(*prehashed, kp->public_key);
+    signer.update(payload);
+    bool restarted = signer.finish(kp->secret_key) == prehashed;
+    if (whole && short_rejected && restarted &&
+        !Signing::verify_signature(payload, *prehashed, kp->public_key)) {
+        test_pass("StreamSigner/StreamVerifier Ed25519ph");
+    } else {
+        test_fail("StreamSigner/StreamVerifier Ed25519ph");
+    }
 }
 
 void test_streaming() {
@@ -258,6 +655,995 @@ void test_streaming() {
     } else {
         test_fail("streaming detected final chunk");
     }
+    
+    ByteVector large(5 * 1024 + 100);
+    utils::random_bytes(large.data(), large.size());
+    
+    ThreadPool pool(4);
+    StreamingEncryption par_enc(key, nonce, 1024);
+    auto frames = par_enc.encrypt_parallel(large, &pool);
+    if (frames && frames->size() == StreamingEncryption::encrypted_size(large.size(), 1024) &&
+        par_enc.current_chunk() == 6) {
+        test_pass("encrypt_parallel");
+    } else {
+        test_fail("encrypt_parallel");
+        return;
+    }
+    
+    StreamingEncryption seq_enc(key, nonce, 1024);
+    ByteVector seq_frames;
+    for (size_t offset = 0; offset < large.size(); offset += 1024) {
+        size_t end = std::min(offset + 1024, large.size());
+        auto frame = seq_enc.encrypt_chunk(
+            ByteVector(large.begin() + offset, large.begin() + end), end == large.size());
+        seq_frames.insert(seq_frames.end(), frame->begin(), frame->end());
+    }
+    if (seq_frames == *frames) {
+        test_pass("encrypt_parallel matches sequential wire format");
+    } else {
+        test_fail("encrypt_parallel matches sequential wire format");
+    }
+    
+    StreamingDecryption par_dec(key, nonce);
+    auto opened = par_dec.decrypt_parallel(*frames, 1024, &pool);
+    if (opened && *opened == large && par_dec.is_complete()) {
+        test_pass("decrypt_parallel");
+    } else {
+        test_fail("decrypt_parallel");
+    }
+    
+    size_t frame_size = 1024 + StreamingEncryption::CHUNK_HEADER_SIZE + SymmetricCrypto::TAG_SIZE;
+    ByteVector truncated(frames->begin(), frames->begin() + 5 * frame_size);
+    ByteVector swapped(*frames);
+    std::swap_ranges(swapped.begin(), swapped.begin() + frame_size, swapped.begin() + frame_size);
+    StreamingDecryption bad_dec(key, nonce);
+    if (!bad_dec.decrypt_parallel(truncated, 1024, &pool) &&
+        !bad_dec.decrypt_parallel(swapped, 1024, &pool) &&
+        bad_dec.expected_chunk() == 0) {
+        test_pass("decrypt_parallel rejects missing-final and reordered streams");
+    } else {
+        test_fail("decrypt_parallel rejects missing-final and reordered streams");
+    }
+    
+    // Frames record their cipher, so the decoder needs no configuration
+    for (AeadAlgorithm algorithm : {AeadAlgorithm::ChaCha20Poly1305, AeadAlgorithm::Aes256Gcm}) {
+        if (!SymmetricCrypto::is_available(algorithm)) {
+            continue;
+        }
+        StreamingEncryption alg_enc(key, nonce, 1024, algorithm);
+        StreamingDecryption alg_dec(key, nonce);
+        auto alg_frames = alg_enc.encrypt_parallel(large, &pool);
+        auto alg_opened = alg_frames ? alg_dec.decrypt_parallel(*alg_frames, 1024, &pool) : std::nullopt;
+        std::string name = std::string("streaming round trip with ") +
+                           SymmetricCrypto::algorithm_name(algorithm);
+        if (alg_opened && *alg_opened == large && alg_dec.algorithm() == algorithm) {
+            test_pass(name.c_str());
+        } else {
+            test_fail(name.c_str());
+        }
+    }
+    
+    StreamingEncryption chacha_enc(key, nonce, 1024, AeadAlgorithm::ChaCha20Poly1305);
+    StreamingDecryption pinned_dec(key, nonce, AeadAlgorithm::Aes256Gcm);
+    auto chacha_frame = chacha_enc.encrypt_chunk(chunk1, true);
+    ByteVector relabeled(*chacha_frame);
+    relabeled[8] |= 0x02;
+    StreamingDecryption relabel_dec(key, nonce);
+    if (!pinned_dec.decrypt_chunk(*chacha_frame) && !relabel_dec.decrypt_chunk(relabeled)) {
+        test_pass("streaming rejects unexpected or relabeled cipher");
+    } else {
+        test_fail("streaming rejects unexpected or relabeled cipher");
+    }
+    
+    // Seal a chunk in place with header and tag in their own buffers, then
+    // open it in place from the same three parts
+    StreamingEncryption contiguous_enc(key, nonce, 1024);
+    StreamingEncryption scatter_enc(key, nonce, 1024);
+    ByteVector body(chunk1);
+    uint8_t header[StreamingEncryption::CHUNK_HEADER_SIZE];
+    uint8_t tag[MAC_SIZE];
+    auto contiguous = contiguous_enc.encrypt_chunk(chunk1, true);
+    auto scattered = scatter_enc.encrypt_chunk(body, true, ByteSpan(header, sizeof(header)), body,
+                                               ByteSpan(tag, sizeof(tag)));
+    ByteVector joined(header, header + sizeof(header));
+    joined.insert(joined.end(), body.begin(), body.end());
+    joined.insert(joined.end(), tag, tag + sizeof(tag));
+    
+    StreamingDecryption gather_dec(key, nonce);
+    ByteVector bad_tag(tag, tag + sizeof(tag));
+    bad_tag[0] ^= 1;
+    ByteVector body_copy(body);
+    bool rejected = !gather_dec.decrypt_chunk(ConstByteSpan(header, sizeof(header)), body_copy, bad_tag,
+                                              body_copy);
+    auto opened_in_place = gather_dec.decrypt_chunk(ConstByteSpan(header, sizeof(header)), body,
+                                                    ConstByteSpan(tag, sizeof(tag)), body);
+    if (contiguous && scattered && *scattered == contiguous->size() && joined == *contiguous &&
+        rejected && opened_in_place && body == chunk1 && gather_dec.is_complete()) {
+        test_pass("streaming scatter/gather frames round-trip in place");
+    } else {
+        test_fail("streaming scatter/gather frames round-trip in place");
+    }
+}
+
+void test_stream_pipeline() {
+    std::cout << "\n=== Testing Stream Pipeline ===" << std::endl;
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    Nonce nonce = utils::random_nonce();
+    const size_t chunk_size = 4096;
+    
+    // Sources hand out odd-sized pieces to exercise refilling
+    auto vector_source = [](const ByteVector& data) {
+        auto offset = std::make_shared<size_t>(0);
+        return [&data, offset](ByteSpan out) -> std::optional<size_t> {
+            size_t n = std::min({out.size(), data.size() - *offset, size_t(1000)});
+            std::memcpy(out.data(), data.data() + *offset, n);
+            *offset += n;
+            return n;
+        };
+    };
+    auto vector_sink = [](ByteVector& out) {
+        return [&out](ConstByteSpan data) {
+            out.insert(out.end(), data.data(), data.data() + data.size());
+            return true;
+        };
+    };
+    
+    bool identical = true;
+    bool round_trip = true;
+    for (size_t size : {size_t(0), size_t(100), chunk_size, 3 * chunk_size, 50 * chunk_size + 7}) {
+        ByteVector data(size);
+        utils::random_bytes(data.data(), data.size());
+        
+        StreamingEncryption reference(key, nonce, chunk_size);
+        ByteVector expected;
+        for (size_t offset = 0; offset < size || offset == 0; offset += chunk_size) {
+            size_t len = std::min(chunk_size, size - offset);
+            ByteVector chunk(data.begin() + offset, data.begin() + offset + len);
+            auto frame = reference.encrypt_chunk(chunk, offset + len == size);
+            expected.insert(expected.end(), frame->begin(), frame->end());
+            if (size == 0) {
+                break;
+            }
+        }
+        
+        StreamingEncryption encryption(key, nonce, chunk_size);
+        ByteVector sealed;
+        auto sealed_stats = StreamPipeline::encrypt(encryption, vector_source(data), vector_sink(sealed), 2);
+        identical = identical && sealed_stats && sealed == expected &&
+                    sealed.size() == StreamingEncryption::encrypted_size(size, chunk_size) &&
+                    sealed_stats->bytes_read == size && sealed_stats->bytes_written == sealed.size();
+        
+        StreamingDecryption decryption(key, nonce);
+        ByteVector opened;
+        auto opened_stats = StreamPipeline::decrypt(decryption, chunk_size, vector_source(sealed),
+                                                    vector_sink(opened));
+        round_trip = round_trip && opened_stats && opened == data && decryption.is_complete() &&
+                     opened_stats->chunks == sealed_stats->chunks;
+    }
+    if (identical) {
+        test_pass("StreamPipeline::encrypt matches sequential encrypt_chunk");
+    } else {
+        test_fail("StreamPipeline::encrypt matches sequential encrypt_chunk");
+    }
+    if (round_trip) {
+        test_pass("StreamPipeline::decrypt round trip");
+    } else {
+        test_fail("StreamPipeline::decrypt round trip");
+    }
+    
+    ByteVector data(10 * chunk_size + 1);
+    utils::random_bytes(data.data(), data.size());
+    StreamingEncryption encryption(key, nonce, chunk_size);
+    ByteVector sealed;
+    StreamPipeline::encrypt(encryption, vector_source(data), vector_sink(sealed));
+    
+    ByteVector truncated(sealed.begin(), sealed.end() - 1 - StreamingEncryption::CHUNK_OVERHEAD);
+    ByteVector tampered = sealed;
+    tampered[5 * (chunk_size + StreamingEncryption::CHUNK_OVERHEAD) + 100] ^= 1;
+    ByteVector ignored;
+    StreamingDecryption truncated_decryption(key, nonce);
+    StreamingDecryption tampered_decryption(key, nonce);
+    StreamingEncryption failing_encryption(key, nonce, chunk_size);
+    size_t sink_calls = 0;
+    auto failing_sink = [&sink_calls](ConstByteSpan) { return ++sink_calls < 3; };
+    
+    if (!StreamPipeline::decrypt(truncated_decryption, chunk_size, vector_source(truncated),
+                                 vector_sink(ignored)) &&
+        !StreamPipeline::decrypt(tampered_decryption, chunk_size, vector_source(tampered),
+                                 vector_sink(ignored)) &&
+        !StreamPipeline::encrypt(failing_encryption, vector_source(data), failing_sink) &&
+        sink_calls == 3) {
+        test_pass("StreamPipeline rejects truncation, tampering and sink failure");
+    } else {
+        test_fail("StreamPipeline rejects truncation, tampering and sink failure");
+    }
+    
+    // Signing as the stream is produced matches signing the finished output
+    StreamSigner stream_signer;
+    StreamingEncryption signed_encryption(key, nonce, chunk_size);
+    signed_encryption.set_signer(&stream_signer);
+    ByteVector signed_sealed;
+    StreamPipeline::encrypt(signed_encryption, vector_source(data), vector_sink(signed_sealed));
+    auto signing_keys = KeyManagement::generate_signing_keypair();
+    auto stream_signature = stream_signer.finish(signing_keys->secret_key);
+    
+    StreamSigner whole_signer;
+    whole_signer.update(signed_sealed);
+    StreamSigner parallel_signer;
+    StreamingEncryption parallel_encryption(key, nonce, chunk_size);
+    parallel_encryption.set_signer(&parallel_signer);
+    parallel_encryption.encrypt_parallel(data);
+    
+    StreamVerifier stream_verifier;
+    StreamingDecryption verified_decryption(key, nonce);
+    verified_decryption.set_verifier(&stream_verifier);
+    ByteVector verified;
+    StreamPipeline::decrypt(verified_decryption, chunk_size, vector_source(signed_sealed),
+                            vector_sink(verified));
+    
+    if (stream_signature && verified == data &&
+        whole_signer.finish(signing_keys->secret_key) == stream_signature &&
+        parallel_signer.finish(signing_keys->secret_key) == stream_signature &&
+        stream_verifier.finish(*stream_signature, signing_keys->public_key)) {
+        test_pass("StreamingEncryption signs frames as they are sealed");
+    } else {
+        test_fail("StreamingEncryption signs frames as they are sealed");
+    }
+    
+    const std::string plain_path = "spear_test_pipeline_plain.bin";
+    const std::string sealed_path = "spear_test_pipeline_sealed.bin";
+    std::ofstream(plain_path, std::ios::binary).write(
+        reinterpret_cast<const char*>(data.data()), data.size());
+    
+    int plain_fd = ::open(plain_path.c_str(), O_RDONLY);
+    int sealed_fd = ::open(sealed_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+    StreamingEncryption file_encryption(key, nonce, chunk_size);
+    auto file_stats = StreamPipeline::encrypt(file_encryption, StreamPipeline::fd_source(plain_fd),
+                                              StreamPipeline::fd_sink(sealed_fd));
+    ::close(plain_fd);
+    ::close(sealed_fd);
+    
+    std::ifstream sealed_file(sealed_path, std::ios::binary);
+    ByteVector from_file((std::istreambuf_iterator<char>(sealed_file)), std::istreambuf_iterator<char>());
+    if (file_stats && from_file == sealed) {
+        test_pass("StreamPipeline file descriptor stages");
+    } else {
+        test_fail("StreamPipeline file descriptor stages");
+    }
+    
+    std::remove(plain_path.c_str());
+    std::remove(sealed_path.c_str());
+}
+
+void test_container() {
+    std::cout << "\n=== Testing Seekable Container ===" << std::endl;
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    
+    ByteVector data(10 * 1000 + 37);
+    utils::random_bytes(data.data(), data.size());
+    
+    ByteVector container;
+    SeekableContainerWriter writer(key, vector_sink(container), 1000);
+    bool written = writer.write(ConstByteSpan(data).subspan(0, 4321)) &&
+                   writer.write(ConstByteSpan(data).subspan(4321, data.size() - 4321)) &&
+                   writer.finish();
+    if (written && container.size() == SeekableContainerWriter::container_size(data.size(), 1000)) {
+        test_pass("container writer");
+    } else {
+        test_fail("container writer");
+        return;
+    }
+    
+    auto reader = SeekableContainerReader::open(key, memory_source(container), container.size());
+    if (reader && reader->plaintext_size() == data.size() && reader->chunk_count() == 11) {
+        test_pass("container reader open");
+    } else {
+        test_fail("container reader open");
+        return;
+    }
+    
+    auto all = reader->read(0, data.size());
+    auto range = reader->read(2990, 2020);
+    auto tail = reader->read(data.size() - 10, 100);
+    if (all && *all == data &&
+        range && ByteVector(data.begin() + 2990, data.begin() + 5010) == *range &&
+        tail && ByteVector(data.end() - 10, data.end()) == *tail) {
+        test_pass("container random-access reads");
+    } else {
+        test_fail("container random-access reads");
+    }
+    
+    SymmetricKey wrong_key = key;
+    wrong_key[0] ^= 1;
+    ByteVector tampered(container);
+    tampered[CONTAINER_HEADER_SIZE + 3 * 1025] ^= 1;
+    ByteVector truncated(container.begin(), container.end() - 1);
+    auto tampered_reader = SeekableContainerReader::open(key, memory_source(tampered), tampered.size());
+    
+    if (!SeekableContainerReader::open(wrong_key, memory_source(container), container.size()) &&
+        !SeekableContainerReader::open(key, memory_source(truncated), truncated.size()) &&
+        tampered_reader && tampered_reader->read(0, 1000) && !tampered_reader->read(3000, 10)) {
+        test_pass("container rejects wrong key, truncation and tampered chunks");
+    } else {
+        test_fail("container rejects wrong key, truncation and tampered chunks");
+    }
+    
+    ByteVector empty_container;
+    SeekableContainerWriter empty_writer(key, vector_sink(empty_container), 1000);
+    auto empty_reader = empty_writer.finish()
+        ? SeekableContainerReader::open(key, memory_source(empty_container), empty_container.size())
+        : nullptr;
+    if (empty_reader && empty_reader->plaintext_size() == 0 && empty_reader->read(0, 10)->empty()) {
+        test_pass("container with empty plaintext");
+    } else {
+        test_fail("container with empty plaintext");
+    }
+}
+
+void test_file_crypto() {
+    std::cout << "\n=== Testing File Encryption ===" << std::endl;
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    
+    ByteVector data(3 * 1024 * 1024 + 123);
+    utils::random_bytes(data.data(), data.size());
+    
+    const std::string plain_path = "spear_test_plain.bin";
+    const std::string sealed_path = "spear_test_sealed.bin";
+    const std::string opened_path = "spear_test_opened.bin";
+    std::ofstream(plain_path, std::ios::binary).write(
+        reinterpret_cast<const char*>(data.data()), data.size());
+    
+    auto read_file = [](const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return ByteVector(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    
+    auto encrypted = FileCrypto::encrypt_file(plain_path, sealed_path, key);
+    auto decrypted = FileCrypto::decrypt_file(sealed_path, opened_path, key);
+    if (encrypted && *encrypted == data.size() && decrypted && *decrypted == data.size() &&
+        read_file(opened_path) == data) {
+        test_pass("encrypt_file/decrypt_file round trip");
+    } else {
+        test_fail("encrypt_file/decrypt_file round trip");
+    }
+    
+    // The output is truncated before the input is read, so writing over the
+    // input, by its own path or through a hard link, has to be refused
+    ByteVector sealed = read_file(sealed_path);
+    const std::string link_path = "spear_test_sealed_link.bin";
+    std::remove(link_path.c_str());
+    bool linked = ::link(sealed_path.c_str(), link_path.c_str()) == 0;
+    if (!FileCrypto::encrypt_file(plain_path, plain_path, key) && read_file(plain_path) == data &&
+        !FileCrypto::decrypt_file(sealed_path, sealed_path, key) && linked &&
+        !FileCrypto::decrypt_file(link_path, sealed_path, key) && read_file(sealed_path) == sealed) {
+        test_pass("encrypt_file/decrypt_file refuse to overwrite their input");
+    } else {
+        test_fail("encrypt_file/decrypt_file refuse to overwrite their input");
+    }
+    std::remove(link_path.c_str());
+    
+    
+    sealed[sealed.size() / 2] ^= 1;
+    std::ofstream(sealed_path, std::ios::binary).write(
+        reinterpret_cast<const char*>(sealed.data()), sealed.size());
+    std::remove(opened_path.c_str());
+    
+    if (!FileCrypto::decrypt_file(sealed_path, opened_path, key) &&
+        !std::ifstream(opened_path).good()) {
+        test_pass("decrypt_file rejects tampered file and removes output");
+    } else {
+        test_fail("decrypt_file rejects tampered file and removes output");
+    }
+    
+    std::remove(plain_path.c_str());
+    std::remove(sealed_path.c_str());
+    std::remove(opened_path.c_str());
+}
+
+void test_async_file_crypto() {
+    std::cout << "\n=== Testing Async File Encryption ===" << std::endl;
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    Nonce nonce = utils::random_nonce();
+    const size_t chunk_size = 64 * 1024;
+    
+    ByteVector data(2 * 1024 * 1024 + 777);
+    utils::random_bytes(data.data(), data.size());
+    
+    const std::string plain_path = "spear_test_async_plain.bin";
+    const std::string sealed_path = "spear_test_async_sealed.bin";
+    const std::string opened_path = "spear_test_async_opened.bin";
+    auto write_file = [](const std::string& path, const ByteVector& bytes) {
+        std::ofstream(path, std::ios::binary).write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    };
+    auto read_file = [](const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        return ByteVector(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    write_file(plain_path, data);
+    
+    StreamingEncryption reference(key, nonce, chunk_size);
+    auto expected = reference.encrypt_parallel(data);
+    
+    // Both backends, with and without O_DIRECT, must produce the same frames
+    const bool have_io_uring = AsyncFileCrypto::io_uring_available();
+    bool round_trips = true;
+    for (bool use_io_uring : {true, false}) {
+        for (bool direct_io : {true, false}) {
+            AsyncFileOptions options;
+            options.use_io_uring = use_io_uring;
+            options.direct_io = direct_io;
+            options.depth = 4;
+            
+            StreamingEncryption enc(key, nonce, chunk_size);
+            auto sealed = AsyncFileCrypto::encrypt_file(plain_path, sealed_path, enc, options);
+            StreamingDecryption dec(key, nonce);
+            auto opened = AsyncFileCrypto::decrypt_file(sealed_path, opened_path, dec, chunk_size, options);
+            round_trips = round_trips && sealed && sealed->plaintext_bytes == data.size() &&
+                          sealed->chunks == (data.size() + chunk_size - 1) / chunk_size &&
+                          sealed->backend == (use_io_uring && have_io_uring ? FileIoBackend::IoUring
+                                                                            : FileIoBackend::Blocking) &&
+                          read_file(sealed_path) == *expected && opened &&
+                          opened->plaintext_bytes == data.size() && read_file(opened_path) == data &&
+                          dec.is_complete();
+        }
+    }
+    if (round_trips) {
+        test_pass(have_io_uring ? "AsyncFileCrypto matches encrypt_parallel on every backend (io_uring)"
+                                : "AsyncFileCrypto matches encrypt_parallel on every backend (blocking only)");
+    } else {
+        test_fail("AsyncFileCrypto matches encrypt_parallel on every backend");
+    }
+    
+    // tmpfs may refuse O_DIRECT only once requests are queued; every one in
+    // flight has to be retried, not just the first to fail
+    const std::string shm_dir = "/dev/shm";
+    std::error_code shm_error;
+    if (std::filesystem::is_directory(shm_dir, shm_error)) {
+        const std::string shm_plain = shm_dir + "/spear_test_async_plain.bin";
+        const std::string shm_sealed = shm_dir + "/spear_test_async_sealed.bin";
+        const std::string shm_opened = shm_dir + "/spear_test_async_opened.bin";
+        write_file(shm_plain, data);
+        bool shm_round_trips = true;
+        for (bool use_io_uring : {true, false}) {
+            AsyncFileOptions options;
+            options.use_io_uring = use_io_uring;
+            options.direct_io = true;
+            options.depth = 8;
+            
+            StreamingEncryption enc(key, nonce, chunk_size);
+            auto sealed = AsyncFileCrypto::encrypt_file(shm_plain, shm_sealed, enc, options);
+            StreamingDecryption dec(key, nonce);
+            auto opened = AsyncFileCrypto::decrypt_file(shm_sealed, shm_opened, dec, chunk_size, options);
+            shm_round_trips = shm_round_trips && sealed && read_file(shm_sealed) == *expected &&
+                              opened && read_file(shm_opened) == data && dec.is_complete();
+        }
+        if (shm_round_trips) {
+            test_pass("AsyncFileCrypto round-trips on tmpfs with O_DIRECT at depth 8");
+        } else {
+            test_fail("AsyncFileCrypto round-trips on tmpfs with O_DIRECT at depth 8");
+        }
+        std::remove(shm_plain.c_str());
+        std::remove(shm_sealed.c_str());
+        std::remove(shm_opened.c_str());
+    }
+    
+    StreamingEncryption in_place_enc(key, nonce, chunk_size);
+    StreamingDecryption in_place_dec(key, nonce);
+    if (!AsyncFileCrypto::encrypt_file(plain_path, plain_path, in_place_enc) && read_file(plain_path) == data &&
+        !AsyncFileCrypto::decrypt_file(sealed_path, sealed_path, in_place_dec, chunk_size) &&
+        read_file(sealed_path) == *expected) {
+        test_pass("AsyncFileCrypto refuses to overwrite its input");
+    } else {
+        test_fail("AsyncFileCrypto refuses to overwrite its input");
+    }
+    
+    write_file(plain_path, {});
+    StreamingEncryption empty_enc(key, nonce, chunk_size);
+    StreamingDecryption empty_dec(key, nonce);
+    auto empty_sealed = AsyncFileCrypto::encrypt_file(plain_path, sealed_path, empty_enc);
+    auto empty_opened = AsyncFileCrypto::decrypt_file(sealed_path, opened_path, empty_dec, chunk_size);
+    if (empty_sealed && empty_sealed->chunks == 1 &&
+        read_file(sealed_path).size() == StreamingEncryption::CHUNK_OVERHEAD &&
+        empty_opened && read_file(opened_path).empty() && empty_dec.is_complete()) {
+        test_pass("AsyncFileCrypto seals an empty file as one final frame");
+    } else {
+        test_fail("AsyncFileCrypto seals an empty file as one final frame");
+    }
+    
+    ByteVector tampered(*expected);
+    tampered[tampered.size() / 2] ^= 1;
+    write_file(sealed_path, tampered);
+    ByteVector truncated(expected->begin(), expected->begin() + 3 * (chunk_size + StreamingEncryption::CHUNK_OVERHEAD));
+    const std::string truncated_path = "spear_test_async_truncated.bin";
+    write_file(truncated_path, truncated);
+    
+    StreamingDecryption tampered_dec(key, nonce);
+    bool tampered_rejected = !AsyncFileCrypto::decrypt_file(sealed_path, opened_path, tampered_dec, chunk_size) &&
+                             !std::ifstream(opened_path).good();
+    StreamingDecryption truncated_dec(key, nonce);
+    bool truncated_rejected = !AsyncFileCrypto::decrypt_file(truncated_path, opened_path, truncated_dec, chunk_size) &&
+                              !std::ifstream(opened_path).good();
+    if (tampered_rejected && truncated_rejected) {
+        test_pass("AsyncFileCrypto rejects tampered and truncated files and removes output");
+    } else {
+        test_fail("AsyncFileCrypto rejects tampered and truncated files and removes output");
+    }
+    
+    std::remove(plain_path.c_str());
+    std::remove(sealed_path.c_str());
+    std::remove(opened_path.c_str());
+    std::remove(truncated_path.c_str());
+}
+
+void test_message_store() {
+    std::cout << "\n=== Testing Message Store ===" << std::endl;
+    
+    const std::string dir = "spear_test_store";
+    std::filesystem::remove_all(dir);
+    
+    MessageStoreOptions options;
+    options.segment_size = 4096;
+    auto store = MessageStore::open(dir, options);
+    if (!store) {
+        test_fail("MessageStore opens a new directory");
+        return;
+    }
+    
+    // Concurrent appends are group-committed across small segments
+    ByteVector nonce(24, 0x24);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 4; ++t) {
+        writers.emplace_back([&store, &nonce, t] {
+            for (int i = 0; i < 50; ++i) {
+                ByteVector content(100, static_cast<uint8_t>(i));
+                MessageRecord message;
+                message.counter = static_cast<uint64_t>(i);
+                message.sender = t % 2 ? "alice" : "carol";
+                message.nonce = nonce;
+                message.content = content;
+                store->append(t % 2 ? "bob" : "dave", message);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    
+    MessageBatch inbox = store->fetch("bob");
+    bool ordered = inbox.size() == 100;
+    for (size_t i = 0; ordered && i < inbox.size(); ++i) {
+        ordered = inbox[i].sender == "alice" && inbox[i].content.size() == 100 &&
+                  inbox[i].content[0] == inbox[i].counter &&
+                  ConstByteSpan(nonce).size() == inbox[i].nonce.size() &&
+                  (i == 0 || inbox[i - 1].id < inbox[i].id);
+    }
+    if (ordered && store->stats().segments > 1 && store->fetch("dave", 10).size() == 10) {
+        test_pass("MessageStore appends and fetches per recipient");
+    } else {
+        test_fail("MessageStore appends and fetches per recipient");
+    }
+    
+    uint64_t last_bob = inbox[inbox.size() - 1].id;
+    auto acked = store->ack("bob", inbox[39].id);
+    if (acked && *acked == 40 && store->fetch("bob").size() == 60 && store->ack("bob", 1) == size_t(0)) {
+        test_pass("MessageStore ack advances the cursor");
+    } else {
+        test_fail("MessageStore ack advances the cursor");
+    }
+    
+    // Acking an id that does not exist yet must not swallow later messages
+    MessageRecord later;
+    later.sender = "ivan";
+    later.nonce = nonce;
+    size_t recipients = store->stats().recipients;
+    auto future_ack = store->ack("henry", 1000000);
+    bool no_queue = store->stats().recipients == recipients && store->last_id("henry") == 0;
+    auto henry_first = store->append("henry", later);
+    auto past_newest = store->ack("henry", UINT64_MAX);
+    auto henry_second = store->append("henry", later);
+    MessageBatch henry = store->fetch("henry");
+    if (future_ack == size_t(0) && no_queue && henry_first && past_newest == size_t(1) &&
+        henry.size() == 1 && henry[0].id == *henry_second && store->last_id("henry") == *henry_second) {
+        test_pass("MessageStore bounds acks by the newest message");
+    } else {
+        test_fail("MessageStore bounds acks by the newest message");
+    }
+    if (henry_second) {
+        store->ack("henry", *henry_second);
+    }
+    
+    // A batch is one commit with consecutive ids, and fails as a whole
+    ByteVector batch_content(100, 0x7E);
+    MessageRecord queued;
+    queued.sender = "erin";
+    queued.nonce = nonce;
+    queued.content = batch_content;
+    uint64_t commits = store->stats().commits;
+    auto first = store->append_batch({"frank", "frank", "grace"}, {queued, queued, queued});
+    std::string too_long(MessageStore::MAX_FIELD_SIZE + 1, 'x');
+    bool rejected = !store->append_batch({"frank", too_long}, {queued, queued}) &&
+                    !store->append_batch({"frank"}, {queued, queued});
+    MessageBatch frank = store->fetch("frank");
+    if (first && store->stats().commits == commits + 1 && rejected && frank.size() == 2 &&
+        frank[0].id == *first && frank[1].id == *first + 1 && store->fetch("grace")[0].id == *first + 2) {
+        test_pass("MessageStore append_batch commits once");
+    } else {
+        test_fail("MessageStore append_batch commits once");
+    }
+    auto grace_owner = first ? store->recipient_of(*first + 2) : std::nullopt;
+    store->ack("frank", *first + 1);
+    store->ack("grace", *first + 2);
+    if (grace_owner && *grace_owner == "grace" && !store->recipient_of(*first + 2) &&
+        !store->recipient_of(UINT64_MAX)) {
+        test_pass("MessageStore finds the recipient of a queued message");
+    } else {
+        test_fail("MessageStore finds the recipient of a queued message");
+    }
+    
+    // Fetched records stay readable after the segments behind them are compacted
+    MessageBatch held = store->fetch("dave");
+    store.reset();
+    std::ofstream(dir + "/" + [&dir] {
+        std::string last;
+        for (const auto& entry : std::filesystem::directory_iterator(dir)) {
+            last = std::max(last, entry.path().filename().string());
+        }
+        return last;
+    }(), std::ios::binary | std::ios::app) << "torn";
+    
+    store = MessageStore::open(dir, options);
+    if (store && store->fetch("bob").size() == 60 && store->fetch("dave").size() == 100) {
+        test_pass("MessageStore recovers queues and cursors from the log");
+    } else {
+        test_fail("MessageStore recovers queues and cursors from the log");
+        return;
+    }
+    
+    size_t segments = store->stats().segments;
+    store->ack("bob", last_bob);
+    MessageBatch dave = store->fetch("dave");
+    store->ack("dave", dave[dave.size() - 1].id);
+    if (store->stats().queued_messages == 0 && store->stats().segments < segments &&
+        held.size() == 100 && held[99].content[0] == held[99].counter) {
+        test_pass("MessageStore compacts acknowledged segments");
+    } else {
+        test_fail("MessageStore compacts acknowledged segments");
+    }
+    
+    store.reset();
+    std::filesystem::remove_all(dir);
+}
+
+void test_wire_codec() {
+    std::cout << "\n=== Testing Wire Codec ===" << std::endl;
+    
+    ByteVector nonce(NONCE_SIZE, 0x24);
+    ByteVector signature(SIGNATURE_SIZE, 0x5A);
+    ByteVector first_content(MAC_SIZE + 37, 0x11);
+    ByteVector second_content(MAC_SIZE, 0x22);
+    
+    WireMessage first;
+    first.recipient = "bob";
+    first.record.sender = "alice";
+    first.record.counter = 7;
+    first.record.nonce = nonce;
+    first.record.signature = signature;
+    first.record.content = first_content;
+    
+    // Server-side form: no recipient, id and timestamp filled in
+    WireMessage second;
+    second.record.sender = "carol";
+    second.record.counter = UINT64_MAX;
+    second.record.id = 42;
+    second.record.timestamp_ms = 1700000000000ULL;
+    second.record.nonce = nonce;
+    second.record.signature = signature;
+    second.record.content = second_content;
+    
+    ByteVector body;
+    bool appended = WireCodec::append(first, body) && WireCodec::append(second, body);
+    auto decoded = WireCodec::decode_all(body);
+    if (appended && body.size() == WireCodec::encoded_size(first) + WireCodec::encoded_size(second) &&
+        decoded && decoded->size() == 2 &&
+        (*decoded)[0].recipient == "bob" && (*decoded)[0].record.sender == "alice" &&
+        (*decoded)[0].record.counter == 7 && (*decoded)[0].record.id == 0 &&
+        ByteVector((*decoded)[0].record.content.data(),
+                   (*decoded)[0].record.content.data() + (*decoded)[0].record.content.size()) == first_content &&
+        (*decoded)[1].recipient.empty() && (*decoded)[1].record.sender == "carol" &&
+        (*decoded)[1].record.counter == UINT64_MAX && (*decoded)[1].record.id == 42 &&
+        (*decoded)[1].record.timestamp_ms == 1700000000000ULL &&
+        std::memcmp((*decoded)[1].record.signature.data(), signature.data(), SIGNATURE_SIZE) == 0) {
+        test_pass("WireCodec round-trips a batch of envelopes");
+    } else {
+        test_fail("WireCodec round-trips a batch of envelopes");
+    }
+    
+    // Decoded fields are views into the body, not copies
+    if (decoded && decoded->size() == 2 &&
+        (*decoded)[1].record.content.data() == body.data() + body.size() - second_content.size() &&
+        (*decoded)[0].record.nonce.data() == body.data() + WireCodec::HEADER_SIZE - NONCE_SIZE - SIGNATURE_SIZE) {
+        test_pass("WireCodec decodes in place");
+    } else {
+        test_fail("WireCodec decodes in place");
+    }
+    
+    WireMessage short_nonce = first;
+    short_nonce.record.nonce = ConstByteSpan(nonce.data(), NONCE_SIZE - 1);
+    WireMessage short_content = first;
+    short_content.record.content = ConstByteSpan(first_content.data(), MAC_SIZE - 1);
+    WireMessage no_sender = first;
+    no_sender.record.sender = "";
+    ByteVector small(WireCodec::encoded_size(first) - 1);
+    if (!WireCodec::encode(short_nonce) && !WireCodec::encode(short_content) && !WireCodec::encode(no_sender) &&
+        !WireCodec::encode(first, small)) {
+        test_pass("WireCodec rejects invalid sizes on encode");
+    } else {
+        test_fail("WireCodec rejects invalid sizes on encode");
+    }
+    
+    ByteVector truncated(body.begin(), body.end() - 1);
+    ByteVector bad_version(body);
+    bad_version[4] = WireCodec::VERSION + 1;
+    ByteVector oversized(body);
+    oversized[12] = oversized[13] = oversized[14] = oversized[15] = 0xFF;
+    ByteVector trailing(body);
+    trailing.push_back(0);
+    if (!WireCodec::decode_all(truncated) && !WireCodec::decode_all(bad_version) &&
+        !WireCodec::decode_all(oversized) && !WireCodec::decode_all(trailing) &&
+        WireCodec::decode_all(ByteVector()) && WireCodec::decode_all(ByteVector())->empty()) {
+        test_pass("WireCodec rejects malformed bodies");
+    } else {
+        test_fail("WireCodec rejects malformed bodies");
+    }
+}
+
+void test_replay_window() {
+    std::cout << "\n=== Testing Replay Window ===" << std::endl;
+    
+    ReplayWindowTable windows(4);
+    bool ordered = windows.check("s1", 0) == ReplayCheck::Replayed;
+    for (uint64_t counter = 1; counter <= 10; ++counter) {
+        ordered = ordered && windows.check("s1", counter) == ReplayCheck::Accepted;
+    }
+    if (ordered && windows.check("s1", 10) == ReplayCheck::Replayed && windows.highest("s1") == uint64_t(10)) {
+        test_pass("ReplayWindowTable accepts increasing counters once");
+    } else {
+        test_fail("ReplayWindowTable accepts increasing counters once");
+    }
+    
+    // Skip ahead across word boundaries, then deliver the gap out of order
+    bool reordered = windows.check("s1", 200) == ReplayCheck::Accepted;
+    for (uint64_t counter = 199; counter > 10; --counter) {
+        reordered = reordered && windows.check("s1", counter) == ReplayCheck::Accepted;
+    }
+    reordered = reordered && windows.check("s1", 150) == ReplayCheck::Replayed &&
+                windows.check("s1", 500) == ReplayCheck::Accepted &&
+                windows.check("s1", 201) == ReplayCheck::Accepted &&
+                windows.check("s1", 200) == ReplayCheck::Replayed &&
+                windows.check("s1", 500 - ReplayWindowTable::WINDOW_SIZE + 1) == ReplayCheck::Replayed &&
+                windows.check("s1", 500 - ReplayWindowTable::WINDOW_SIZE) == ReplayCheck::TooOld;
+    if (reordered && windows.check("s2", 5) == ReplayCheck::Accepted) {
+        test_pass("ReplayWindowTable accepts bounded reordering");
+    } else {
+        test_fail("ReplayWindowTable accepts bounded reordering");
+    }
+    
+    bool seeded = windows.seed("s3", 1000) && !windows.seed("s3", 1) &&
+                  windows.check("s3", 999) == ReplayCheck::Replayed &&
+                  windows.check("s3", 1001) == ReplayCheck::Accepted;
+    bool forgotten = windows.forget("s2") && !windows.forget("s2") && !windows.highest("s2") &&
+                     windows.highest("s1") && windows.size() == 2;
+    
+    // Removals from one crowded shard must not break other probe chains
+    ReplayWindowTable crowded(1);
+    for (uint64_t i = 0; i < 500; ++i) {
+        crowded.check("session" + std::to_string(i), i + 1);
+    }
+    for (uint64_t i = 0; i < 500; i += 2) {
+        forgotten = forgotten && crowded.forget("session" + std::to_string(i));
+    }
+    for (uint64_t i = 0; i < 500; ++i) {
+        auto top = crowded.highest("session" + std::to_string(i));
+        forgotten = forgotten && (i % 2 ? top == i + 1 : !top);
+    }
+    if (seeded && forgotten) {
+        test_pass("ReplayWindowTable seed and forget");
+    } else {
+        test_fail("ReplayWindowTable seed and forget");
+    }
+    
+    // Two threads race through the same counters on each shared session:
+    // every counter must be accepted exactly once
+    std::atomic<uint64_t> accepted{0};
+    std::vector<std::thread> checkers;
+    for (int t = 0; t < 8; ++t) {
+        checkers.emplace_back([&windows, &accepted, t] {
+            std::string shared = "shared" + std::to_string(t % 4);
+            for (uint64_t counter = 1; counter <= 2000; ++counter) {
+                if (windows.check(shared, counter) == ReplayCheck::Accepted) {
+                    accepted++;
+                }
+                windows.check("own" + std::to_string(t) + "-" + std::to_string(counter % 300), counter);
+            }
+        });
+    }
+    for (auto& checker : checkers) {
+        checker.join();
+    }
+    if (accepted == 4 * 2000 && windows.size() == 2 + 4 + 8 * 300) {
+        test_pass("ReplayWindowTable is consistent across threads");
+    } else {
+        test_fail("ReplayWindowTable is consistent across threads");
+    }
+}
+
+void test_secure_memory() {
+    std::cout << "\n=== Testing Secure Memory ===" << std::endl;
+    
+    SecureSlab slab(32, 4);
+    std::vector<void*> blocks;
+    for (int i = 0; i < 6; ++i) {
+        blocks.push_back(slab.allocate());
+    }
+    bool distinct = std::all_of(blocks.begin(), blocks.end(), [](void* block) {
+        return block && reinterpret_cast<uintptr_t>(block) % 16 == 0;
+    });
+    std::sort(blocks.begin(), blocks.end());
+    distinct = distinct && std::adjacent_find(blocks.begin(), blocks.end()) == blocks.end();
+    bool counted = slab.in_use() == 6;
+    for (void* block : blocks) {
+        slab.deallocate(block);
+    }
+    if (distinct && counted && slab.in_use() == 0) {
+        test_pass("SecureSlab hands out distinct aligned blocks");
+    } else {
+        test_fail("SecureSlab hands out distinct aligned blocks");
+    }
+    
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    size_t before = SecureSlab::shared().in_use();
+    {
+        SecureBox<SymmetricKey> box(key);
+        SecureBox<SymmetricKey> moved(std::move(box));
+        bool boxed = moved.locked() && *moved == key && !box.get() &&
+                     SecureSlab::shared().in_use() == before + 1;
+        if (boxed) {
+            test_pass("SecureBox keeps a secret in the locked slab");
+        } else {
+            test_fail("SecureBox keeps a secret in the locked slab");
+        }
+    }
+    if (SecureSlab::shared().in_use() == before) {
+        test_pass("SecureBox releases its block");
+    } else {
+        test_fail("SecureBox releases its block");
+    }
+    
+    ScratchArena arena(256);
+    ByteSpan first = arena.allocate(5);
+    ByteSpan second = arena.allocate(40);
+    ByteSpan spill = arena.allocate(1024);
+    bool aligned = reinterpret_cast<uintptr_t>(second.data()) % ScratchArena::ALIGNMENT ==
+                   reinterpret_cast<uintptr_t>(first.data()) % ScratchArena::ALIGNMENT &&
+                   second.data() == first.data() + 16 && spill.size() == 1024 &&
+                   arena.used() == 56;
+    std::fill(second.data(), second.data() + second.size(), 0xAB);
+    uint8_t* reused = second.data();
+    arena.reset();
+    bool wiped = arena.used() == 0 && std::all_of(reused, reused + 40, [](uint8_t b) { return b == 0; });
+    if (aligned && wiped && arena.allocate(5).data() == first.data()) {
+        test_pass("ScratchArena bump-allocates and wipes on reset");
+    } else {
+        test_fail("ScratchArena bump-allocates and wipes on reset");
+    }
+    arena.reset();
+    
+    Nonce nonce = utils::random_nonce();
+    ByteVector message = {'A', 'r', 'e', 'n', 'a', ' ', 'p', 'l', 'a', 'i', 'n', 't', 'e', 'x', 't'};
+    ByteVector aad = {'h', 'e', 'a', 'd', 'e', 'r'};
+    auto sealed = SymmetricCrypto::encrypt_aead(message, key, nonce, aad, arena);
+    auto reference = SymmetricCrypto::encrypt_aead(message, key, nonce, aad);
+    bool round_trip = sealed && reference && sealed->size() == reference->size() &&
+                      std::equal(reference->begin(), reference->end(), sealed->data());
+    if (round_trip) {
+        auto opened = SymmetricCrypto::decrypt_aead(*sealed, key, nonce, aad, arena);
+        round_trip = opened && opened->size() == message.size() &&
+                     std::equal(message.begin(), message.end(), opened->data());
+    }
+    if (round_trip) {
+        (*sealed)[0] ^= 1;
+    }
+    if (round_trip && !SymmetricCrypto::decrypt_aead(*sealed, key, nonce, aad, arena)) {
+        test_pass("AEAD round trip through a scratch arena");
+    } else {
+        test_fail("AEAD round trip through a scratch arena");
+    }
+}
+
+void test_metrics() {
+    std::cout << "\n=== Testing Metrics ===" << std::endl;
+    
+    bool bucketed = true;
+    size_t previous = 0;
+    for (uint64_t nanos = 0; nanos < (uint64_t(1) << 40); nanos = nanos * 5 / 4 + 1) {
+        size_t bucket = LatencyHistogram::bucket_for(nanos);
+        bool in_range = LatencyHistogram::bucket_lower(bucket) <= nanos &&
+                        nanos <= LatencyHistogram::bucket_upper(bucket);
+        bucketed = bucketed && in_range && bucket >= previous;
+        previous = bucket;
+    }
+    LatencyHistogram histogram;
+    histogram.counts[LatencyHistogram::bucket_for(100)] = 90;
+    histogram.counts[LatencyHistogram::bucket_for(5000)] = 10;
+    if (bucketed && histogram.quantile(0.5) >= 100 && histogram.quantile(0.5) < 113 &&
+        histogram.quantile(0.99) >= 5000 && histogram.max() == histogram.quantile(0.99)) {
+        test_pass("LatencyHistogram log-linear buckets");
+    } else {
+        test_fail("LatencyHistogram log-linear buckets");
+    }
+    
+    Metrics::reset();
+    SymmetricKey key;
+    utils::random_bytes(key.data(), key.size());
+    Nonce nonce = utils::random_nonce();
+    ByteVector message(1000, 0x42);
+    auto sealed = SymmetricCrypto::encrypt_aead(message, key, nonce);
+    SymmetricCrypto::encrypt_aead(message, key, nonce);
+    ByteVector tampered = *sealed;
+    tampered[0] ^= 1;
+    SymmetricCrypto::decrypt_aead(*sealed, key, nonce);
+    SymmetricCrypto::decrypt_aead(tampered, key, nonce);
+    
+    auto signing_keys = KeyManagement::generate_signing_keypair();
+    auto signature = Signing::sign_message(message, signing_keys->secret_key);
+    Signing::verify_signature(message, *signature, signing_keys->public_key);
+    
+    StreamingEncryption encryption(key, nonce, 256);
+    encryption.encrypt_parallel(message);
+    
+    std::vector<std::thread> workers;
+    for (int t = 0; t < 4; ++t) {
+        workers.emplace_back([&key, &nonce, &message] {
+            for (int i = 0; i < 100; ++i) {
+                SymmetricCrypto::encrypt_aead(message, key, nonce);
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    
+    MetricsSnapshot snapshot = Metrics::snapshot();
+    const OpMetrics& encrypts = snapshot[MetricOp::AeadEncrypt];
+    const OpMetrics& decrypts = snapshot[MetricOp::AeadDecrypt];
+    const OpMetrics& chunks = snapshot[MetricOp::StreamEncryptChunk];
+    bool recorded;
+    if (Metrics::enabled()) {
+        // Each of the 4 stream chunks also counts as one AEAD encrypt
+        recorded = snapshot.enabled && encrypts.ops == 2 + 4 + 400 && encrypts.failures == 0 &&
+                   encrypts.bytes == 403 * 1000 &&
+                   encrypts.latency.count() == encrypts.ops &&
+                   decrypts.ops == 2 && decrypts.failures == 1 &&
+                   snapshot[MetricOp::Sign].ops == 1 && snapshot[MetricOp::Verify].ops == 1 &&
+                   snapshot[MetricOp::Verify].failures == 0 &&
+                   chunks.ops == 4 && chunks.bytes == 1000 && encrypts.latency.quantile(0.5) > 0;
+    } else {
+        recorded = !snapshot.enabled && encrypts.ops == 0 && chunks.ops == 0;
+    }
+    if (recorded) {
+        test_pass("Metrics snapshot counts operations across threads");
+    } else {
+        test_fail("Metrics snapshot counts operations across threads");
+    }
 }
 
 int main() {
@@ -275,6 +1661,15 @@ int main() {
     test_symmetric_crypto();
     test_signing();
     test_streaming();
+    test_stream_pipeline();
+    test_container();
+    test_file_crypto();
+    test_async_file_crypto();
+    test_message_store();
+    test_wire_codec();
+    test_replay_window();
+    test_secure_memory();
+    test_metrics();
     
     std::cout << "\n=============================" << std::endl;
     std::cout << "Tests passed: " << tests_passed << std::endl;
@@ -5,9 +5,32 @@
 #include "key_exchange.hpp"
 #include "symmetric_crypto.hpp"
 #include "signing.hpp"
+#include "session_cache.hpp"
+#include "file_crypto.hpp"
+#include "message_store.hpp"
+#include "wire_codec.hpp"
+#include "replay_window.hpp"
+#include "metrics.hpp"
+#include "key_pool.hpp"
+#include <sodium.h>
+#include <cmath>
+#include <functional>
+#include <memory>
 
 using namespace spear::crypto;
 
+static SessionKeyCache& session_cache() {
+    static SessionKeyCache cache;
+    return cache;
+}
+
+// Cache entries are keyed by a hash of the local secret key, never the key itself
+static std::string local_key_id(const SecretKey& secret_key) {
+    uint8_t id[16];
+    crypto_generichash(id, sizeof(id), secret_key.data(), secret_key.size(), nullptr, 0);
+    return std::string(reinterpret_cast<const char*>(id), sizeof(id));
+}
+
 Napi::Object GenerateKeypair(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
@@ -65,7 +88,7 @@ Napi::Value DeriveSharedSecret(const Napi::CallbackInfo& info) {
     std::copy(secret_buf.Data(), secret_buf.Data() + SECRET_KEY_SIZE, secret_key.begin());
     std::copy(public_buf.Data(), public_buf.Data() + PUBLIC_KEY_SIZE, public_key.begin());
     
-    auto shared_secret = KeyExchange::derive_shared_secret(secret_key, public_key);
+    auto shared_secret = session_cache().shared_secret(local_key_id(secret_key), secret_key, public_key);
     if (!shared_secret) {
         Napi::Error::New(env, "Key exchange failed").ThrowAsJavaScriptException();
         return env.Null();
@@ -74,6 +97,48 @@ Napi::Value DeriveSharedSecret(const Napi::CallbackInfo& info) {
     return Napi::Buffer<uint8_t>::Copy(env, shared_secret->data(), SHARED_SECRET_SIZE);
 }
 
+Napi::Object SessionCacheStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    SessionKeyCache::Stats stats = session_cache().stats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+    result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+    result.Set("evictions", Napi::Number::New(env, static_cast<double>(stats.evictions)));
+    result.Set("size", Napi::Number::New(env, static_cast<double>(stats.size)));
+    
+    return result;
+}
+
+// Optional trailing cipher argument: "chacha20-poly1305" (the default, since
+// raw ciphertext carries no header), "aes-256-gcm", or "auto" for the fastest
+// cipher this CPU supports. Both peers must use the same choice.
+static bool aead_algorithm_arg(const Napi::CallbackInfo& info, size_t index, AeadAlgorithm& out) {
+    out = AeadAlgorithm::ChaCha20Poly1305;
+    if (info.Length() <= index || info[index].IsUndefined()) {
+        return true;
+    }
+    if (!info[index].IsString()) {
+        return false;
+    }
+    
+    std::string name = info[index].As<Napi::String>().Utf8Value();
+    if (name == "auto") {
+        out = SymmetricCrypto::preferred_algorithm();
+    } else if (name == SymmetricCrypto::algorithm_name(AeadAlgorithm::Aes256Gcm)) {
+        out = AeadAlgorithm::Aes256Gcm;
+    } else if (name != SymmetricCrypto::algorithm_name(AeadAlgorithm::ChaCha20Poly1305)) {
+        return false;
+    }
+    return SymmetricCrypto::is_available(out);
+}
+
+Napi::Value PreferredAeadAlgorithm(const Napi::CallbackInfo& info) {
+    return Napi::String::New(info.Env(),
+        SymmetricCrypto::algorithm_name(SymmetricCrypto::preferred_algorithm()));
+}
+
 Napi::Value Encrypt(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
     
@@ -91,19 +156,29 @@ Napi::Value Encrypt(const Napi::CallbackInfo& info) {
         return env.Null();
     }
     
-    ByteVector plaintext(plaintext_buf.Data(), plaintext_buf.Data() + plaintext_buf.Length());
+    AeadAlgorithm algorithm;
+    if (!aead_algorithm_arg(info, 3, algorithm)) {
+        Napi::TypeError::New(env, "Unsupported AEAD algorithm").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
     SymmetricKey key;
     Nonce nonce;
     std::copy(key_buf.Data(), key_buf.Data() + SYMMETRIC_KEY_SIZE, key.begin());
     std::copy(nonce_buf.Data(), nonce_buf.Data() + NONCE_SIZE, nonce.begin());
     
-    auto ciphertext = SymmetricCrypto::encrypt_aead(plaintext, key, nonce);
-    if (!ciphertext) {
+    Napi::Buffer<uint8_t> ciphertext = Napi::Buffer<uint8_t>::New(
+        env, plaintext_buf.Length() + SymmetricCrypto::TAG_SIZE);
+    
+    auto written = SymmetricCrypto::encrypt_aead(
+        ConstByteSpan(plaintext_buf.Data(), plaintext_buf.Length()), key, nonce, {},
+        ByteSpan(ciphertext.Data(), ciphertext.Length()), algorithm);
+    if (!written) {
         Napi::Error::New(env, "Encryption failed").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    return Napi::Buffer<uint8_t>::Copy(env, ciphertext->data(), ciphertext->size());
+    return ciphertext;
 }
 
 Napi::Value Decrypt(const Napi::CallbackInfo& info) {
@@ -123,19 +198,135 @@ Napi::Value Decrypt(const Napi::CallbackInfo& info) {
         return env.Null();
     }
     
-    ByteVector ciphertext(ciphertext_buf.Data(), ciphertext_buf.Data() + ciphertext_buf.Length());
+    AeadAlgorithm algorithm;
+    if (!aead_algorithm_arg(info, 3, algorithm)) {
+        Napi::TypeError::New(env, "Unsupported AEAD algorithm").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (ciphertext_buf.Length() < SymmetricCrypto::TAG_SIZE) {
+        Napi::Error::New(env, "Decryption failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    SymmetricKey key;
+    Nonce nonce;
+    std::copy(key_buf.Data(), key_buf.Data() + SYMMETRIC_KEY_SIZE, key.begin());
+    std::copy(nonce_buf.Data(), nonce_buf.Data() + NONCE_SIZE, nonce.begin());
+    
+    Napi::Buffer<uint8_t> plaintext = Napi::Buffer<uint8_t>::New(
+        env, ciphertext_buf.Length() - SymmetricCrypto::TAG_SIZE);
+    
+    auto written = SymmetricCrypto::decrypt_aead(
+        ConstByteSpan(ciphertext_buf.Data(), ciphertext_buf.Length()), key, nonce, {},
+        ByteSpan(plaintext.Data(), plaintext.Length()), algorithm);
+    if (!written) {
+        Napi::Error::New(env, "Decryption failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return plaintext;
+}
+
+// Encrypts into a caller-supplied buffer and returns the number of bytes
+// written. `out` may be `plaintext` itself when it has TAG_SIZE spare bytes.
+Napi::Value EncryptInto(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsBuffer() || !info[1].IsBuffer() ||
+        !info[2].IsBuffer() || !info[3].IsBuffer()) {
+        Napi::TypeError::New(env, "Expected four buffers (plaintext, key, nonce, out)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Buffer<uint8_t> plaintext_buf = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> key_buf = info[1].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> nonce_buf = info[2].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> out_buf = info[3].As<Napi::Buffer<uint8_t>>();
+    
+    if (key_buf.Length() != SYMMETRIC_KEY_SIZE || nonce_buf.Length() != NONCE_SIZE) {
+        Napi::TypeError::New(env, "Invalid key or nonce size").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    AeadAlgorithm algorithm;
+    if (!aead_algorithm_arg(info, 4, algorithm)) {
+        Napi::TypeError::New(env, "Unsupported AEAD algorithm").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (out_buf.Length() < plaintext_buf.Length() + SymmetricCrypto::TAG_SIZE) {
+        Napi::RangeError::New(env, "Output buffer too small").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    SymmetricKey key;
+    Nonce nonce;
+    std::copy(key_buf.Data(), key_buf.Data() + SYMMETRIC_KEY_SIZE, key.begin());
+    std::copy(nonce_buf.Data(), nonce_buf.Data() + NONCE_SIZE, nonce.begin());
+    
+    auto written = SymmetricCrypto::encrypt_aead(
+        ConstByteSpan(plaintext_buf.Data(), plaintext_buf.Length()), key, nonce, {},
+        ByteSpan(out_buf.Data(), out_buf.Length()), algorithm);
+    if (!written) {
+        Napi::Error::New(env, "Encryption failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    return Napi::Number::New(env, static_cast<double>(*written));
+}
+
+// Decrypts into a caller-supplied buffer and returns the number of bytes
+// written. `out` may be `ciphertext` itself.
+Napi::Value DecryptInto(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 4 || !info[0].IsBuffer() || !info[1].IsBuffer() ||
+        !info[2].IsBuffer() || !info[3].IsBuffer()) {
+        Napi::TypeError::New(env, "Expected four buffers (ciphertext, key, nonce, out)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Buffer<uint8_t> ciphertext_buf = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> key_buf = info[1].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> nonce_buf = info[2].As<Napi::Buffer<uint8_t>>();
+    Napi::Buffer<uint8_t> out_buf = info[3].As<Napi::Buffer<uint8_t>>();
+    
+    if (key_buf.Length() != SYMMETRIC_KEY_SIZE || nonce_buf.Length() != NONCE_SIZE) {
+        Napi::TypeError::New(env, "Invalid key or nonce size").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    AeadAlgorithm algorithm;
+    if (!aead_algorithm_arg(info, 4, algorithm)) {
+        Napi::TypeError::New(env, "Unsupported AEAD algorithm").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (ciphertext_buf.Length() < SymmetricCrypto::TAG_SIZE) {
+        Napi::Error::New(env, "Decryption failed").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    if (out_buf.Length() < ciphertext_buf.Length() - SymmetricCrypto::TAG_SIZE) {
+        Napi::RangeError::New(env, "Output buffer too small").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
     SymmetricKey key;
     Nonce nonce;
     std::copy(key_buf.Data(), key_buf.Data() + SYMMETRIC_KEY_SIZE, key.begin());
     std::copy(nonce_buf.Data(), nonce_buf.Data() + NONCE_SIZE, nonce.begin());
     
-    auto plaintext = SymmetricCrypto::decrypt_aead(ciphertext, key, nonce);
-    if (!plaintext) {
+    auto written = SymmetricCrypto::decrypt_aead(
+        ConstByteSpan(ciphertext_buf.Data(), ciphertext_buf.Length()), key, nonce, {},
+        ByteSpan(out_buf.Data(), out_buf.Length()), algorithm);
+    if (!written) {
         Napi::Error::New(env, "Decryption failed").ThrowAsJavaScriptException();
         return env.Null();
     }
     
-    return Napi::Buffer<uint8_t>::Copy(env, plaintext->data(), plaintext->size());
+    return Napi::Number::New(env, static_cast<double>(*written));
 }
 
 Napi::Value Sign(const Napi::CallbackInfo& info) {
@@ -154,7 +345,7 @@ Napi::Value Sign(const Napi::CallbackInfo& info) {
         return env.Null();
     }
     
-    ByteVector message(message_buf.Data(), message_buf.Data() + message_buf.Length());
+    ConstByteSpan message(message_buf.Data(), message_buf.Length());
     SigningSecretKey secret_key;
     std::copy(key_buf.Data(), key_buf.Data() + SIGNING_SECRET_KEY_SIZE, secret_key.begin());
     
@@ -184,7 +375,7 @@ Napi::Value Verify(const Napi::CallbackInfo& info) {
         return env.Null();
     }
     
-    ByteVector message(message_buf.Data(), message_buf.Data() + message_buf.Length());
+    ConstByteSpan message(message_buf.Data(), message_buf.Length());
     Signature signature;
     SigningPublicKey public_key;
     std::copy(sig_buf.Data(), sig_buf.Data() + SIGNATURE_SIZE, signature.begin());
@@ -194,19 +385,1361 @@ Napi::Value Verify(const Napi::CallbackInfo& info) {
     return Napi::Boolean::New(env, valid);
 }
 
-Napi::Object Init(Napi::Env env, Napi::Object exports) {
-    if (!utils::initialize()) {
-        Napi::Error::New(env, "Failed to initialize crypto library").ThrowAsJavaScriptException();
-        return exports;
+Napi::Value VerifyBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsArray() || !info[1].IsArray() || !info[2].IsArray()) {
+        Napi::TypeError::New(env, "Expected three arrays (messages, signatures, publicKeys)").ThrowAsJavaScriptException();
+        return env.Null();
     }
     
-    exports.Set("generateKeypair", Napi::Function::New(env, GenerateKeypair));
-    exports.Set("generateSigningKeypair", Napi::Function::New(env, GenerateSigningKeypair));
-    exports.Set("deriveSharedSecret", Napi::Function::New(env, DeriveSharedSecret));
-    exports.Set("encrypt", Napi::Function::New(env, Encrypt));
-    exports.Set("decrypt", Napi::Function::New(env, Decrypt));
-    exports.Set("sign", Napi::Function::New(env, Sign));
-    exports.Set("verify", Napi::Function::New(env, Verify));
+    Napi::Array messages = info[0].As<Napi::Array>();
+    Napi::Array signatures = info[1].As<Napi::Array>();
+    Napi::Array public_keys = info[2].As<Napi::Array>();
+    
+    uint32_t count = messages.Length();
+    if (signatures.Length() != count || public_keys.Length() != count) {
+        Napi::TypeError::New(env, "Array lengths differ").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::vector<SignatureCheck> checks(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        Napi::Value message_val = messages.Get(i);
+        Napi::Value sig_val = signatures.Get(i);
+        Napi::Value key_val = public_keys.Get(i);
+        
+        if (!message_val.IsBuffer() || !sig_val.IsBuffer() || !key_val.IsBuffer()) {
+            Napi::TypeError::New(env, "Expected arrays of buffers").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        
+        Napi::Buffer<uint8_t> message_buf = message_val.As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> sig_buf = sig_val.As<Napi::Buffer<uint8_t>>();
+        Napi::Buffer<uint8_t> key_buf = key_val.As<Napi::Buffer<uint8_t>>();
+        
+        if (sig_buf.Length() != SIGNATURE_SIZE || key_buf.Length() != SIGNING_PUBLIC_KEY_SIZE) {
+            Napi::TypeError::New(env, "Invalid signature or key size").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        
+        checks[i].message = ConstByteSpan(message_buf.Data(), message_buf.Length());
+        std::copy(sig_buf.Data(), sig_buf.Data() + SIGNATURE_SIZE, checks[i].signature.begin());
+        std::copy(key_buf.Data(), key_buf.Data() + SIGNING_PUBLIC_KEY_SIZE, checks[i].public_key.begin());
+    }
+    
+    BatchVerifyResult result = Signing::verify_batch(checks);
+    
+    Napi::Array valid = Napi::Array::New(env, count);
+    for (uint32_t i = 0; i < count; ++i) {
+        valid.Set(i, Napi::Boolean::New(env, result.valid(i)));
+    }
+    
+    return valid;
+}
+
+// Payloads smaller than this are processed inline: the hop to the libuv
+// thread pool costs more than sealing a few kilobytes.
+static size_t async_threshold = 64 * 1024;
+
+// Runs `work` on the libuv thread pool and settles a promise with the value
+// built by `resolve` back on the main thread.
+class PromiseWorker : public Napi::AsyncWorker {
+public:
+    using Work = std::function<bool()>;
+    using Resolve = std::function<Napi::Value(Napi::Env)>;
+    
+    PromiseWorker(Napi::Env env, const char* error, Work work, Resolve resolve)
+        : Napi::AsyncWorker(env),
+          deferred_(Napi::Promise::Deferred::New(env)),
+          error_(error),
+          work_(std::move(work)),
+          resolve_(std::move(resolve)) {
+    }
+    
+    Napi::Promise Promise() const { return deferred_.Promise(); }
+    
+    void Execute() override {
+        if (!work_()) {
+            SetError(error_);
+        }
+    }
+    
+    void OnOK() override {
+        deferred_.Resolve(resolve_(Env()));
+    }
+    
+    void OnError(const Napi::Error& error) override {
+        deferred_.Reject(error.Value());
+    }
+
+private:
+    Napi::Promise::Deferred deferred_;
+    std::string error_;
+    Work work_;
+    Resolve resolve_;
+};
+
+static Napi::Value run_async(Napi::Env env, bool offload, const char* error,
+                             PromiseWorker::Work work, PromiseWorker::Resolve resolve) {
+    if (offload) {
+        PromiseWorker* worker = new PromiseWorker(env, error, std::move(work), std::move(resolve));
+        Napi::Promise promise = worker->Promise();
+        worker->Queue();
+        return promise;
+    }
+    
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    if (work()) {
+        deferred.Resolve(resolve(env));
+    } else {
+        deferred.Reject(Napi::Error::New(env, error).Value());
+    }
+    return deferred.Promise();
+}
+
+static Napi::Value rejected(Napi::Env env, const char* message) {
+    Napi::Promise::Deferred deferred = Napi::Promise::Deferred::New(env);
+    deferred.Reject(Napi::TypeError::New(env, message).Value());
+    return deferred.Promise();
+}
+
+static bool all_buffers(const Napi::CallbackInfo& info, size_t count) {
+    if (info.Length() < count) {
+        return false;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        if (!info[i].IsBuffer()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <size_t N>
+static bool copy_exact(const Napi::Value& value, std::array<uint8_t, N>& out) {
+    Napi::Buffer<uint8_t> buf = value.As<Napi::Buffer<uint8_t>>();
+    if (buf.Length() != N) {
+        return false;
+    }
+    std::copy(buf.Data(), buf.Data() + N, out.begin());
+    return true;
+}
+
+// Keeps a JS buffer alive for the lifetime of a worker and returns a view of
+// its memory, so the worker reads the caller's bytes in place. Callers must
+// not mutate the buffer until the promise settles.
+static ConstByteSpan pin_buffer(const Napi::Value& value, Napi::ObjectReference& ref) {
+    Napi::Buffer<uint8_t> buf = value.As<Napi::Buffer<uint8_t>>();
+    ref = Napi::Persistent(buf);
+    return ConstByteSpan(buf.Data(), buf.Length());
+}
+
+// Hands native memory to JS without copying; V8 frees it with the Buffer
+static Napi::Buffer<uint8_t> external_buffer(Napi::Env env, ByteVector&& data) {
+    if (data.empty()) {
+        return Napi::Buffer<uint8_t>::New(env, 0);
+    }
+    
+    ByteVector* owned = new ByteVector(std::move(data));
+    return Napi::Buffer<uint8_t>::New(env, owned->data(), owned->size(),
+        [](Napi::Env, uint8_t*, ByteVector* hint) { delete hint; }, owned);
+}
+
+static Napi::Value keypair_object(Napi::Env env, const uint8_t* public_key, size_t public_size,
+                                  const uint8_t* secret_key, size_t secret_size) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("publicKey", Napi::Buffer<uint8_t>::Copy(env, public_key, public_size));
+    result.Set("secretKey", Napi::Buffer<uint8_t>::Copy(env, secret_key, secret_size));
+    return result;
+}
+
+Napi::Value GenerateKeypairAsync(const Napi::CallbackInfo& info) {
+    auto keypair = std::make_shared<std::optional<KeyPair>>();
+    
+    return run_async(info.Env(), true, "Failed to generate keypair",
+        [keypair] {
+            *keypair = KeyManagement::generate_keypair();
+            return keypair->has_value();
+        },
+        [keypair](Napi::Env env) {
+            return keypair_object(env, (*keypair)->public_key.data(), PUBLIC_KEY_SIZE,
+                                  (*keypair)->secret_key.data(), SECRET_KEY_SIZE);
+        });
+}
+
+Napi::Value GenerateSigningKeypairAsync(const Napi::CallbackInfo& info) {
+    auto keypair = std::make_shared<std::optional<SigningKeyPair>>();
+    
+    return run_async(info.Env(), true, "Failed to generate signing keypair",
+        [keypair] {
+            *keypair = KeyManagement::generate_signing_keypair();
+            return keypair->has_value();
+        },
+        [keypair](Napi::Env env) {
+            return keypair_object(env, (*keypair)->public_key.data(), SIGNING_PUBLIC_KEY_SIZE,
+                                  (*keypair)->secret_key.data(), SIGNING_SECRET_KEY_SIZE);
+        });
+}
+
+Napi::Value DeriveSharedSecretAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        SecretKey secret_key;
+        PublicKey public_key;
+        std::optional<SharedSecret> shared_secret;
+        ~State() { utils::secure_memzero(secret_key.data(), secret_key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (!all_buffers(info, 2) ||
+        !copy_exact(info[0], state->secret_key) || !copy_exact(info[1], state->public_key)) {
+        return rejected(env, "Expected two buffers (secretKey, publicKey)");
+    }
+    
+    return run_async(env, true, "Key exchange failed",
+        [state] {
+            state->shared_secret = session_cache().shared_secret(
+                local_key_id(state->secret_key), state->secret_key, state->public_key);
+            return state->shared_secret.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Buffer<uint8_t>::Copy(env, state->shared_secret->data(), SHARED_SECRET_SIZE);
+        });
+}
+
+Napi::Value EncryptAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        Napi::ObjectReference input_ref;
+        ConstByteSpan input;
+        SymmetricKey key;
+        Nonce nonce;
+        AeadAlgorithm algorithm;
+        ByteVector output;
+        ~State() { utils::secure_memzero(key.data(), key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (!all_buffers(info, 3) ||
+        !copy_exact(info[1], state->key) || !copy_exact(info[2], state->nonce)) {
+        return rejected(env, "Expected three buffers (plaintext, key, nonce)");
+    }
+    if (!aead_algorithm_arg(info, 3, state->algorithm)) {
+        return rejected(env, "Unsupported AEAD algorithm");
+    }
+    state->input = pin_buffer(info[0], state->input_ref);
+    
+    return run_async(env, state->input.size() >= async_threshold, "Encryption failed",
+        [state] {
+            state->output.resize(state->input.size() + SymmetricCrypto::TAG_SIZE);
+            return SymmetricCrypto::encrypt_aead(
+                state->input, state->key, state->nonce, {}, state->output, state->algorithm).has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return external_buffer(env, std::move(state->output));
+        });
+}
+
+Napi::Value DecryptAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        Napi::ObjectReference input_ref;
+        ConstByteSpan input;
+        SymmetricKey key;
+        Nonce nonce;
+        AeadAlgorithm algorithm;
+        ByteVector output;
+        ~State() { utils::secure_memzero(key.data(), key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (!all_buffers(info, 3) ||
+        !copy_exact(info[1], state->key) || !copy_exact(info[2], state->nonce)) {
+        return rejected(env, "Expected three buffers (ciphertext, key, nonce)");
+    }
+    if (!aead_algorithm_arg(info, 3, state->algorithm)) {
+        return rejected(env, "Unsupported AEAD algorithm");
+    }
+    state->input = pin_buffer(info[0], state->input_ref);
+    
+    return run_async(env, state->input.size() >= async_threshold, "Decryption failed",
+        [state] {
+            if (state->input.size() < SymmetricCrypto::TAG_SIZE) {
+                return false;
+            }
+            state->output.resize(state->input.size() - SymmetricCrypto::TAG_SIZE);
+            return SymmetricCrypto::decrypt_aead(
+                state->input, state->key, state->nonce, {}, state->output, state->algorithm).has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return external_buffer(env, std::move(state->output));
+        });
+}
+
+Napi::Value SignAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        Napi::ObjectReference message_ref;
+        ConstByteSpan message;
+        SigningSecretKey secret_key;
+        std::optional<Signature> signature;
+        ~State() { utils::secure_memzero(secret_key.data(), secret_key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (!all_buffers(info, 2) || !copy_exact(info[1], state->secret_key)) {
+        return rejected(env, "Expected two buffers (message, secretKey)");
+    }
+    state->message = pin_buffer(info[0], state->message_ref);
+    
+    return run_async(env, state->message.size() >= async_threshold, "Signing failed",
+        [state] {
+            state->signature = Signing::sign_message(state->message, state->secret_key);
+            return state->signature.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Buffer<uint8_t>::Copy(env, state->signature->data(), SIGNATURE_SIZE);
+        });
+}
+
+Napi::Value VerifyAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        Napi::ObjectReference message_ref;
+        ConstByteSpan message;
+        Signature signature;
+        SigningPublicKey public_key;
+        bool valid = false;
+    };
+    auto state = std::make_shared<State>();
+    
+    if (!all_buffers(info, 3) ||
+        !copy_exact(info[1], state->signature) || !copy_exact(info[2], state->public_key)) {
+        return rejected(env, "Expected three buffers (message, signature, publicKey)");
+    }
+    state->message = pin_buffer(info[0], state->message_ref);
+    
+    return run_async(env, state->message.size() >= async_threshold, "Verification failed",
+        [state] {
+            state->valid = Signing::verify_signature(state->message, state->signature, state->public_key);
+            return true;
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Boolean::New(env, state->valid);
+        });
+}
+
+Napi::Value VerifyBatchAsync(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 3 || !info[0].IsArray() || !info[1].IsArray() || !info[2].IsArray()) {
+        return rejected(env, "Expected three arrays (messages, signatures, publicKeys)");
+    }
+    
+    Napi::Array messages = info[0].As<Napi::Array>();
+    Napi::Array signatures = info[1].As<Napi::Array>();
+    Napi::Array public_keys = info[2].As<Napi::Array>();
+    
+    uint32_t count = messages.Length();
+    if (signatures.Length() != count || public_keys.Length() != count) {
+        return rejected(env, "Array lengths differ");
+    }
+    
+    struct State {
+        std::vector<Napi::ObjectReference> message_refs;
+        std::vector<SignatureCheck> checks;
+        BatchVerifyResult result;
+    };
+    auto state = std::make_shared<State>();
+    state->message_refs.resize(count);
+    state->checks.resize(count);
+    
+    size_t total_size = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        Napi::Value message_val = messages.Get(i);
+        Napi::Value sig_val = signatures.Get(i);
+        Napi::Value key_val = public_keys.Get(i);
+        
+        if (!message_val.IsBuffer() || !sig_val.IsBuffer() || !key_val.IsBuffer() ||
+            !copy_exact(sig_val, state->checks[i].signature) ||
+            !copy_exact(key_val, state->checks[i].public_key)) {
+            return rejected(env, "Expected arrays of buffers with valid signature and key sizes");
+        }
+        
+        state->checks[i].message = pin_buffer(message_val, state->message_refs[i]);
+        total_size += state->checks[i].message.size();
+    }
+    
+    bool offload = count >= Signing::PARALLEL_BATCH_THRESHOLD || total_size >= async_threshold;
+    
+    return run_async(env, offload, "Verification failed",
+        [state] {
+            state->result = Signing::verify_batch(state->checks);
+            return true;
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            Napi::Array valid = Napi::Array::New(env, state->result.count);
+            for (uint32_t i = 0; i < state->result.count; ++i) {
+                valid.Set(i, Napi::Boolean::New(env, state->result.valid(i)));
+            }
+            return valid;
+        });
+}
+
+// File encryption always runs off the main thread: it is bound by disk I/O
+// regardless of size. Resolves with the number of plaintext bytes processed.
+Napi::Value EncryptFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        std::string input_path;
+        std::string output_path;
+        SymmetricKey key;
+        size_t chunk_size = StreamingEncryption::DEFAULT_CHUNK_SIZE;
+        std::optional<uint64_t> processed;
+        ~State() { utils::secure_memzero(key.data(), key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsString() || !info[2].IsBuffer() ||
+        !copy_exact(info[2], state->key) ||
+        (info.Length() > 3 && !info[3].IsUndefined() && !info[3].IsNumber())) {
+        return rejected(env, "Expected (inputPath, outputPath, key[, chunkSize])");
+    }
+    state->input_path = info[0].As<Napi::String>().Utf8Value();
+    state->output_path = info[1].As<Napi::String>().Utf8Value();
+    if (info.Length() > 3 && info[3].IsNumber()) {
+        double chunk_size = info[3].As<Napi::Number>().DoubleValue();
+        if (chunk_size < 1 || chunk_size > UINT32_MAX) {
+            return rejected(env, "chunkSize must be between 1 and 2^32 - 1");
+        }
+        state->chunk_size = static_cast<size_t>(chunk_size);
+    }
+    
+    return run_async(env, true, "File encryption failed",
+        [state] {
+            state->processed = FileCrypto::encrypt_file(
+                state->input_path, state->output_path, state->key, state->chunk_size);
+            return state->processed.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Number::New(env, static_cast<double>(*state->processed));
+        });
+}
+
+Napi::Value DecryptFile(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        std::string input_path;
+        std::string output_path;
+        SymmetricKey key;
+        std::optional<uint64_t> processed;
+        ~State() { utils::secure_memzero(key.data(), key.size()); }
+    };
+    auto state = std::make_shared<State>();
+    
+    if (info.Length() < 3 || !info[0].IsString() || !info[1].IsString() || !info[2].IsBuffer() ||
+        !copy_exact(info[2], state->key)) {
+        return rejected(env, "Expected (inputPath, outputPath, key)");
+    }
+    state->input_path = info[0].As<Napi::String>().Utf8Value();
+    state->output_path = info[1].As<Napi::String>().Utf8Value();
+    
+    return run_async(env, true, "File decryption failed",
+        [state] {
+            state->processed = FileCrypto::decrypt_file(
+                state->input_path, state->output_path, state->key);
+            return state->processed.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Number::New(env, static_cast<double>(*state->processed));
+        });
+}
+
+// Shared state for encryptBatch/decryptBatch and their async variants. Keys
+// are copied once (a single key buffer is shared by every item); message and
+// AAD buffers are pinned and read in place.
+struct AeadBatchState {
+    std::vector<Napi::ObjectReference> refs;
+    std::vector<SymmetricKey> keys;
+    std::vector<AeadBatchItem> items;
+    AeadBatchResult result;
+    size_t total_size = 0;
+    ~AeadBatchState() {
+        for (SymmetricKey& key : keys) {
+            utils::secure_memzero(key.data(), key.size());
+        }
+    }
+};
+
+// Arguments: (inputs[], key | keys[], nonces[], aads[]?, algorithm?)
+static const char* parse_aead_batch(const Napi::CallbackInfo& info, AeadBatchState& state) {
+    if (info.Length() < 3 || !info[0].IsArray() || !info[2].IsArray() ||
+        !(info[1].IsBuffer() || info[1].IsArray())) {
+        return "Expected (inputs[], key or keys[], nonces[], aads[]?, algorithm?)";
+    }
+    
+    Napi::Array inputs = info[0].As<Napi::Array>();
+    Napi::Array nonces = info[2].As<Napi::Array>();
+    bool shared_key = info[1].IsBuffer();
+    bool has_aad = info.Length() > 3 && !info[3].IsUndefined() && !info[3].IsNull();
+    
+    uint32_t count = inputs.Length();
+    if (nonces.Length() != count ||
+        (!shared_key && info[1].As<Napi::Array>().Length() != count) ||
+        (has_aad && (!info[3].IsArray() || info[3].As<Napi::Array>().Length() != count))) {
+        return "Array lengths differ";
+    }
+    
+    AeadAlgorithm algorithm;
+    if (!aead_algorithm_arg(info, 4, algorithm)) {
+        return "Unsupported AEAD algorithm";
+    }
+    
+    // Items hold pointers into `keys`, so it must not reallocate
+    state.keys.resize(shared_key ? 1 : count);
+    state.refs.resize(has_aad ? 2 * count : count);
+    state.items.resize(count);
+    
+    if (shared_key && !copy_exact(info[1], state.keys[0])) {
+        return "Invalid key size";
+    }
+    
+    for (uint32_t i = 0; i < count; ++i) {
+        Napi::Value input_val = inputs.Get(i);
+        Napi::Value nonce_val = nonces.Get(i);
+        if (!input_val.IsBuffer() || !nonce_val.IsBuffer() ||
+            !copy_exact(nonce_val, state.items[i].nonce)) {
+            return "Expected arrays of buffers with valid nonce sizes";
+        }
+        
+        if (!shared_key) {
+            Napi::Value key_val = info[1].As<Napi::Array>().Get(i);
+            if (!key_val.IsBuffer() || !copy_exact(key_val, state.keys[i])) {
+                return "Invalid key size";
+            }
+        }
+        
+        if (has_aad) {
+            Napi::Value aad_val = info[3].As<Napi::Array>().Get(i);
+            if (!aad_val.IsBuffer()) {
+                return "Expected an array of AAD buffers";
+            }
+            state.items[i].aad = pin_buffer(aad_val, state.refs[count + i]);
+        }
+        
+        state.items[i].input = pin_buffer(input_val, state.refs[i]);
+        state.items[i].key = &state.keys[shared_key ? 0 : i];
+        state.items[i].algorithm = algorithm;
+        state.total_size += state.items[i].input.size();
+    }
+    
+    return nullptr;
+}
+
+// { data: Buffer, offsets: number[count + 1], ok: boolean[count] }; item i is
+// data.subarray(offsets[i], offsets[i + 1]). The arena is handed over without
+// copying.
+static Napi::Value batch_result_object(Napi::Env env, AeadBatchResult& result) {
+    Napi::Array offsets = Napi::Array::New(env, result.offsets.size());
+    for (uint32_t i = 0; i < result.offsets.size(); ++i) {
+        offsets.Set(i, Napi::Number::New(env, static_cast<double>(result.offsets[i])));
+    }
+    
+    Napi::Array ok = Napi::Array::New(env, result.size());
+    for (uint32_t i = 0; i < result.size(); ++i) {
+        ok.Set(i, Napi::Boolean::New(env, result.ok(i)));
+    }
+    
+    Napi::Object object = Napi::Object::New(env);
+    object.Set("data", external_buffer(env, std::move(result.arena)));
+    object.Set("offsets", offsets);
+    object.Set("ok", ok);
+    return object;
+}
+
+static Napi::Value run_aead_batch(const Napi::CallbackInfo& info, bool encrypt, bool async) {
+    Napi::Env env = info.Env();
+    auto state = std::make_shared<AeadBatchState>();
+    
+    if (const char* error = parse_aead_batch(info, *state)) {
+        if (async) {
+            return rejected(env, error);
+        }
+        Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    auto work = [state, encrypt] {
+        state->result = encrypt ? SymmetricCrypto::encrypt_batch(state->items)
+                                : SymmetricCrypto::decrypt_batch(state->items);
+        return true;
+    };
+    
+    if (!async) {
+        work();
+        return batch_result_object(env, state->result);
+    }
+    
+    bool offload = state->total_size >= async_threshold;
+    return run_async(env, offload, encrypt ? "Encryption failed" : "Decryption failed", work,
+        [state](Napi::Env env) { return batch_result_object(env, state->result); });
+}
+
+Napi::Value EncryptBatch(const Napi::CallbackInfo& info) {
+    return run_aead_batch(info, true, false);
+}
+
+Napi::Value DecryptBatch(const Napi::CallbackInfo& info) {
+    return run_aead_batch(info, false, false);
+}
+
+Napi::Value EncryptBatchAsync(const Napi::CallbackInfo& info) {
+    return run_aead_batch(info, true, true);
+}
+
+Napi::Value DecryptBatchAsync(const Napi::CallbackInfo& info) {
+    return run_aead_batch(info, false, true);
+}
+
+// Counters and message ids arrive as JS numbers, so they are limited to 2^53
+static bool counter_arg(const Napi::Value& value, uint64_t& out) {
+    if (!value.IsNumber()) {
+        return false;
+    }
+    double counter = value.As<Napi::Number>().DoubleValue();
+    if (!(counter >= 0) || counter > 9007199254740991.0 || counter != std::floor(counter)) {
+        return false;
+    }
+    out = static_cast<uint64_t>(counter);
+    return true;
+}
+
+// Relay message queue. Opened once per process; async workers hold their own
+// reference so an in-flight commit never outlives the store.
+static std::shared_ptr<MessageStore> message_store;
+
+static std::shared_ptr<MessageStore> open_store_or_throw(Napi::Env env) {
+    if (!message_store) {
+        Napi::Error::New(env, "Message store is not open").ThrowAsJavaScriptException();
+    }
+    return message_store;
+}
+
+// Arguments: (directory, { segmentSize?, sync? }?)
+Napi::Value OpenMessageStore(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() ||
+        (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsObject())) {
+        Napi::TypeError::New(env, "Expected (directory, options?)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    if (message_store) {
+        Napi::Error::New(env, "Message store is already open").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    MessageStoreOptions options;
+    if (info.Length() > 1 && info[1].IsObject()) {
+        Napi::Object opts = info[1].As<Napi::Object>();
+        if (opts.Has("segmentSize") && opts.Get("segmentSize").IsNumber()) {
+            options.segment_size = static_cast<uint64_t>(opts.Get("segmentSize").As<Napi::Number>().DoubleValue());
+        }
+        if (opts.Has("sync") && opts.Get("sync").IsBoolean()) {
+            options.sync = opts.Get("sync").As<Napi::Boolean>().Value();
+        }
+    }
+    
+    std::unique_ptr<MessageStore> store =
+        MessageStore::open(info[0].As<Napi::String>().Utf8Value(), options);
+    if (!store) {
+        Napi::Error::New(env, "Failed to open message store").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    message_store = std::move(store);
+    return env.Undefined();
+}
+
+// Arguments: (recipient, { fromUsername, content, nonce, signature, counter }).
+// Always offloaded, since the promise settles only after the group commit.
+Napi::Value AppendMessage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        std::shared_ptr<MessageStore> store;
+        std::string recipient;
+        std::string sender;
+        Napi::ObjectReference refs[3];
+        MessageRecord message;
+        std::optional<uint64_t> id;
+    };
+    auto state = std::make_shared<State>();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !info[1].IsObject()) {
+        return rejected(env, "Expected (recipient, message)");
+    }
+    Napi::Object message = info[1].As<Napi::Object>();
+    if (!message.Get("fromUsername").IsString() || !message.Get("content").IsBuffer() ||
+        !message.Get("nonce").IsBuffer() || !message.Get("signature").IsBuffer() ||
+        !counter_arg(message.Get("counter"), state->message.counter)) {
+        return rejected(env, "Message needs fromUsername, content, nonce, signature and counter");
+    }
+    
+    state->store = message_store;
+    if (!state->store) {
+        return rejected(env, "Message store is not open");
+    }
+    state->recipient = info[0].As<Napi::String>().Utf8Value();
+    state->sender = message.Get("fromUsername").As<Napi::String>().Utf8Value();
+    state->message.sender = state->sender;
+    state->message.content = pin_buffer(message.Get("content"), state->refs[0]);
+    state->message.nonce = pin_buffer(message.Get("nonce"), state->refs[1]);
+    state->message.signature = pin_buffer(message.Get("signature"), state->refs[2]);
+    
+    return run_async(env, true, "Failed to store message",
+        [state] {
+            state->id = state->store->append(state->recipient, state->message);
+            return state->id.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Number::New(env, static_cast<double>(*state->id));
+        });
+}
+
+// Arguments: (recipients[], messages[]) of equal length, messages shaped as
+// for appendMessage. Appends them all in one commit and returns the first
+// id; the rest follow consecutively. Blocks until the commit is durable, so
+// it is meant for bulk imports such as the startup migration.
+Napi::Value AppendMessageBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsArray() ||
+        info[0].As<Napi::Array>().Length() != info[1].As<Napi::Array>().Length()) {
+        Napi::TypeError::New(env, "Expected (recipients[], messages[]) of equal length").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    
+    Napi::Array recipient_values = info[0].As<Napi::Array>();
+    Napi::Array message_values = info[1].As<Napi::Array>();
+    uint32_t count = recipient_values.Length();
+    // The records view these strings and the JS buffers, which stay
+    // reachable from the arguments until the call returns
+    std::vector<std::string> names(2 * static_cast<size_t>(count));
+    std::vector<std::string_view> recipients(count);
+    std::vector<MessageRecord> messages(count);
+    auto view = [](const Napi::Value& value) {
+        Napi::Buffer<uint8_t> buf = value.As<Napi::Buffer<uint8_t>>();
+        return ConstByteSpan(buf.Data(), buf.Length());
+    };
+    for (uint32_t i = 0; i < count; ++i) {
+        Napi::Value recipient = recipient_values.Get(i);
+        Napi::Value value = message_values.Get(i);
+        Napi::Object message = value.IsObject() ? value.As<Napi::Object>() : Napi::Object::New(env);
+        if (!recipient.IsString() || !message.Get("fromUsername").IsString() ||
+            !message.Get("content").IsBuffer() || !message.Get("nonce").IsBuffer() ||
+            !message.Get("signature").IsBuffer() || !counter_arg(message.Get("counter"), messages[i].counter)) {
+            Napi::TypeError::New(env, "Message needs fromUsername, content, nonce, signature and counter")
+                .ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        names[2 * i] = recipient.As<Napi::String>().Utf8Value();
+        names[2 * i + 1] = message.Get("fromUsername").As<Napi::String>().Utf8Value();
+        recipients[i] = names[2 * i];
+        messages[i].sender = names[2 * i + 1];
+        messages[i].content = view(message.Get("content"));
+        messages[i].nonce = view(message.Get("nonce"));
+        messages[i].signature = view(message.Get("signature"));
+    }
+    if (count == 0) {
+        return Napi::Number::New(env, 0);
+    }
+    
+    std::optional<uint64_t> first = store->append_batch(recipients, messages);
+    if (!first) {
+        Napi::Error::New(env, "Failed to store messages").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(*first));
+}
+
+// Arguments: (recipient, limit?). Copies each record out of the mapped
+// segment straight into a JS buffer.
+Napi::Value FetchMessages(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() ||
+        (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNumber())) {
+        Napi::TypeError::New(env, "Expected (recipient, limit?)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    
+    size_t limit = SIZE_MAX;
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        limit = static_cast<size_t>(std::max(0.0, info[1].As<Napi::Number>().DoubleValue()));
+    }
+    
+    MessageBatch batch = store->fetch(info[0].As<Napi::String>().Utf8Value(), limit);
+    Napi::Array result = Napi::Array::New(env, batch.size());
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const MessageRecord& record = batch[i];
+        Napi::Object msg = Napi::Object::New(env);
+        msg.Set("id", Napi::Number::New(env, static_cast<double>(record.id)));
+        msg.Set("fromUsername", Napi::String::New(env, record.sender.data(), record.sender.size()));
+        msg.Set("encryptedContent", Napi::Buffer<uint8_t>::Copy(env, record.content.data(), record.content.size()));
+        msg.Set("nonce", Napi::Buffer<uint8_t>::Copy(env, record.nonce.data(), record.nonce.size()));
+        msg.Set("signature", Napi::Buffer<uint8_t>::Copy(env, record.signature.data(), record.signature.size()));
+        msg.Set("counter", Napi::Number::New(env, static_cast<double>(record.counter)));
+        msg.Set("createdAt", Napi::Number::New(env, static_cast<double>(record.timestamp_ms)));
+        result.Set(static_cast<uint32_t>(i), msg);
+    }
+    return result;
+}
+
+// Arguments: (recipient, upToId). Resolves with the number of messages
+// acknowledged once the cursor record is committed.
+Napi::Value AckMessages(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    struct State {
+        std::shared_ptr<MessageStore> store;
+        std::string recipient;
+        uint64_t up_to_id = 0;
+        std::optional<size_t> removed;
+    };
+    auto state = std::make_shared<State>();
+    
+    if (info.Length() < 2 || !info[0].IsString() || !counter_arg(info[1], state->up_to_id)) {
+        return rejected(env, "Expected (recipient, upToId)");
+    }
+    state->store = message_store;
+    if (!state->store) {
+        return rejected(env, "Message store is not open");
+    }
+    state->recipient = info[0].As<Napi::String>().Utf8Value();
+    
+    return run_async(env, true, "Failed to acknowledge messages",
+        [state] {
+            state->removed = state->store->ack(state->recipient, state->up_to_id);
+            return state->removed.has_value();
+        },
+        [state](Napi::Env env) -> Napi::Value {
+            return Napi::Number::New(env, static_cast<double>(*state->removed));
+        });
+}
+
+// Arguments: (recipient). The newest id ever queued for the recipient, 0 if
+// none; acks above it are out of range.
+Napi::Value LastMessageId(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (recipient)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(store->last_id(info[0].As<Napi::String>().Utf8Value())));
+}
+
+// Arguments: (id). The recipient of a message still queued, or null; backs
+// the legacy per-message ack route.
+Napi::Value MessageRecipient(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    uint64_t id;
+    if (info.Length() < 1 || !counter_arg(info[0], id)) {
+        Napi::TypeError::New(env, "Expected (id)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    std::optional<std::string> recipient = store->recipient_of(id);
+    if (!recipient) {
+        return env.Null();
+    }
+    return Napi::String::New(env, *recipient);
+}
+
+Napi::Value CompactMessageStore(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(store->compact()));
+}
+
+Napi::Value MessageStoreStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    
+    MessageStore::Stats stats = store->stats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("queuedMessages", Napi::Number::New(env, static_cast<double>(stats.queued_messages)));
+    result.Set("recipients", Napi::Number::New(env, static_cast<double>(stats.recipients)));
+    result.Set("segments", Napi::Number::New(env, static_cast<double>(stats.segments)));
+    result.Set("commits", Napi::Number::New(env, static_cast<double>(stats.commits)));
+    result.Set("records", Napi::Number::New(env, static_cast<double>(stats.records)));
+    
+    return result;
+}
+
+// Arguments: (recipient, limit?). Encodes the queued messages as one body of
+// wire envelopes, copied once from the mapped segment into the JS buffer.
+// Records whose fields don't fit an envelope are left out.
+Napi::Value FetchMessagesEncoded(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString() ||
+        (info.Length() > 1 && !info[1].IsUndefined() && !info[1].IsNumber())) {
+        Napi::TypeError::New(env, "Expected (recipient, limit?)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    std::shared_ptr<MessageStore> store = open_store_or_throw(env);
+    if (!store) {
+        return env.Null();
+    }
+    
+    size_t limit = SIZE_MAX;
+    if (info.Length() > 1 && info[1].IsNumber()) {
+        limit = static_cast<size_t>(std::max(0.0, info[1].As<Napi::Number>().DoubleValue()));
+    }
+    
+    MessageBatch batch = store->fetch(info[0].As<Napi::String>().Utf8Value(), limit);
+    size_t total = 0;
+    for (const MessageRecord& record : batch) {
+        total += WireCodec::encoded_size(WireMessage{{}, record});
+    }
+    
+    Napi::Buffer<uint8_t> body = Napi::Buffer<uint8_t>::New(env, total);
+    size_t offset = 0;
+    for (const MessageRecord& record : batch) {
+        auto written = WireCodec::encode(WireMessage{{}, record}, ByteSpan(body.Data() + offset, total - offset));
+        if (written) {
+            offset += *written;
+        }
+    }
+    return body;
+}
+
+// Arguments: ({ fromUsername, toUsername?, encryptedContent, nonce, signature,
+// counter, id?, createdAt? }). Returns one wire envelope.
+Napi::Value EncodeMessage(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsObject()) {
+        Napi::TypeError::New(env, "Expected (message)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Object message = info[0].As<Napi::Object>();
+    // id and createdAt are optional, but must be valid when given
+    auto optional_number = [&message](const char* name, uint64_t& out) {
+        Napi::Value value = message.Get(name);
+        out = 0;
+        return value.IsUndefined() || counter_arg(value, out);
+    };
+    WireMessage wire;
+    if (!message.Get("fromUsername").IsString() || !message.Get("encryptedContent").IsBuffer() ||
+        !message.Get("nonce").IsBuffer() || !message.Get("signature").IsBuffer() ||
+        !counter_arg(message.Get("counter"), wire.record.counter) ||
+        !optional_number("id", wire.record.id) || !optional_number("createdAt", wire.record.timestamp_ms)) {
+        Napi::TypeError::New(env, "Message needs fromUsername, encryptedContent, nonce, signature and counter")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    auto view = [](const Napi::Value& value) {
+        Napi::Buffer<uint8_t> buf = value.As<Napi::Buffer<uint8_t>>();
+        return ConstByteSpan(buf.Data(), buf.Length());
+    };
+    std::string sender = message.Get("fromUsername").As<Napi::String>().Utf8Value();
+    std::string recipient = message.Get("toUsername").IsString()
+        ? message.Get("toUsername").As<Napi::String>().Utf8Value() : std::string();
+    
+    wire.recipient = recipient;
+    wire.record.sender = sender;
+    wire.record.content = view(message.Get("encryptedContent"));
+    wire.record.nonce = view(message.Get("nonce"));
+    wire.record.signature = view(message.Get("signature"));
+    
+    size_t size = WireCodec::encoded_size(wire);
+    if (size == 0) {
+        Napi::TypeError::New(env, "Invalid message field sizes").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Buffer<uint8_t> envelope = Napi::Buffer<uint8_t>::New(env, size);
+    WireCodec::encode(wire, ByteSpan(envelope.Data(), envelope.Length()));
+    return envelope;
+}
+
+// Arguments: (body). Parses back-to-back envelopes in place; the Buffer
+// fields of each message are views into `body`, not copies.
+Napi::Value DecodeMessages(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsBuffer()) {
+        Napi::TypeError::New(env, "Expected a buffer").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Buffer<uint8_t> body = info[0].As<Napi::Buffer<uint8_t>>();
+    
+    auto messages = WireCodec::decode_all(ConstByteSpan(body.Data(), body.Length()));
+    if (!messages) {
+        Napi::Error::New(env, "Malformed message body").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Function subarray = body.Get("subarray").As<Napi::Function>();
+    auto field = [&](ConstByteSpan span) {
+        size_t start = static_cast<size_t>(span.data() - body.Data());
+        return subarray.Call(body, {Napi::Number::New(env, static_cast<double>(start)),
+                                    Napi::Number::New(env, static_cast<double>(start + span.size()))});
+    };
+    
+    Napi::Array result = Napi::Array::New(env, messages->size());
+    for (size_t i = 0; i < messages->size(); ++i) {
+        const WireMessage& wire = (*messages)[i];
+        const MessageRecord& record = wire.record;
+        Napi::Object msg = Napi::Object::New(env);
+        msg.Set("id", Napi::Number::New(env, static_cast<double>(record.id)));
+        msg.Set("fromUsername", Napi::String::New(env, record.sender.data(), record.sender.size()));
+        msg.Set("toUsername", Napi::String::New(env, wire.recipient.data(), wire.recipient.size()));
+        msg.Set("encryptedContent", field(record.content));
+        msg.Set("nonce", field(record.nonce));
+        msg.Set("signature", field(record.signature));
+        msg.Set("counter", Napi::Number::New(env, static_cast<double>(record.counter)));
+        msg.Set("createdAt", Napi::Number::New(env, static_cast<double>(record.timestamp_ms)));
+        result.Set(static_cast<uint32_t>(i), msg);
+    }
+    return result;
+}
+
+static ReplayWindowTable& replay_windows() {
+    static ReplayWindowTable windows;
+    return windows;
+}
+
+static const char* replay_check_name(ReplayCheck result) {
+    switch (result) {
+        case ReplayCheck::Accepted: return "accepted";
+        case ReplayCheck::Replayed: return "replayed";
+        case ReplayCheck::TooOld: return "too-old";
+    }
+    return "too-old";
+}
+
+// Arguments: (sessionKey, counter). Returns "accepted", "replayed" or "too-old".
+Napi::Value ReplayCheckCounter(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    uint64_t counter;
+    if (info.Length() < 2 || !info[0].IsString() || !counter_arg(info[1], counter)) {
+        Napi::TypeError::New(env, "Expected (sessionKey, counter)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    ReplayCheck result = replay_windows().check(info[0].As<Napi::String>().Utf8Value(), counter);
+    return Napi::String::New(env, replay_check_name(result));
+}
+
+// Arguments: (sessionKeys[], counters[]). One native call for many checks.
+Napi::Value ReplayCheckBatch(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 2 || !info[0].IsArray() || !info[1].IsArray() ||
+        info[0].As<Napi::Array>().Length() != info[1].As<Napi::Array>().Length()) {
+        Napi::TypeError::New(env, "Expected (sessionKeys[], counters[]) of equal length").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Array sessions = info[0].As<Napi::Array>();
+    Napi::Array counters = info[1].As<Napi::Array>();
+    Napi::Array result = Napi::Array::New(env, sessions.Length());
+    for (uint32_t i = 0; i < sessions.Length(); ++i) {
+        uint64_t counter;
+        if (!sessions.Get(i).IsString() || !counter_arg(counters.Get(i), counter)) {
+            Napi::TypeError::New(env, "Session keys must be strings and counters integers").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        ReplayCheck check = replay_windows().check(sessions.Get(i).As<Napi::String>().Utf8Value(), counter);
+        result.Set(i, Napi::String::New(env, replay_check_name(check)));
+    }
+    return result;
+}
+
+// Arguments: (sessionKey, highest). Restores a persisted high-water mark;
+// returns false if the session is already tracked.
+Napi::Value ReplaySeed(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    uint64_t highest;
+    if (info.Length() < 2 || !info[0].IsString() || !counter_arg(info[1], highest)) {
+        Napi::TypeError::New(env, "Expected (sessionKey, highest)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Boolean::New(env, replay_windows().seed(info[0].As<Napi::String>().Utf8Value(), highest));
+}
+
+Napi::Value ReplayHighest(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (sessionKey)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    auto highest = replay_windows().highest(info[0].As<Napi::String>().Utf8Value());
+    if (!highest) {
+        return env.Null();
+    }
+    return Napi::Number::New(env, static_cast<double>(*highest));
+}
+
+Napi::Value ReplayForget(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsString()) {
+        Napi::TypeError::New(env, "Expected (sessionKey)").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    return Napi::Boolean::New(env, replay_windows().forget(info[0].As<Napi::String>().Utf8Value()));
+}
+
+Napi::Value SetAsyncThreshold(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber() || info[0].As<Napi::Number>().DoubleValue() < 0) {
+        Napi::TypeError::New(env, "Expected a non-negative byte count").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    async_threshold = static_cast<size_t>(info[0].As<Napi::Number>().DoubleValue());
+    return env.Undefined();
+}
+
+// Per-primitive counters and latency quantiles (nanoseconds) since start-up
+// or the last resetMetrics(). `enabled` is false when the core was built
+// without SPEAR_METRICS, in which case every count is zero.
+Napi::Object MetricsSnapshotValue(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    MetricsSnapshot snapshot = Metrics::snapshot();
+    
+    Napi::Object ops = Napi::Object::New(env);
+    for (size_t i = 0; i < METRIC_OP_COUNT; ++i) {
+        const OpMetrics& op = snapshot.ops[i];
+        auto number = [&env](uint64_t value) {
+            return Napi::Number::New(env, static_cast<double>(value));
+        };
+        
+        Napi::Object entry = Napi::Object::New(env);
+        entry.Set("ops", number(op.ops));
+        entry.Set("failures", number(op.failures));
+        entry.Set("bytes", number(op.bytes));
+        entry.Set("totalNs", number(op.total_nanos));
+        entry.Set("p50Ns", number(op.latency.quantile(0.5)));
+        entry.Set("p90Ns", number(op.latency.quantile(0.9)));
+        entry.Set("p99Ns", number(op.latency.quantile(0.99)));
+        entry.Set("p999Ns", number(op.latency.quantile(0.999)));
+        entry.Set("maxNs", number(op.latency.max()));
+        ops.Set(Metrics::op_name(static_cast<MetricOp>(i)), entry);
+    }
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("enabled", Napi::Boolean::New(env, snapshot.enabled));
+    result.Set("ops", ops);
+    return result;
+}
+
+Napi::Value ResetMetrics(const Napi::CallbackInfo& info) {
+    Metrics::reset();
+    return info.Env().Undefined();
+}
+
+// Started on first use so processes that never take pooled keys do not run
+// the refill thread
+static KeyPool& key_pool() {
+    static KeyPool pool;
+    return pool;
+}
+
+template <typename KeyPairT>
+static Napi::Object keypair_object(Napi::Env env, const KeyPairT& keypair) {
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("publicKey", 
+        Napi::Buffer<uint8_t>::Copy(env, keypair.public_key.data(), keypair.public_key.size()));
+    result.Set("secretKey", 
+        Napi::Buffer<uint8_t>::Copy(env, keypair.secret_key.data(), keypair.secret_key.size()));
+    return result;
+}
+
+Napi::Object TakeKeypair(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    auto keypair = key_pool().take_keypair();
+    if (!keypair) {
+        Napi::Error::New(env, "Failed to generate keypair").ThrowAsJavaScriptException();
+        return Napi::Object::New(env);
+    }
+    return keypair_object(env, *keypair);
+}
+
+Napi::Object TakeSigningKeypair(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    auto keypair = key_pool().take_signing_keypair();
+    if (!keypair) {
+        Napi::Error::New(env, "Failed to generate signing keypair").ThrowAsJavaScriptException();
+        return Napi::Object::New(env);
+    }
+    return keypair_object(env, *keypair);
+}
+
+Napi::Object KeyPoolStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    
+    KeyPool::Stats stats = key_pool().stats();
+    
+    Napi::Object result = Napi::Object::New(env);
+    result.Set("capacity", Napi::Number::New(env, static_cast<double>(key_pool().capacity())));
+    result.Set("keypairs", Napi::Number::New(env, static_cast<double>(stats.keypairs)));
+    result.Set("signingKeypairs", Napi::Number::New(env, static_cast<double>(stats.signing_keypairs)));
+    result.Set("hits", Napi::Number::New(env, static_cast<double>(stats.hits)));
+    result.Set("misses", Napi::Number::New(env, static_cast<double>(stats.misses)));
+    result.Set("generated", Napi::Number::New(env, static_cast<double>(stats.generated)));
+    
+    return result;
+}
+
+template <typename KeyPairT, typename Generate>
+static Napi::Value generate_keypairs_value(const Napi::CallbackInfo& info, Generate generate) {
+    Napi::Env env = info.Env();
+    
+    if (info.Length() < 1 || !info[0].IsNumber()) {
+        Napi::TypeError::New(env, "Expected a keypair count").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    double count = info[0].As<Napi::Number>().DoubleValue();
+    if (!(count >= 0) || count > 65536 || count != std::floor(count)) {
+        Napi::RangeError::New(env, "Keypair count must be an integer in [0, 65536]").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    std::optional<std::vector<KeyPairT>> keypairs = generate(static_cast<size_t>(count));
+    if (!keypairs) {
+        Napi::Error::New(env, "Failed to generate keypairs").ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    
+    Napi::Array result = Napi::Array::New(env, keypairs->size());
+    for (size_t i = 0; i < keypairs->size(); ++i) {
+        result.Set(static_cast<uint32_t>(i), keypair_object(env, (*keypairs)[i]));
+        utils::secure_memzero((*keypairs)[i].secret_key.data(), (*keypairs)[i].secret_key.size());
+    }
+    return result;
+}
+
+// Arguments: (count). Generated in parallel on the shared thread pool.
+Napi::Value GenerateKeypairs(const Napi::CallbackInfo& info) {
+    return generate_keypairs_value<KeyPair>(info, [](size_t count) {
+        return KeyManagement::generate_keypairs(count, &ThreadPool::shared());
+    });
+}
+
+Napi::Value GenerateSigningKeypairs(const Napi::CallbackInfo& info) {
+    return generate_keypairs_value<SigningKeyPair>(info, [](size_t count) {
+        return KeyManagement::generate_signing_keypairs(count, &ThreadPool::shared());
+    });
+}
+
+Napi::Object Init(Napi::Env env, Napi::Object exports) {
+    if (!utils::initialize()) {
+        Napi::Error::New(env, "Failed to initialize crypto library").ThrowAsJavaScriptException();
+        return exports;
+    }
+    
+    exports.Set("generateKeypair", Napi::Function::New(env, GenerateKeypair));
+    exports.Set("generateSigningKeypair", Napi::Function::New(env, GenerateSigningKeypair));
+    exports.Set("deriveSharedSecret", Napi::Function::New(env, DeriveSharedSecret));
+    exports.Set("sessionCacheStats", Napi::Function::New(env, SessionCacheStats));
+    exports.Set("preferredAeadAlgorithm", Napi::Function::New(env, PreferredAeadAlgorithm));
+    exports.Set("encrypt", Napi::Function::New(env, Encrypt));
+    exports.Set("decrypt", Napi::Function::New(env, Decrypt));
+    exports.Set("encryptInto", Napi::Function::New(env, EncryptInto));
+    exports.Set("decryptInto", Napi::Function::New(env, DecryptInto));
+    exports.Set("sign", Napi::Function::New(env, Sign));
+    exports.Set("verify", Napi::Function::New(env, Verify));
+    exports.Set("verifyBatch", Napi::Function::New(env, VerifyBatch));
+    exports.Set("encryptBatch", Napi::Function::New(env, EncryptBatch));
+    exports.Set("decryptBatch", Napi::Function::New(env, DecryptBatch));
+    
+    exports.Set("generateKeypairAsync", Napi::Function::New(env, GenerateKeypairAsync));
+    exports.Set("generateSigningKeypairAsync", Napi::Function::New(env, GenerateSigningKeypairAsync));
+    exports.Set("deriveSharedSecretAsync", Napi::Function::New(env, DeriveSharedSecretAsync));
+    exports.Set("encryptAsync", Napi::Function::New(env, EncryptAsync));
+    exports.Set("decryptAsync", Napi::Function::New(env, DecryptAsync));
+    exports.Set("signAsync", Napi::Function::New(env, SignAsync));
+    exports.Set("verifyAsync", Napi::Function::New(env, VerifyAsync));
+    exports.Set("verifyBatchAsync", Napi::Function::New(env, VerifyBatchAsync));
+    exports.Set("encryptBatchAsync", Napi::Function::New(env, EncryptBatchAsync));
+    exports.Set("decryptBatchAsync", Napi::Function::New(env, DecryptBatchAsync));
+    exports.Set("encryptFile", Napi::Function::New(env, EncryptFile));
+    exports.Set("decryptFile", Napi::Function::New(env, DecryptFile));
+    exports.Set("setAsyncThreshold", Napi::Function::New(env, SetAsyncThreshold));
+    
+    exports.Set("openMessageStore", Napi::Function::New(env, OpenMessageStore));
+    exports.Set("appendMessage", Napi::Function::New(env, AppendMessage));
+    exports.Set("appendMessageBatch", Napi::Function::New(env, AppendMessageBatch));
+    exports.Set("fetchMessages", Napi::Function::New(env, FetchMessages));
+    exports.Set("ackMessages", Napi::Function::New(env, AckMessages));
+    exports.Set("lastMessageId", Napi::Function::New(env, LastMessageId));
+    exports.Set("messageRecipient", Napi::Function::New(env, MessageRecipient));
+    exports.Set("compactMessageStore", Napi::Function::New(env, CompactMessageStore));
+    exports.Set("messageStoreStats", Napi::Function::New(env, MessageStoreStats));
+    exports.Set("fetchMessagesEncoded", Napi::Function::New(env, FetchMessagesEncoded));
+    exports.Set("encodeMessage", Napi::Function::New(env, EncodeMessage));
+    exports.Set("decodeMessages", Napi::Function::New(env, DecodeMessages));
+    
+    exports.Set("replayCheck", Napi::Function::New(env, ReplayCheckCounter));
+    exports.Set("replayCheckBatch", Napi::Function::New(env, ReplayCheckBatch));
+    exports.Set("replaySeed", Napi::Function::New(env, ReplaySeed));
+    exports.Set("replayHighest", Napi::Function::New(env, ReplayHighest));
+    exports.Set("replayForget", Napi::Function::New(env, ReplayForget));
+    
+    exports.Set("metricsSnapshot", Napi::Function::New(env, MetricsSnapshotValue));
+    exports.Set("resetMetrics", Napi::Function::New(env, ResetMetrics));
+    
+    exports.Set("generateKeypairs", Napi::Function::New(env, GenerateKeypairs));
+    exports.Set("generateSigningKeypairs", Napi::Function::New(env, GenerateSigningKeypairs));
+    exports.Set("takeKeypair", Napi::Function::New(env, TakeKeypair));
+    exports.Set("takeSigningKeypair", Napi::Function::New(env, TakeSigningKeypair));
+    exports.Set("keyPoolStats", Napi::Function::New(env, KeyPoolStats));
     
     return exports;
 }
@@ -30,6 +30,26 @@ const decrypted = spear.decrypt(ciphertext, key, nonce);
 console.log('   Decrypted:', decrypted.toString());
 console.log('   Match:', decrypted.equals(plaintext));
 
+const sealed = Buffer.alloc(plaintext.length + 16);
+const sealedLength = spear.encryptInto(plaintext, key, nonce, sealed);
+const opened = Buffer.alloc(plaintext.length);
+const openedLength = spear.decryptInto(sealed.subarray(0, sealedLength), key, nonce, opened);
+console.log('   Caller-buffer round trip:', openedLength === plaintext.length && opened.equals(plaintext));
+
+const cipher = spear.preferredAeadAlgorithm();
+const fastCiphertext = spear.encrypt(plaintext, key, nonce, 'auto');
+console.log(`   Round trip with ${cipher}:`,
+  spear.decrypt(fastCiphertext, key, nonce, cipher).equals(plaintext));
+
+const batchPlaintexts = [Buffer.from('one'), Buffer.from('two'), Buffer.alloc(0)];
+const batchNonces = batchPlaintexts.map(() => require('crypto').randomBytes(24));
+const sealedBatch = spear.encryptBatch(batchPlaintexts, key, batchNonces);
+const sealedParts = batchPlaintexts.map((_, i) =>
+  sealedBatch.data.subarray(sealedBatch.offsets[i], sealedBatch.offsets[i + 1]));
+const openedBatch = spear.decryptBatch(sealedParts, key, batchNonces);
+console.log('   Batch round trip:', batchPlaintexts.every((p, i) => openedBatch.ok[i] &&
+  openedBatch.data.subarray(openedBatch.offsets[i], openedBatch.offsets[i + 1]).equals(p)));
+
 console.log('\n4. Testing signing/verification...');
 const signingKeypair = spear.generateSigningKeypair();
 const message = Buffer.from('Test message for signing');
@@ -44,4 +64,105 @@ const tamperedMessage = Buffer.from('Tampered message');
 const invalid = spear.verify(tamperedMessage, signature, signingKeypair.publicKey);
 console.log('   Tampered message valid:', invalid);
 
-console.log('\n=== All tests completed! ===');
\ No newline at end of file
+console.log('\n5. Testing async variants...');
+(async () => {
+  const largePlaintext = Buffer.alloc(1024 * 1024, 0x61);
+  const largeCiphertext = await spear.encryptAsync(largePlaintext, key, nonce);
+  const largeDecrypted = await spear.decryptAsync(largeCiphertext, key, nonce);
+  console.log('   Async round trip (1 MB):', largeDecrypted.equals(largePlaintext));
+
+  const asyncSignature = await spear.signAsync(message, signingKeypair.secretKey);
+  console.log('   Async signature valid:',
+    await spear.verifyAsync(message, asyncSignature, signingKeypair.publicKey));
+
+  const asyncSecret = await spear.deriveSharedSecretAsync(keypair1.secretKey, keypair2.publicKey);
+  console.log('   Async shared secret matches:', asyncSecret.equals(sharedSecret1));
+
+  await spear.decryptAsync(largeCiphertext, Buffer.alloc(32), nonce)
+    .then(() => console.log('   Wrong key rejected: false'))
+    .catch(() => console.log('   Wrong key rejected: true'));
+
+  console.log('\n6. Testing message store...');
+  const storeDir = require('fs').mkdtempSync(require('path').join(require('os').tmpdir(), 'spear-store-'));
+  spear.openMessageStore(storeDir);
+  const ids = await Promise.all([1, 2, 3].map(counter => spear.appendMessage('alice', {
+    fromUsername: 'bob', content: ciphertext, nonce, signature, counter
+  })));
+  const inbox = spear.fetchMessages('alice');
+  console.log('   Fetched in order:', inbox.map(msg => msg.id).join() === ids.join() &&
+    inbox[0].encryptedContent.equals(ciphertext));
+  const encodedInbox = spear.decodeMessages(spear.fetchMessagesEncoded('alice'));
+  console.log('   Fetched encoded:', encodedInbox.map(msg => msg.id).join() === ids.join() &&
+    encodedInbox[0].encryptedContent.equals(ciphertext));
+  console.log('   Acknowledged:', await spear.ackMessages('alice', ids[1]));
+  console.log('   Remaining:', spear.fetchMessages('alice').length);
+  console.log('   Last id:', spear.lastMessageId('alice') === ids[2], spear.lastMessageId('nobody') === 0);
+  console.log('   Future ack bounded:', await spear.ackMessages('carol', ids[2] + 100) === 0);
+  const carolId = await spear.appendMessage('carol', {
+    fromUsername: 'bob', content: ciphertext, nonce, signature, counter: 1
+  });
+  console.log('   Delivered after future ack:', spear.fetchMessages('carol').map(msg => msg.id).join() === String(carolId));
+  await spear.appendMessage('carol', {
+    fromUsername: 'bob', content: ciphertext, nonce: nonce.subarray(0, 8), signature, counter: 2
+  });
+  console.log('   Unencodable record skipped:',
+    spear.decodeMessages(spear.fetchMessagesEncoded('carol')).map(msg => msg.id).join() === String(carolId));
+  console.log('   Bad counter rejected:', await spear.appendMessage('carol', {
+    fromUsername: 'bob', content: ciphertext, nonce, signature, counter: -1
+  }).then(() => false, () => true));
+  console.log('   Bad ack id rejected:', await spear.ackMessages('carol', NaN).then(() => false, () => true),
+    await spear.ackMessages('carol', 2 ** 64).then(() => false, () => true));
+  const batchFirst = spear.appendMessageBatch(['dave', 'erin'], [1, 2].map(counter => ({
+    fromUsername: 'bob', content: ciphertext, nonce, signature, counter
+  })));
+  console.log('   Batch appended:', spear.fetchMessages('dave')[0].id === batchFirst &&
+    spear.fetchMessages('erin')[0].id === batchFirst + 1);
+  console.log('   Recipient by id:', spear.messageRecipient(batchFirst + 1) === 'erin',
+    spear.messageRecipient(ids[0]) === null);
+  require('fs').rmSync(storeDir, { recursive: true, force: true });
+
+  console.log('\n7. Testing replay window...');
+  console.log('   In order:', spear.replayCheck('test:1', 1), spear.replayCheck('test:1', 3));
+  console.log('   Reordered:', spear.replayCheck('test:1', 2));
+  console.log('   Replayed:', spear.replayCheck('test:1', 2));
+  console.log('   Batch:', spear.replayCheckBatch(['test:1', 'test:2'], [4, 4]).join());
+
+  console.log('\n8. Testing metrics...');
+  const metrics = spear.metricsSnapshot();
+  console.log('   Enabled:', metrics.enabled);
+  console.log('   AEAD encrypts:', metrics.ops.aead_encrypt.ops, 'p99', metrics.ops.aead_encrypt.p99Ns, 'ns');
+  spear.resetMetrics();
+  console.log('   Reset:', spear.metricsSnapshot().ops.aead_encrypt.ops === 0);
+
+  console.log('\n9. Testing key pool...');
+  const pooled = spear.takeKeypair();
+  console.log('   Pooled keypair:', pooled.publicKey.length === 32 && pooled.secretKey.length === 32);
+  const bulk = spear.generateSigningKeypairs(8);
+  console.log('   Bulk signing keypairs:', bulk.length, new Set(bulk.map(kp => kp.publicKey.toString('hex'))).size === 8);
+  console.log('   Pool stats:', spear.keyPoolStats());
+
+  console.log('\n10. Testing wire codec...');
+  const envelope = spear.encodeMessage({
+    fromUsername: 'bob', toUsername: 'alice', encryptedContent: ciphertext, nonce, signature, counter: 9
+  });
+  const [decoded] = spear.decodeMessages(envelope);
+  console.log('   Round trip:', decoded.toUsername === 'alice' && decoded.counter === 9 &&
+    decoded.encryptedContent.equals(ciphertext) && decoded.signature.equals(signature));
+  console.log('   Shares memory:', decoded.encryptedContent.buffer === envelope.buffer);
+  try {
+    spear.decodeMessages(envelope.subarray(0, envelope.length - 1));
+    console.log('   Truncated rejected: false');
+  } catch (error) {
+    console.log('   Truncated rejected: true');
+  }
+  for (const counter of ['9', -1, 2 ** 64]) {
+    try {
+      spear.encodeMessage({ fromUsername: 'bob', encryptedContent: ciphertext, nonce, signature, counter });
+      console.log(`   Counter ${counter} rejected: false`);
+    } catch (error) {
+      console.log(`   Counter ${counter} rejected: true`);
+    }
+  }
+
+  console.log('\n=== All tests completed! ===');
+})();
\ No newline at end of file
@@ -0,0 +1,346 @@
+// Closed-loop load generator for the relay's send path. Works against any
+// server speaking the relay API (spear_relayd or the Node server):
+//
+//   relay_load [--host=<ipv4>] [--port=<port>] [--connections=<n>]
+//              [--threads=<n>] [--duration=<seconds>] [--size=<bytes>] [--wire]
+//
+// Registers a sender and a recipient, then keeps every connection busy with
+// POST /api/messages (JSON with base64 fields, or one binary envelope with
+// --wire), each sent as soon as the previous reply arrives. Prints
+// throughput and latency quantiles, then one JSON line for scripts.
+
+#include "metrics.hpp"
+#include "types.hpp"
+#include "utils.hpp"
+#include "wire_codec.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace spear::crypto;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    uint16_t port = 3000;
+    size_t connections = 64;
+    size_t threads = 1;
+    double duration = 10.0;
+    size_t size = 256;
+    bool wire = false;
+};
+
+struct Result {
+    uint64_t ok = 0;
+    uint64_t errors = 0;
+    LatencyHistogram latency;
+};
+
+int connect_to(const Options& options, bool nonblocking) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.port);
+    if (::inet_pton(AF_INET, options.host.c_str(), &address.sin_addr) != 1) {
+        return -1;
+    }
+    int fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    int one = 1;
+    ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (nonblocking) {
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK);
+    }
+    return fd;
+}
+
+std::string build_request(const std::string& content_type, const std::string& body) {
+    std::string request = "POST /api/messages HTTP/1.1\r\nHost: relay\r\nContent-Type: ";
+    request += content_type;
+    request += "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    request += body;
+    return request;
+}
+
+// Length of the complete response at the front of `data` (0 while partial)
+// and its status code
+size_t parse_response(const std::string& data, int& status) {
+    size_t header_end = data.find("\r\n\r\n");
+    if (header_end == std::string::npos || data.size() < 12) {
+        return 0;
+    }
+    status = std::atoi(data.c_str() + 9);
+    size_t length = 0;
+    size_t pos = 0;
+    while ((pos = data.find("\r\n", pos)) != std::string::npos && pos < header_end) {
+        pos += 2;
+        if (strncasecmp(data.c_str() + pos, "content-length:", 15) == 0) {
+            length = std::strtoull(data.c_str() + pos + 15, nullptr, 10);
+        }
+    }
+    size_t total = header_end + 4 + length;
+    return data.size() >= total ? total : 0;
+}
+
+// One blocking request; returns the status code, or 0 on failure
+int request_once(const Options& options, const std::string& request) {
+    int fd = connect_to(options, false);
+    if (fd < 0) {
+        return 0;
+    }
+    int status = 0;
+    if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) == static_cast<ssize_t>(request.size())) {
+        std::string response;
+        char buffer[4096];
+        ssize_t n;
+        while (parse_response(response, status) == 0 && (n = ::recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<size_t>(n));
+        }
+    }
+    ::close(fd);
+    return status;
+}
+
+bool register_user(const Options& options, const std::string& username) {
+    PublicKey public_key;
+    SigningPublicKey signing_key;
+    utils::random_bytes(public_key.data(), public_key.size());
+    utils::random_bytes(signing_key.data(), signing_key.size());
+    std::string body = "{\"username\":\"" + username + "\",\"publicKey\":\"" +
+                       utils::to_base64(public_key.data(), public_key.size()) +
+                       "\",\"signingPublicKey\":\"" +
+                       utils::to_base64(signing_key.data(), signing_key.size()) + "\"}";
+    std::string request = "POST /api/register HTTP/1.1\r\nHost: relay\r\nContent-Type: application/json\r\n"
+                          "Content-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    return request_once(options, request) == 201;
+}
+
+struct Connection {
+    int fd = -1;
+    std::string in;
+    size_t sent = 0;
+    Clock::time_point started;
+};
+
+void run_client(const Options& options, const std::string& request, size_t connections,
+                Clock::time_point deadline, Result& result) {
+    int epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+    std::vector<Connection> conns(connections);
+    
+    auto send_request = [&](Connection& c) {
+        c.started = Clock::now();
+        c.sent = 0;
+        while (c.sent < request.size()) {
+            ssize_t n = ::send(c.fd, request.data() + c.sent, request.size() - c.sent, MSG_NOSIGNAL);
+            if (n <= 0) {
+                // The rest goes out on EPOLLOUT
+                return;
+            }
+            c.sent += static_cast<size_t>(n);
+        }
+    };
+    
+    for (size_t i = 0; i < connections; ++i) {
+        conns[i].fd = connect_to(options, true);
+        if (conns[i].fd < 0) {
+            result.errors++;
+            continue;
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+        event.data.u64 = i;
+        ::epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conns[i].fd, &event);
+        send_request(conns[i]);
+    }
+    
+    epoll_event events[256];
+    char buffer[64 * 1024];
+    while (Clock::now() < deadline) {
+        int n = ::epoll_wait(epoll_fd, events, 256, 100);
+        for (int i = 0; i < n; ++i) {
+            Connection& c = conns[events[i].data.u64];
+            if (c.fd < 0) {
+                continue;
+            }
+            if (c.sent < request.size()) {
+                ssize_t w;
+                while (c.sent < request.size() &&
+                       (w = ::send(c.fd, request.data() + c.sent, request.size() - c.sent, MSG_NOSIGNAL)) > 0) {
+                    c.sent += static_cast<size_t>(w);
+                }
+            }
+            while (true) {
+                ssize_t r = ::recv(c.fd, buffer, sizeof(buffer), 0);
+                if (r > 0) {
+                    c.in.append(buffer, static_cast<size_t>(r));
+                    continue;
+                }
+                if (r == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                    ::close(c.fd);
+                    c.fd = -1;
+                    result.errors++;
+                }
+                break;
+            }
+            int status = 0;
+            size_t length;
+            while (c.fd >= 0 && (length = parse_response(c.in, status)) != 0) {
+                c.in.erase(0, length);
+                uint64_t nanos = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - c.started).count());
+                result.latency.counts[LatencyHistogram::bucket_for(nanos)]++;
+                if (status == 201) {
+                    result.ok++;
+                } else {
+                    result.errors++;
+                }
+                send_request(c);
+            }
+        }
+    }
+    
+    for (Connection& c : conns) {
+        if (c.fd >= 0) {
+            ::close(c.fd);
+        }
+    }
+    ::close(epoll_fd);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--host=", 0) == 0) {
+            options.host = arg.substr(7);
+        } else if (arg.rfind("--port=", 0) == 0) {
+            options.port = static_cast<uint16_t>(std::stoul(arg.substr(7)));
+        } else if (arg.rfind("--connections=", 0) == 0) {
+            options.connections = std::stoul(arg.substr(14));
+        } else if (arg.rfind("--threads=", 0) == 0) {
+            options.threads = std::stoul(arg.substr(10));
+        } else if (arg.rfind("--duration=", 0) == 0) {
+            options.duration = std::stod(arg.substr(11));
+        } else if (arg.rfind("--size=", 0) == 0) {
+            options.size = std::stoul(arg.substr(7));
+        } else if (arg == "--wire") {
+            options.wire = true;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host=<ipv4>] [--port=<port>] [--connections=<n>] [--threads=<n>]"
+                      << " [--duration=<seconds>] [--size=<bytes>] [--wire]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.threads == 0 || options.connections < options.threads || options.size < MAC_SIZE) {
+        std::cerr << "Need at least one connection per thread and a size of at least "
+                  << MAC_SIZE << " bytes" << std::endl;
+        return 1;
+    }
+    
+    if (!utils::initialize()) {
+        std::cerr << "Failed to initialize libsodium" << std::endl;
+        return 1;
+    }
+    
+    // Fresh users per run, so repeated runs against one server don't collide
+    std::string suffix = utils::to_hex(utils::random_nonce().data(), 6);
+    std::string sender = "load_sender_" + suffix;
+    std::string recipient = "load_recipient_" + suffix;
+    if (!register_user(options, sender) || !register_user(options, recipient)) {
+        std::cerr << "Failed to register load users on " << options.host << ":" << options.port << std::endl;
+        return 1;
+    }
+    
+    // The server relays ciphertext without opening it, so random bytes do
+    ByteVector content(options.size);
+    Nonce nonce;
+    Signature signature;
+    utils::random_bytes(content.data(), content.size());
+    utils::random_bytes(nonce.data(), nonce.size());
+    utils::random_bytes(signature.data(), signature.size());
+    
+    std::string request;
+    if (options.wire) {
+        WireMessage message;
+        message.recipient = recipient;
+        message.record.sender = sender;
+        message.record.counter = 1;
+        message.record.nonce = nonce;
+        message.record.signature = signature;
+        message.record.content = content;
+        auto envelope = WireCodec::encode(message);
+        request = build_request("application/vnd.spear.message",
+                                std::string(envelope->begin(), envelope->end()));
+    } else {
+        std::string body = "{\"fromUsername\":\"" + sender + "\",\"toUsername\":\"" + recipient +
+                           "\",\"encryptedContent\":\"" + utils::to_base64(content.data(), content.size()) +
+                           "\",\"nonce\":\"" + utils::to_base64(nonce.data(), nonce.size()) +
+                           "\",\"signature\":\"" + utils::to_base64(signature.data(), signature.size()) +
+                           "\",\"counter\":1}";
+        request = build_request("application/json", body);
+    }
+    
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(options.duration));
+    std::vector<Result> results(options.threads);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < options.threads; ++t) {
+        size_t share = options.connections / options.threads + (t < options.connections % options.threads ? 1 : 0);
+        threads.emplace_back(run_client, std::cref(options), std::cref(request), share, deadline,
+                             std::ref(results[t]));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    
+    Result total;
+    for (const Result& r : results) {
+        total.ok += r.ok;
+        total.errors += r.errors;
+        for (size_t b = 0; b < LatencyHistogram::BUCKETS; ++b) {
+            total.latency.counts[b] += r.latency.counts[b];
+        }
+    }
+    
+    double rate = static_cast<double>(total.ok) / elapsed;
+    double p50 = static_cast<double>(total.latency.quantile(0.5)) / 1e3;
+    double p99 = static_cast<double>(total.latency.quantile(0.99)) / 1e3;
+    double p999 = static_cast<double>(total.latency.quantile(0.999)) / 1e3;
+    
+    std::printf("%s sends, %zu connections, %zu-byte messages, %.1f s\n",
+                options.wire ? "Wire" : "JSON", options.connections, options.size, elapsed);
+    std::printf("  %llu ok, %llu errors, %.0f req/s\n",
+                static_cast<unsigned long long>(total.ok), static_cast<unsigned long long>(total.errors), rate);
+    std::printf("  latency p50 %.0f us, p99 %.0f us, p999 %.0f us\n", p50, p99, p999);
+    std::printf("{\"mode\":\"%s\",\"connections\":%zu,\"size\":%zu,\"ok\":%llu,\"errors\":%llu,"
+                "\"rps\":%.0f,\"p50_us\":%.0f,\"p99_us\":%.0f,\"p999_us\":%.0f}\n",
+                options.wire ? "wire" : "json", options.connections, options.size,
+                static_cast<unsigned long long>(total.ok), static_cast<unsigned long long>(total.errors),
+                rate, p50, p99, p999);
+    return total.errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+#ifndef SPEAR_RELAY_HTTP_HPP
+#define SPEAR_RELAY_HTTP_HPP
+
+#include "types.hpp"
+#include <string>
+#include <string_view>
+
+namespace spear {
+namespace relay {
+
+using crypto::ByteVector;
+using crypto::ConstByteSpan;
+
+enum class HttpMethod : uint8_t {
+    Get,
+    Post,
+    Delete,
+    Options,
+    Other,
+};
+
+// A parsed request. Every view points into the connection's read buffer and
+// is valid until the request is consumed.
+struct HttpRequest {
+    HttpMethod method = HttpMethod::Other;
+    std::string_view path;
+    std::string_view content_type;
+    std::string_view accept;
+    ConstByteSpan body;
+    bool keep_alive = true;
+};
+
+enum class ParseStatus : uint8_t {
+    Complete,
+    Incomplete,
+    Error,
+};
+
+struct ParseResult {
+    ParseStatus status;
+    // Bytes the request occupies when Complete; the HTTP status to reply
+    // with before closing when Error
+    size_t consumed;
+    int error_status;
+};
+
+// HTTP/1.1 request framing for the relay API: Content-Length bodies only,
+// keep-alive and pipelining. Chunked request bodies are refused with 411.
+class HttpParser {
+public:
+    static constexpr size_t MAX_HEADER_SIZE = 16 * 1024;
+    // Matches the Node server's body parser limit
+    static constexpr size_t MAX_BODY_SIZE = 10 * 1024 * 1024;
+    
+    // Parses the request at the front of `data` into `request`
+    static ParseResult parse(ConstByteSpan data, HttpRequest& request);
+};
+
+// "Not Found" for 404, and so on for the statuses the relay sends
+const char* reason_phrase(int status);
+
+// Appends a complete response. CORS is open, as in the Node server.
+void append_response(ByteVector& out, int status, std::string_view content_type,
+                     ConstByteSpan body, bool keep_alive);
+void append_json(ByteVector& out, int status, std::string_view json, bool keep_alive);
+void append_error(ByteVector& out, int status, std::string_view message, bool keep_alive);
+// 204 answer to a CORS preflight
+void append_preflight(ByteVector& out, bool keep_alive);
+
+// Decodes %XX escapes in a path segment; false on a malformed escape
+bool percent_decode(std::string_view in, std::string& out);
+
+// Whether a comma-separated media type list contains `type`
+bool media_type_matches(std::string_view header, std::string_view type);
+
+} // namespace relay
+} // namespace spear
+
+#endif // SPEAR_RELAY_HTTP_HPP
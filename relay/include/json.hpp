@@ -0,0 +1,84 @@
+#ifndef SPEAR_RELAY_JSON_HPP
+#define SPEAR_RELAY_JSON_HPP
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace spear {
+namespace relay {
+
+struct JsonValue {
+    enum class Type : uint8_t {
+        Null,
+        Bool,
+        Number,
+        String,
+        // Nested arrays and objects are skipped, not kept
+        Compound,
+    };
+    
+    Type type = Type::Null;
+    bool boolean = false;
+    double number = 0;
+    std::string string;
+    
+    bool is_string() const { return type == Type::String; }
+    bool is_number() const { return type == Type::Number; }
+    
+    // A non-negative integer below 2^53, as JS Number.isSafeInteger
+    std::optional<uint64_t> safe_integer() const;
+};
+
+// The relay's request bodies are flat objects, so that is all this parses:
+// top-level fields keep strings, numbers, booleans and null.
+class JsonObject {
+public:
+    static std::optional<JsonObject> parse(std::string_view text);
+    
+    const JsonValue* get(std::string_view key) const;
+    // The field if it is a non-empty string, as JS truthiness
+    const std::string* string(std::string_view key) const;
+
+private:
+    std::unordered_map<std::string, JsonValue> fields_;
+};
+
+// Appends compact JSON to a string. Callers nest begin/end calls correctly;
+// commas between members are inserted automatically.
+class JsonWriter {
+public:
+    JsonWriter& begin_object();
+    JsonWriter& end_object();
+    JsonWriter& begin_array();
+    JsonWriter& end_array();
+    JsonWriter& key(std::string_view name);
+    JsonWriter& value(std::string_view s);
+    JsonWriter& value(const char* s) { return value(std::string_view(s)); }
+    JsonWriter& value(uint64_t n);
+    JsonWriter& value(bool b);
+    // Raw, already valid JSON (e.g. a base64 string built in place)
+    JsonWriter& raw(std::string_view json);
+    
+    template <typename T>
+    JsonWriter& field(std::string_view name, const T& v) {
+        key(name);
+        return value(v);
+    }
+    
+    const std::string& str() const { return out_; }
+    std::string take() { return std::move(out_); }
+
+private:
+    void separate();
+    
+    std::string out_;
+    bool need_comma_ = false;
+};
+
+} // namespace relay
+} // namespace spear
+
+#endif // SPEAR_RELAY_JSON_HPP
@@ -0,0 +1,79 @@
+#ifndef SPEAR_RELAY_RELAY_API_HPP
+#define SPEAR_RELAY_RELAY_API_HPP
+
+#include "http.hpp"
+#include "relay_state.hpp"
+#include <string>
+#include <vector>
+
+namespace spear {
+namespace relay {
+
+// Binary message envelopes (see WireCodec), as in the Node server
+constexpr std::string_view WIRE_TYPE = "application/vnd.spear.message";
+
+// A send or ack whose reply waits until the message store has committed it.
+// Requests that need no commit are answered inline by RelayApi::handle.
+struct PendingWrite {
+    enum class Kind : uint8_t {
+        Send,
+        Ack,
+    };
+    
+    Kind kind = Kind::Send;
+    uint64_t connection = 0;
+    bool keep_alive = true;
+    // Send: the message as one wire envelope, owned so the request buffer
+    // can be reused while the commit is in flight
+    ByteVector envelope;
+    // Ack
+    std::string recipient;
+    uint64_t up_to_id = 0;
+    // Came in on the legacy DELETE /api/messages/:id route, whose reply
+    // carries no count
+    bool legacy = false;
+    
+    // Filled in by commit(): the message id or the number acknowledged
+    bool ok = false;
+    uint64_t result = 0;
+};
+
+// The Node server's HTTP API on top of RelayState: register, user lookup,
+// sessions and counters, send, poll and ack, plus /metrics and /health.
+// Responses match the Node server's JSON field for field.
+class RelayApi {
+public:
+    explicit RelayApi(RelayState& state) : state_(state) {}
+    
+    // Appends the response to `out` and returns false, or returns true with
+    // `pending` filled in when the reply has to wait for commit()
+    bool handle(const HttpRequest& request, ByteVector& out, PendingWrite& pending);
+    
+    // Commits a batch of writes: every send in one message store commit,
+    // then the acks. Safe to call from any thread.
+    void commit(std::vector<PendingWrite>& writes);
+    
+    // Appends the reply to a committed write
+    static void complete(const PendingWrite& write, ByteVector& out);
+
+private:
+    void register_user(const HttpRequest& request, ByteVector& out);
+    void list_users(const HttpRequest& request, ByteVector& out);
+    void get_user(const HttpRequest& request, std::string_view username, ByteVector& out);
+    void open_session(const HttpRequest& request, ByteVector& out);
+    void update_counter(const HttpRequest& request, ByteVector& out);
+    bool send_message(const HttpRequest& request, ByteVector& out, PendingWrite& pending);
+    void get_messages(const HttpRequest& request, std::string_view username, ByteVector& out);
+    bool ack_messages(const HttpRequest& request, std::string username, std::string_view id,
+                      ByteVector& out, PendingWrite& pending);
+    bool ack_message(const HttpRequest& request, std::string_view id, ByteVector& out, PendingWrite& pending);
+    void metrics(const HttpRequest& request, ByteVector& out);
+    void health(const HttpRequest& request, ByteVector& out);
+    
+    RelayState& state_;
+};
+
+} // namespace relay
+} // namespace spear
+
+#endif // SPEAR_RELAY_RELAY_API_HPP
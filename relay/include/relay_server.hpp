@@ -0,0 +1,62 @@
+#ifndef SPEAR_RELAY_RELAY_SERVER_HPP
+#define SPEAR_RELAY_RELAY_SERVER_HPP
+
+#include "relay_api.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace spear {
+namespace relay {
+
+struct RelayServerOptions {
+    // IPv4 address to listen on
+    std::string host = "0.0.0.0";
+    // 0 picks a free port; see RelayServer::port
+    uint16_t port = 3000;
+    // One per core when 0
+    size_t reactors = 0;
+    // Pin reactor i to core i (mod the core count)
+    bool pin_threads = true;
+};
+
+// Thread-per-core HTTP server for RelayApi. Every reactor owns an epoll
+// instance and its own SO_REUSEPORT listening socket, so the kernel spreads
+// connections across them and nothing is shared on the request path but
+// RelayState. Connections are non-blocking and keep-alive; pipelined
+// requests are answered in order.
+//
+// Sends and acks are handed to the reactor's committer thread, which
+// commits everything queued since its last pass in one batch, so the
+// reactor keeps serving other connections while the log syncs.
+class RelayServer {
+public:
+    RelayServer(RelayState& state, const RelayServerOptions& options = {});
+    ~RelayServer();
+    
+    RelayServer(const RelayServer&) = delete;
+    RelayServer& operator=(const RelayServer&) = delete;
+    
+    // Binds every reactor's socket and starts their threads
+    bool start();
+    // Stops accepting, closes every connection and joins the threads.
+    // Writes already being committed finish; their replies are dropped.
+    void stop();
+    
+    // The bound port, once started
+    uint16_t port() const { return port_; }
+    size_t reactor_count() const { return reactors_.size(); }
+
+private:
+    class Reactor;
+    
+    RelayApi api_;
+    RelayServerOptions options_;
+    uint16_t port_ = 0;
+    std::vector<std::unique_ptr<Reactor>> reactors_;
+};
+
+} // namespace relay
+} // namespace spear
+
+#endif // SPEAR_RELAY_RELAY_SERVER_HPP
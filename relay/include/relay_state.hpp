@@ -0,0 +1,164 @@
+#ifndef SPEAR_RELAY_RELAY_STATE_HPP
+#define SPEAR_RELAY_RELAY_STATE_HPP
+
+#include "types.hpp"
+#include "message_store.hpp"
+#include "replay_window.hpp"
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace spear {
+namespace relay {
+
+struct RelayStateOptions {
+    // fdatasync registrations, new sessions and message commits before
+    // they are acknowledged
+    bool sync = true;
+    uint64_t segment_size = 64 * 1024 * 1024;
+    // Counter high-water marks are journaled at most this often, as the
+    // Node server writes them back to SQLite
+    std::chrono::milliseconds counter_flush_interval{1000};
+};
+
+struct UserRecord {
+    uint64_t id;
+    std::string username;
+    crypto::PublicKey public_key;
+    crypto::SigningPublicKey signing_public_key;
+    uint64_t created_ms;
+};
+
+// user1 is always the lower user id, as in the Node server's sessions table
+struct SessionRecord {
+    uint64_t id;
+    uint64_t user1_id;
+    uint64_t user2_id;
+    uint64_t last_counter_user1;
+    uint64_t last_counter_user2;
+    uint64_t rotation_threshold;
+};
+
+enum class RegisterStatus : uint8_t {
+    Created,
+    Exists,
+    Failed,
+};
+
+enum class SessionStatus : uint8_t {
+    Ok,
+    UserNotFound,
+    Failed,
+};
+
+struct CounterResult {
+    enum class Status : uint8_t {
+        Accepted,
+        Replayed,
+        TooOld,
+        SessionNotFound,
+    };
+    
+    Status status;
+    uint64_t highest;
+    uint64_t rotation_threshold;
+};
+
+// Everything the relay keeps: users, sessions and their replay windows in
+// memory, messages in a MessageStore. Users and sessions are records in an
+// append-only journal replayed on open and compacted when it is mostly
+// superseded counter records. Thread-safe.
+class RelayState {
+public:
+    static constexpr uint64_t DEFAULT_ROTATION_THRESHOLD = 100;
+    
+    // Creates the directory if needed; messages live in `directory`/messages
+    static std::unique_ptr<RelayState> open(const std::string& directory,
+                                            const RelayStateOptions& options = {});
+    // Journals any counters not yet flushed
+    ~RelayState();
+    
+    RelayState(const RelayState&) = delete;
+    RelayState& operator=(const RelayState&) = delete;
+    
+    RegisterStatus register_user(std::string_view username, const crypto::PublicKey& public_key,
+                                 const crypto::SigningPublicKey& signing_public_key, uint64_t& id);
+    std::optional<UserRecord> find_user(std::string_view username) const;
+    bool has_user(std::string_view username) const;
+    // Newest first
+    std::vector<UserRecord> list_users() const;
+    
+    // Finds the session between two users, creating it if needed
+    SessionStatus open_session(std::string_view username1, std::string_view username2,
+                               SessionRecord& session);
+    
+    // Checks a message counter against the replay window for `from_user`'s
+    // direction of the session between the two users
+    CounterResult check_counter(std::string_view username1, std::string_view username2,
+                                std::string_view from_user, uint64_t counter);
+    
+    // Journals counters accepted since the last flush
+    bool flush_counters();
+    
+    crypto::MessageStore& messages() { return *messages_; }
+
+private:
+    struct DirtyCounter {
+        uint64_t session_id;
+        bool user1;
+        uint64_t highest;
+    };
+    
+    RelayState(const std::string& directory, const RelayStateOptions& options);
+    
+    bool replay_journal();
+    bool compact_journal();
+    bool append_journal(const crypto::ByteVector& record);
+    void flush_loop();
+    
+    const UserRecord* user_locked(std::string_view username) const;
+    SessionRecord* session_locked(uint64_t user_a, uint64_t user_b);
+    void raise_counter_locked(uint64_t session_id, bool user1, uint64_t highest);
+    
+    std::string directory_;
+    RelayStateOptions options_;
+    std::unique_ptr<crypto::MessageStore> messages_;
+    
+    mutable std::shared_mutex mutex_;
+    std::unordered_map<std::string, UserRecord> users_;
+    std::unordered_map<uint64_t, const UserRecord*> users_by_id_;
+    std::map<std::pair<uint64_t, uint64_t>, SessionRecord> sessions_;
+    std::unordered_map<uint64_t, SessionRecord*> sessions_by_id_;
+    uint64_t next_user_id_ = 1;
+    uint64_t next_session_id_ = 1;
+    
+    crypto::ReplayWindowTable windows_;
+    
+    // Journal appends are serialized here; dirty_ is keyed by window name
+    std::mutex journal_mutex_;
+    int journal_fd_ = -1;
+    // Set when a failed append could not be cut back off or a sync failed;
+    // no further records are written
+    bool journal_failed_ = false;
+    std::mutex dirty_mutex_;
+    std::unordered_map<std::string, DirtyCounter> dirty_;
+    
+    std::mutex flush_mutex_;
+    std::condition_variable flush_wakeup_;
+    bool stopping_ = false;
+    std::thread flusher_;
+};
+
+} // namespace relay
+} // namespace spear
+
+#endif // SPEAR_RELAY_RELAY_STATE_HPP
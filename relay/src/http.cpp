@@ -0,0 +1,266 @@
+#include "http.hpp"
+#include <cstdio>
+
+namespace spear {
+namespace relay {
+
+namespace {
+
+constexpr std::string_view HEADER_END = "\r\n\r\n";
+
+bool iequals(std::string_view a, std::string_view b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        char x = a[i] >= 'A' && a[i] <= 'Z' ? static_cast<char>(a[i] - 'A' + 'a') : a[i];
+        char y = b[i] >= 'A' && b[i] <= 'Z' ? static_cast<char>(b[i] - 'A' + 'a') : b[i];
+        if (x != y) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// Whether a comma-separated header list has an item equal to `token`,
+// ignoring any ;parameters when `strip_params` is set
+bool list_contains(std::string_view list, std::string_view token, bool strip_params) {
+    while (!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        if (strip_params) {
+            item = item.substr(0, item.find(';'));
+        }
+        if (iequals(trim(item), token)) {
+            return true;
+        }
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+HttpMethod parse_method(std::string_view method) {
+    if (method == "GET") {
+        return HttpMethod::Get;
+    }
+    if (method == "POST") {
+        return HttpMethod::Post;
+    }
+    if (method == "DELETE") {
+        return HttpMethod::Delete;
+    }
+    if (method == "OPTIONS") {
+        return HttpMethod::Options;
+    }
+    return HttpMethod::Other;
+}
+
+void append(ByteVector& out, std::string_view s) {
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+ParseResult error(int status) {
+    return ParseResult{ParseStatus::Error, 0, status};
+}
+
+} // namespace
+
+ParseResult HttpParser::parse(ConstByteSpan data, HttpRequest& request) {
+    std::string_view text(reinterpret_cast<const char*>(data.data()), data.size());
+    size_t header_end = text.find(HEADER_END);
+    if (header_end == std::string_view::npos) {
+        if (text.size() > MAX_HEADER_SIZE) {
+            return error(431);
+        }
+        return ParseResult{ParseStatus::Incomplete, 0, 0};
+    }
+    if (header_end > MAX_HEADER_SIZE) {
+        return error(431);
+    }
+    
+    std::string_view head = text.substr(0, header_end);
+    size_t line_end = head.find("\r\n");
+    std::string_view request_line = head.substr(0, line_end);
+    head.remove_prefix(line_end == std::string_view::npos ? head.size() : line_end + 2);
+    
+    size_t method_end = request_line.find(' ');
+    size_t target_end = request_line.rfind(' ');
+    if (method_end == std::string_view::npos || target_end <= method_end) {
+        return error(400);
+    }
+    std::string_view version = request_line.substr(target_end + 1);
+    if (version != "HTTP/1.1" && version != "HTTP/1.0") {
+        return error(400);
+    }
+    std::string_view target = request_line.substr(method_end + 1, target_end - method_end - 1);
+    if (target.empty() || target.front() != '/') {
+        return error(400);
+    }
+    
+    request = HttpRequest();
+    request.method = parse_method(request_line.substr(0, method_end));
+    request.path = target.substr(0, target.find('?'));
+    request.keep_alive = version == "HTTP/1.1";
+    
+    size_t content_length = 0;
+    bool has_length = false;
+    while (!head.empty()) {
+        line_end = head.find("\r\n");
+        std::string_view line = head.substr(0, line_end);
+        head.remove_prefix(line_end == std::string_view::npos ? head.size() : line_end + 2);
+        
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos || colon == 0) {
+            return error(400);
+        }
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = trim(line.substr(colon + 1));
+        
+        if (iequals(name, "content-length")) {
+            if (value.empty() || value.size() > 12 || has_length) {
+                return error(400);
+            }
+            content_length = 0;
+            for (char c : value) {
+                if (c < '0' || c > '9') {
+                    return error(400);
+                }
+                content_length = content_length * 10 + static_cast<size_t>(c - '0');
+            }
+            has_length = true;
+        } else if (iequals(name, "transfer-encoding")) {
+            return error(411);
+        } else if (iequals(name, "content-type")) {
+            request.content_type = value;
+        } else if (iequals(name, "accept")) {
+            request.accept = value;
+        } else if (iequals(name, "connection")) {
+            if (list_contains(value, "close", false)) {
+                request.keep_alive = false;
+            } else if (list_contains(value, "keep-alive", false)) {
+                request.keep_alive = true;
+            }
+        }
+    }
+    
+    if (content_length > MAX_BODY_SIZE) {
+        return error(413);
+    }
+    size_t body_start = header_end + HEADER_END.size();
+    if (data.size() - body_start < content_length) {
+        return ParseResult{ParseStatus::Incomplete, 0, 0};
+    }
+    request.body = data.subspan(body_start, content_length);
+    return ParseResult{ParseStatus::Complete, body_start + content_length, 0};
+}
+
+const char* reason_phrase(int status) {
+    switch (status) {
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+    }
+    return "Unknown";
+}
+
+void append_response(ByteVector& out, int status, std::string_view content_type,
+                     ConstByteSpan body, bool keep_alive) {
+    char line[64];
+    int n = std::snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", status, reason_phrase(status));
+    append(out, std::string_view(line, static_cast<size_t>(n)));
+    if (!content_type.empty()) {
+        append(out, "Content-Type: ");
+        append(out, content_type);
+        append(out, "\r\n");
+    }
+    n = std::snprintf(line, sizeof(line), "Content-Length: %zu\r\n", body.size());
+    append(out, std::string_view(line, static_cast<size_t>(n)));
+    append(out, "Access-Control-Allow-Origin: *\r\n");
+    append(out, keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    out.insert(out.end(), body.data(), body.data() + body.size());
+}
+
+void append_json(ByteVector& out, int status, std::string_view json, bool keep_alive) {
+    append_response(out, status, "application/json; charset=utf-8",
+                    ConstByteSpan(reinterpret_cast<const uint8_t*>(json.data()), json.size()), keep_alive);
+}
+
+void append_error(ByteVector& out, int status, std::string_view message, bool keep_alive) {
+    std::string json = "{\"error\":\"";
+    json += message;
+    json += "\"}";
+    append_json(out, status, json, keep_alive);
+}
+
+void append_preflight(ByteVector& out, bool keep_alive) {
+    append(out, "HTTP/1.1 204 No Content\r\n"
+                "Access-Control-Allow-Origin: *\r\n"
+                "Access-Control-Allow-Methods: GET,HEAD,PUT,PATCH,POST,DELETE\r\n"
+                "Access-Control-Allow-Headers: Content-Type, Accept\r\n"
+                "Content-Length: 0\r\n");
+    append(out, keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+}
+
+bool percent_decode(std::string_view in, std::string& out) {
+    out.clear();
+    out.reserve(in.size());
+    for (size_t i = 0; i < in.size(); ++i) {
+        if (in[i] != '%') {
+            out += in[i];
+            continue;
+        }
+        if (i + 2 >= in.size()) {
+            return false;
+        }
+        int high = hex_value(in[i + 1]);
+        int low = hex_value(in[i + 2]);
+        if (high < 0 || low < 0) {
+            return false;
+        }
+        out += static_cast<char>(high * 16 + low);
+        i += 2;
+    }
+    return true;
+}
+
+bool media_type_matches(std::string_view header, std::string_view type) {
+    return list_contains(header, type, true);
+}
+
+} // namespace relay
+} // namespace spear
@@ -0,0 +1,374 @@
+#include "json.hpp"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace spear {
+namespace relay {
+
+namespace {
+
+constexpr size_t MAX_DEPTH = 32;
+
+class Parser {
+public:
+    explicit Parser(std::string_view text) : text_(text) {}
+    
+    bool at_end() {
+        skip_space();
+        return pos_ == text_.size();
+    }
+    
+    bool consume(char c) {
+        skip_space();
+        if (pos_ < text_.size() && text_[pos_] == c) {
+            pos_++;
+            return true;
+        }
+        return false;
+    }
+    
+    bool parse_value(JsonValue& out, size_t depth) {
+        skip_space();
+        if (pos_ >= text_.size() || depth > MAX_DEPTH) {
+            return false;
+        }
+        char c = text_[pos_];
+        if (c == '"') {
+            out.type = JsonValue::Type::String;
+            return parse_string(out.string);
+        }
+        if (c == '{' || c == '[') {
+            out.type = JsonValue::Type::Compound;
+            return skip_compound(depth);
+        }
+        if (literal("true")) {
+            out.type = JsonValue::Type::Bool;
+            out.boolean = true;
+            return true;
+        }
+        if (literal("false")) {
+            out.type = JsonValue::Type::Bool;
+            out.boolean = false;
+            return true;
+        }
+        if (literal("null")) {
+            out.type = JsonValue::Type::Null;
+            return true;
+        }
+        out.type = JsonValue::Type::Number;
+        return parse_number(out.number);
+    }
+    
+    bool parse_string(std::string& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        out.clear();
+        while (pos_ < text_.size()) {
+            char c = text_[pos_++];
+            if (c == '"') {
+                return true;
+            }
+            if (static_cast<unsigned char>(c) < 0x20) {
+                return false;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                return false;
+            }
+            switch (text_[pos_++]) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!parse_hex4(code)) {
+                        return false;
+                    }
+                    if (code >= 0xD800 && code <= 0xDBFF) {
+                        uint32_t low;
+                        if (pos_ + 1 >= text_.size() || text_[pos_] != '\\' || text_[pos_ + 1] != 'u') {
+                            return false;
+                        }
+                        pos_ += 2;
+                        if (!parse_hex4(low) || low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    } else if (code >= 0xDC00 && code <= 0xDFFF) {
+                        return false;
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+        return false;
+    }
+
+private:
+    void skip_space() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            pos_++;
+        }
+    }
+    
+    bool literal(std::string_view word) {
+        if (text_.substr(pos_, word.size()) == word) {
+            pos_ += word.size();
+            return true;
+        }
+        return false;
+    }
+    
+    bool parse_number(double& out) {
+        size_t start = pos_;
+        if (pos_ < text_.size() && text_[pos_] == '-') {
+            pos_++;
+        }
+        size_t digits = pos_;
+        while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+            pos_++;
+        }
+        if (pos_ == digits) {
+            return false;
+        }
+        if (pos_ < text_.size() && text_[pos_] == '.') {
+            pos_++;
+            size_t fraction = pos_;
+            while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+                pos_++;
+            }
+            if (pos_ == fraction) {
+                return false;
+            }
+        }
+        if (pos_ < text_.size() && (text_[pos_] == 'e' || text_[pos_] == 'E')) {
+            pos_++;
+            if (pos_ < text_.size() && (text_[pos_] == '+' || text_[pos_] == '-')) {
+                pos_++;
+            }
+            size_t exponent = pos_;
+            while (pos_ < text_.size() && text_[pos_] >= '0' && text_[pos_] <= '9') {
+                pos_++;
+            }
+            if (pos_ == exponent) {
+                return false;
+            }
+        }
+        std::string number(text_.substr(start, pos_ - start));
+        out = std::strtod(number.c_str(), nullptr);
+        return true;
+    }
+    
+    bool parse_hex4(uint32_t& out) {
+        if (pos_ + 4 > text_.size()) {
+            return false;
+        }
+        out = 0;
+        for (size_t i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            uint32_t digit;
+            if (c >= '0' && c <= '9') {
+                digit = static_cast<uint32_t>(c - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                digit = static_cast<uint32_t>(c - 'a' + 10);
+            } else if (c >= 'A' && c <= 'F') {
+                digit = static_cast<uint32_t>(c - 'A' + 10);
+            } else {
+                return false;
+            }
+            out = out * 16 + digit;
+        }
+        return true;
+    }
+    
+    static void append_utf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+    
+    bool skip_compound(size_t depth) {
+        char close = text_[pos_] == '{' ? '}' : ']';
+        bool object = close == '}';
+        pos_++;
+        if (consume(close)) {
+            return true;
+        }
+        do {
+            JsonValue ignored;
+            if (object) {
+                std::string key;
+                if (!parse_string(key) || !consume(':')) {
+                    return false;
+                }
+            }
+            if (!parse_value(ignored, depth + 1)) {
+                return false;
+            }
+        } while (consume(','));
+        return consume(close);
+    }
+    
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+} // namespace
+
+std::optional<uint64_t> JsonValue::safe_integer() const {
+    if (type != Type::Number || number < 0 || number > 9007199254740991.0 ||
+        std::floor(number) != number) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(number);
+}
+
+std::optional<JsonObject> JsonObject::parse(std::string_view text) {
+    Parser parser(text);
+    JsonObject object;
+    if (!parser.consume('{')) {
+        return std::nullopt;
+    }
+    if (!parser.consume('}')) {
+        do {
+            std::string key;
+            JsonValue value;
+            if (!parser.parse_string(key) || !parser.consume(':') || !parser.parse_value(value, 1)) {
+                return std::nullopt;
+            }
+            // Last duplicate wins, as with JSON.parse
+            object.fields_[std::move(key)] = std::move(value);
+        } while (parser.consume(','));
+        if (!parser.consume('}')) {
+            return std::nullopt;
+        }
+    }
+    if (!parser.at_end()) {
+        return std::nullopt;
+    }
+    return object;
+}
+
+const JsonValue* JsonObject::get(std::string_view key) const {
+    auto it = fields_.find(std::string(key));
+    return it == fields_.end() ? nullptr : &it->second;
+}
+
+const std::string* JsonObject::string(std::string_view key) const {
+    const JsonValue* value = get(key);
+    if (value == nullptr || !value->is_string() || value->string.empty()) {
+        return nullptr;
+    }
+    return &value->string;
+}
+
+void JsonWriter::separate() {
+    if (need_comma_) {
+        out_ += ',';
+    }
+    need_comma_ = true;
+}
+
+JsonWriter& JsonWriter::begin_object() {
+    separate();
+    out_ += '{';
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_object() {
+    out_ += '}';
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::begin_array() {
+    separate();
+    out_ += '[';
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::end_array() {
+    out_ += ']';
+    need_comma_ = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(std::string_view name) {
+    value(name);
+    out_ += ':';
+    need_comma_ = false;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(std::string_view s) {
+    separate();
+    out_ += '"';
+    for (char c : s) {
+        switch (c) {
+            case '"': out_ += "\\\""; break;
+            case '\\': out_ += "\\\\"; break;
+            case '\n': out_ += "\\n"; break;
+            case '\r': out_ += "\\r"; break;
+            case '\t': out_ += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char escape[8];
+                    std::snprintf(escape, sizeof(escape), "\\u%04x", static_cast<unsigned>(c));
+                    out_ += escape;
+                } else {
+                    out_ += c;
+                }
+        }
+    }
+    out_ += '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(uint64_t n) {
+    separate();
+    out_ += std::to_string(n);
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool b) {
+    separate();
+    out_ += b ? "true" : "false";
+    return *this;
+}
+
+JsonWriter& JsonWriter::raw(std::string_view json) {
+    separate();
+    out_ += json;
+    return *this;
+}
+
+} // namespace relay
+} // namespace spear
@@ -0,0 +1,74 @@
+// spear_relayd: the relay server's HTTP API as a native daemon.
+//
+//   spear_relayd [--host=<ipv4>] [--port=<port>] [--data=<dir>]
+//                [--reactors=<n>] [--no-sync] [--no-pin]
+//
+// Runs until SIGINT or SIGTERM.
+
+#include "relay_server.hpp"
+#include "utils.hpp"
+#include <csignal>
+#include <iostream>
+#include <string>
+
+using namespace spear;
+
+int main(int argc, char** argv) {
+    relay::RelayServerOptions server_options;
+    relay::RelayStateOptions state_options;
+    std::string data_dir = "relay-data";
+    
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.rfind("--host=", 0) == 0) {
+            server_options.host = arg.substr(7);
+        } else if (arg.rfind("--port=", 0) == 0) {
+            server_options.port = static_cast<uint16_t>(std::stoul(arg.substr(7)));
+        } else if (arg.rfind("--data=", 0) == 0) {
+            data_dir = arg.substr(7);
+        } else if (arg.rfind("--reactors=", 0) == 0) {
+            server_options.reactors = std::stoul(arg.substr(11));
+        } else if (arg == "--no-sync") {
+            state_options.sync = false;
+        } else if (arg == "--no-pin") {
+            server_options.pin_threads = false;
+        } else {
+            std::cerr << "Usage: " << argv[0]
+                      << " [--host=<ipv4>] [--port=<port>] [--data=<dir>] [--reactors=<n>]"
+                      << " [--no-sync] [--no-pin]" << std::endl;
+            return 1;
+        }
+    }
+    
+    if (!crypto::utils::initialize()) {
+        std::cerr << "Failed to initialize libsodium" << std::endl;
+        return 1;
+    }
+    
+    // Blocked before any thread starts, so only sigwait below sees them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+    
+    auto state = relay::RelayState::open(data_dir, state_options);
+    if (!state) {
+        std::cerr << "Failed to open relay state in " << data_dir << std::endl;
+        return 1;
+    }
+    
+    relay::RelayServer server(*state, server_options);
+    if (!server.start()) {
+        std::cerr << "Failed to listen on " << server_options.host << ":" << server_options.port << std::endl;
+        return 1;
+    }
+    std::cout << "SPEAR relay listening on " << server_options.host << ":" << server.port()
+              << " (" << server.reactor_count() << " reactors, data in " << data_dir << ")" << std::endl;
+    
+    int received = 0;
+    sigwait(&signals, &received);
+    std::cout << "Shutting down" << std::endl;
+    server.stop();
+    return 0;
+}
@@ -0,0 +1,614 @@
+#include "relay_api.hpp"
+#include "json.hpp"
+#include "metrics.hpp"
+#include "utils.hpp"
+#include "wire_codec.hpp"
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+
+namespace spear {
+namespace relay {
+
+using crypto::MessageRecord;
+using crypto::WireCodec;
+using crypto::WireMessage;
+
+namespace {
+
+constexpr std::string_view JSON_TYPE = "application/json";
+
+uint64_t now_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+// "2024-01-31T12:00:00.000Z", as Date.prototype.toISOString
+std::string iso_time(uint64_t ms) {
+    time_t seconds = static_cast<time_t>(ms / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    char text[64];
+    std::snprintf(text, sizeof(text), "%04d-%02d-%02dT%02d:%02d:%02d.%03dZ",
+                  utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                  utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(ms % 1000));
+    return text;
+}
+
+// "2024-01-31 12:00:00", as SQLite's CURRENT_TIMESTAMP in the Node server
+std::string sql_time(uint64_t ms) {
+    time_t seconds = static_cast<time_t>(ms / 1000);
+    struct tm utc;
+    gmtime_r(&seconds, &utc);
+    char text[64];
+    std::snprintf(text, sizeof(text), "%04d-%02d-%02d %02d:%02d:%02d",
+                  utc.tm_year + 1900, utc.tm_mon + 1, utc.tm_mday,
+                  utc.tm_hour, utc.tm_min, utc.tm_sec);
+    return text;
+}
+
+// Base64 straight into the JSON buffer's quotes
+void base64_field(JsonWriter& json, std::string_view name, ConstByteSpan data) {
+    std::string quoted(crypto::utils::base64_encoded_size(data.size()) + 2, '"');
+    crypto::utils::to_base64(data, &quoted[1], quoted.size() - 2);
+    json.key(name).raw(quoted);
+}
+
+bool decode_base64(const std::string& text, ByteVector& out) {
+    out.resize(crypto::utils::base64_decoded_max_size(text.size()));
+    auto written = crypto::utils::from_base64(text, out);
+    if (!written) {
+        return false;
+    }
+    out.resize(*written);
+    return true;
+}
+
+template <size_t N>
+bool decode_key(const std::string& text, std::array<uint8_t, N>& out) {
+    ByteVector bytes;
+    if (!decode_base64(text, bytes) || bytes.size() != N) {
+        return false;
+    }
+    std::copy(bytes.begin(), bytes.end(), out.begin());
+    return true;
+}
+
+// Bodies that are not JSON parse as an empty object, as with body-parser
+std::optional<JsonObject> parse_body(const HttpRequest& request) {
+    if (!media_type_matches(request.content_type, JSON_TYPE)) {
+        return JsonObject();
+    }
+    return JsonObject::parse(std::string_view(reinterpret_cast<const char*>(request.body.data()),
+                                              request.body.size()));
+}
+
+// Splits "/a/b/c" into its segments, percent-decoded
+bool split_path(std::string_view path, std::vector<std::string>& segments) {
+    while (!path.empty()) {
+        if (path.front() == '/') {
+            path.remove_prefix(1);
+            continue;
+        }
+        size_t slash = path.find('/');
+        std::string segment;
+        if (!percent_decode(path.substr(0, slash), segment)) {
+            return false;
+        }
+        segments.push_back(std::move(segment));
+        if (slash == std::string_view::npos) {
+            break;
+        }
+        path.remove_prefix(slash);
+    }
+    return true;
+}
+
+// Number(s) for an ack id: digits only, positive and below 2^53
+std::optional<uint64_t> parse_id(std::string_view s) {
+    if (s.empty() || s.size() > 16) {
+        return std::nullopt;
+    }
+    uint64_t value = 0;
+    for (char c : s) {
+        if (c < '0' || c > '9') {
+            return std::nullopt;
+        }
+        value = value * 10 + static_cast<uint64_t>(c - '0');
+    }
+    if (value == 0 || value > 9007199254740991ULL) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+} // namespace
+
+bool RelayApi::handle(const HttpRequest& request, ByteVector& out, PendingWrite& pending) {
+    if (request.method == HttpMethod::Options) {
+        append_preflight(out, request.keep_alive);
+        return false;
+    }
+    
+    std::vector<std::string> segments;
+    if (!split_path(request.path, segments)) {
+        append_error(out, 400, "Invalid path", request.keep_alive);
+        return false;
+    }
+    size_t n = segments.size();
+    HttpMethod method = request.method;
+    
+    if (n >= 2 && segments[0] == "api") {
+        const std::string& resource = segments[1];
+        if (resource == "register" && n == 2 && method == HttpMethod::Post) {
+            register_user(request, out);
+            return false;
+        }
+        if (resource == "users" && method == HttpMethod::Get) {
+            if (n == 2) {
+                list_users(request, out);
+                return false;
+            }
+            if (n == 3) {
+                get_user(request, segments[2], out);
+                return false;
+            }
+        }
+        if (resource == "sessions" && method == HttpMethod::Post) {
+            if (n == 2) {
+                open_session(request, out);
+                return false;
+            }
+            if (n == 3 && segments[2] == "counter") {
+                update_counter(request, out);
+                return false;
+            }
+        }
+        if (resource == "messages") {
+            if (n == 2 && method == HttpMethod::Post) {
+                return send_message(request, out, pending);
+            }
+            if (n == 3 && method == HttpMethod::Get) {
+                get_messages(request, segments[2], out);
+                return false;
+            }
+            if (n == 4 && method == HttpMethod::Delete) {
+                return ack_messages(request, std::move(segments[2]), segments[3], out, pending);
+            }
+            if (n == 3 && method == HttpMethod::Delete) {
+                return ack_message(request, segments[2], out, pending);
+            }
+        }
+    } else if (n == 1 && method == HttpMethod::Get) {
+        if (segments[0] == "metrics") {
+            metrics(request, out);
+            return false;
+        }
+        if (segments[0] == "health") {
+            health(request, out);
+            return false;
+        }
+    }
+    
+    append_error(out, 404, "Not found", request.keep_alive);
+    return false;
+}
+
+void RelayApi::commit(std::vector<PendingWrite>& writes) {
+    std::vector<std::string_view> recipients;
+    std::vector<MessageRecord> records;
+    std::vector<PendingWrite*> sends;
+    for (PendingWrite& write : writes) {
+        if (write.kind != PendingWrite::Kind::Send) {
+            continue;
+        }
+        auto message = WireCodec::decode(write.envelope);
+        if (!message) {
+            write.ok = false;
+            continue;
+        }
+        // The store assigns ids and timestamps, whatever the client sent
+        message->record.id = 0;
+        message->record.timestamp_ms = 0;
+        recipients.push_back(message->recipient);
+        records.push_back(message->record);
+        sends.push_back(&write);
+    }
+    
+    if (!sends.empty()) {
+        auto first = state_.messages().append_batch(recipients, records);
+        for (size_t i = 0; i < sends.size(); ++i) {
+            sends[i]->ok = first.has_value();
+            sends[i]->result = first ? *first + i : 0;
+        }
+    }
+    
+    for (PendingWrite& write : writes) {
+        if (write.kind != PendingWrite::Kind::Ack) {
+            continue;
+        }
+        auto acknowledged = state_.messages().ack(write.recipient, write.up_to_id);
+        write.ok = acknowledged.has_value();
+        write.result = acknowledged ? *acknowledged : 0;
+    }
+}
+
+void RelayApi::complete(const PendingWrite& write, ByteVector& out) {
+    if (!write.ok) {
+        append_error(out, 500, "Internal server error", write.keep_alive);
+        return;
+    }
+    JsonWriter json;
+    json.begin_object();
+    if (write.kind == PendingWrite::Kind::Send) {
+        json.field("id", write.result).field("message", "Message sent successfully");
+        json.end_object();
+        append_json(out, 201, json.str(), write.keep_alive);
+    } else if (write.legacy) {
+        json.field("message", "Message acknowledged");
+        json.end_object();
+        append_json(out, 200, json.str(), write.keep_alive);
+    } else {
+        json.field("message", "Messages acknowledged").field("acknowledged", write.result);
+        json.end_object();
+        append_json(out, 200, json.str(), write.keep_alive);
+    }
+}
+
+void RelayApi::register_user(const HttpRequest& request, ByteVector& out) {
+    auto body = parse_body(request);
+    if (!body) {
+        append_error(out, 400, "Invalid JSON", request.keep_alive);
+        return;
+    }
+    const std::string* username = body->string("username");
+    const std::string* public_key = body->string("publicKey");
+    const std::string* signing_public_key = body->string("signingPublicKey");
+    if (!username || !public_key || !signing_public_key) {
+        append_error(out, 400, "Missing required fields", request.keep_alive);
+        return;
+    }
+    
+    crypto::PublicKey pk;
+    crypto::SigningPublicKey spk;
+    if (!decode_key(*public_key, pk) || !decode_key(*signing_public_key, spk)) {
+        append_error(out, 400, "Invalid key sizes", request.keep_alive);
+        return;
+    }
+    
+    uint64_t id = 0;
+    switch (state_.register_user(*username, pk, spk, id)) {
+        case RegisterStatus::Created: {
+            JsonWriter json;
+            json.begin_object()
+                .field("id", id)
+                .field("username", *username)
+                .field("message", "User registered successfully")
+                .end_object();
+            append_json(out, 201, json.str(), request.keep_alive);
+            return;
+        }
+        case RegisterStatus::Exists:
+            append_error(out, 409, "Username already exists", request.keep_alive);
+            return;
+        case RegisterStatus::Failed:
+            break;
+    }
+    append_error(out, 500, "Internal server error", request.keep_alive);
+}
+
+void RelayApi::list_users(const HttpRequest& request, ByteVector& out) {
+    JsonWriter json;
+    json.begin_object().key("users").begin_array();
+    for (const UserRecord& user : state_.list_users()) {
+        json.begin_object()
+            .field("id", user.id)
+            .field("username", user.username)
+            .field("created_at", sql_time(user.created_ms))
+            .end_object();
+    }
+    json.end_array().end_object();
+    append_json(out, 200, json.str(), request.keep_alive);
+}
+
+void RelayApi::get_user(const HttpRequest& request, std::string_view username, ByteVector& out) {
+    auto user = state_.find_user(username);
+    if (!user) {
+        append_error(out, 404, "User not found", request.keep_alive);
+        return;
+    }
+    JsonWriter json;
+    json.begin_object().field("id", user->id).field("username", user->username);
+    base64_field(json, "publicKey", user->public_key);
+    base64_field(json, "signingPublicKey", user->signing_public_key);
+    json.field("createdAt", sql_time(user->created_ms)).end_object();
+    append_json(out, 200, json.str(), request.keep_alive);
+}
+
+void RelayApi::open_session(const HttpRequest& request, ByteVector& out) {
+    auto body = parse_body(request);
+    if (!body) {
+        append_error(out, 400, "Invalid JSON", request.keep_alive);
+        return;
+    }
+    const std::string* username1 = body->string("username1");
+    const std::string* username2 = body->string("username2");
+    if (!username1 || !username2) {
+        append_error(out, 400, "Missing required fields", request.keep_alive);
+        return;
+    }
+    
+    SessionRecord session;
+    switch (state_.open_session(*username1, *username2, session)) {
+        case SessionStatus::Ok: {
+            JsonWriter json;
+            json.begin_object()
+                .field("sessionId", session.id)
+                .field("lastCounterUser1", session.last_counter_user1)
+                .field("lastCounterUser2", session.last_counter_user2)
+                .field("rotationThreshold", session.rotation_threshold)
+                .field("needsRotation", false)
+                .end_object();
+            append_json(out, 200, json.str(), request.keep_alive);
+            return;
+        }
+        case SessionStatus::UserNotFound:
+            append_error(out, 404, "User not found", request.keep_alive);
+            return;
+        case SessionStatus::Failed:
+            break;
+    }
+    append_error(out, 500, "Internal server error", request.keep_alive);
+}
+
+void RelayApi::update_counter(const HttpRequest& request, ByteVector& out) {
+    auto body = parse_body(request);
+    if (!body) {
+        append_error(out, 400, "Invalid JSON", request.keep_alive);
+        return;
+    }
+    const std::string* username1 = body->string("username1");
+    const std::string* username2 = body->string("username2");
+    const std::string* from_user = body->string("fromUser");
+    const JsonValue* counter_value = body->get("counter");
+    if (!username1 || !username2 || !counter_value || !from_user) {
+        append_error(out, 400, "Missing required fields", request.keep_alive);
+        return;
+    }
+    auto counter = counter_value->safe_integer();
+    if (!counter) {
+        append_error(out, 400, "Invalid counter", request.keep_alive);
+        return;
+    }
+    
+    CounterResult result = state_.check_counter(*username1, *username2, *from_user, *counter);
+    JsonWriter json;
+    switch (result.status) {
+        case CounterResult::Status::Accepted:
+            json.begin_object()
+                .field("success", true)
+                .field("counter", *counter)
+                .field("needsRotation", *counter >= result.rotation_threshold)
+                .field("rotationThreshold", result.rotation_threshold)
+                .end_object();
+            append_json(out, 200, json.str(), request.keep_alive);
+            return;
+        case CounterResult::Status::Replayed:
+        case CounterResult::Status::TooOld:
+            json.begin_object()
+                .field("error", "Replay attack detected")
+                .field("reason", result.status == CounterResult::Status::Replayed ? "replayed" : "too-old")
+                .field("expectedCounter", result.highest + 1)
+                .field("receivedCounter", *counter)
+                .end_object();
+            append_json(out, 400, json.str(), request.keep_alive);
+            return;
+        case CounterResult::Status::SessionNotFound:
+            break;
+    }
+    append_error(out, 404, "Session not found", request.keep_alive);
+}
+
+bool RelayApi::send_message(const HttpRequest& request, ByteVector& out, PendingWrite& pending) {
+    std::string recipient;
+    std::string sender;
+    
+    if (media_type_matches(request.content_type, WIRE_TYPE)) {
+        // Already an envelope: validate it and queue the bytes as they came
+        auto messages = WireCodec::decode_all(request.body);
+        if (!messages || messages->size() != 1 || (*messages)[0].recipient.empty()) {
+            append_error(out, 400, "Missing required fields", request.keep_alive);
+            return false;
+        }
+        sender = (*messages)[0].record.sender;
+        recipient = (*messages)[0].recipient;
+        pending.envelope.assign(request.body.data(), request.body.data() + request.body.size());
+    } else {
+        auto body = parse_body(request);
+        if (!body) {
+            append_error(out, 400, "Invalid JSON", request.keep_alive);
+            return false;
+        }
+        const std::string* from = body->string("fromUsername");
+        const std::string* to = body->string("toUsername");
+        const std::string* content = body->string("encryptedContent");
+        const std::string* nonce = body->string("nonce");
+        const std::string* signature = body->string("signature");
+        const JsonValue* counter = body->get("counter");
+        if (!from || !to || !content || !nonce || !signature || !counter) {
+            append_error(out, 400, "Missing required fields", request.keep_alive);
+            return false;
+        }
+        
+        ByteVector content_bytes;
+        ByteVector nonce_bytes;
+        ByteVector signature_bytes;
+        auto counter_int = counter->safe_integer();
+        if (!counter_int || !decode_base64(*content, content_bytes) ||
+            !decode_base64(*nonce, nonce_bytes) || !decode_base64(*signature, signature_bytes)) {
+            append_error(out, 400, "Invalid message", request.keep_alive);
+            return false;
+        }
+        
+        WireMessage message;
+        message.recipient = *to;
+        message.record.counter = *counter_int;
+        message.record.sender = *from;
+        message.record.nonce = nonce_bytes;
+        message.record.signature = signature_bytes;
+        message.record.content = content_bytes;
+        auto envelope = WireCodec::encode(message);
+        if (!envelope) {
+            append_error(out, 400, "Invalid message", request.keep_alive);
+            return false;
+        }
+        sender = *from;
+        recipient = *to;
+        pending.envelope = std::move(*envelope);
+    }
+    
+    if (!state_.has_user(sender) || !state_.has_user(recipient)) {
+        append_error(out, 404, "User not found", request.keep_alive);
+        return false;
+    }
+    pending.kind = PendingWrite::Kind::Send;
+    pending.keep_alive = request.keep_alive;
+    return true;
+}
+
+void RelayApi::get_messages(const HttpRequest& request, std::string_view username, ByteVector& out) {
+    if (!state_.has_user(username)) {
+        append_error(out, 404, "User not found", request.keep_alive);
+        return;
+    }
+    crypto::MessageBatch batch = state_.messages().fetch(username);
+    
+    if (media_type_matches(request.accept, WIRE_TYPE)) {
+        // Polled envelopes leave the recipient empty; it is the caller
+        ByteVector body;
+        for (const MessageRecord& record : batch) {
+            WireCodec::append(WireMessage{std::string_view(), record}, body);
+        }
+        append_response(out, 200, WIRE_TYPE, body, request.keep_alive);
+        return;
+    }
+    
+    JsonWriter json;
+    json.begin_object().key("messages").begin_array();
+    for (const MessageRecord& record : batch) {
+        json.begin_object().field("id", record.id).field("fromUsername", record.sender);
+        base64_field(json, "encryptedContent", record.content);
+        base64_field(json, "nonce", record.nonce);
+        base64_field(json, "signature", record.signature);
+        json.field("counter", record.counter)
+            .field("createdAt", iso_time(record.timestamp_ms))
+            .end_object();
+    }
+    json.end_array().end_object();
+    append_json(out, 200, json.str(), request.keep_alive);
+}
+
+bool RelayApi::ack_messages(const HttpRequest& request, std::string username, std::string_view id,
+                            ByteVector& out, PendingWrite& pending) {
+    auto up_to_id = parse_id(id);
+    if (!up_to_id) {
+        append_error(out, 400, "Invalid message id", request.keep_alive);
+        return false;
+    }
+    if (!state_.has_user(username)) {
+        append_error(out, 404, "User not found", request.keep_alive);
+        return false;
+    }
+    // An id that has not been assigned yet would move the cursor past
+    // messages still to come
+    if (*up_to_id > state_.messages().last_id(username)) {
+        append_error(out, 400, "Invalid message id", request.keep_alive);
+        return false;
+    }
+    pending.kind = PendingWrite::Kind::Ack;
+    pending.keep_alive = request.keep_alive;
+    pending.recipient = std::move(username);
+    pending.up_to_id = *up_to_id;
+    return true;
+}
+
+// Legacy route from before acks were per recipient: the recipient is found
+// from the id, then everything for them up to it is acknowledged
+bool RelayApi::ack_message(const HttpRequest& request, std::string_view id, ByteVector& out,
+                           PendingWrite& pending) {
+    auto up_to_id = parse_id(id);
+    if (!up_to_id) {
+        append_error(out, 400, "Invalid message id", request.keep_alive);
+        return false;
+    }
+    auto recipient = state_.messages().recipient_of(*up_to_id);
+    if (!recipient) {
+        append_error(out, 404, "Message not found", request.keep_alive);
+        return false;
+    }
+    pending.kind = PendingWrite::Kind::Ack;
+    pending.keep_alive = request.keep_alive;
+    pending.recipient = std::move(*recipient);
+    pending.up_to_id = *up_to_id;
+    pending.legacy = true;
+    return true;
+}
+
+void RelayApi::metrics(const HttpRequest& request, ByteVector& out) {
+    static constexpr std::pair<const char*, double> QUANTILES[] = {
+        {"0.5", 0.5}, {"0.9", 0.9}, {"0.99", 0.99}, {"0.999", 0.999},
+    };
+    
+    crypto::MetricsSnapshot snapshot = crypto::Metrics::snapshot();
+    std::string text;
+    char line[256];
+    auto add = [&](int n) {
+        if (n > 0) {
+            text.append(line, std::min(static_cast<size_t>(n), sizeof(line) - 1));
+        }
+    };
+    auto counter = [&](const char* name, const char* help, uint64_t crypto::OpMetrics::*field) {
+        add(std::snprintf(line, sizeof(line), "# HELP %s %s\n# TYPE %s counter\n", name, help, name));
+        for (size_t i = 0; i < crypto::METRIC_OP_COUNT; ++i) {
+            const char* op = crypto::Metrics::op_name(static_cast<crypto::MetricOp>(i));
+            add(std::snprintf(line, sizeof(line), "%s{op=\"%s\"} %llu\n", name, op,
+                              static_cast<unsigned long long>(snapshot.ops[i].*field)));
+        }
+    };
+    
+    text += "# HELP spear_crypto_metrics_enabled Whether the native core records metrics\n";
+    text += "# TYPE spear_crypto_metrics_enabled gauge\n";
+    text += snapshot.enabled ? "spear_crypto_metrics_enabled 1\n" : "spear_crypto_metrics_enabled 0\n";
+    
+    counter("spear_crypto_ops_total", "Crypto primitive calls", &crypto::OpMetrics::ops);
+    counter("spear_crypto_failures_total", "Crypto primitive calls that failed", &crypto::OpMetrics::failures);
+    counter("spear_crypto_bytes_total", "Bytes processed by crypto primitives", &crypto::OpMetrics::bytes);
+    
+    text += "# HELP spear_crypto_latency_seconds Crypto primitive latency\n";
+    text += "# TYPE spear_crypto_latency_seconds summary\n";
+    for (size_t i = 0; i < crypto::METRIC_OP_COUNT; ++i) {
+        const char* op = crypto::Metrics::op_name(static_cast<crypto::MetricOp>(i));
+        const crypto::OpMetrics& stats = snapshot.ops[i];
+        for (const auto& quantile : QUANTILES) {
+            add(std::snprintf(line, sizeof(line), "spear_crypto_latency_seconds{op=\"%s\",quantile=\"%s\"} %.9g\n",
+                              op, quantile.first, static_cast<double>(stats.latency.quantile(quantile.second)) / 1e9));
+        }
+        add(std::snprintf(line, sizeof(line), "spear_crypto_latency_seconds_sum{op=\"%s\"} %.9g\n",
+                          op, static_cast<double>(stats.total_nanos) / 1e9));
+        add(std::snprintf(line, sizeof(line), "spear_crypto_latency_seconds_count{op=\"%s\"} %llu\n",
+                          op, static_cast<unsigned long long>(stats.ops)));
+    }
+    
+    append_response(out, 200, "text/plain; version=0.0.4",
+                    ConstByteSpan(reinterpret_cast<const uint8_t*>(text.data()), text.size()),
+                    request.keep_alive);
+}
+
+void RelayApi::health(const HttpRequest& request, ByteVector& out) {
+    JsonWriter json;
+    json.begin_object().field("status", "ok").field("timestamp", iso_time(now_ms())).end_object();
+    append_json(out, 200, json.str(), request.keep_alive);
+}
+
+} // namespace relay
+} // namespace spear
@@ -0,0 +1,461 @@
+#include "relay_server.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace spear {
+namespace relay {
+
+namespace {
+
+constexpr uint64_t LISTEN_ID = 0;
+constexpr uint64_t WAKE_ID = 1;
+constexpr int MAX_EVENTS = 256;
+constexpr size_t READ_CHUNK = 64 * 1024;
+// Unparsed input held per connection; past this, reading waits for the
+// pending reply, so a pipelining client is pushed back through TCP
+constexpr size_t MAX_BUFFERED = HttpParser::MAX_HEADER_SIZE + HttpParser::MAX_BODY_SIZE;
+// Unsent output past which no further requests are parsed
+constexpr size_t MAX_BACKLOG = 4 * 1024 * 1024;
+
+} // namespace
+
+class RelayServer::Reactor {
+public:
+    explicit Reactor(RelayApi& api) : api_(api) {}
+    
+    ~Reactor() {
+        stop();
+        for (auto& entry : connections_) {
+            ::close(entry.second->fd);
+        }
+        if (listen_fd_ >= 0) {
+            ::close(listen_fd_);
+        }
+        if (spare_fd_ >= 0) {
+            ::close(spare_fd_);
+        }
+        if (wake_fd_ >= 0) {
+            ::close(wake_fd_);
+        }
+        if (epoll_fd_ >= 0) {
+            ::close(epoll_fd_);
+        }
+    }
+    
+    // Binds to `address`; a zero port there is replaced by the one chosen
+    bool listen(sockaddr_in& address) {
+        listen_fd_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (listen_fd_ < 0) {
+            return false;
+        }
+        int one = 1;
+        ::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if (::setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one)) != 0 ||
+            ::bind(listen_fd_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listen_fd_, SOMAXCONN) != 0) {
+            return false;
+        }
+        socklen_t length = sizeof(address);
+        if (::getsockname(listen_fd_, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            return false;
+        }
+        
+        epoll_fd_ = ::epoll_create1(EPOLL_CLOEXEC);
+        wake_fd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return epoll_fd_ >= 0 && wake_fd_ >= 0 && spare_fd_ >= 0 &&
+               watch(listen_fd_, LISTEN_ID, EPOLLIN) && watch(wake_fd_, WAKE_ID, EPOLLIN);
+    }
+    
+    void start(bool pin, size_t cpu) {
+        committer_ = std::thread(&Reactor::commit_loop, this);
+        thread_ = std::thread(&Reactor::run, this);
+        if (pin) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            pthread_setaffinity_np(thread_.native_handle(), sizeof(set), &set);
+        }
+    }
+    
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        commit_wakeup_.notify_one();
+        wake();
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+        if (committer_.joinable()) {
+            committer_.join();
+        }
+    }
+
+private:
+    struct Connection {
+        int fd;
+        uint64_t id;
+        ByteVector in;
+        size_t in_start = 0;
+        size_t in_end = 0;
+        ByteVector out;
+        size_t out_offset = 0;
+        // A send or ack is being committed; later requests wait behind it
+        bool awaiting = false;
+        // Close once the output drains
+        bool closing = false;
+        bool peer_closed = false;
+        bool failed = false;
+    };
+    
+    bool watch(int fd, uint64_t id, uint32_t events) {
+        epoll_event event{};
+        event.events = events;
+        event.data.u64 = id;
+        return ::epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0;
+    }
+    
+    void wake() {
+        uint64_t one = 1;
+        ssize_t written = ::write(wake_fd_, &one, sizeof(one));
+        (void)written;
+    }
+    
+    void run() {
+        epoll_event events[MAX_EVENTS];
+        while (!stopping_) {
+            int n = ::epoll_wait(epoll_fd_, events, MAX_EVENTS, -1);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            for (int i = 0; i < n; ++i) {
+                uint64_t id = events[i].data.u64;
+                if (id == LISTEN_ID) {
+                    accept_connections();
+                } else if (id == WAKE_ID) {
+                    uint64_t count;
+                    ssize_t got = ::read(wake_fd_, &count, sizeof(count));
+                    (void)got;
+                    complete_writes();
+                } else {
+                    auto it = connections_.find(id);
+                    if (it != connections_.end()) {
+                        service(*it->second, (events[i].events & (EPOLLRDHUP | EPOLLHUP)) != 0);
+                    }
+                }
+            }
+            submit();
+        }
+    }
+    
+    void accept_connections() {
+        while (true) {
+            int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if ((errno == EMFILE || errno == ENFILE) && shed_connection()) {
+                    continue;
+                }
+                return;
+            }
+            int one = 1;
+            ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            uint64_t id = next_id_++;
+            if (!watch(fd, id, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET)) {
+                ::close(fd);
+                continue;
+            }
+            auto connection = std::make_unique<Connection>();
+            connection->fd = fd;
+            connection->id = id;
+            connections_.emplace(id, std::move(connection));
+        }
+    }
+    
+    // Out of descriptors: the level-triggered listener would report the
+    // pending connection again straight away, so give up the spare
+    // descriptor long enough to accept it and close it
+    bool shed_connection() {
+        if (spare_fd_ < 0 && (spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC)) < 0) {
+            return false;
+        }
+        ::close(spare_fd_);
+        int fd = ::accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        spare_fd_ = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+        return fd >= 0 && spare_fd_ >= 0;
+    }
+    
+    // Reads whatever has arrived, answers what it can, writes what is
+    // pending and closes the connection when it is done. Edge-triggered, so
+    // no further event comes for input left unread or requests left
+    // unanswered under the limits: the pass repeats until the socket would
+    // block, the connection waits on a commit or nothing is left to parse.
+    void service(Connection& c, bool hangup = false) {
+        while (true) {
+            bool backlogged = c.out.size() - c.out_offset >= MAX_BACKLOG;
+            bool read_all = !backlogged && read_available(c, hangup);
+            bool answered = process(c);
+            if (!flush(c) || c.failed || c.awaiting || c.closing) {
+                break;
+            }
+            if (!backlogged && !(answered && (!read_all || c.in_start < c.in_end))) {
+                break;
+            }
+        }
+        bool drained = c.out_offset == c.out.size();
+        if (c.failed || (drained && (c.closing || (c.peer_closed && !c.awaiting)))) {
+            close(c.id);
+        }
+    }
+    
+    // A short read means the socket is drained, unless the peer hung up,
+    // when reading on to the end of stream is the only way to notice. False
+    // when it stopped at MAX_BUFFERED with input possibly left unread.
+    bool read_available(Connection& c, bool hangup) {
+        while (!c.peer_closed && !c.failed && c.in_end - c.in_start < MAX_BUFFERED) {
+            if (c.in.size() - c.in_end < READ_CHUNK) {
+                if (c.in_start > 0) {
+                    std::memmove(c.in.data(), c.in.data() + c.in_start, c.in_end - c.in_start);
+                    c.in_end -= c.in_start;
+                    c.in_start = 0;
+                }
+                if (c.in.size() - c.in_end < READ_CHUNK) {
+                    c.in.resize(c.in_end + READ_CHUNK);
+                }
+            }
+            size_t space = c.in.size() - c.in_end;
+            ssize_t n = ::recv(c.fd, c.in.data() + c.in_end, space, 0);
+            if (n > 0) {
+                c.in_end += static_cast<size_t>(n);
+                if (static_cast<size_t>(n) < space && !hangup) {
+                    return true;
+                }
+            } else if (n == 0) {
+                c.peer_closed = true;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return true;
+            } else if (errno != EINTR) {
+                c.failed = true;
+            }
+        }
+        return c.peer_closed || c.failed;
+    }
+    
+    // True when at least one request was answered or handed on
+    bool process(Connection& c) {
+        bool answered = false;
+        while (!c.awaiting && !c.closing && c.in_start < c.in_end &&
+               c.out.size() - c.out_offset < MAX_BACKLOG) {
+            HttpRequest request;
+            ParseResult result = HttpParser::parse(
+                ConstByteSpan(c.in.data() + c.in_start, c.in_end - c.in_start), request);
+            if (result.status == ParseStatus::Incomplete) {
+                break;
+            }
+            if (result.status == ParseStatus::Error) {
+                append_error(c.out, result.error_status, reason_phrase(result.error_status), false);
+                c.closing = true;
+                break;
+            }
+            
+            PendingWrite pending;
+            if (api_.handle(request, c.out, pending)) {
+                pending.connection = c.id;
+                c.awaiting = true;
+                submissions_.push_back(std::move(pending));
+            } else if (!request.keep_alive) {
+                c.closing = true;
+            }
+            c.in_start += result.consumed;
+            answered = true;
+        }
+        if (c.in_start == c.in_end) {
+            c.in_start = 0;
+            c.in_end = 0;
+        }
+        return answered;
+    }
+    
+    // True once everything pending has been sent
+    bool flush(Connection& c) {
+        while (c.out_offset < c.out.size()) {
+            ssize_t n = ::send(c.fd, c.out.data() + c.out_offset, c.out.size() - c.out_offset, MSG_NOSIGNAL);
+            if (n > 0) {
+                c.out_offset += static_cast<size_t>(n);
+            } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                return false;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                c.failed = true;
+                return false;
+            }
+        }
+        // Keeps the capacity for the next response
+        c.out.clear();
+        c.out_offset = 0;
+        return true;
+    }
+    
+    void close(uint64_t id) {
+        auto it = connections_.find(id);
+        if (it == connections_.end()) {
+            return;
+        }
+        // Closing the descriptor removes it from the epoll set
+        ::close(it->second->fd);
+        connections_.erase(it);
+    }
+    
+    // Hands this pass's sends and acks to the committer in one batch
+    void submit() {
+        if (submissions_.empty()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (PendingWrite& write : submissions_) {
+                queued_.push_back(std::move(write));
+            }
+        }
+        submissions_.clear();
+        commit_wakeup_.notify_one();
+    }
+    
+    void commit_loop() {
+        std::vector<PendingWrite> batch;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                commit_wakeup_.wait(lock, [this] { return stopping_ || !queued_.empty(); });
+                if (stopping_) {
+                    return;
+                }
+                batch.swap(queued_);
+            }
+            api_.commit(batch);
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                for (PendingWrite& write : batch) {
+                    committed_.push_back(std::move(write));
+                }
+            }
+            batch.clear();
+            wake();
+        }
+    }
+    
+    void complete_writes() {
+        std::vector<PendingWrite> done;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done.swap(committed_);
+        }
+        for (const PendingWrite& write : done) {
+            auto it = connections_.find(write.connection);
+            if (it == connections_.end()) {
+                // Closed while its write was committed
+                continue;
+            }
+            Connection& c = *it->second;
+            RelayApi::complete(write, c.out);
+            c.awaiting = false;
+            if (!write.keep_alive) {
+                c.closing = true;
+            }
+            service(c);
+        }
+    }
+    
+    RelayApi& api_;
+    int listen_fd_ = -1;
+    // Held open so an exhausted descriptor table can still shed connections
+    int spare_fd_ = -1;
+    int epoll_fd_ = -1;
+    int wake_fd_ = -1;
+    uint64_t next_id_ = WAKE_ID + 1;
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;
+    std::vector<PendingWrite> submissions_;
+    
+    // Shared with the committer
+    std::mutex mutex_;
+    std::condition_variable commit_wakeup_;
+    std::vector<PendingWrite> queued_;
+    std::vector<PendingWrite> committed_;
+    std::atomic<bool> stopping_{false};
+    
+    std::thread thread_;
+    std::thread committer_;
+};
+
+RelayServer::RelayServer(RelayState& state, const RelayServerOptions& options)
+    : api_(state), options_(options) {}
+
+RelayServer::~RelayServer() {
+    stop();
+}
+
+bool RelayServer::start() {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options_.port);
+    if (::inet_pton(AF_INET, options_.host.c_str(), &address.sin_addr) != 1) {
+        return false;
+    }
+    
+    size_t cores = std::thread::hardware_concurrency();
+    if (cores == 0) {
+        cores = 1;
+    }
+    size_t count = options_.reactors != 0 ? options_.reactors : cores;
+    for (size_t i = 0; i < count; ++i) {
+        auto reactor = std::make_unique<Reactor>(api_);
+        // The first bind settles the port for the rest
+        if (!reactor->listen(address)) {
+            reactors_.clear();
+            return false;
+        }
+        reactors_.push_back(std::move(reactor));
+    }
+    port_ = ntohs(address.sin_port);
+    
+    for (size_t i = 0; i < count; ++i) {
+        reactors_[i]->start(options_.pin_threads, i % cores);
+    }
+    return true;
+}
+
+void RelayServer::stop() {
+    for (auto& reactor : reactors_) {
+        reactor->stop();
+    }
+    reactors_.clear();
+}
+
+} // namespace relay
+} // namespace spear
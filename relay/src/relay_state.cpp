@@ -0,0 +1,501 @@
+#include "relay_state.hpp"
+#include "endian.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace spear {
+namespace relay {
+
+using crypto::ByteVector;
+using crypto::crc32;
+using crypto::get_u32;
+using crypto::get_u64;
+using crypto::put_u32;
+using crypto::put_u64;
+
+namespace {
+
+// Journal record layout, little-endian:
+//   0 size u32 | 4 crc32 u32 | 8 type u8 | 9 payload
+//   user:    id u64 | created_ms u64 | public_key | signing_public_key | name
+//   session: id u64 | user1_id u64 | user2_id u64 | rotation_threshold u64
+//   counter: session_id u64 | side u8 (1 or 2) | highest u64
+// The checksum covers everything after itself.
+constexpr size_t RECORD_HEADER_SIZE = 9;
+constexpr uint8_t RECORD_USER = 1;
+constexpr uint8_t RECORD_SESSION = 2;
+constexpr uint8_t RECORD_COUNTER = 3;
+constexpr size_t USER_FIXED_SIZE = 16 + crypto::PUBLIC_KEY_SIZE + crypto::SIGNING_PUBLIC_KEY_SIZE;
+constexpr size_t SESSION_SIZE = 32;
+constexpr size_t COUNTER_SIZE = 17;
+constexpr const char* JOURNAL_NAME = "relay.journal";
+
+// Starts a record at the end of `out`; returns a pointer to its payload
+uint8_t* begin_record(ByteVector& out, uint8_t type, size_t payload) {
+    size_t start = out.size();
+    out.resize(start + RECORD_HEADER_SIZE + payload);
+    uint8_t* rec = out.data() + start;
+    put_u32(rec, static_cast<uint32_t>(RECORD_HEADER_SIZE + payload));
+    rec[8] = type;
+    return rec + RECORD_HEADER_SIZE;
+}
+
+void seal_record(ByteVector& out, size_t start) {
+    uint8_t* rec = out.data() + start;
+    uint32_t size = get_u32(rec);
+    put_u32(rec + 4, crc32(rec + 8, size - 8));
+}
+
+void encode_user(ByteVector& out, const UserRecord& user) {
+    size_t start = out.size();
+    uint8_t* p = begin_record(out, RECORD_USER, USER_FIXED_SIZE + user.username.size());
+    put_u64(p, user.id);
+    put_u64(p + 8, user.created_ms);
+    std::memcpy(p + 16, user.public_key.data(), crypto::PUBLIC_KEY_SIZE);
+    std::memcpy(p + 16 + crypto::PUBLIC_KEY_SIZE, user.signing_public_key.data(), crypto::SIGNING_PUBLIC_KEY_SIZE);
+    std::memcpy(p + USER_FIXED_SIZE, user.username.data(), user.username.size());
+    seal_record(out, start);
+}
+
+void encode_session(ByteVector& out, const SessionRecord& session) {
+    size_t start = out.size();
+    uint8_t* p = begin_record(out, RECORD_SESSION, SESSION_SIZE);
+    put_u64(p, session.id);
+    put_u64(p + 8, session.user1_id);
+    put_u64(p + 16, session.user2_id);
+    put_u64(p + 24, session.rotation_threshold);
+    seal_record(out, start);
+}
+
+void encode_counter(ByteVector& out, uint64_t session_id, bool user1, uint64_t highest) {
+    size_t start = out.size();
+    uint8_t* p = begin_record(out, RECORD_COUNTER, COUNTER_SIZE);
+    put_u64(p, session_id);
+    p[8] = user1 ? 1 : 2;
+    put_u64(p + 9, highest);
+    seal_record(out, start);
+}
+
+bool write_all(int fd, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool sync_directory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::fsync(fd) == 0;
+    ::close(fd);
+    return ok;
+}
+
+uint64_t now_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+std::string window_name(uint64_t session_id, bool user1) {
+    return std::to_string(session_id) + (user1 ? ":1" : ":2");
+}
+
+} // namespace
+
+RelayState::RelayState(const std::string& directory, const RelayStateOptions& options)
+    : directory_(directory), options_(options) {}
+
+std::unique_ptr<RelayState> RelayState::open(const std::string& directory, const RelayStateOptions& options) {
+    if (directory.empty() || (::mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST)) {
+        return nullptr;
+    }
+    
+    std::unique_ptr<RelayState> state(new RelayState(directory, options));
+    
+    crypto::MessageStoreOptions store_options;
+    store_options.segment_size = options.segment_size;
+    store_options.sync = options.sync;
+    state->messages_ = crypto::MessageStore::open(directory + "/messages", store_options);
+    if (!state->messages_ || !state->replay_journal()) {
+        return nullptr;
+    }
+    
+    state->flusher_ = std::thread([raw = state.get()] { raw->flush_loop(); });
+    return state;
+}
+
+RelayState::~RelayState() {
+    {
+        std::lock_guard<std::mutex> lock(flush_mutex_);
+        stopping_ = true;
+    }
+    flush_wakeup_.notify_all();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    if (journal_fd_ >= 0) {
+        flush_counters();
+        ::close(journal_fd_);
+    }
+}
+
+// Reads the whole journal, truncating a torn record at its tail
+bool RelayState::replay_journal() {
+    std::string path = directory_ + "/" + JOURNAL_NAME;
+    journal_fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (journal_fd_ < 0) {
+        return false;
+    }
+    
+    struct stat st;
+    if (::fstat(journal_fd_, &st) != 0) {
+        return false;
+    }
+    ByteVector data(static_cast<size_t>(st.st_size));
+    size_t read_total = 0;
+    while (read_total < data.size()) {
+        ssize_t n = ::pread(journal_fd_, data.data() + read_total, data.size() - read_total,
+                            static_cast<off_t>(read_total));
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        read_total += static_cast<size_t>(n);
+    }
+    
+    size_t offset = 0;
+    size_t counter_records = 0;
+    while (offset + RECORD_HEADER_SIZE <= data.size()) {
+        const uint8_t* rec = data.data() + offset;
+        uint32_t size = get_u32(rec);
+        if (size < RECORD_HEADER_SIZE || size > data.size() - offset ||
+            get_u32(rec + 4) != crc32(rec + 8, size - 8)) {
+            break;
+        }
+        const uint8_t* p = rec + RECORD_HEADER_SIZE;
+        size_t payload = size - RECORD_HEADER_SIZE;
+        
+        if (rec[8] == RECORD_USER && payload > USER_FIXED_SIZE) {
+            UserRecord user;
+            user.id = get_u64(p);
+            user.created_ms = get_u64(p + 8);
+            std::memcpy(user.public_key.data(), p + 16, crypto::PUBLIC_KEY_SIZE);
+            std::memcpy(user.signing_public_key.data(), p + 16 + crypto::PUBLIC_KEY_SIZE,
+                        crypto::SIGNING_PUBLIC_KEY_SIZE);
+            user.username.assign(reinterpret_cast<const char*>(p + USER_FIXED_SIZE), payload - USER_FIXED_SIZE);
+            next_user_id_ = std::max(next_user_id_, user.id + 1);
+            auto inserted = users_.emplace(user.username, user);
+            users_by_id_[user.id] = &inserted.first->second;
+        } else if (rec[8] == RECORD_SESSION && payload == SESSION_SIZE) {
+            SessionRecord session{get_u64(p), get_u64(p + 8), get_u64(p + 16), 0, 0, get_u64(p + 24)};
+            next_session_id_ = std::max(next_session_id_, session.id + 1);
+            SessionRecord& stored = sessions_[{session.user1_id, session.user2_id}];
+            stored = session;
+            sessions_by_id_[session.id] = &stored;
+        } else if (rec[8] == RECORD_COUNTER && payload == COUNTER_SIZE) {
+            raise_counter_locked(get_u64(p), p[8] == 1, get_u64(p + 9));
+            counter_records++;
+        }
+        offset += size;
+    }
+    
+    if (offset < data.size() && ::ftruncate(journal_fd_, static_cast<off_t>(offset)) != 0) {
+        return false;
+    }
+    if (::lseek(journal_fd_, static_cast<off_t>(offset), SEEK_SET) < 0) {
+        return false;
+    }
+    
+    // Two live counters per session at most; the rest are superseded
+    if (counter_records > 2 * sessions_.size() + 1024) {
+        return compact_journal();
+    }
+    return true;
+}
+
+// Rewrites the journal as one record per user and session plus the latest
+// counters, then swaps it in atomically
+bool RelayState::compact_journal() {
+    std::vector<const UserRecord*> users;
+    for (const auto& entry : users_) {
+        users.push_back(&entry.second);
+    }
+    std::sort(users.begin(), users.end(),
+              [](const UserRecord* a, const UserRecord* b) { return a->id < b->id; });
+    
+    ByteVector out;
+    for (const UserRecord* user : users) {
+        encode_user(out, *user);
+    }
+    for (const auto& entry : sessions_) {
+        const SessionRecord& session = entry.second;
+        encode_session(out, session);
+        if (session.last_counter_user1 > 0) {
+            encode_counter(out, session.id, true, session.last_counter_user1);
+        }
+        if (session.last_counter_user2 > 0) {
+            encode_counter(out, session.id, false, session.last_counter_user2);
+        }
+    }
+    
+    std::string path = directory_ + "/" + JOURNAL_NAME;
+    std::string temp = path + ".tmp";
+    int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    if (!write_all(fd, out.data(), out.size()) || ::fdatasync(fd) != 0 ||
+        ::rename(temp.c_str(), path.c_str()) != 0) {
+        ::close(fd);
+        ::unlink(temp.c_str());
+        return false;
+    }
+    sync_directory(directory_);
+    
+    ::close(journal_fd_);
+    journal_fd_ = fd;
+    return true;
+}
+
+// Replay stops at the first torn record, so a failed append is truncated
+// away before anything else is written after it
+bool RelayState::append_journal(const ByteVector& record) {
+    std::lock_guard<std::mutex> lock(journal_mutex_);
+    if (journal_failed_) {
+        return false;
+    }
+    off_t start = ::lseek(journal_fd_, 0, SEEK_CUR);
+    if (start < 0) {
+        journal_failed_ = true;
+        return false;
+    }
+    
+    if (!write_all(journal_fd_, record.data(), record.size())) {
+        journal_failed_ = ::ftruncate(journal_fd_, start) != 0 || ::lseek(journal_fd_, start, SEEK_SET) < 0;
+        return false;
+    }
+    // After a failed sync the kernel may have dropped earlier dirty pages
+    // too, so the journal can no longer vouch for what it holds
+    if (options_.sync && ::fdatasync(journal_fd_) != 0) {
+        journal_failed_ = true;
+        int truncated = ::ftruncate(journal_fd_, start);
+        (void)truncated;
+        return false;
+    }
+    return true;
+}
+
+const UserRecord* RelayState::user_locked(std::string_view username) const {
+    auto it = users_.find(std::string(username));
+    return it == users_.end() ? nullptr : &it->second;
+}
+
+SessionRecord* RelayState::session_locked(uint64_t user_a, uint64_t user_b) {
+    auto it = sessions_.find({std::min(user_a, user_b), std::max(user_a, user_b)});
+    return it == sessions_.end() ? nullptr : &it->second;
+}
+
+void RelayState::raise_counter_locked(uint64_t session_id, bool user1, uint64_t highest) {
+    auto it = sessions_by_id_.find(session_id);
+    if (it != sessions_by_id_.end()) {
+        uint64_t& last = user1 ? it->second->last_counter_user1 : it->second->last_counter_user2;
+        last = std::max(last, highest);
+    }
+}
+
+// The journal write happens under the exclusive lock so a name is never
+// handed out twice; registrations are rare next to message traffic
+RegisterStatus RelayState::register_user(std::string_view username, const crypto::PublicKey& public_key,
+                                         const crypto::SigningPublicKey& signing_public_key, uint64_t& id) {
+    if (username.empty() || username.size() > crypto::MessageStore::MAX_FIELD_SIZE) {
+        return RegisterStatus::Failed;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    if (user_locked(username) != nullptr) {
+        return RegisterStatus::Exists;
+    }
+    
+    UserRecord user{next_user_id_, std::string(username), public_key, signing_public_key, now_ms()};
+    ByteVector record;
+    encode_user(record, user);
+    if (!append_journal(record)) {
+        return RegisterStatus::Failed;
+    }
+    
+    next_user_id_++;
+    auto inserted = users_.emplace(user.username, user);
+    users_by_id_[user.id] = &inserted.first->second;
+    id = user.id;
+    return RegisterStatus::Created;
+}
+
+std::optional<UserRecord> RelayState::find_user(std::string_view username) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const UserRecord* user = user_locked(username);
+    if (user == nullptr) {
+        return std::nullopt;
+    }
+    return *user;
+}
+
+bool RelayState::has_user(std::string_view username) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return user_locked(username) != nullptr;
+}
+
+std::vector<UserRecord> RelayState::list_users() const {
+    std::vector<UserRecord> users;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        users.reserve(users_.size());
+        for (const auto& entry : users_) {
+            users.push_back(entry.second);
+        }
+    }
+    std::sort(users.begin(), users.end(),
+              [](const UserRecord& a, const UserRecord& b) { return a.id > b.id; });
+    return users;
+}
+
+SessionStatus RelayState::open_session(std::string_view username1, std::string_view username2,
+                                       SessionRecord& session) {
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const UserRecord* a = user_locked(username1);
+        const UserRecord* b = user_locked(username2);
+        if (a == nullptr || b == nullptr) {
+            return SessionStatus::UserNotFound;
+        }
+        if (SessionRecord* existing = session_locked(a->id, b->id)) {
+            session = *existing;
+            return SessionStatus::Ok;
+        }
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    const UserRecord* a = user_locked(username1);
+    const UserRecord* b = user_locked(username2);
+    if (SessionRecord* existing = session_locked(a->id, b->id)) {
+        session = *existing;
+        return SessionStatus::Ok;
+    }
+    
+    SessionRecord created{next_session_id_, std::min(a->id, b->id), std::max(a->id, b->id),
+                          0, 0, DEFAULT_ROTATION_THRESHOLD};
+    ByteVector record;
+    encode_session(record, created);
+    if (!append_journal(record)) {
+        return SessionStatus::Failed;
+    }
+    next_session_id_++;
+    SessionRecord& stored = sessions_[{created.user1_id, created.user2_id}];
+    stored = created;
+    sessions_by_id_[created.id] = &stored;
+    session = created;
+    return SessionStatus::Ok;
+}
+
+CounterResult RelayState::check_counter(std::string_view username1, std::string_view username2,
+                                        std::string_view from_user, uint64_t counter) {
+    uint64_t session_id;
+    bool user1;
+    uint64_t last;
+    uint64_t rotation_threshold;
+    {
+        std::shared_lock<std::shared_mutex> lock(mutex_);
+        const UserRecord* a = user_locked(username1);
+        const UserRecord* b = user_locked(username2);
+        const SessionRecord* session = a && b ? session_locked(a->id, b->id) : nullptr;
+        if (session == nullptr) {
+            return CounterResult{CounterResult::Status::SessionNotFound, 0, 0};
+        }
+        // Anyone but user1 counts as user2, as in the Node server
+        const UserRecord* first = users_by_id_.at(session->user1_id);
+        session_id = session->id;
+        user1 = from_user == first->username;
+        last = user1 ? session->last_counter_user1 : session->last_counter_user2;
+        rotation_threshold = session->rotation_threshold;
+    }
+    
+    std::string name = window_name(session_id, user1);
+    windows_.seed(name, last);
+    crypto::ReplayCheck check = windows_.check(name, counter);
+    uint64_t highest = windows_.highest(name).value_or(0);
+    
+    CounterResult::Status status = CounterResult::Status::Accepted;
+    if (check == crypto::ReplayCheck::Accepted) {
+        std::lock_guard<std::mutex> lock(dirty_mutex_);
+        DirtyCounter& dirty = dirty_[name];
+        dirty = DirtyCounter{session_id, user1, std::max(dirty.highest, highest)};
+    } else {
+        status = check == crypto::ReplayCheck::Replayed ? CounterResult::Status::Replayed
+                                                        : CounterResult::Status::TooOld;
+    }
+    return CounterResult{status, highest, rotation_threshold};
+}
+
+bool RelayState::flush_counters() {
+    std::unordered_map<std::string, DirtyCounter> dirty;
+    {
+        std::lock_guard<std::mutex> lock(dirty_mutex_);
+        dirty.swap(dirty_);
+    }
+    if (dirty.empty()) {
+        return true;
+    }
+    
+    ByteVector records;
+    for (const auto& entry : dirty) {
+        encode_counter(records, entry.second.session_id, entry.second.user1, entry.second.highest);
+    }
+    if (!append_journal(records)) {
+        // Retry with the next flush; anything newer wins
+        std::lock_guard<std::mutex> lock(dirty_mutex_);
+        for (auto& entry : dirty) {
+            DirtyCounter& current = dirty_[entry.first];
+            current = DirtyCounter{entry.second.session_id, entry.second.user1,
+                                   std::max(current.highest, entry.second.highest)};
+        }
+        return false;
+    }
+    
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    for (const auto& entry : dirty) {
+        raise_counter_locked(entry.second.session_id, entry.second.user1, entry.second.highest);
+    }
+    return true;
+}
+
+void RelayState::flush_loop() {
+    std::unique_lock<std::mutex> lock(flush_mutex_);
+    while (!stopping_) {
+        flush_wakeup_.wait_for(lock, options_.counter_flush_interval);
+        if (stopping_) {
+            break;
+        }
+        lock.unlock();
+        flush_counters();
+        lock.lock();
+    }
+}
+
+} // namespace relay
+} // namespace spear
@@ -0,0 +1,453 @@
+#include "../include/http.hpp"
+#include "../include/json.hpp"
+#include "../include/relay_state.hpp"
+#include "../include/relay_api.hpp"
+#include "../include/relay_server.hpp"
+#include "utils.hpp"
+#include "wire_codec.hpp"
+#include <iostream>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <csignal>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace spear;
+using namespace spear::relay;
+
+int tests_passed = 0;
+int tests_failed = 0;
+
+void test_pass(const char* test_name) {
+    std::cout << "[PASS] " << test_name << std::endl;
+    tests_passed++;
+}
+
+void test_fail(const char* test_name) {
+    std::cout << "[FAIL] " << test_name << std::endl;
+    tests_failed++;
+}
+
+ConstByteSpan bytes(const std::string& s) {
+    return ConstByteSpan(reinterpret_cast<const uint8_t*>(s.data()), s.size());
+}
+
+void test_http() {
+    std::cout << "\n=== Testing HTTP Parser ===" << std::endl;
+    
+    std::string pipelined =
+        "POST /api/messages?x=1 HTTP/1.1\r\nHost: a\r\ncontent-type: application/json\r\n"
+        "Content-Length: 2\r\n\r\n{}"
+        "GET /health HTTP/1.0\r\n\r\n";
+    HttpRequest request;
+    ParseResult first = HttpParser::parse(bytes(pipelined), request);
+    bool first_ok = first.status == ParseStatus::Complete && request.method == HttpMethod::Post &&
+                    request.path == "/api/messages" && request.content_type == "application/json" &&
+                    request.body.size() == 2 && request.keep_alive;
+    ParseResult second = HttpParser::parse(bytes(pipelined).subspan(first.consumed,
+                                                                    pipelined.size() - first.consumed), request);
+    if (first_ok && second.status == ParseStatus::Complete && request.method == HttpMethod::Get &&
+        request.path == "/health" && !request.keep_alive && first.consumed + second.consumed == pipelined.size()) {
+        test_pass("HttpParser parses pipelined requests");
+    } else {
+        test_fail("HttpParser parses pipelined requests");
+    }
+    
+    std::string partial = "POST /a HTTP/1.1\r\nContent-Length: 10\r\n\r\n12345";
+    std::string chunked = "POST /a HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n";
+    std::string huge = "POST /a HTTP/1.1\r\nContent-Length: 999999999\r\n\r\n";
+    std::string garbage = "HELLO\r\n\r\n";
+    if (HttpParser::parse(bytes(partial), request).status == ParseStatus::Incomplete &&
+        HttpParser::parse(bytes(chunked), request).error_status == 411 &&
+        HttpParser::parse(bytes(huge), request).error_status == 413 &&
+        HttpParser::parse(bytes(garbage), request).status == ParseStatus::Error) {
+        test_pass("HttpParser waits for bodies and rejects bad framing");
+    } else {
+        test_fail("HttpParser waits for bodies and rejects bad framing");
+    }
+    
+    std::string decoded;
+    bool bad_escape = !percent_decode("a%2", decoded) && !percent_decode("%zz", decoded);
+    if (percent_decode("al%20ice%2F", decoded) && decoded == "al ice/" && bad_escape &&
+        media_type_matches("text/html, application/vnd.spear.message;q=0.9", WIRE_TYPE) &&
+        !media_type_matches("application/json", WIRE_TYPE)) {
+        test_pass("percent_decode and media_type_matches");
+    } else {
+        test_fail("percent_decode and media_type_matches");
+    }
+}
+
+void test_json() {
+    std::cout << "\n=== Testing JSON ===" << std::endl;
+    
+    auto object = JsonObject::parse(
+        R"( {"name":"al\"iceé","n":42,"big":1e300,"neg":-1,"ok":true,"nested":{"a":[1,{"b":2}]},"empty":""} )");
+    if (object && *object->string("name") == "al\"ice\xc3\xa9" && object->get("n")->safe_integer() == 42u &&
+        !object->get("big")->safe_integer() && !object->get("neg")->safe_integer() &&
+        object->get("ok")->boolean && object->get("nested")->type == JsonValue::Type::Compound &&
+        object->string("empty") == nullptr && object->get("missing") == nullptr) {
+        test_pass("JsonObject parses a flat object");
+    } else {
+        test_fail("JsonObject parses a flat object");
+    }
+    
+    if (!JsonObject::parse("{\"a\":1,}") && !JsonObject::parse("{\"a\":1} x") && !JsonObject::parse("[1]") &&
+        !JsonObject::parse(std::string(100, '[') + std::string(100, ']'))) {
+        test_pass("JsonObject rejects malformed input");
+    } else {
+        test_fail("JsonObject rejects malformed input");
+    }
+    
+    JsonWriter writer;
+    writer.begin_object()
+        .field("s", "a\"b\n")
+        .field("n", uint64_t(7))
+        .field("b", false)
+        .key("list").begin_array().value(uint64_t(1)).value("x").end_array()
+        .end_object();
+    if (writer.str() == R"({"s":"a\"b\n","n":7,"b":false,"list":[1,"x"]})") {
+        test_pass("JsonWriter writes compact JSON");
+    } else {
+        test_fail("JsonWriter writes compact JSON");
+    }
+}
+
+void test_relay_state() {
+    std::cout << "\n=== Testing Relay State ===" << std::endl;
+    
+    const std::string dir = "spear_test_relay";
+    std::filesystem::remove_all(dir);
+    
+    RelayStateOptions options;
+    options.sync = false;
+    auto state = RelayState::open(dir, options);
+    if (!state) {
+        test_fail("RelayState opens a new directory");
+        return;
+    }
+    
+    crypto::PublicKey pk{};
+    crypto::SigningPublicKey spk{};
+    pk[0] = 0xA1;
+    uint64_t alice = 0;
+    uint64_t bob = 0;
+    uint64_t again = 0;
+    if (state->register_user("alice", pk, spk, alice) == RegisterStatus::Created &&
+        state->register_user("bob", pk, spk, bob) == RegisterStatus::Created &&
+        state->register_user("alice", pk, spk, again) == RegisterStatus::Exists &&
+        alice == 1 && bob == 2 && state->list_users()[0].username == "bob") {
+        test_pass("RelayState registers unique users");
+    } else {
+        test_fail("RelayState registers unique users");
+    }
+    
+    SessionRecord session;
+    SessionRecord same;
+    bool opened = state->open_session("bob", "alice", session) == SessionStatus::Ok &&
+                  state->open_session("alice", "bob", same) == SessionStatus::Ok &&
+                  session.id == same.id && session.user1_id == alice &&
+                  state->open_session("alice", "nobody", same) == SessionStatus::UserNotFound;
+    using Status = CounterResult::Status;
+    bool counters = state->check_counter("alice", "bob", "bob", 5).status == Status::Accepted &&
+                    state->check_counter("alice", "bob", "bob", 3).status == Status::Accepted &&
+                    state->check_counter("alice", "bob", "bob", 5).status == Status::Replayed &&
+                    state->check_counter("alice", "bob", "alice", 5).status == Status::Accepted &&
+                    state->check_counter("bob", "carol", "bob", 1).status == Status::SessionNotFound;
+    if (opened && counters) {
+        test_pass("RelayState sessions and replay windows");
+    } else {
+        test_fail("RelayState sessions and replay windows");
+    }
+    
+    // Everything survives a reopen; counters come back as high-water marks
+    state.reset();
+    state = RelayState::open(dir, options);
+    auto user = state ? state->find_user("alice") : std::nullopt;
+    if (user && user->id == alice && user->public_key[0] == 0xA1 && state->has_user("bob") &&
+        state->open_session("alice", "bob", session) == SessionStatus::Ok && session.id == same.id &&
+        session.last_counter_user2 == 5 &&
+        state->check_counter("alice", "bob", "bob", 5).status != Status::Accepted &&
+        state->check_counter("alice", "bob", "bob", 6).status == Status::Accepted) {
+        test_pass("RelayState recovers from its journal");
+    } else {
+        test_fail("RelayState recovers from its journal");
+    }
+    
+    // A registration cut short by a full disk must not strand the ones
+    // after it behind a torn record
+    struct rlimit original_limit;
+    ::getrlimit(RLIMIT_FSIZE, &original_limit);
+    ::signal(SIGXFSZ, SIG_IGN);
+    struct rlimit tight_limit = original_limit;
+    tight_limit.rlim_cur = std::filesystem::file_size(dir + "/relay.journal") + 10;
+    uint64_t carol = 0;
+    uint64_t dave = 0;
+    ::setrlimit(RLIMIT_FSIZE, &tight_limit);
+    bool carol_failed = state->register_user("carol", pk, spk, carol) == RegisterStatus::Failed;
+    ::setrlimit(RLIMIT_FSIZE, &original_limit);
+    bool dave_created = state->register_user("dave", pk, spk, dave) == RegisterStatus::Created;
+    state.reset();
+    state = RelayState::open(dir, options);
+    if (carol_failed && dave_created && state && state->has_user("dave") && !state->has_user("carol") &&
+        state->has_user("alice")) {
+        test_pass("RelayState cuts a failed journal append back off");
+    } else {
+        test_fail("RelayState cuts a failed journal append back off");
+    }
+    
+    state.reset();
+    std::filesystem::remove_all(dir);
+}
+
+// Writes `request` and reads until `expected` responses have arrived
+std::string exchange(int fd, const std::string& request, size_t expected) {
+    if (::send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+        return "";
+    }
+    std::string response;
+    char buffer[64 * 1024];
+    size_t count = 0;
+    size_t next = 0;
+    auto complete = [&] {
+        size_t pos;
+        while ((pos = response.find("\r\n\r\n", next)) != std::string::npos) {
+            size_t length_at = response.rfind("Content-Length: ", pos);
+            size_t end = pos + 4 + std::strtoull(response.c_str() + length_at + 16, nullptr, 10);
+            if (end > response.size()) {
+                break;
+            }
+            count++;
+            next = end;
+        }
+        return count >= expected;
+    };
+    while (!complete()) {
+        ssize_t n = ::recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        response.append(buffer, static_cast<size_t>(n));
+    }
+    return response;
+}
+
+std::string post(const std::string& path, const std::string& type, const std::string& body) {
+    return "POST " + path + " HTTP/1.1\r\nContent-Type: " + type + "\r\nContent-Length: " +
+           std::to_string(body.size()) + "\r\n\r\n" + body;
+}
+
+void test_relay_server() {
+    std::cout << "\n=== Testing Relay Server ===" << std::endl;
+    
+    const std::string dir = "spear_test_relay_server";
+    std::filesystem::remove_all(dir);
+    RelayStateOptions state_options;
+    state_options.sync = false;
+    auto state = RelayState::open(dir, state_options);
+    
+    RelayServerOptions options;
+    options.host = "127.0.0.1";
+    options.port = 0;
+    options.reactors = 2;
+    options.pin_threads = false;
+    RelayServer server(*state, options);
+    if (!server.start() || server.port() == 0) {
+        test_fail("RelayServer listens on a free port");
+        return;
+    }
+    
+    int fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(server.port());
+    ::inet_pton(AF_INET, "127.0.0.1", &address.sin_addr);
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+        test_fail("RelayServer listens on a free port");
+        ::close(fd);
+        return;
+    }
+    
+    std::string key = crypto::utils::to_base64(crypto::PublicKey{}.data(), crypto::PUBLIC_KEY_SIZE);
+    std::string registration;
+    for (const char* name : {"alice", "bob", "alice"}) {
+        registration += post("/api/register", "application/json",
+                             std::string("{\"username\":\"") + name + "\",\"publicKey\":\"" + key +
+                             "\",\"signingPublicKey\":\"" + key + "\"}");
+    }
+    std::string replies = exchange(fd, registration, 3);
+    size_t created = replies.find("HTTP/1.1 201");
+    size_t conflict = replies.find("HTTP/1.1 409");
+    if (created != std::string::npos && replies.find("\"username\":\"bob\"") != std::string::npos &&
+        conflict > replies.find("\"username\":\"bob\"") && conflict != std::string::npos) {
+        test_pass("RelayServer answers pipelined requests in order");
+    } else {
+        test_fail("RelayServer answers pipelined requests in order");
+    }
+    
+    // A JSON send and a wire send, pipelined behind each other, then a poll
+    ByteVector nonce(crypto::NONCE_SIZE, 0x24);
+    ByteVector signature(crypto::SIGNATURE_SIZE, 0x5A);
+    ByteVector content(crypto::MAC_SIZE + 8, 0x11);
+    crypto::WireMessage message;
+    message.recipient = "bob";
+    message.record.sender = "alice";
+    message.record.counter = 2;
+    message.record.nonce = nonce;
+    message.record.signature = signature;
+    message.record.content = content;
+    auto envelope = crypto::WireCodec::encode(message);
+    std::string sends =
+        post("/api/messages", "application/json",
+             "{\"fromUsername\":\"alice\",\"toUsername\":\"bob\",\"counter\":1,\"encryptedContent\":\"" +
+             crypto::utils::to_base64(content.data(), content.size()) + "\",\"nonce\":\"" +
+             crypto::utils::to_base64(nonce.data(), nonce.size()) + "\",\"signature\":\"" +
+             crypto::utils::to_base64(signature.data(), signature.size()) + "\"}") +
+        post("/api/messages", std::string(WIRE_TYPE), std::string(envelope->begin(), envelope->end())) +
+        post("/api/messages", "application/json", "{\"fromUsername\":\"alice\",\"toUsername\":\"zed\"}") +
+        "GET /api/messages/bob HTTP/1.1\r\nAccept: " + std::string(WIRE_TYPE) + "\r\n\r\n";
+    replies = exchange(fd, sends, 4);
+    size_t body_at = replies.rfind("\r\n\r\n") + 4;
+    ByteVector polled(replies.begin() + static_cast<std::ptrdiff_t>(body_at), replies.end());
+    auto messages = crypto::WireCodec::decode_all(polled);
+    if (replies.find("\"message\":\"Message sent successfully\"") != std::string::npos &&
+        replies.find("HTTP/1.1 400") != std::string::npos && messages && messages->size() == 2 &&
+        (*messages)[0].record.counter == 1 && (*messages)[1].record.counter == 2 &&
+        (*messages)[1].record.id == (*messages)[0].record.id + 1 && (*messages)[1].record.timestamp_ms != 0) {
+        test_pass("RelayServer sends JSON and wire messages and polls envelopes");
+    } else {
+        test_fail("RelayServer sends JSON and wire messages and polls envelopes");
+    }
+    
+    uint64_t last_id = messages ? (*messages)[1].record.id : 0;
+    std::string bad_acks = "DELETE /api/messages/zed/1 HTTP/1.1\r\n\r\n"
+                           "DELETE /api/messages/bob/" + std::to_string(last_id + 1000) + " HTTP/1.1\r\n\r\n";
+    replies = exchange(fd, bad_acks, 2);
+    size_t not_found = replies.find("HTTP/1.1 404");
+    size_t invalid = replies.find("HTTP/1.1 400");
+    if (not_found != std::string::npos && invalid != std::string::npos && not_found < invalid &&
+        state->messages().fetch("bob").size() == 2) {
+        test_pass("RelayServer rejects acks for unknown users and unassigned ids");
+    } else {
+        test_fail("RelayServer rejects acks for unknown users and unassigned ids");
+    }
+    
+    // The legacy per-message route finds bob from the id alone
+    std::string legacy_acks = "DELETE /api/messages/" + std::to_string(last_id - 1) + " HTTP/1.1\r\n\r\n"
+                              "DELETE /api/messages/" + std::to_string(last_id - 1) + " HTTP/1.1\r\n\r\n";
+    replies = exchange(fd, legacy_acks, 2);
+    if (replies.find("\"message\":\"Message acknowledged\"") < replies.find("HTTP/1.1 404") &&
+        replies.find("HTTP/1.1 404") != std::string::npos && state->messages().fetch("bob").size() == 1) {
+        test_pass("RelayServer serves the legacy per-message ack route");
+    } else {
+        test_fail("RelayServer serves the legacy per-message ack route");
+    }
+    
+    std::string ack = "DELETE /api/messages/bob/" + std::to_string(last_id) +
+                      " HTTP/1.1\r\nConnection: close\r\n\r\n";
+    replies = exchange(fd, ack, 1);
+    char probe;
+    bool closed = ::recv(fd, &probe, 1, 0) == 0;
+    if (replies.find("\"acknowledged\":1") != std::string::npos && closed &&
+        state->messages().fetch("bob").empty()) {
+        test_pass("RelayServer acknowledges and honours Connection: close");
+    } else {
+        test_fail("RelayServer acknowledges and honours Connection: close");
+    }
+    ::close(fd);
+    
+    // Pipelined polls whose replies run past the output backlog: the server
+    // stops parsing at the limit and has to pick up again once it drains.
+    // A receive buffer that takes the whole backlog lets it drain without
+    // the socket ever blocking, so no further event comes.
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    timeval timeout{5, 0};
+    int receive_buffer = 16 * 1024 * 1024;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+    ByteVector big_content(1024 * 1024, 0x33);
+    message.record.content = big_content;
+    envelope = crypto::WireCodec::encode(message);
+    std::string polls;
+    for (int i = 0; i < 12; ++i) {
+        polls += "GET /api/messages/bob HTTP/1.1\r\nAccept: " + std::string(WIRE_TYPE) + "\r\n\r\n";
+    }
+    std::string big_send = post("/api/messages", std::string(WIRE_TYPE), std::string(envelope->begin(), envelope->end()));
+    size_t polled_count = 0;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+        exchange(fd, big_send, 1).find("HTTP/1.1 201") != std::string::npos) {
+        replies = exchange(fd, polls, 12);
+        for (size_t pos = 0; (pos = replies.find("HTTP/1.1 200", pos)) != std::string::npos; ++pos) {
+            polled_count++;
+        }
+    }
+    if (polled_count == 12 && replies.size() > 12 * (1024 * 1024)) {
+        test_pass("RelayServer answers pipelined requests past the output backlog");
+    } else {
+        test_fail("RelayServer answers pipelined requests past the output backlog");
+    }
+    ::close(fd);
+    
+    // With the descriptor table full, a pending connection has to be shed
+    // rather than left queued for the level-triggered listener to report
+    // again on every wait
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    timeval short_timeout{2, 0};
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &short_timeout, sizeof(short_timeout));
+    int lowest_free = ::dup(STDOUT_FILENO);
+    ::close(lowest_free);
+    struct rlimit files;
+    ::getrlimit(RLIMIT_NOFILE, &files);
+    struct rlimit exhausted = files;
+    exhausted.rlim_cur = static_cast<rlim_t>(lowest_free);
+    ::setrlimit(RLIMIT_NOFILE, &exhausted);
+    bool shed = false;
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0) {
+        ssize_t got = ::recv(fd, &probe, 1, 0);
+        shed = got == 0 || (got < 0 && errno == ECONNRESET);
+    }
+    ::setrlimit(RLIMIT_NOFILE, &files);
+    ::close(fd);
+    fd = ::socket(AF_INET, SOCK_STREAM, 0);
+    bool serving = ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+                   exchange(fd, "GET /health HTTP/1.1\r\n\r\n", 1).find("HTTP/1.1 200") != std::string::npos;
+    if (shed && serving) {
+        test_pass("RelayServer sheds connections when out of descriptors");
+    } else {
+        test_fail("RelayServer sheds connections when out of descriptors");
+    }
+    ::close(fd);
+    
+    server.stop();
+    state.reset();
+    std::filesystem::remove_all(dir);
+}
+
+int main() {
+    if (!crypto::utils::initialize()) {
+        std::cerr << "Failed to initialize crypto library" << std::endl;
+        return 1;
+    }
+    
+    std::cout << "SPEAR Relay Unit Tests" << std::endl;
+    std::cout << "======================" << std::endl;
+    
+    test_http();
+    test_json();
+    test_relay_state();
+    test_relay_server();
+    
+    std::cout << "\n======================" << std::endl;
+    std::cout << "Tests passed: " << tests_passed << std::endl;
+    std::cout << "Tests failed: " << tests_failed << std::endl;
+    
+    if (tests_failed == 0) {
+        std::cout << "\nAll tests passed!" << std::endl;
+        return 0;
+    }
+    return 1;
+}
@@ -1,39 +1,72 @@
 const db = require('../models/database');
+const store = require('../models/messageStore');
+const spear = require('../../spear_addon.node');
+
+// Binary wire envelopes (see WireCodec), accepted on send and served on poll
+// in place of JSON with base64 fields
+const WIRE_TYPE = 'application/vnd.spear.message';
+exports.WIRE_TYPE = WIRE_TYPE;
+
+const userExists = db.prepare('SELECT 1 FROM users WHERE username = ?').pluck();
+
+// Returns { fromUsername, toUsername, content, nonce, signature, counter } or
+// null. Wire bodies are decoded in place; their buffers are views of req.body.
+function parseSendBody(req) {
+  if (req.is(WIRE_TYPE)) {
+    let messages;
+    try {
+      messages = spear.decodeMessages(req.body);
+    } catch (error) {
+      return null;
+    }
+    if (messages.length !== 1 || !messages[0].toUsername) {
+      return null;
+    }
+    const { fromUsername, toUsername, encryptedContent, nonce, signature, counter } = messages[0];
+    return { fromUsername, toUsername, content: encryptedContent, nonce, signature, counter };
+  }
 
-exports.sendMessage = (req, res) => {
+  const { fromUsername, toUsername, encryptedContent, nonce, signature, counter } = req.body;
+  if (!fromUsername || !toUsername || !encryptedContent || !nonce || !signature ||
+      !Number.isSafeInteger(counter) || counter < 0) {
+    return null;
+  }
+  const message = {
+    fromUsername,
+    toUsername,
+    content: Buffer.from(encryptedContent, 'base64'),
+    nonce: Buffer.from(nonce, 'base64'),
+    signature: Buffer.from(signature, 'base64'),
+    counter
+  };
+  // Held to the wire envelope's field sizes, so every stored message can be
+  // served on the binary poll path
   try {
-    const { fromUsername, toUsername, encryptedContent, nonce, signature, counter } = req.body;
+    spear.encodeMessage({ ...message, encryptedContent: message.content });
+  } catch (error) {
+    return null;
+  }
+  return message;
+}
+
+exports.sendMessage = async (req, res) => {
+  try {
+    const message = parseSendBody(req);
 
-    if (!fromUsername || !toUsername || !encryptedContent || !nonce || !signature || counter === undefined) {
+    if (!message) {
       return res.status(400).json({ error: 'Missing required fields' });
     }
 
-    const fromUser = db.prepare('SELECT id FROM users WHERE username = ?').get(fromUsername);
-    const toUser = db.prepare('SELECT id FROM users WHERE username = ?').get(toUsername);
+    const { fromUsername, toUsername, content, nonce, signature, counter } = message;
 
-    if (!fromUser || !toUser) {
+    if (!userExists.get(fromUsername) || !userExists.get(toUsername)) {
       return res.status(404).json({ error: 'User not found' });
     }
 
-    const encryptedBuffer = Buffer.from(encryptedContent, 'base64');
-    const nonceBuffer = Buffer.from(nonce, 'base64');
-    const signatureBuffer = Buffer.from(signature, 'base64');
-
-    const stmt = db.prepare(
-      'INSERT INTO messages (from_user_id, to_user_id, encrypted_content, nonce, signature, counter) VALUES (?, ?, ?, ?, ?, ?)'
-    );
-
-    const result = stmt.run(
-      fromUser.id,
-      toUser.id,
-      encryptedBuffer,
-      nonceBuffer,
-      signatureBuffer,
-      counter
-    );
+    const id = await store.appendMessage(toUsername, { fromUsername, content, nonce, signature, counter });
 
     res.status(201).json({
-      id: result.lastInsertRowid,
+      id,
       message: 'Message sent successfully'
     });
   } catch (error) {
@@ -46,37 +79,22 @@ exports.getMessages = (req, res) => {
   try {
     const { username } = req.params;
 
-    const user = db.prepare('SELECT id FROM users WHERE username = ?').get(username);
-
-    if (!user) {
+    if (!userExists.get(username)) {
       return res.status(404).json({ error: 'User not found' });
     }
 
-    const stmt = db.prepare(`
-      SELECT 
-        m.id,
-        u.username as from_username,
-        m.encrypted_content,
-        m.nonce,
-        m.signature,
-        m.counter,
-        m.created_at
-      FROM messages m
-      JOIN users u ON m.from_user_id = u.id
-      WHERE m.to_user_id = ? AND m.delivered = 0
-      ORDER BY m.created_at ASC
-    `);
-
-    const messages = stmt.all(user.id);
-
-    const formattedMessages = messages.map(msg => ({
+    if (req.accepts(['application/json', WIRE_TYPE]) === WIRE_TYPE) {
+      return res.type(WIRE_TYPE).send(spear.fetchMessagesEncoded(username));
+    }
+
+    const formattedMessages = store.fetchMessages(username).map(msg => ({
       id: msg.id,
-      fromUsername: msg.from_username,
-      encryptedContent: msg.encrypted_content.toString('base64'),
+      fromUsername: msg.fromUsername,
+      encryptedContent: msg.encryptedContent.toString('base64'),
       nonce: msg.nonce.toString('base64'),
       signature: msg.signature.toString('base64'),
       counter: msg.counter,
-      createdAt: msg.created_at
+      createdAt: new Date(msg.createdAt).toISOString()
     }));
 
     res.json({ messages: formattedMessages });
@@ -86,20 +104,56 @@ exports.getMessages = (req, res) => {
   }
 };
 
-exports.acknowledgeMessage = (req, res) => {
+// Acknowledges every message for the user up to and including :id
+exports.acknowledgeMessages = async (req, res) => {
   try {
-    const { id } = req.params;
+    const { username } = req.params;
+    const id = Number(req.params.id);
 
-    const stmt = db.prepare('UPDATE messages SET delivered = 1 WHERE id = ?');
-    const result = stmt.run(id);
+    if (!Number.isSafeInteger(id) || id <= 0) {
+      return res.status(400).json({ error: 'Invalid message id' });
+    }
 
-    if (result.changes === 0) {
+    if (!userExists.get(username)) {
+      return res.status(404).json({ error: 'User not found' });
+    }
+
+    // An id that has not been assigned yet would move the cursor past
+    // messages still to come
+    if (id > store.lastMessageId(username)) {
+      return res.status(400).json({ error: 'Invalid message id' });
+    }
+
+    const acknowledged = await store.ackMessages(username, id);
+
+    res.json({ message: 'Messages acknowledged', acknowledged });
+  } catch (error) {
+    console.error('Acknowledge message error:', error);
+    res.status(500).json({ error: 'Internal server error' });
+  }
+};
+
+// Legacy DELETE /api/messages/:id from before acks were per recipient. The
+// recipient is looked up from the id, and as on the current route every
+// message for them up to and including :id is acknowledged.
+exports.acknowledgeMessage = async (req, res) => {
+  try {
+    const id = Number(req.params.id);
+
+    if (!Number.isSafeInteger(id) || id <= 0) {
+      return res.status(400).json({ error: 'Invalid message id' });
+    }
+
+    const recipient = store.messageRecipient(id);
+    if (recipient === null) {
       return res.status(404).json({ error: 'Message not found' });
     }
 
+    await store.ackMessages(recipient, id);
+
     res.json({ message: 'Message acknowledged' });
   } catch (error) {
     console.error('Acknowledge message error:', error);
     res.status(500).json({ error: 'Internal server error' });
   }
-};
\ No newline at end of file
+};
@@ -0,0 +1,51 @@
+const spear = require('../../spear_addon.node');
+
+const QUANTILES = [
+  ['0.5', 'p50Ns'],
+  ['0.9', 'p90Ns'],
+  ['0.99', 'p99Ns'],
+  ['0.999', 'p999Ns']
+];
+
+// Prometheus text exposition of the native crypto counters. Latencies come
+// from the core's log-linear histograms, so quantiles are bucket upper
+// bounds (within 12.5%).
+exports.getMetrics = (req, res) => {
+  try {
+    const { enabled, ops } = spear.metricsSnapshot();
+    const names = Object.keys(ops);
+    const lines = [];
+
+    const counter = (name, help, field) => {
+      lines.push(`# HELP ${name} ${help}`);
+      lines.push(`# TYPE ${name} counter`);
+      for (const op of names) {
+        lines.push(`${name}{op="${op}"} ${ops[op][field]}`);
+      }
+    };
+
+    lines.push('# HELP spear_crypto_metrics_enabled Whether the native core records metrics');
+    lines.push('# TYPE spear_crypto_metrics_enabled gauge');
+    lines.push(`spear_crypto_metrics_enabled ${enabled ? 1 : 0}`);
+
+    counter('spear_crypto_ops_total', 'Crypto primitive calls', 'ops');
+    counter('spear_crypto_failures_total', 'Crypto primitive calls that failed', 'failures');
+    counter('spear_crypto_bytes_total', 'Bytes processed by crypto primitives', 'bytes');
+
+    lines.push('# HELP spear_crypto_latency_seconds Crypto primitive latency');
+    lines.push('# TYPE spear_crypto_latency_seconds summary');
+    for (const op of names) {
+      const stats = ops[op];
+      for (const [quantile, field] of QUANTILES) {
+        lines.push(`spear_crypto_latency_seconds{op="${op}",quantile="${quantile}"} ${stats[field] / 1e9}`);
+      }
+      lines.push(`spear_crypto_latency_seconds_sum{op="${op}"} ${stats.totalNs / 1e9}`);
+      lines.push(`spear_crypto_latency_seconds_count{op="${op}"} ${stats.ops}`);
+    }
+
+    res.type('text/plain; version=0.0.4').send(lines.join('\n') + '\n');
+  } catch (error) {
+    console.error('Get metrics error:', error);
+    res.status(500).json({ error: 'Internal server error' });
+  }
+};
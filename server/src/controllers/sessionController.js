@@ -1,4 +1,5 @@
 const db = require('../models/database');
+const replayWindow = require('../models/replayWindow');
 
 exports.getOrCreateSession = (req, res) => {
   try {
@@ -44,6 +45,17 @@ exports.getOrCreateSession = (req, res) => {
   }
 };
 
+// Both orderings of the pair in one lookup; user1_name tells the caller
+// which side of the session a sender is on
+const findSession = db.prepare(`
+  SELECT s.id, s.rotation_threshold, s.last_counter_user1, s.last_counter_user2,
+         u1.username AS user1_name
+  FROM sessions s
+  JOIN users u1 ON u1.id = s.user1_id
+  JOIN users u2 ON u2.id = s.user2_id
+  WHERE (u1.username = ? AND u2.username = ?) OR (u1.username = ? AND u2.username = ?)
+`);
+
 exports.updateCounter = (req, res) => {
   try {
     const { username1, username2, counter, fromUser } = req.body;
@@ -52,41 +64,30 @@ exports.updateCounter = (req, res) => {
       return res.status(400).json({ error: 'Missing required fields' });
     }
 
-    const user1 = db.prepare('SELECT id FROM users WHERE username = ?').get(username1);
-    const user2 = db.prepare('SELECT id FROM users WHERE username = ?').get(username2);
-
-    if (!user1 || !user2) {
-      return res.status(404).json({ error: 'User not found' });
+    if (!Number.isSafeInteger(counter) || counter < 0) {
+      return res.status(400).json({ error: 'Invalid counter' });
     }
 
-    const minId = Math.min(user1.id, user2.id);
-    const maxId = Math.max(user1.id, user2.id);
-
-    const session = db.prepare(
-      'SELECT * FROM sessions WHERE user1_id = ? AND user2_id = ?'
-    ).get(minId, maxId);
+    const session = findSession.get(username1, username2, username2, username1);
 
     if (!session) {
       return res.status(404).json({ error: 'Session not found' });
     }
 
-    const isUser1 = fromUser === username1 && user1.id === minId;
-    const counterField = isUser1 ? 'last_counter_user1' : 'last_counter_user2';
-    const lastCounter = isUser1 ? session.last_counter_user1 : session.last_counter_user2;
+    // Counters may arrive out of order within the replay window, but each
+    // is accepted only once
+    const isUser1 = fromUser === session.user1_name;
+    const { result, highest } = replayWindow.check(session, isUser1, counter);
 
-    if (counter <= lastCounter) {
+    if (result !== 'accepted') {
       return res.status(400).json({ 
         error: 'Replay attack detected',
-        expectedCounter: lastCounter + 1,
+        reason: result,
+        expectedCounter: highest + 1,
         receivedCounter: counter
       });
     }
 
-    const stmt = db.prepare(
-      `UPDATE sessions SET ${counterField} = ? WHERE id = ?`
-    );
-    stmt.run(counter, session.id);
-
     const needsRotation = counter >= session.rotation_threshold;
 
     res.json({
@@ -99,4 +100,4 @@ exports.updateCounter = (req, res) => {
     console.error('Update counter error:', error);
     res.status(500).json({ error: 'Internal server error' });
   }
-};
\ No newline at end of file
+};
@@ -27,21 +27,6 @@ db.exec(`
     UNIQUE(user1_id, user2_id)
   );
 
-  CREATE TABLE IF NOT EXISTS messages (
-    id INTEGER PRIMARY KEY AUTOINCREMENT,
-    from_user_id INTEGER NOT NULL,
-    to_user_id INTEGER NOT NULL,
-    encrypted_content BLOB NOT NULL,
-    nonce BLOB NOT NULL,
-    signature BLOB NOT NULL,
-    counter INTEGER NOT NULL,
-    delivered BOOLEAN DEFAULT 0,
-    created_at DATETIME DEFAULT CURRENT_TIMESTAMP,
-    FOREIGN KEY (from_user_id) REFERENCES users(id),
-    FOREIGN KEY (to_user_id) REFERENCES users(id)
-  );
-
-  CREATE INDEX IF NOT EXISTS idx_messages_to_user ON messages(to_user_id, delivered);
   CREATE INDEX IF NOT EXISTS idx_sessions_users ON sessions(user1_id, user2_id);
 `);
 
@@ -0,0 +1,57 @@
+const path = require('path');
+const db = require('./database');
+const spear = require('../../spear_addon.node');
+
+const storePath = process.env.SPEAR_MESSAGE_STORE || path.join(__dirname, '../../spear-messages');
+
+spear.openMessageStore(storePath, {
+  sync: process.env.SPEAR_MESSAGE_STORE_SYNC !== '0'
+});
+
+// Queues used to live in the SQLite messages table. Its undelivered rows are
+// moved into the store in one commit, oldest first, and the table is then
+// dropped. If the process dies in between, the next start imports them
+// again; recipients discard the copies by counter. Any failure stops
+// startup rather than leave those messages behind.
+function migrateLegacyMessages() {
+  const legacy = db.prepare(
+    "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'messages'"
+  ).pluck().get();
+  if (!legacy) {
+    return;
+  }
+
+  const rows = db.prepare(`
+    SELECT
+      recipient.username AS to_username,
+      sender.username AS from_username,
+      m.encrypted_content,
+      m.nonce,
+      m.signature,
+      m.counter
+    FROM messages m
+    JOIN users recipient ON m.to_user_id = recipient.id
+    JOIN users sender ON m.from_user_id = sender.id
+    WHERE m.delivered = 0
+    ORDER BY m.id ASC
+  `).all();
+
+  if (rows.length > 0) {
+    spear.appendMessageBatch(
+      rows.map(row => row.to_username),
+      rows.map(row => ({
+        fromUsername: row.from_username,
+        content: row.encrypted_content,
+        nonce: row.nonce,
+        signature: row.signature,
+        counter: row.counter
+      }))
+    );
+    console.log(`Migrated ${rows.length} undelivered messages into the message store`);
+  }
+  db.exec('DROP INDEX IF EXISTS idx_messages_to_user; DROP TABLE messages;');
+}
+
+migrateLegacyMessages();
+
+module.exports = spear;
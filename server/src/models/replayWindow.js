@@ -0,0 +1,65 @@
+const db = require('./database');
+const spear = require('../../spear_addon.node');
+
+// Replay windows live in native memory. The high-water marks are written
+// back to SQLite in one transaction per interval and used to seed the
+// windows after a restart, so at most one interval of counters is at risk
+// if the process dies.
+const FLUSH_INTERVAL_MS = 1000;
+
+const dirty = new Map();
+const seeded = new Set();
+
+const persistUser1 = db.prepare(
+  'UPDATE sessions SET last_counter_user1 = MAX(last_counter_user1, ?) WHERE id = ?'
+);
+const persistUser2 = db.prepare(
+  'UPDATE sessions SET last_counter_user2 = MAX(last_counter_user2, ?) WHERE id = ?'
+);
+
+const persist = db.transaction(entries => {
+  for (const { sessionId, isUser1, highest } of entries) {
+    (isUser1 ? persistUser1 : persistUser2).run(highest, sessionId);
+  }
+});
+
+function flush() {
+  if (dirty.size === 0) {
+    return;
+  }
+  const pending = [...dirty];
+  dirty.clear();
+  try {
+    persist(pending.map(([, entry]) => entry));
+  } catch (error) {
+    // Keep the marks for the next interval unless a newer one has arrived
+    console.error('Replay window flush error:', error);
+    for (const [key, entry] of pending) {
+      if (!dirty.has(key)) {
+        dirty.set(key, entry);
+      }
+    }
+  }
+}
+
+setInterval(flush, FLUSH_INTERVAL_MS).unref();
+process.on('exit', flush);
+
+// Returns 'accepted', 'replayed' or 'too-old' along with the highest counter
+// seen for this direction of the session
+exports.check = (session, isUser1, counter) => {
+  const key = `${session.id}:${isUser1 ? 1 : 2}`;
+  if (!seeded.has(key)) {
+    spear.replaySeed(key, isUser1 ? session.last_counter_user1 : session.last_counter_user2);
+    seeded.add(key);
+  }
+
+  const result = spear.replayCheck(key, counter);
+  const highest = spear.replayHighest(key);
+  if (result === 'accepted') {
+    dirty.set(key, { sessionId: session.id, isUser1, highest });
+  }
+  return { result, highest };
+};
+
+exports.flush = flush;
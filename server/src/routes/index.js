@@ -3,6 +3,7 @@ const router = express.Router();
 const userController = require('../controllers/userController');
 const messageController = require('../controllers/messageController');
 const sessionController = require('../controllers/sessionController');
+const metricsController = require('../controllers/metricsController');
 
 router.post('/api/register', userController.registerUser);
 router.get('/api/users', userController.listUsers);
@@ -13,8 +14,12 @@ router.post('/api/sessions/counter', sessionController.updateCounter);
 
 router.post('/api/messages', messageController.sendMessage);
 router.get('/api/messages/:username', messageController.getMessages);
+router.delete('/api/messages/:username/:id', messageController.acknowledgeMessages);
+// Superseded by the route above; kept for clients that ack one id at a time
 router.delete('/api/messages/:id', messageController.acknowledgeMessage);
 
+router.get('/metrics', metricsController.getMetrics);
+
 router.get('/health', (req, res) => {
   res.json({ status: 'ok', timestamp: new Date().toISOString() });
 });
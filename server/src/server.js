@@ -2,12 +2,14 @@ const express = require('express');
 const bodyParser = require('body-parser');
 const cors = require('cors');
 const routes = require('./routes');
+const { WIRE_TYPE } = require('./controllers/messageController');
 
 const app = express();
 const PORT = process.env.PORT || 3000;
 
 app.use(cors());
 app.use(bodyParser.json({ limit: '10mb' }));
+app.use(bodyParser.raw({ type: WIRE_TYPE, limit: '10mb' }));
 app.use(bodyParser.urlencoded({ extended: true }));
 
 app.use(routes);
@@ -0,0 +1,136 @@
+const test = require('node:test');
+const assert = require('node:assert');
+const Module = require('module');
+
+// The controller's dependencies (SQLite, the native addon and its message
+// store) are replaced with in-memory fakes, so these tests need neither a
+// database nor a built addon.
+const users = new Set(['alice', 'bob']);
+const queues = new Map();
+let nextId = 1;
+
+const fakeDb = {
+  prepare: () => ({ pluck: () => ({ get: name => (users.has(name) ? 1 : undefined) }) })
+};
+
+const fakeStore = {
+  appendMessage: async (recipient, message) => {
+    const id = nextId++;
+    if (!queues.has(recipient)) {
+      queues.set(recipient, []);
+    }
+    queues.get(recipient).push({ id, ...message });
+    return id;
+  },
+  messageRecipient: id => {
+    for (const [recipient, queue] of queues) {
+      if (queue.some(msg => msg.id === id)) {
+        return recipient;
+      }
+    }
+    return null;
+  },
+  lastMessageId: recipient => {
+    const queue = queues.get(recipient) || [];
+    return queue.length ? queue[queue.length - 1].id : 0;
+  },
+  ackMessages: async (recipient, upToId) => {
+    const queue = queues.get(recipient) || [];
+    const kept = queue.filter(msg => msg.id > upToId);
+    queues.set(recipient, kept);
+    return queue.length - kept.length;
+  }
+};
+
+// Stands in for the wire codec's size check
+const fakeAddon = {
+  encodeMessage: message => {
+    if (message.nonce.length !== 24 || message.signature.length !== 64) {
+      throw new TypeError('Invalid message field sizes');
+    }
+    return Buffer.alloc(0);
+  }
+};
+
+const load = Module._load;
+Module._load = function (request, parent, isMain) {
+  if (request === '../models/database') return fakeDb;
+  if (request === '../models/messageStore') return fakeStore;
+  if (request === '../../spear_addon.node') return fakeAddon;
+  return load.call(this, request, parent, isMain);
+};
+const controller = require('../src/controllers/messageController');
+Module._load = load;
+
+function call(handler, req) {
+  return new Promise(resolve => {
+    const res = {
+      statusCode: 200,
+      status(code) { this.statusCode = code; return this; },
+      json(body) { resolve({ status: this.statusCode, body }); return this; }
+    };
+    Promise.resolve(handler({ body: {}, is: () => false, ...req }, res));
+  });
+}
+
+test('acknowledging for an unknown user is a 404', async () => {
+  const res = await call(controller.acknowledgeMessages, { params: { username: 'mallory', id: '1' } });
+  assert.strictEqual(res.status, 404);
+});
+
+test('acknowledging an id that does not exist yet is rejected', async () => {
+  const id = await fakeStore.appendMessage('bob', { fromUsername: 'alice' });
+  const future = await call(controller.acknowledgeMessages,
+    { params: { username: 'bob', id: String(Number.MAX_SAFE_INTEGER) } });
+  assert.strictEqual(future.status, 400);
+  assert.strictEqual(queues.get('bob').length, 1);
+
+  const ok = await call(controller.acknowledgeMessages, { params: { username: 'bob', id: String(id) } });
+  assert.strictEqual(ok.status, 200);
+  assert.strictEqual(ok.body.acknowledged, 1);
+});
+
+test('a JSON send that cannot be encoded is rejected before it is stored', async () => {
+  const body = {
+    fromUsername: 'alice',
+    toUsername: 'bob',
+    encryptedContent: Buffer.from('ciphertext').toString('base64'),
+    nonce: Buffer.alloc(8).toString('base64'),
+    signature: Buffer.alloc(64).toString('base64'),
+    counter: 1
+  };
+  const queued = (queues.get('bob') || []).length;
+  const bad = await call(controller.sendMessage, { body });
+  assert.strictEqual(bad.status, 400);
+  assert.strictEqual((queues.get('bob') || []).length, queued);
+
+  const ok = await call(controller.sendMessage, { body: { ...body, nonce: Buffer.alloc(24).toString('base64') } });
+  assert.strictEqual(ok.status, 201);
+  assert.strictEqual(queues.get('bob').length, queued + 1);
+});
+
+test('a JSON send with a counter that is not a non-negative integer is a 400', async () => {
+  const body = {
+    fromUsername: 'alice',
+    toUsername: 'bob',
+    encryptedContent: Buffer.from('ciphertext').toString('base64'),
+    nonce: Buffer.alloc(24).toString('base64'),
+    signature: Buffer.alloc(64).toString('base64')
+  };
+  for (const counter of ['1', -1, 1.5, 2 ** 64]) {
+    const res = await call(controller.sendMessage, { body: { ...body, counter } });
+    assert.strictEqual(res.status, 400, `counter ${counter}`);
+  }
+});
+
+test('the legacy per-message ack route still acknowledges by id', async () => {
+  const id = await fakeStore.appendMessage('alice', { fromUsername: 'bob' });
+  const ok = await call(controller.acknowledgeMessage, { params: { id: String(id) } });
+  assert.strictEqual(ok.status, 200);
+  assert.strictEqual((queues.get('alice') || []).length, 0);
+
+  const gone = await call(controller.acknowledgeMessage, { params: { id: String(id) } });
+  assert.strictEqual(gone.status, 404);
+  const bad = await call(controller.acknowledgeMessage, { params: { id: 'x' } });
+  assert.strictEqual(bad.status, 400);
+});
@@ -0,0 +1,82 @@
+const test = require('node:test');
+const assert = require('node:assert');
+const Module = require('module');
+
+// Loads the message store module against a fake legacy database and addon,
+// so the startup migration runs without SQLite or a built addon
+function load({ tableExists, rows, appendMessageBatch }) {
+  const executed = [];
+  const batches = [];
+  const fakeDb = {
+    prepare: sql => ({
+      pluck: () => ({ get: () => (sql.includes('sqlite_master') && tableExists ? 1 : undefined) }),
+      all: () => rows
+    }),
+    exec: sql => executed.push(sql)
+  };
+  const fakeAddon = {
+    openMessageStore: () => {},
+    appendMessageBatch: (recipients, messages) => {
+      batches.push({ recipients, messages });
+      return appendMessageBatch ? appendMessageBatch() : 1;
+    }
+  };
+
+  const modulePath = require.resolve('../src/models/messageStore');
+  delete require.cache[modulePath];
+  const original = Module._load;
+  Module._load = function (request, parent, isMain) {
+    if (request === './database') return fakeDb;
+    if (request === '../../spear_addon.node') return fakeAddon;
+    return original.call(this, request, parent, isMain);
+  };
+  const log = console.log;
+  console.log = () => {};
+  try {
+    require(modulePath);
+    return { executed, batches, error: null };
+  } catch (error) {
+    return { executed, batches, error };
+  } finally {
+    Module._load = original;
+    console.log = log;
+  }
+}
+
+const legacyRow = (to, from, counter) => ({
+  to_username: to,
+  from_username: from,
+  encrypted_content: Buffer.from('ciphertext'),
+  nonce: Buffer.alloc(24),
+  signature: Buffer.alloc(64),
+  counter
+});
+
+test('undelivered legacy rows move into the store and the table is dropped', () => {
+  const { executed, batches, error } = load({
+    tableExists: true,
+    rows: [legacyRow('bob', 'alice', 1), legacyRow('carol', 'alice', 7)]
+  });
+  assert.strictEqual(error, null);
+  assert.strictEqual(batches.length, 1);
+  assert.deepStrictEqual(batches[0].recipients, ['bob', 'carol']);
+  assert.deepStrictEqual(batches[0].messages.map(msg => msg.counter), [1, 7]);
+  assert.ok(executed.some(sql => sql.includes('DROP TABLE messages')));
+});
+
+test('a failed import stops startup and keeps the legacy table', () => {
+  const { executed, error } = load({
+    tableExists: true,
+    rows: [legacyRow('bob', 'alice', 1)],
+    appendMessageBatch: () => { throw new Error('Failed to store messages'); }
+  });
+  assert.ok(error);
+  assert.strictEqual(executed.length, 0);
+});
+
+test('nothing is migrated once the table is gone', () => {
+  const { executed, batches, error } = load({ tableExists: false, rows: [] });
+  assert.strictEqual(error, null);
+  assert.strictEqual(batches.length, 0);
+  assert.strictEqual(executed.length, 0);
+});
@@ -0,0 +1,89 @@
+const test = require('node:test');
+const assert = require('node:assert');
+const Module = require('module');
+
+// Loads the replay window module against a fake database and addon; the
+// fake transaction throws while failing.fail is set
+function load() {
+  const failing = { fail: false };
+  const persisted = [];
+  const seeds = [];
+  const highest = new Map();
+  const fakeDb = {
+    prepare: sql => ({
+      run: (value, sessionId) => persisted.push({ user1: sql.includes('user1'), value, sessionId })
+    }),
+    transaction: fn => entries => {
+      if (failing.fail) {
+        throw new Error('database is locked');
+      }
+      fn(entries);
+    }
+  };
+  const fakeAddon = {
+    replaySeed: (key, value) => {
+      seeds.push(key);
+      if (!highest.has(key)) {
+        highest.set(key, value);
+      }
+      return true;
+    },
+    replayCheck: (key, counter) => {
+      if (counter <= highest.get(key)) {
+        return 'replayed';
+      }
+      highest.set(key, counter);
+      return 'accepted';
+    },
+    replayHighest: key => highest.get(key)
+  };
+
+  const modulePath = require.resolve('../src/models/replayWindow');
+  delete require.cache[modulePath];
+  const original = Module._load;
+  Module._load = function (request, parent, isMain) {
+    if (request === './database') return fakeDb;
+    if (request === '../../spear_addon.node') return fakeAddon;
+    return original.call(this, request, parent, isMain);
+  };
+  try {
+    return { replayWindow: require(modulePath), failing, persisted, seeds };
+  } finally {
+    Module._load = original;
+  }
+}
+
+const session = { id: 7, last_counter_user1: 3, last_counter_user2: 0 };
+
+test('each window is seeded once from the session row', () => {
+  const { replayWindow, seeds } = load();
+  assert.strictEqual(replayWindow.check(session, true, 4).result, 'accepted');
+  assert.strictEqual(replayWindow.check(session, true, 5).result, 'accepted');
+  assert.strictEqual(replayWindow.check(session, false, 1).result, 'accepted');
+  assert.deepStrictEqual(seeds, ['7:1', '7:2']);
+});
+
+test('a failed flush keeps the high-water marks for the next one', () => {
+  const { replayWindow, failing, persisted } = load();
+  replayWindow.check(session, true, 4);
+  replayWindow.check(session, false, 2);
+
+  const error = console.error;
+  console.error = () => {};
+  failing.fail = true;
+  try {
+    assert.doesNotThrow(() => replayWindow.flush());
+  } finally {
+    console.error = error;
+  }
+  assert.deepStrictEqual(persisted, []);
+
+  // A mark that arrives before the retry replaces the stale one
+  replayWindow.check(session, true, 9);
+  failing.fail = false;
+  replayWindow.flush();
+  assert.deepStrictEqual(persisted, [
+    { user1: true, value: 9, sessionId: 7 },
+    { user1: false, value: 2, sessionId: 7 }
+  ]);
+});